@@ -0,0 +1,479 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+/*
+ * Benchmarks how quickly msh responds when used interactively, by
+ * running it under a pseudo-terminal and typing at it:
+ *
+ *   make bench && bin/bench-pty [ITERATIONS] [HISTORY]...
+ *
+ * For each history size (by default 0, 1000, 10000 and 100000), the
+ * shell first runs that many (built-in) commands, then this many times
+ * (by default 2000) types a command one key at a time and runs it,
+ * timing:
+ *
+ *   echo    from writing each key to it being echoed back
+ *   start   from writing Enter to the command's process starting
+ *   prompt  from the command's process exiting to the next prompt
+ *
+ * The command is this program again (with --child), which reports
+ * when it started and when it's about to exit. The shell is bin/msh,
+ * or whatever MSH names; anything else it reads from the environment
+ * (e.g. MSH_ZYGOTE) is passed along.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// what the shell is made to print as its prompt
+#define BENCH_PROMPT "msh> "
+
+// the command which fills up the history (a built-in, so it's quick)
+#define BENCH_FILLER "let h=1\r"
+
+// how long to wait on the shell before giving up, in milliseconds
+#define BENCH_PATIENCE 30000
+
+/**
+ * Samples of one latency, in nanoseconds.
+ */
+typedef struct bench_samples_t
+{
+  int64_t* values;
+  size_t count, capacity;
+} bench_samples_t;
+
+/**
+ * The shell being typed at.
+ */
+typedef struct bench_shell_t
+{
+  /** Its process, and the pseudo-terminal's master side */
+  pid_t pid;
+  int master;
+
+  /** What it's written that hasn't been looked through yet */
+  char output[ 1 << 16 ];
+  size_t size;
+} bench_shell_t;
+
+static int64_t bench_now( void )
+{
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void bench_add( bench_samples_t* this, int64_t value )
+{
+  if ( this->count == this->capacity )
+  {
+    this->capacity = this->capacity == 0 ? 1024 : this->capacity * 2;
+    this->values = realloc( this->values, this->capacity * sizeof( int64_t ) );
+  }
+
+  this->values[ this->count++ ] = value;
+}
+
+static int bench_compare( const void* a, const void* b )
+{
+  int64_t left = *( const int64_t* ) a;
+  int64_t right = *( const int64_t* ) b;
+
+  return ( left > right ) - ( left < right );
+}
+
+/**
+ * Prints the percentiles of [samples] (in microseconds).
+ */
+static void bench_report( size_t history, const char* name, bench_samples_t* samples )
+{
+  if ( samples->count == 0 ) return;
+
+  qsort( samples->values, samples->count, sizeof( int64_t ), &bench_compare );
+
+  const int64_t* values = samples->values;
+  size_t last = samples->count - 1;
+
+  printf( "%8zu %-7s %8zu %10.1f %10.1f %10.1f %10.1f\n", history, name,
+          samples->count, values[ last * 50 / 100 ] / 1e3,
+          values[ last * 90 / 100 ] / 1e3, values[ last * 99 / 100 ] / 1e3,
+          values[ last ] / 1e3 );
+}
+
+/**
+ * Runs as the command being timed: reports when it started, and when
+ * it's exiting.
+ */
+static int bench_child( void )
+{
+  int64_t started = bench_now();
+
+  char line[ 64 ];
+  int length = snprintf( line, sizeof( line ), "<<%lld %lld>>\n",
+                         ( long long ) started, ( long long ) bench_now() );
+  ssize_t written = write( STDOUT_FILENO, line, length );
+
+  _exit( written == length ? 0 : 1 );
+}
+
+/**
+ * Starts the shell on a new pseudo-terminal.
+ */
+static bool bench_start( bench_shell_t* this, const char* msh )
+{
+  this->size = 0;
+  this->master = posix_openpt( O_RDWR | O_NOCTTY | O_CLOEXEC );
+  if ( this->master == -1 || grantpt( this->master ) < 0
+    || unlockpt( this->master ) < 0 )
+  {
+    perror( "pty" );
+    return false;
+  }
+
+  const char* slave = ptsname( this->master );
+
+  this->pid = fork();
+  if ( this->pid == 0 )
+  {
+    // (the terminal becomes its controlling one, as it's opened first
+    // thing in a new session)
+    setsid();
+    int fd = open( slave, O_RDWR );
+    if ( fd == -1 ) _exit( 127 );
+
+    dup2( fd, STDIN_FILENO );
+    dup2( fd, STDOUT_FILENO );
+    dup2( fd, STDERR_FILENO );
+    if ( fd > STDERR_FILENO ) close( fd );
+
+    // (msh looks for programs under the working directory first, so
+    // from the root, this program's absolute path finds it)
+    if ( chdir( "/" ) < 0 ) _exit( 127 );
+
+    // nothing should be written anywhere but the terminal
+    setenv( "PS1", BENCH_PROMPT, 1 );
+    setenv( "MSH_DIRS_FILE", "", 1 );
+    unsetenv( "MSH_SHARED_HISTORY" );
+
+    execl( msh, msh, ( char* ) NULL );
+    _exit( 127 );
+  }
+
+  fcntl( this->master, F_SETFL, O_NONBLOCK );
+  return this->pid > 0;
+}
+
+/**
+ * Reads whatever the shell has written (waiting for it to write
+ * something). Returns [false] if it hasn't in a long time (or has
+ * gone away).
+ */
+static bool bench_read( bench_shell_t* this )
+{
+  struct pollfd fd = { this->master, POLLIN, 0 };
+  if ( poll( &fd, 1, BENCH_PATIENCE ) <= 0 ) return false;
+
+  // (what's been looked through already is only needed if a marker
+  // could have been split across reads)
+  if ( this->size > sizeof( this->output ) / 2 )
+  {
+    size_t keep = 64;
+    memmove( this->output, this->output + this->size - keep, keep );
+    this->size = keep;
+  }
+
+  ssize_t count = read( this->master, this->output + this->size,
+                        sizeof( this->output ) - this->size - 1 );
+  if ( count <= 0 ) return count < 0 && errno == EAGAIN;
+
+  this->size += count;
+  this->output[ this->size ] = '\0';
+  return true;
+}
+
+/**
+ * Waits until the shell writes [marker], returning when it was read
+ * (or -1 if it never was). Everything up to the end of the marker is
+ * then thrown away, and what was just before it is left in [before]
+ * (if not NULL).
+ */
+static int64_t bench_expect( bench_shell_t* this, const char* marker,
+                             char* before, size_t before_size )
+{
+  for ( ;; )
+  {
+    this->output[ this->size ] = '\0';
+    char* found = memmem( this->output, this->size, marker, strlen( marker ) );
+
+    if ( found != NULL )
+    {
+      int64_t now = bench_now();
+
+      if ( before != NULL )
+      {
+        size_t length = found - this->output;
+        if ( length >= before_size ) length = before_size - 1;
+        memcpy( before, found - length, length );
+        before[ length ] = '\0';
+      }
+
+      size_t end = found - this->output + strlen( marker );
+      memmove( this->output, this->output + end, this->size - end );
+      this->size -= end;
+      return now;
+    }
+
+    if ( !bench_read( this ) ) return -1;
+  }
+}
+
+/**
+ * Throws away everything the shell has written up to its last prompt,
+ * counting the prompts.
+ */
+static void bench_count( bench_shell_t* this, size_t* prompts )
+{
+  size_t prompt_length = strlen( BENCH_PROMPT );
+
+  char* found;
+  while ( ( found = memmem( this->output, this->size, BENCH_PROMPT,
+                            prompt_length ) ) != NULL )
+  {
+    size_t end = found - this->output + prompt_length;
+    memmove( this->output, this->output + end, this->size - end );
+    this->size -= end;
+    *prompts += 1;
+  }
+}
+
+/**
+ * Writes all of [text] to the shell, reading what it writes back in
+ * the meantime (so neither side fills up waiting on the other), and
+ * counting the prompts it prints along the way.
+ */
+static bool bench_type( bench_shell_t* this, const char* text, size_t length,
+                        size_t* prompts )
+{
+  while ( length > 0 )
+  {
+    struct pollfd fd = { this->master, POLLIN | POLLOUT, 0 };
+    if ( poll( &fd, 1, BENCH_PATIENCE ) <= 0 ) return false;
+
+    if ( fd.revents & POLLOUT )
+    {
+      ssize_t count = write( this->master, text, length );
+      if ( count < 0 && errno != EAGAIN ) return false;
+      if ( count > 0 )
+      {
+        text += count;
+        length -= count;
+      }
+    }
+
+    if ( fd.revents & POLLIN )
+    {
+      if ( !bench_read( this ) ) return false;
+      bench_count( this, prompts );
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Fills the shell's history with [count] commands, waiting for it to
+ * have run all of them.
+ */
+static bool bench_fill( bench_shell_t* this, size_t count )
+{
+  size_t length = strlen( BENCH_FILLER );
+  size_t batch = 128;
+  char* text = malloc( batch * length );
+
+  size_t i;
+  for ( i = 0; i < batch; i++ ) memcpy( text + i * length, BENCH_FILLER, length );
+
+  size_t prompts = 0;
+  size_t sent = 0;
+  bool ok = true;
+
+  while ( ok && sent < count )
+  {
+    size_t lines = count - sent < batch ? count - sent : batch;
+    ok = bench_type( this, text, lines * length, &prompts );
+    sent += lines;
+
+    // (the terminal only holds so much typed ahead, so the shell has to
+    // catch up before there's any more)
+    while ( ok && prompts + batch < sent )
+    {
+      ok = bench_read( this );
+      bench_count( this, &prompts );
+    }
+  }
+
+  while ( ok && prompts < count )
+  {
+    ok = bench_read( this );
+    bench_count( this, &prompts );
+  }
+
+  free( text );
+  return ok;
+}
+
+/**
+ * Types [command] a key at a time, then runs it, adding how long each
+ * step took onto the samples.
+ */
+static bool bench_iteration( bench_shell_t* this, const char* command,
+                             bench_samples_t* echo, bench_samples_t* start,
+                             bench_samples_t* prompt )
+{
+  const char* key;
+  for ( key = command; *key != '\0'; key++ )
+  {
+    char typed[ 2 ] = { *key, '\0' };
+
+    int64_t sent = bench_now();
+    if ( write( this->master, key, 1 ) != 1 ) return false;
+
+    int64_t echoed = bench_expect( this, typed, NULL, 0 );
+    if ( echoed < 0 ) return false;
+    bench_add( echo, echoed - sent );
+  }
+
+  int64_t entered = bench_now();
+  if ( write( this->master, "\r", 1 ) != 1 ) return false;
+
+  char report[ 64 ];
+  if ( bench_expect( this, ">>", report, sizeof( report ) ) < 0 ) return false;
+
+  long long started, exited;
+  const char* at = strstr( report, "<<" );
+  if ( at == NULL || sscanf( at, "<<%lld %lld", &started, &exited ) != 2 )
+  {
+    return false;
+  }
+
+  int64_t prompted = bench_expect( this, BENCH_PROMPT, NULL, 0 );
+  if ( prompted < 0 ) return false;
+
+  bench_add( start, started - entered );
+  bench_add( prompt, prompted - exited );
+  return true;
+}
+
+/**
+ * Runs the whole benchmark for one history size.
+ */
+static bool bench_run( const char* msh, const char* self, size_t history,
+                       size_t iterations )
+{
+  bench_shell_t* shell = malloc( sizeof( *shell ) );
+  bench_samples_t echo = { NULL, 0, 0 };
+  bench_samples_t start = { NULL, 0, 0 };
+  bench_samples_t prompt = { NULL, 0, 0 };
+
+  char command[ PATH_MAX + 16 ];
+  snprintf( command, sizeof( command ), "%s --child", self );
+
+  bool ok = bench_start( shell, msh )
+         && bench_expect( shell, BENCH_PROMPT, NULL, 0 ) >= 0
+         && bench_fill( shell, history );
+  if ( !ok ) printf( "%zu: the shell didn't start (or stopped responding)\n", history );
+
+  size_t i;
+  for ( i = 0; ok && i < iterations; i++ )
+  {
+    ok = bench_iteration( shell, command, &echo, &start, &prompt );
+    if ( !ok ) printf( "%zu: the shell stopped responding\n", history );
+  }
+
+  bench_report( history, "echo", &echo );
+  bench_report( history, "start", &start );
+  bench_report( history, "prompt", &prompt );
+
+  if ( shell->pid > 0 )
+  {
+    if ( write( shell->master, "exit\r", 5 ) != 5 || !ok ) kill( shell->pid, SIGKILL );
+    waitpid( shell->pid, NULL, 0 );
+  }
+  if ( shell->master != -1 ) close( shell->master );
+
+  free( echo.values );
+  free( start.values );
+  free( prompt.values );
+  free( shell );
+
+  return ok;
+}
+
+int main( int argc, char** argv )
+{
+  if ( argc == 2 && strcmp( argv[ 1 ], "--child" ) == 0 )
+  {
+    return bench_child();
+  }
+
+  size_t iterations = argc > 1 ? strtoul( argv[ 1 ], NULL, 10 ) : 2000;
+  if ( iterations == 0 ) iterations = 2000;
+
+  char msh[ PATH_MAX ];
+  const char* name = getenv( "MSH" );
+  if ( realpath( name != NULL ? name : "bin/msh", msh ) == NULL )
+  {
+    perror( name != NULL ? name : "bin/msh" );
+    return 1;
+  }
+
+  char self[ PATH_MAX ];
+  ssize_t length = readlink( "/proc/self/exe", self, sizeof( self ) - 1 );
+  if ( length < 0 )
+  {
+    perror( "/proc/self/exe" );
+    return 1;
+  }
+  self[ length ] = '\0';
+
+  printf( "%zu iterations of %s (times in microseconds)\n\n", iterations, msh );
+  printf( "%8s %-7s %8s %10s %10s %10s %10s\n", "history", "latency", "samples",
+          "p50", "p90", "p99", "max" );
+
+  static const size_t histories[] = { 0, 1000, 10000, 100000 };
+  bool ok = true;
+
+  if ( argc > 2 )
+  {
+    int i;
+    for ( i = 2; i < argc; i++ )
+    {
+      ok = bench_run( msh, self, strtoul( argv[ i ], NULL, 10 ), iterations ) && ok;
+    }
+  }
+  else
+  {
+    size_t i;
+    for ( i = 0; i < sizeof( histories ) / sizeof( *histories ); i++ )
+    {
+      ok = bench_run( msh, self, histories[ i ], iterations ) && ok;
+    }
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+/*
+ * Benchmarks the lexer with each level of the scanner the CPU can do,
+ * on a few kinds of multi-megabyte input:
+ *
+ *   make bench && bin/bench-scan [MEGABYTES]
+ *
+ * (With the default flags, nothing is optimized; for numbers that mean
+ * anything, build it with e.g. `make bench CFLAGS='-O2 -pthread'` from
+ * a clean tree.)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "command.h"
+#include "scan.h"
+
+// how many times each is run (the fastest is what's reported)
+#define BENCH_RUNS 7
+
+/**
+ * What a kind of input is made of (repeated until it's big enough).
+ */
+typedef struct bench_input_t
+{
+  const char* name;
+  const char* piece;
+} bench_input_t;
+
+static const bench_input_t bench_inputs[] =
+{
+  { "commands", "ls -la /usr/local/bin ; echo hello world > out.txt ; "
+                "grep -n pattern file.c 2>&1 ; " },
+  { "quoted", "echo \"a fairly long double quoted argument, with $HOME in it\" "
+              "'and a single quoted one, which goes on for a while too' ; " },
+  { "paths", "/usr/share/doc/some-package/examples/configuration-file.conf "
+             "\t/var/lib/another-package/state/with/a/deeply/nested/path " },
+  { "blanks", "a                                                        "
+              "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t b " },
+};
+
+static double bench_now( void )
+{
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Repeats [piece] into a line of (about) [size] bytes.
+ */
+static char* bench_line( const char* piece, size_t size )
+{
+  size_t length = strlen( piece );
+  size_t count = size / length + 1;
+  char* line = malloc( count * length + 1 );
+
+  size_t i;
+  for ( i = 0; i < count; i++ ) memcpy( line + i * length, piece, length );
+  line[ count * length ] = '\0';
+
+  return line;
+}
+
+/**
+ * Lexes [line] into tokens, returning how long it took (and a digest
+ * of the tokens, to check each level gets the same ones).
+ */
+static double bench_parse( const char* line, unsigned long* digest )
+{
+  command_t command;
+
+  // (once to get the heap the same way for every level, then again to
+  // time it)
+  command_init( &command );
+  command_parse( &command, line );
+  command_destroy( &command );
+
+  command_init( &command );
+
+  double start = bench_now();
+  command_parse( &command, line );
+  double elapsed = bench_now() - start;
+
+  // (walking the nodes, since getting each by index is quadratic)
+  *digest = command.tokens->size;
+  __typeof__( command.tokens->head ) node;
+  for ( node = command.tokens->head; node != NULL; node = node->next )
+  {
+    *digest = *digest * 31 + strlen( node->data );
+  }
+
+  command_destroy( &command );
+  return elapsed;
+}
+
+/**
+ * Only finds the words (without copying them out), i.e. the part the
+ * scanner speeds up.
+ */
+static double bench_scan( const char* line, unsigned long* words )
+{
+  double start = bench_now();
+
+  const char* current = scan_blanks( line );
+  *words = 0;
+  while ( *current != '\0' )
+  {
+    const char* stop = scan_word( current );
+    if ( stop == current ) stop++;
+    *words += 1;
+    current = scan_blanks( stop );
+  }
+
+  return bench_now() - start;
+}
+
+int main( int argc, char** argv )
+{
+  size_t megabytes = argc > 1 ? strtoul( argv[ 1 ], NULL, 10 ) : 8;
+  if ( megabytes == 0 ) megabytes = 8;
+
+  scan_level_t best = scan_best();
+  printf( "%zu MB per input, best level: %s\n\n", megabytes, scan_name( best ) );
+  printf( "%-10s %-8s %12s %12s %8s\n", "input", "level", "lex MB/s", "scan MB/s",
+          "speedup" );
+
+  bool mismatch = false;
+
+  unsigned int input;
+  for ( input = 0; input < sizeof( bench_inputs ) / sizeof( *bench_inputs ); input++ )
+  {
+    char* line = bench_line( bench_inputs[ input ].piece, megabytes << 20 );
+    double size = strlen( line ) / ( double ) ( 1 << 20 );
+
+    // (the levels take turns, so none is favored by the state the heap
+    // was left in)
+    double lex[ SCAN_AVX2 + 1 ], scan[ SCAN_AVX2 + 1 ];
+    unsigned long digests[ SCAN_AVX2 + 1 ], words;
+    scan_level_t level;
+
+    for ( level = SCAN_SCALAR; level <= best; level++ )
+    {
+      lex[ level ] = scan[ level ] = 1e9;
+    }
+
+    unsigned int run;
+    for ( run = 0; run < BENCH_RUNS; run++ )
+    {
+      for ( level = SCAN_SCALAR; level <= best; level++ )
+      {
+        scan_use( level );
+
+        double elapsed = bench_parse( line, &digests[ level ] );
+        if ( elapsed < lex[ level ] ) lex[ level ] = elapsed;
+
+        elapsed = bench_scan( line, &words );
+        if ( elapsed < scan[ level ] ) scan[ level ] = elapsed;
+      }
+    }
+
+    for ( level = SCAN_SCALAR; level <= best; level++ )
+    {
+      if ( digests[ level ] != digests[ SCAN_SCALAR ] )
+      {
+        printf( "%s: %s gave different tokens to scalar\n",
+                bench_inputs[ input ].name, scan_name( level ) );
+        mismatch = true;
+      }
+
+      printf( "%-10s %-8s %12.1f %12.1f %7.2fx\n", bench_inputs[ input ].name,
+              scan_name( level ), size / lex[ level ], size / scan[ level ],
+              lex[ SCAN_SCALAR ] / lex[ level ] );
+    }
+
+    free( line );
+  }
+
+  scan_use( best );
+  return mismatch ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_ARITH_H__
+#define __MSH_ARITH_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// the number of compiled expressions kept around (must be a power of two)
+#define ARITH_CACHE_SIZE 256
+
+typedef struct arith_op_t arith_op_t;
+typedef struct arith_program_t arith_program_t;
+typedef struct arith_cache_t arith_cache_t;
+
+/**
+ * A single instruction of a compiled expression.
+ */
+struct arith_op_t
+{
+  /** What the instruction does (one of the ARITH_* codes in arith.c) */
+  unsigned char code;
+
+  /** The variable the instruction refers to, if any */
+  unsigned int variable;
+
+  /** A constant, a jump target, or an increment, depending on [code] */
+  int64_t value;
+};
+
+/**
+ * An arithmetic expression, compiled into a flat postfix program
+ * which runs on a stack of 64-bit integers.
+ */
+struct arith_program_t
+{
+  /** The text the program was compiled from */
+  char* source;
+
+  /** The instructions, in the order they run */
+  arith_op_t* ops;
+
+  /** The number of [ops] */
+  size_t count;
+
+  /** The names of the variables the program uses */
+  char** variables;
+
+  /** The number of [variables] */
+  unsigned int variable_count;
+};
+
+/**
+ * A cache of compiled programs, keyed by their source text, so an
+ * expression in a loop is only ever parsed once.
+ */
+struct arith_cache_t
+{
+  /** The cached programs, indexed by the hash of their source */
+  arith_program_t* slots[ ARITH_CACHE_SIZE ];
+};
+
+/**
+ * Initializes an empty cache.
+ */
+void arith_cache_init( arith_cache_t* );
+
+/**
+ * Frees every program in the cache.
+ */
+void arith_cache_destroy( arith_cache_t* );
+
+/**
+ * Gets the compiled program for [source], compiling it (and caching
+ * the result) if needed. Returns NULL (after telling the user why) if
+ * the expression is malformed.
+ */
+const arith_program_t* arith_compile( arith_cache_t*, const char* source );
+
+/**
+ * Runs a compiled program, reading and assigning variables in the
+ * environment. Returns [false] (after telling the user why) if it
+ * fails, e.g. by dividing by zero.
+ */
+bool arith_run( const arith_program_t*, int64_t* result );
+
+/**
+ * Compiles (or finds the cached copy of) [source] and runs it.
+ */
+bool arith_evaluate( arith_cache_t*, const char* source, int64_t* result );
+
+#endif
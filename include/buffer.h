@@ -0,0 +1,65 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_BUFFER_H__
+#define __MSH_BUFFER_H__
+
+#include <stddef.h>
+
+typedef struct buffer_t buffer_t;
+
+/**
+ * A growable, contiguous byte buffer.
+ *
+ * This is used anywhere we would otherwise be allocating once per
+ * item (directory entries, expanded words, captured output), so the
+ * cost of filling it is bounded by the number of times it doubles.
+ */
+struct buffer_t
+{
+  /** The bytes in the buffer (or NULL if nothing was ever reserved) */
+  char* data;
+
+  /** The number of bytes currently in use */
+  size_t size;
+
+  /** The number of bytes allocated for [data] */
+  size_t capacity;
+};
+
+/**
+ * Initializes an empty buffer. This does not allocate anything.
+ */
+void buffer_init( buffer_t* );
+
+/**
+ * Frees the data held by this buffer.
+ */
+void buffer_destroy( buffer_t* );
+
+/**
+ * Makes sure there is room for at least [extra] more bytes after
+ * [size], and returns a pointer to the first free byte.
+ */
+char* buffer_reserve( buffer_t*, size_t extra );
+
+/**
+ * Appends [length] bytes from [data] onto the end of the buffer.
+ */
+void buffer_append( buffer_t*, const void* data, size_t length );
+
+/**
+ * Appends a NUL-terminated string (including its terminator) and
+ * returns the offset it was written at.
+ */
+size_t buffer_append_string( buffer_t*, const char* string );
+
+/**
+ * Transfers ownership of the data to the caller, leaving the
+ * buffer empty.
+ */
+char* buffer_release( buffer_t* );
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_CACHE_H__
+#define __MSH_CACHE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include "command.h"
+
+// identifies a file as being one of our cache entries ("MSHC")
+#define CACHE_MAGIC 0x4D534843
+#define CACHE_VERSION 1
+
+typedef struct cache_key_t cache_key_t;
+typedef struct cache_header_t cache_header_t;
+typedef struct cache_chunk_t cache_chunk_t;
+typedef struct cache_entry_t cache_entry_t;
+
+/**
+ * What a command's results are stored under: a hash of everything it
+ * could depend on (128 bits of it, as hex).
+ */
+struct cache_key_t
+{
+  char hex[ 33 ];
+};
+
+/**
+ * The start of an entry's file.
+ */
+struct cache_header_t
+{
+  /** CACHE_MAGIC and CACHE_VERSION */
+  uint32_t magic, version;
+
+  /** The command's exit status */
+  int32_t status;
+
+  /** (unused, and zero) */
+  uint32_t reserved;
+};
+
+/**
+ * What follows the header, once for each read of the command's output
+ * (so its stdout and stderr are replayed in the order they came in).
+ */
+struct cache_chunk_t
+{
+  /** Which of the command's descriptors it was written to (1 or 2) */
+  uint32_t fd;
+
+  /** How many bytes of it follow */
+  uint32_t length;
+};
+
+/**
+ * An entry being recorded.
+ */
+struct cache_entry_t
+{
+  /** The file it's being written to, and where that goes once it's done */
+  int fd;
+  char temp[ PATH_MAX ];
+  char path[ PATH_MAX ];
+
+  /** If anything couldn't be written (so it mustn't be kept) */
+  bool failed;
+};
+
+/**
+ * Hashes [length] bytes with xxHash's XXH64.
+ */
+uint64_t cache_hash( const void* data, size_t length, uint64_t seed );
+
+/**
+ * Works out the key for running the command's tokens from [first]
+ * on, out of:
+ *
+ *  - the working directory, PATH, and the words of the command
+ *    (along with its `NAME=value` assignments)
+ *  - the environment variables named in [env] (separated by commas,
+ *    or NULL for none)
+ *  - the files named in [inputs] (the same), by their contents, or
+ *    (if [mtime] is set) just their size and when they were modified
+ *
+ * Anything else it reads (e.g. its stdin) isn't accounted for.
+ */
+void cache_key( cache_key_t*, const command_t* command, unsigned int first,
+                const char* inputs, const char* env, bool mtime );
+
+/**
+ * Writes what the command stored under [key] wrote to stdout and
+ * stderr out again, setting [status] to what it exited with. Returns
+ * [false] if there's nothing (readable) stored under it.
+ */
+bool cache_replay( const cache_key_t* key, int* status );
+
+/**
+ * Starts recording a new entry for [key]. Returns [false] if it can't
+ * be (e.g. the cache directory can't be made), in which case nothing
+ * else should be done with it.
+ */
+bool cache_begin( cache_entry_t*, const cache_key_t* key );
+
+/**
+ * Records what the command wrote to [fd] (1 or 2).
+ */
+void cache_record( cache_entry_t*, int fd, const void* data, size_t length );
+
+/**
+ * Finishes the entry with the command's exit status, putting it in
+ * the cache (all at once, so nothing ever replays half of one).
+ */
+void cache_commit( cache_entry_t*, int status );
+
+/**
+ * Throws the entry away (e.g. if the command was killed).
+ */
+void cache_abort( cache_entry_t* );
+
+#endif
@@ -21,16 +21,33 @@
 
 /** Allocates a new unmanaged list, whose metadata resides on the heap. */
 #define list_u( x ) ({                                                         \
-      list_t( x )* tmp = malloc( sizeof( list_t( x ) ) );                      \
+      list_t( x )* tmp = mem_malloc( MEM_LISTS, sizeof( list_t( x ) ) );       \
       list_##x##_init( tmp );                                                  \
       tmp;                                                                     \
     })
 
+/** The most bytes a single chunk of a POOLED list's nodes will take up */
+#define LIST_POOL_CHUNK_BYTES 4096
+
+/** The number of nodes in a POOLED list's first chunk */
+#define LIST_POOL_FIRST_CHUNK 8
+
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include "preproc.h"
 #include "vtable.h"
+#include "memstats.h"
+
+/**
+ * Counts a list's nodes as [tag] (see memstats.h) rather than as
+ * MEM_LISTS (which has to be done before anything is added to it).
+ */
+#ifdef MEMSTATS
+#define list_tag( l, tag ) ( ( l )->mem_tag = ( tag ) )
+#else
+#define list_tag( l, tag ) ( ( void ) 0 )
+#endif
 
 #endif // END OF INCLUDE GUARD
 
@@ -40,6 +57,17 @@
   #define TYPE int
 #endif
 
+// if they define VTABLE_DISPATCH, then the methods are real functions,
+// defined once by the IMPLEMENTATION_ONLY include and only meant to be
+// called through the list's vtable. otherwise (the default) every method
+// is static inline in the header, so calls like list_int_get( l, 0 )
+// dispatch statically and can be inlined, and the IMPLEMENTATION_ONLY
+// include emits nothing. the vtable is filled in either way.
+
+// if they define POOLED, then each list allocates its nodes in chunks,
+// reusing removed nodes through a free list, and frees the chunks all
+// at once when it's destroyed (rather than a malloc/free per node)
+
 // if they didn't define COPY_VALUE, then we assume
 // that we assume that the reference type should be
 // a const pointer
@@ -64,6 +92,30 @@
 #define L_METHOD(x) METHOD_NAME(L_P, x)
 
 #if defined(HEADER_ONLY) || !defined(IMPLEMENTATION_ONLY)
+  #define L_HEADER
+#endif
+#if defined(IMPLEMENTATION_ONLY) || !defined(HEADER_ONLY)
+  #define L_IMPLEMENTATION
+#endif
+
+// where the method bodies (and vtables) end up, and how they're linked
+#ifdef VTABLE_DISPATCH
+  #define L_DEFINE_VTABLE DEFINE_VTABLE
+  #define L_LINKAGE
+  #define L_VT_LINKAGE
+  #ifdef L_IMPLEMENTATION
+    #define L_BODIES
+  #endif
+#else
+  #define L_DEFINE_VTABLE DEFINE_STATIC_VTABLE
+  #define L_LINKAGE static inline
+  #define L_VT_LINKAGE static
+  #ifdef L_HEADER
+    #define L_BODIES
+  #endif
+#endif
+
+#ifdef L_HEADER
 
 //
 // Forward declare all of the typedefs
@@ -78,13 +130,13 @@ typedef struct L_T L_T;
 
 // (method doc is on the implementation on vtabled files)
 
-DEFINE_VTABLE(
+L_DEFINE_VTABLE(
   LN_T, 
   METHOD(void, LN_P, init, LN_T* this, REF_TYPE data),
   METHOD(void, LN_P, destroy, LN_T* this),
 )
 
-DEFINE_VTABLE(
+L_DEFINE_VTABLE(
   L_T,
   METHOD(void, L_P, init,    L_T* this),
   METHOD(void, L_P, destroy, L_T* this),
@@ -136,19 +188,54 @@ struct L_T
   /** The number of elements in the list. */
   unsigned int size;
 
+#ifdef POOLED
+  /** Allocated nodes not in the list (linked through their [next]) */
+  LN_T* free_nodes;
+
+  /** The chunks nodes are allocated from (linked through their first node) */
+  LN_T* chunks;
+
+  /** The number of nodes to put in the next chunk */
+  unsigned int chunk_size;
+#endif
+
+#ifdef MEMSTATS
+  /** What the list's nodes are counted as (see list_tag) */
+  mem_tag_t mem_tag;
+#endif
+
   /** A pointer to our vtable */
   const vtable_t(L_T)* fun;
 };
 
+#ifdef VTABLE_DISPATCH
+extern const vtable_t(LN_T) LN_VT;
+extern const vtable_t(L_T) L_VT;
+#endif
+
 #endif // HEADER
 
-#if defined(IMPLEMENTATION_ONLY) || !defined(HEADER_ONLY) 
+#ifdef L_BODIES
 
 /** The constant vtable for list nodes */
-vtable_t(LN_T)* LN_VT = NULL;
+L_VT_LINKAGE const vtable_t(LN_T) LN_VT =
+{
+  .init = &LN_METHOD(init),
+  .destroy = &LN_METHOD(destroy),
+};
 
 /** The constant vtable for lists */
-vtable_t(L_T)* L_VT = NULL;
+L_VT_LINKAGE const vtable_t(L_T) L_VT =
+{
+  .init = &L_METHOD(init),
+  .destroy = &L_METHOD(destroy),
+  .push = &L_METHOD(push),
+  .enqueue = &L_METHOD(enqueue),
+  .pop = &L_METHOD(pop),
+  .pop_back = &L_METHOD(pop_back),
+  .remove = &L_METHOD(remove),
+  .get = &L_METHOD(get),
+};
 
 //
 // list_node_t implementation
@@ -159,9 +246,9 @@ vtable_t(L_T)* L_VT = NULL;
  * manage. This node will initialize the previous and next pointers
  * to NULL, as it hasn't been put in the list yet.
  */
-void METHOD_NAME(LN_P, init)( LN_T* this, REF_TYPE data )
+L_LINKAGE void METHOD_NAME(LN_P, init)( LN_T* this, REF_TYPE data )
 {
-  this->fun = LN_VT;
+  this->fun = &LN_VT;
   this->data = data;
   this->prev = NULL;
   this->next = NULL;
@@ -173,7 +260,7 @@ void METHOD_NAME(LN_P, init)( LN_T* this, REF_TYPE data )
  * This will maintain the linkage of the overall list (i.e. it'll
  * relink the previous and next nodes).
  */
-void METHOD_NAME(LN_P, destroy)( LN_T* this )
+L_LINKAGE void METHOD_NAME(LN_P, destroy)( LN_T* this )
 {
   // maintain the surrounding nodes' linkage
   if ( this->prev != NULL )
@@ -199,39 +286,90 @@ void METHOD_NAME(LN_P, destroy)( LN_T* this )
 //
 
 /**
- * Initializes the given list.
+ * Gets an uninitialized node for this list.
  */
-DEF_METHOD(void, L_P, init, L_T* this)
+static inline LN_T* L_METHOD(alloc_node)( L_T* this )
 {
-  if ( L_VT == NULL )
+#ifdef POOLED
+  if ( this->free_nodes == NULL )
   {
-    L_VT = calloc( 1, sizeof( *L_VT ) );
-    L_VT->destroy = &METHOD_NAME(L_P,  destroy );
-    L_VT->push = &METHOD_NAME(L_P,  push );
-    L_VT->enqueue = &METHOD_NAME(L_P,  enqueue );
-    L_VT->pop = &METHOD_NAME(L_P,  pop );
-    L_VT->pop_back = &METHOD_NAME(L_P,  pop_back );
-    L_VT->remove = &METHOD_NAME(L_P,  remove );
-    L_VT->get = &METHOD_NAME(L_P,  get );
-
-    // while we're at it, let's create the vt for our nodes
-    // so we don't have to worry about it in the future
-    LN_VT = calloc( 1, sizeof( *LN_VT ) );
-    LN_VT->init = &METHOD_NAME(LN_P, init);
-    LN_VT->destroy = &METHOD_NAME(LN_P, destroy);
-  } 
-
-  this->fun = L_VT;
+    // the first node of the chunk just links it to the other chunks,
+    // the rest all go onto the free list
+    LN_T* chunk = mem_malloc( this->mem_tag, sizeof( LN_T ) * ( this->chunk_size + 1 ) );
+    chunk->next = this->chunks;
+    this->chunks = chunk;
+
+    unsigned int i;
+    for ( i = 1; i <= this->chunk_size; i++ )
+    {
+      chunk[ i ].next = this->free_nodes;
+      this->free_nodes = &chunk[ i ];
+    }
+
+    // grow geometrically, up to a page at a time
+    if ( sizeof( LN_T ) * ( this->chunk_size * 2 + 1 ) <= LIST_POOL_CHUNK_BYTES )
+    {
+      this->chunk_size *= 2;
+    }
+  }
+
+  LN_T* node = this->free_nodes;
+  this->free_nodes = node->next;
+  return node;
+#else
+  return mem_malloc( this->mem_tag, sizeof( LN_T ) );
+#endif
+}
+
+/**
+ * Returns a (destroyed) node to this list's allocator.
+ */
+static inline void L_METHOD(free_node)( L_T* this, LN_T* node )
+{
+#ifdef POOLED
+  node->next = this->free_nodes;
+  this->free_nodes = node;
+#else
+  mem_free( this->mem_tag, node );
+#endif
+}
+
+/**
+ * Initializes the given list.
+ */
+L_LINKAGE DEF_METHOD(void, L_P, init, L_T* this)
+{
+  this->fun = &L_VT;
   this->head = NULL;
   this->tail = NULL;
   this->size = 0;
+
+#ifdef POOLED
+  this->free_nodes = NULL;
+  this->chunks = NULL;
+  this->chunk_size = LIST_POOL_FIRST_CHUNK;
+#endif
+
+#ifdef MEMSTATS
+  this->mem_tag = MEM_LISTS;
+#endif
 }
 
 /**
  * Destroys the given list.
  */
-DEF_METHOD(void, L_P, destroy, L_T* this)
+L_LINKAGE DEF_METHOD(void, L_P, destroy, L_T* this)
 {
+#ifdef POOLED
+  // every node lives in one of the chunks, so there's no need
+  // to visit them one by one
+  while ( this->chunks != NULL )
+  {
+    LN_T* next = this->chunks->next;
+    mem_free( this->mem_tag, this->chunks );
+    this->chunks = next;
+  }
+#else
   // if we have no elements, there's nothing to free
   if ( this->size == 0 ) return;
 
@@ -241,11 +379,12 @@ DEF_METHOD(void, L_P, destroy, L_T* this)
   while ( current->next != NULL )
   {
     LN_T* next = current->next;
-    LN_VT->destroy( next );
-    free( next );
+    LN_METHOD(destroy)( next );
+    mem_free( this->mem_tag, next );
   }
-  LN_VT->destroy( current );
-  free( current );
+  LN_METHOD(destroy)( current );
+  mem_free( this->mem_tag, current );
+#endif
 
   // zero ourselves out to indicate that we're dead
   memset( this, 0, sizeof( *this ) );
@@ -255,10 +394,10 @@ DEF_METHOD(void, L_P, destroy, L_T* this)
  * Pushes a new item of type T onto the front (=> index=0)
  * of this list.
  */
-DEF_METHOD(void, L_P, push, L_T* this, REF_TYPE item)
+L_LINKAGE DEF_METHOD(void, L_P, push, L_T* this, REF_TYPE item)
 {
-  LN_T* node = malloc( sizeof( LN_T ) );
-  LN_VT->init( node, item );
+  LN_T* node = L_METHOD(alloc_node)( this );
+  LN_METHOD(init)( node, item );
 
   node->next = this->head;
   if ( this->size == 0 )
@@ -278,10 +417,10 @@ DEF_METHOD(void, L_P, push, L_T* this, REF_TYPE item)
  * Puts an item of type T onto the back (=> index=list.size)
  * of this list.
  */
-DEF_METHOD(void, L_P, enqueue, L_T* this, REF_TYPE item)
+L_LINKAGE DEF_METHOD(void, L_P, enqueue, L_T* this, REF_TYPE item)
 {
-  LN_T* node = malloc( sizeof( LN_T ) );
-  LN_VT->init( node, item );
+  LN_T* node = L_METHOD(alloc_node)( this );
+  LN_METHOD(init)( node, item );
 
   node->prev = this->tail;
   if ( this->size == 0 )
@@ -303,9 +442,9 @@ DEF_METHOD(void, L_P, enqueue, L_T* this, REF_TYPE item)
  * Assertions:
  * * this->size > 0
  */
-DEF_METHOD(REF_TYPE, L_P, pop, L_T* this)
+L_LINKAGE DEF_METHOD(REF_TYPE, L_P, pop, L_T* this)
 {
-  return L_VT->remove( this, 0 );
+  return L_METHOD(remove)( this, 0 );
 }
 
 /**
@@ -314,9 +453,9 @@ DEF_METHOD(REF_TYPE, L_P, pop, L_T* this)
  * Assertions:
  * * this->size > 0
  */
-DEF_METHOD(REF_TYPE, L_P, pop_back,  L_T* this)
+L_LINKAGE DEF_METHOD(REF_TYPE, L_P, pop_back,  L_T* this)
 {
-  return L_VT->remove( this, this->size - 1 );
+  return L_METHOD(remove)( this, this->size - 1 );
 }
 
 /**
@@ -325,7 +464,7 @@ DEF_METHOD(REF_TYPE, L_P, pop_back,  L_T* this)
  * Assertions:
  * * this->size > index 
  */
-DEF_METHOD(REF_TYPE, L_P, remove, L_T* this, unsigned int index)
+L_LINKAGE DEF_METHOD(REF_TYPE, L_P, remove, L_T* this, unsigned int index)
 {
   assert( this->size > index );
 
@@ -355,8 +494,8 @@ DEF_METHOD(REF_TYPE, L_P, remove, L_T* this, unsigned int index)
     this->head = current->next;
   }
 
-  LN_VT->destroy( current );
-  free( current );
+  LN_METHOD(destroy)( current );
+  L_METHOD(free_node)( this, current );
 
   this->size -= 1;
 
@@ -367,7 +506,7 @@ DEF_METHOD(REF_TYPE, L_P, remove, L_T* this, unsigned int index)
  * Returns a constant reference to the item in the nth position
  * of this list.
  */
-DEF_METHOD(CONST_REF_TYPE, L_P, get, const L_T* this, unsigned int index)
+L_LINKAGE DEF_METHOD(CONST_REF_TYPE, L_P, get, const L_T* this, unsigned int index)
 {
   // TODO start from back if index >= size/2
  
@@ -385,12 +524,17 @@ DEF_METHOD(CONST_REF_TYPE, L_P, get, const L_T* this, unsigned int index)
 #endif
 }
 
-#endif // IMPLEMENTATION
+#endif // BODIES
 
 // don't leak any of our preprocessor symbols
 #undef IMPLEMENTATION_ONLY
 #undef HEADER_ONLY
-#undef HEADER_ONLY
+#undef L_HEADER
+#undef L_IMPLEMENTATION
+#undef L_BODIES
+#undef L_DEFINE_VTABLE
+#undef L_LINKAGE
+#undef L_VT_LINKAGE
 #undef L_METHOD
 #undef LN_METHOD
 #undef L_VT
@@ -402,5 +546,7 @@ DEF_METHOD(CONST_REF_TYPE, L_P, get, const L_T* this, unsigned int index)
 #undef CONST_REF_TYPE
 #undef REF_TYPE
 #undef COPY_VALUE
+#undef POOLED
+#undef VTABLE_DISPATCH
 #undef TYPE
 
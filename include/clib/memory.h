@@ -6,16 +6,19 @@
 #ifndef __CLIB_MEMORY_H__
 #define __CLIB_MEMORY_H__
 
+#include "memstats.h"
+
 /**
  * Runs the destructor on the heap-allocated type (requires
  * a vtable), frees the memory, and sets the pointer back
- * to NULL (for easier debugging).
+ * to NULL (for easier debugging). This is for lists made with
+ * list_u, so their headers are counted as MEM_LISTS.
  */
 #define delete(x)                                                              \
   do                                                                           \
   {                                                                            \
     x->fun->destroy( x );                                                      \
-    free( x );                                                                 \
+    mem_free( MEM_LISTS, x );                                                  \
     x = NULL;                                                                  \
   }                                                                            \
   while ( 0 );                                                                 \
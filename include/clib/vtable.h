@@ -27,6 +27,13 @@
 #define _VTABLE_DEC_METHOD(return, type, name, ...)                            \
   return type##_##name( __VA_ARGS__ );
 
+/** Preprocessor indirection to turn a method into a static declaration */
+#define VTABLE_STATIC_DEC_METHOD(x) CAT(_VTABLE_STATIC_DEC_, x)
+
+/** Generates a static inline declaration for the given function */
+#define _VTABLE_STATIC_DEC_METHOD(return, type, name, ...)                     \
+  static inline return type##_##name( __VA_ARGS__ );
+
 /**
  * Defines a vtable for the given type, generates the structure
  * definition (filling it with pointers for the supplied methods),
@@ -41,5 +48,18 @@
   };                                                                           \
   EVAL(MAP(VTABLE_DEC_METHOD, __VA_ARGS__))
 
+/**
+ * Like DEFINE_VTABLE, but the methods are declared static inline, so
+ * they can be called (and inlined) directly in every file that sees
+ * their definitions, without going through the vtable.
+ */
+#define DEFINE_STATIC_VTABLE(type, ...)                                        \
+  typedef struct vtable_t(type) vtable_t(type);                                \
+  struct vtable_t(type)                                                        \
+  {                                                                            \
+    EVAL(MAP(VTABLE_PTR_METHOD, __VA_ARGS__))                                  \
+  };                                                                           \
+  EVAL(MAP(VTABLE_STATIC_DEC_METHOD, __VA_ARGS__))
+
 #endif
 
@@ -12,6 +12,12 @@ typedef struct command_t command_t;
 #include <stdbool.h>
 #include "generic.h"
 
+// generic.h only declares list_t(command_t) after this header, so
+// forward declare it for the functions below which need it
+typedef struct list_t(command_t) list_t(command_t);
+
+typedef struct spawn_t spawn_t;
+
 /**
  * A command type.
  */
@@ -20,9 +26,44 @@ struct command_t {
   /** The string entered by the user */
   char* string;
 
-  /** A list of all of the tokens in this command */
+  /**
+   * A list of all of the tokens in this command. Tokens read from
+   * the user still have their quotes in them, which are only removed
+   * once the command is expanded.
+   */
   list_t(string)* tokens;
 
+  /**
+   * The backing storage for the tokens of an expanded command (or NULL
+   * if each token was allocated on its own).
+   */
+  char* arena;
+
+  /**
+   * The bodies of the command's here-documents, in the order their
+   * `<<` operators appear in [tokens].
+   */
+  list_t(string)* heredocs;
+
+  /**
+   * The redirections to apply when running the command. These are
+   * only filled in once the command has been expanded.
+   */
+  list_t(redirect_t)* redirects;
+
+  /**
+   * The `NAME=value` assignments written before the command's name.
+   * These are only filled in once the command has been expanded.
+   */
+  list_t(string)* assignments;
+
+  /**
+   * How many owners a (heap allocated) command has, i.e. once it's in
+   * the history and being run from there again. A command with more
+   * than one mustn't be changed.
+   */
+  unsigned int references;
+
 };
 
 /**
@@ -33,11 +74,30 @@ void command_init( command_t* );
 void command_copy( command_t* this, const command_t* src );
 
 /**
- * Reads a new command from the user. This also prints out the shell's
- * prompt.
+ * Takes another reference to a (heap allocated) command, returning it.
+ * (Only its count of references changes, which is why it can be const.)
+ */
+command_t* command_retain( const command_t* );
+
+/**
+ * Drops a reference to a (heap allocated) command, destroying and
+ * freeing it once there aren't any left.
+ */
+void command_release( command_t* );
+
+/**
+ * Reads a new command from the user (after the shell has printed its
+ * prompt).
  */
 void command_read( command_t* );
 
+/**
+ * Splits the given line into the command's tokens. Quotes are
+ * kept in the tokens, so the expansion step knows which parts
+ * were quoted.
+ */
+void command_parse( command_t*, const char* line );
+
 /**
  * Deletes the data allocated for this command structure,
  * so it can be freed or drop out of scope, without any
@@ -45,6 +105,29 @@ void command_read( command_t* );
  */
 void command_destroy( command_t* );
 
+/**
+ * Initializes [this] as a copy of the tokens of [src] in the range
+ * [from, to), along with the bodies of any here-documents they use.
+ */
+void command_slice( command_t* this, const command_t* src,
+                    unsigned int from, unsigned int to );
+
+/**
+ * Splits the command at each `;` (or `&`) token, appending a new (heap
+ * allocated) command for each non-empty piece onto [into]. A `&` is
+ * kept on the end of its piece. If there aren't any such tokens (other
+ * than a `&` at the very end), this returns [false] without adding
+ * anything.
+ */
+bool command_split( const command_t*, list_t(command_t)* into );
+
+/**
+ * Given a pointer to the start of a command substitution (either
+ * `$(` or a backtick) or a process substitution (`<(` or `>(`),
+ * returns a pointer just past its end.
+ */
+const char* command_skip_substitution( const char* text );
+
 /**
  * Gets an immutable pointer to the first token of this
  * command (or NULL if none exist). This only borrows
@@ -53,10 +136,29 @@ void command_destroy( command_t* );
 const char* command_get_name( const command_t* );
 
 /**
- * Tries to execute the given command. This will return the pid of the
- * child process which ran (or is running).
+ * Applies all of the command's redirections to the current process.
+ * Returns [false] if any of them couldn't be applied.
+ */
+bool command_redirect( const command_t* );
+
+/**
+ * Sets each of the command's assignments in the current process's
+ * environment.
+ */
+void command_assign( const command_t* );
+
+/**
+ * Replaces the current process with the given command (after
+ * applying its redirections and assignments). This never returns.
+ */
+void command_execv( const command_t* );
+
+/**
+ * Tries to execute the given command, giving the child the spawn
+ * attributes (if not NULL) before it execs. This will return the pid
+ * of the child process which ran (or is running).
  */
-pid_t command_exec( const command_t* );
+pid_t command_exec( const command_t*, const spawn_t* spawn );
 
 #endif
 
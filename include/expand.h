@@ -0,0 +1,68 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_EXPAND_H__
+#define __MSH_EXPAND_H__
+
+#include "buffer.h"
+#include "command.h"
+#include "pathglob.h"
+
+typedef struct expansion_t expansion_t;
+typedef struct shell_t shell_t;
+
+/**
+ * The state needed to expand a single command, i.e. turn the raw
+ * tokens the user typed into the arguments the command is run with.
+ */
+struct expansion_t
+{
+  /** The shell command substitutions are run by */
+  shell_t* shell;
+
+  /** Listings of the directories read while globbing this command */
+  dircache_t dircache;
+
+  /** The expanded words, NUL-terminated and back to back */
+  buffer_t arena;
+
+  /** The offset of each word in [arena], as size_t's */
+  buffer_t offsets;
+
+  /** The offset of each assignment in [arena], as size_t's */
+  buffer_t assignments;
+
+  /** Scratch space for building glob patterns */
+  buffer_t pattern;
+
+  /** If anything failed to expand (so the command shouldn't run) */
+  bool failed;
+};
+
+/**
+ * Initializes the expansion state for a new command, which will
+ * be run by the given shell.
+ */
+void expansion_init( expansion_t*, shell_t* );
+
+/**
+ * Frees the expansion state.
+ */
+void expansion_destroy( expansion_t* );
+
+/**
+ * Expands the tokens of [src] into [dst] (which must not be
+ * initialized yet). Variables and command substitutions are
+ * expanded (and split into fields, if unquoted), process substitutions
+ * are started (see shell_substitute), quotes are removed,
+ * unquoted glob patterns are replaced by the paths they match, and
+ * redirections and leading assignments are moved out of the arguments.
+ *
+ * Returns [false] (after telling the user why) if the command is
+ * malformed and shouldn't be run. [dst] must be destroyed either way.
+ */
+bool expansion_expand( expansion_t*, const command_t* src, command_t* dst );
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_FRECENCY_H__
+#define __MSH_FRECENCY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "buffer.h"
+
+// identifies a file as being our table of directories ("MSHD")
+#define FRECENCY_MAGIC 0x4D534844
+#define FRECENCY_VERSION 1
+
+// once the directories' ranks add up to more than this, they're all
+// aged (and those which were hardly ever visited are forgotten)
+#define FRECENCY_MAX_TOTAL 100000
+
+typedef struct frecency_header_t frecency_header_t;
+typedef struct frecency_record_t frecency_record_t;
+typedef struct frecency_t frecency_t;
+
+/**
+ * The start of the table's file. The records follow it, and then the
+ * paths they point into (so the records can grow by moving the paths
+ * up, and the paths by growing the file).
+ */
+struct frecency_header_t
+{
+  /** FRECENCY_MAGIC and FRECENCY_VERSION */
+  uint32_t magic, version;
+
+  /** How many records there are, and how many there's room for */
+  uint32_t count, capacity;
+
+  /** Where the paths start, and how many bytes of them are used */
+  uint64_t pool_offset, pool_used;
+
+  /** How many of those bytes are the paths of forgotten directories */
+  uint64_t pool_garbage;
+
+  /** What every directory's rank adds up to */
+  double total;
+};
+
+/**
+ * A directory which has been visited.
+ */
+struct frecency_record_t
+{
+  /** Its path (an offset into the paths, NUL-terminated) and length */
+  uint64_t path;
+  uint32_t length;
+
+  /** How many times it's been visited (less, as it's aged) */
+  float rank;
+
+  /**
+   * Which characters its path has (see frecency_chars), so paths
+   * which couldn't match a pattern are passed over without reading
+   * them
+   */
+  uint64_t chars;
+
+  /** When it was last visited */
+  int64_t time;
+};
+
+/**
+ * The directories the user has visited, ranked by how often and how
+ * recently they were (their "frecency"), kept in a file every session
+ * maps. It's only locked (with flock) while it's being read or
+ * updated, and a session remaps it whenever another one has grown it.
+ */
+struct frecency_t
+{
+  /** Where the table is kept (or NULL if it isn't) */
+  char* path;
+
+  /** The file, once it's been opened (or -1) */
+  int fd;
+
+  /** The file, as mapped, and how much of it was */
+  void* map;
+  size_t size;
+
+  /** If it couldn't be opened (so it isn't tried again) */
+  bool failed;
+};
+
+/**
+ * Initializes the table kept at MSH_DIRS_FILE (where an empty value
+ * means none is), or otherwise in the user's data directory. It isn't
+ * opened until it's first needed.
+ */
+void frecency_init( frecency_t* );
+
+/**
+ * Unmaps and closes the table.
+ */
+void frecency_destroy( frecency_t* );
+
+/**
+ * Records a visit to [dir] (an absolute path).
+ */
+void frecency_visit( frecency_t*, const char* dir );
+
+/**
+ * Forgets [dir] (e.g. as it's been removed).
+ */
+void frecency_forget( frecency_t*, const char* dir );
+
+/**
+ * Finds the (up to [max]) highest ranked directories whose paths have
+ * each of [words] in them, in order (ignoring case, if none match
+ * otherwise), appending their paths (NUL-terminated, back to back)
+ * onto [out] from the highest down. Returns how many there were.
+ */
+size_t frecency_query( frecency_t*, const char* const* words, size_t count,
+                       size_t max, buffer_t* out );
+
+#endif
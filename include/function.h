@@ -0,0 +1,79 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_FUNCTION_H__
+#define __MSH_FUNCTION_H__
+
+#include <stdbool.h>
+#include "command.h"
+#include "generic.h"
+
+// the number of buckets in a function table (must be a power of two)
+#define FUNCTION_TABLE_SIZE 64
+
+typedef struct function_t function_t;
+typedef struct function_table_t function_table_t;
+
+/**
+ * A named list of commands, which have already been tokenized,
+ * so running them never has to re-read their source. This is
+ * used for both aliases and shell functions.
+ */
+struct function_t
+{
+  /** The name it's invoked by */
+  char* name;
+
+  /** The text it was defined from (for printing it back out) */
+  char* text;
+
+  /** The (raw) commands to run, in order */
+  list_t(command_t)* body;
+
+  /** The next function in the same bucket */
+  function_t* next;
+};
+
+/**
+ * A hash table of functions, keyed by name.
+ */
+struct function_table_t
+{
+  /** The chains of functions, indexed by the hash of their names */
+  function_t* buckets[ FUNCTION_TABLE_SIZE ];
+
+  /** The number of functions in the table */
+  unsigned int size;
+};
+
+/**
+ * Initializes an empty table.
+ */
+void function_table_init( function_table_t* );
+
+/**
+ * Frees every function in the table.
+ */
+void function_table_destroy( function_table_t* );
+
+/**
+ * Defines (or redefines) a function. The table takes ownership
+ * of the [body] and its commands.
+ */
+void function_table_set( function_table_t*, const char* name,
+                         const char* text, list_t(command_t)* body );
+
+/**
+ * Looks up a function by name, returning NULL if there isn't one.
+ */
+const function_t* function_table_get( const function_table_t*,
+                                      const char* name );
+
+/**
+ * Removes a function. Returns [false] if it wasn't defined.
+ */
+bool function_table_remove( function_table_t*, const char* name );
+
+#endif
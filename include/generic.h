@@ -13,22 +13,31 @@
 #define HEADER_ONLY
 #define TYPE pid_t
 #define COPY_VALUE
+#define POOLED
 #include "clib/list.h"
 
 #define HEADER_ONLY
 #define TYPE int
 #define COPY_VALUE
+#define POOLED
 #include "clib/list.h"
 
 typedef char* string;
 #define HEADER_ONLY
 #define TYPE string
 #define COPY_VALUE
+#define POOLED
 #include "clib/list.h"
 
 #define HEADER_ONLY
 #define TYPE char
 #define COPY_VALUE
+#define POOLED
+#include "clib/list.h"
+
+#include "redirect.h"
+#define HEADER_ONLY
+#define TYPE redirect_t
 #include "clib/list.h"
 
 #include "command.h"
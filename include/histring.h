@@ -0,0 +1,149 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_HISTRING_H__
+#define __MSH_HISTRING_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <time.h>
+
+// identifies a segment as being one of ours ("MSHR")
+#define HISTRING_MAGIC 0x4D534852
+#define HISTRING_VERSION 1
+
+// how many commands the ring holds (a power of two, so a sequence
+// number maps onto its slot with a mask)
+#define HISTRING_CAPACITY 1024
+
+// the size of each slot, and so how much of a command fits in one
+#define HISTRING_SLOT_SIZE 1024
+#define HISTRING_TEXT ( HISTRING_SLOT_SIZE - 24 )
+
+typedef struct histring_header_t histring_header_t;
+typedef struct histring_slot_t histring_slot_t;
+typedef struct histring_entry_t histring_entry_t;
+typedef struct histring_t histring_t;
+
+/**
+ * The start of the shared segment.
+ */
+struct histring_header_t
+{
+  /** HISTRING_MAGIC, stored last by whoever creates the segment */
+  _Atomic uint32_t magic;
+
+  /** HISTRING_VERSION */
+  uint32_t version;
+
+  /** HISTRING_CAPACITY and HISTRING_SLOT_SIZE, as the creator had them */
+  uint32_t capacity, slot_size;
+
+  /** The sequence number the next command will be given */
+  _Atomic uint64_t next __attribute__(( aligned( 64 ) ));
+};
+
+/**
+ * A single command in the shared segment.
+ */
+struct histring_slot_t
+{
+  /**
+   * 2 * (sequence + 1) once the command with that sequence number is
+   * published, or one less while it's still being written (zero
+   * means the slot was never used)
+   */
+  _Atomic uint64_t sequence;
+
+  /** The session which ran the command */
+  int32_t pid;
+
+  /** The length of the whole command (which may not all fit in [text]) */
+  uint32_t length;
+
+  /** When the command was run */
+  int64_t time;
+
+  /** The command, as it was entered */
+  char text[ HISTRING_TEXT ];
+};
+
+/**
+ * A copy of a command, taken out of the ring.
+ */
+struct histring_entry_t
+{
+  /** Its sequence number, i.e. how many commands came before it */
+  uint64_t sequence;
+
+  /** The session which ran it */
+  pid_t pid;
+
+  /** When it was run */
+  time_t time;
+
+  /** If it was too long to fit in its slot, and was cut short */
+  bool truncated;
+
+  /** The command, NUL-terminated */
+  char text[ HISTRING_TEXT + 1 ];
+};
+
+/**
+ * A history of commands shared by every session which maps the same
+ * segment in /dev/shm. Nothing is ever locked: a writer reserves the
+ * next sequence number with a fetch-add, and publishes the command in
+ * its slot (seqlock style) once it's been copied in. Readers copy a
+ * slot out and check its sequence number didn't change while they
+ * did, so they never see half a command (or one that's been lapped).
+ */
+struct histring_t
+{
+  /** The segment, as mapped */
+  histring_header_t* header;
+
+  /** The slots, following the header */
+  histring_slot_t* slots;
+
+  /** The segment's name (in /dev/shm) */
+  char* name;
+};
+
+/**
+ * Maps the named segment, creating it if no other session has yet.
+ * Returns NULL (after telling the user why) if it can't be.
+ */
+histring_t* histring_open( const char* name );
+
+/**
+ * Unmaps the segment and frees the ring. The segment itself is left
+ * behind for the other sessions (and any started later).
+ */
+void histring_close( histring_t* );
+
+/**
+ * Adds a command to the ring. Returns [false] if a newer command got
+ * to its slot first, i.e. the ring went all the way around while it
+ * was being written.
+ */
+bool histring_append( histring_t*, const char* text );
+
+/**
+ * Gets the sequence number the next command will be given, so every
+ * command before it (back to HISTRING_CAPACITY of them) can be read.
+ */
+uint64_t histring_next( const histring_t* );
+
+/**
+ * Copies the command with the given sequence number out of the ring.
+ * Returns [false] if there isn't one (i.e. it's been overwritten, or
+ * it's still being written).
+ */
+bool histring_read( const histring_t*, uint64_t sequence,
+                    histring_entry_t* entry );
+
+#endif
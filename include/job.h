@@ -0,0 +1,117 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_JOB_H__
+#define __MSH_JOB_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "buffer.h"
+
+typedef struct job_t job_t;
+typedef struct job_table_t job_table_t;
+
+/**
+ * What a job is currently doing.
+ */
+typedef enum job_state_t
+{
+  JOB_RUNNING,
+  JOB_STOPPED
+} job_state_t;
+
+/**
+ * A process the shell has put in the background (either by
+ * suspending it, or by resuming it with `bg`), or started as a
+ * coprocess (with `coproc`).
+ */
+struct job_t
+{
+  /** The number the user refers to the job by (i.e. `%1`) */
+  unsigned int id;
+
+  /** The job's process */
+  pid_t pid;
+
+  /** If the job is running or stopped */
+  job_state_t state;
+
+  /**
+   * For a coprocess, the name it was given, and the shell's ends of
+   * the pipes to its stdin and from its stdout (otherwise NULL and
+   * -1, and [input] is -1 once it's been closed)
+   */
+  char* name;
+  int input, output;
+
+  /**
+   * What's been read from a coprocess, of which everything from
+   * [start] on hasn't been taken (by `coread`) yet
+   */
+  buffer_t pending;
+  size_t start;
+
+  /** The next job (in order of their ids) */
+  job_t* next;
+};
+
+/**
+ * Every job the shell is keeping track of, in order of their ids.
+ */
+struct job_table_t
+{
+  /** The job with the lowest id (or NULL if there aren't any) */
+  job_t* head;
+
+  /** The number of jobs in the table */
+  unsigned int size;
+};
+
+/**
+ * Initializes an empty table.
+ */
+void job_table_init( job_table_t* );
+
+/**
+ * Kills (with SIGKILL) and reaps every job left in the table,
+ * so nothing is left behind, then frees the table.
+ */
+void job_table_destroy( job_table_t* );
+
+/**
+ * Adds a job for the given process, numbered one past the
+ * highest id currently in use, and returns it.
+ */
+job_t* job_table_add( job_table_t*, pid_t pid, job_state_t state );
+
+/**
+ * Gets the job with the given id, or NULL if there isn't one.
+ */
+job_t* job_table_get( const job_table_t*, unsigned int id );
+
+/**
+ * Gets the most recent job in the given state, or NULL if there
+ * isn't one.
+ */
+job_t* job_table_last( const job_table_t*, job_state_t state );
+
+/**
+ * Gets the coprocess with the given name, or NULL if there isn't one.
+ */
+job_t* job_table_named( const job_table_t*, const char* name );
+
+/**
+ * Parses a job specification (`%N`, or a bare `N`), returning NULL
+ * (after telling the user why) if it doesn't name a job.
+ */
+job_t* job_table_parse( const job_table_t*, const char* spec );
+
+/**
+ * Removes the job from the table, and frees it (closing the pipes,
+ * if it's a coprocess).
+ */
+void job_table_remove( job_table_t*, job_t* job );
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_MEMSTATS_H__
+#define __MSH_MEMSTATS_H__
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// allocations are accounted for unless this is a release build (i.e.
+// NDEBUG is defined), where every mem_* call is the plain libc one
+#ifndef NDEBUG
+#define MEMSTATS 1
+#endif
+
+/**
+ * What an allocation is for.
+ */
+typedef enum mem_tag_t
+{
+  /** The nodes (and headers) of lists */
+  MEM_LISTS,
+
+  /** The words of commands, as read or expanded */
+  MEM_TOKENS,
+
+  /** The text commands were read from, and their here-documents */
+  MEM_STRINGS,
+
+  /** Commands (and pids) kept in the history */
+  MEM_HISTORY,
+
+  /** The job table, and the output kept for each job */
+  MEM_JOBS,
+
+  /** (the number of tags) */
+  MEM_TAGS
+} mem_tag_t;
+
+/**
+ * The allocations made for one tag.
+ */
+typedef struct mem_stats_t
+{
+  /** The bytes allocated and not yet freed */
+  int64_t live_bytes;
+
+  /** The number of allocations not yet freed */
+  int64_t live_count;
+
+  /** The most [live_bytes] has been */
+  int64_t peak_bytes;
+
+  /** The number of allocations ever made */
+  int64_t total_count;
+} mem_stats_t;
+
+/**
+ * Returns a tag's name (i.e. "tokens").
+ */
+const char* mem_tag_name( mem_tag_t );
+
+/**
+ * Fills in the stats for every tag, added up over every thread which
+ * has allocated anything. Returns [false] (leaving them zeroed) if
+ * allocations aren't being accounted for in this build.
+ */
+bool mem_snapshot( mem_stats_t stats[ MEM_TAGS ] );
+
+#ifdef MEMSTATS
+
+/**
+ * The same as malloc, calloc, strdup, strndup and free, but counting
+ * the (usable) size of each allocation against [tag]. The counters
+ * are thread-local, so counting costs a few plain adds.
+ *
+ * Something allocated under one tag has to be freed under the same
+ * one (or be moved with mem_retag first).
+ */
+void* mem_malloc( mem_tag_t tag, size_t size );
+void* mem_calloc( mem_tag_t tag, size_t count, size_t size );
+char* mem_strdup( mem_tag_t tag, const char* string );
+char* mem_strndup( mem_tag_t tag, const char* string, size_t length );
+void mem_free( mem_tag_t tag, void* pointer );
+
+/**
+ * Counts something libc allocated itself (e.g. with getline or
+ * asprintf) against [tag], so it can be freed with mem_free.
+ */
+void mem_adopt( mem_tag_t tag, void* pointer );
+
+/**
+ * Moves an allocation from one tag to another (e.g. once a command
+ * is kept in the history).
+ */
+void mem_retag( mem_tag_t from, mem_tag_t to, void* pointer );
+
+#else
+
+#define mem_malloc( tag, size ) malloc( size )
+#define mem_calloc( tag, count, size ) calloc( count, size )
+#define mem_strdup( tag, string ) strdup( string )
+#define mem_strndup( tag, string, length ) strndup( string, length )
+#define mem_free( tag, pointer ) free( pointer )
+#define mem_adopt( tag, pointer ) ( ( void ) 0 )
+#define mem_retag( from, to, pointer ) ( ( void ) 0 )
+
+#endif
+
+#endif
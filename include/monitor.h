@@ -0,0 +1,131 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_MONITOR_H__
+#define __MSH_MONITOR_H__
+
+#include <stdbool.h>
+#include <time.h>
+#include "buffer.h"
+#include "job.h"
+
+typedef struct monitor_process_t monitor_process_t;
+typedef struct monitor_entry_t monitor_entry_t;
+typedef struct monitor_t monitor_t;
+
+/**
+ * A process in a job's group, whose /proc files are kept open.
+ */
+struct monitor_process_t
+{
+  /** The process */
+  pid_t pid;
+
+  /**
+   * /proc/<pid>/stat, /proc/<pid>/statm, /proc/<pid>/io and
+   * /proc/<pid>/task/<pid>/children (or -1)
+   */
+  int stat_fd, statm_fd, io_fd, children_fd;
+
+  /** The CPU time it had used at the last sample (user + system) */
+  unsigned long long ticks;
+
+  /** If it was found in the group by the sample being taken */
+  bool seen;
+};
+
+/**
+ * The most recent sample of a single job, i.e. of every process in
+ * its group.
+ */
+struct monitor_entry_t
+{
+  /** The job's id */
+  unsigned int id;
+
+  /** The job's process, which leads its group */
+  pid_t pid;
+
+  /** The processes found in the group, and how many there's room for */
+  monitor_process_t* processes;
+  unsigned int count, capacity;
+
+  /** If any of them were still there at the last sample */
+  bool alive;
+
+  /** The leading process' name */
+  char name[ 17 ];
+
+  /** The leading process' state (R, S, T, Z, ...) */
+  char state;
+
+  /** The share of a CPU used since the previous sample, in percent */
+  double cpu;
+
+  /** The resident set size, in bytes */
+  unsigned long long rss;
+
+  /** The bytes read and written through syscalls so far */
+  unsigned long long read_bytes, write_bytes;
+};
+
+/**
+ * A live view of the resources used by the shell's jobs, each summed
+ * over its whole process group. The /proc files of each process are
+ * opened once and re-read in place, and the group is found by
+ * following each process' children down from the job's own, so
+ * taking a sample costs a few preads per process.
+ */
+struct monitor_t
+{
+  /** One entry per job, in order of their ids */
+  monitor_entry_t* entries;
+
+  /** The number of [entries] */
+  unsigned int count;
+
+  /** When the last sample was taken */
+  struct timespec sampled;
+
+  /** The number of lines in the last frame drawn (to redraw over it) */
+  unsigned int lines;
+
+  /** If frames are drawn in place (i.e. stdout is a terminal) */
+  bool in_place;
+
+  /** The frame being built, written out all at once */
+  buffer_t frame;
+};
+
+/**
+ * Starts monitoring every job in the table, taking the first sample.
+ */
+void monitor_init( monitor_t*, const job_table_t* jobs );
+
+/**
+ * Closes the /proc files and frees the monitor.
+ */
+void monitor_destroy( monitor_t* );
+
+/**
+ * Samples every job again, updating their entries. Returns [false]
+ * once none of the jobs are left.
+ */
+bool monitor_sample( monitor_t* );
+
+/**
+ * Draws the current samples to stdout, over the previous frame if
+ * drawing in place.
+ */
+void monitor_draw( monitor_t* );
+
+/**
+ * Draws a frame every [interval] seconds until [frames] have been
+ * drawn (or forever, if zero), the jobs have all exited, or the
+ * user presses enter (or ^C).
+ */
+void monitor_run( const job_table_t* jobs, double interval, unsigned int frames );
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_MUX_H__
+#define __MSH_MUX_H__
+
+#include <stdbool.h>
+#include <poll.h>
+#include <sys/types.h>
+#include "buffer.h"
+
+// how much is read from a job's pipe at once
+#define MUX_READ_SIZE ( 64 * 1024 )
+
+// how much of each job's output is kept for `jobs -o`
+#define MUX_RING_SIZE ( 64 * 1024 )
+
+// the longest a line can get before it's let out without its end
+#define MUX_LINE_MAX ( 4 * 1024 )
+
+typedef struct mux_stream_t mux_stream_t;
+typedef struct mux_job_t mux_job_t;
+typedef struct mux_t mux_t;
+
+/**
+ * One of a job's pipes (its stdout or stderr).
+ */
+struct mux_stream_t
+{
+  /** Our end of the pipe (or -1, once the job has closed it) */
+  int fd;
+
+  /** The start of a line whose end hasn't been read yet */
+  buffer_t partial;
+};
+
+/**
+ * A background job whose output is being multiplexed.
+ */
+struct mux_job_t
+{
+  /** The job's id */
+  unsigned int id;
+
+  /** Its stdout and stderr */
+  mux_stream_t streams[ 2 ];
+
+  /** The last MUX_RING_SIZE bytes of its output, as a ring */
+  char* ring;
+
+  /** Where the oldest byte in [ring] is, and how many there are */
+  size_t ring_start, ring_size;
+
+  /** The next job (the most recently started come first) */
+  mux_job_t* next;
+};
+
+/**
+ * Collects the output of background jobs through pipes, and writes
+ * it to the terminal a whole line at a time, tagged with the job it
+ * came from (so jobs writing at once don't garble each other). Each
+ * job's output is also kept, for `jobs -o` to show again later.
+ */
+struct mux_t
+{
+  /** The jobs, including finished ones (until their id is reused) */
+  mux_job_t* jobs;
+
+  /** The lines waiting to be written, all at once */
+  buffer_t out;
+
+  /** Where reads go */
+  char* chunk;
+};
+
+/**
+ * Initializes a multiplexer without any jobs.
+ */
+void mux_init( mux_t* );
+
+/**
+ * Closes every job's pipes, and frees the multiplexer.
+ */
+void mux_destroy( mux_t* );
+
+/**
+ * Opens the pipes for a job's stdout and stderr. The job is given the
+ * [write] ends, and the [read] ends go to [mux_add] once it's started.
+ * Returns [false] (after telling the user why) if they couldn't be.
+ */
+bool mux_pipes( int read[ 2 ], int write[ 2 ] );
+
+/**
+ * Starts multiplexing the output of job [id] from the [read] ends of
+ * its pipes (replacing what was kept of any older job with the id).
+ */
+void mux_add( mux_t*, unsigned int id, const int read[ 2 ] );
+
+/**
+ * Fills in up to [max] pollfds with the pipes still open. Returns how
+ * many there are.
+ */
+unsigned int mux_poll_fds( const mux_t*, struct pollfd* fds, unsigned int max );
+
+/**
+ * Counts the pipes still open.
+ */
+unsigned int mux_count( const mux_t* );
+
+/**
+ * Reads whatever the jobs have written so far (without blocking), and
+ * writes out every complete line. Returns [true] if anything happened
+ * (i.e. lines were written, or a job closed its pipes).
+ */
+bool mux_drain( mux_t* );
+
+/**
+ * Writes out what was kept of job [id]'s output. Returns [false] if
+ * there's nothing for it.
+ */
+bool mux_replay( const mux_t*, unsigned int id );
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_PATHGLOB_H__
+#define __MSH_PATHGLOB_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include "buffer.h"
+
+typedef struct glob_op_t glob_op_t;
+typedef struct glob_segment_t glob_segment_t;
+typedef struct glob_pattern_t glob_pattern_t;
+typedef struct dircache_entry_t dircache_entry_t;
+typedef struct dircache_t dircache_t;
+
+/**
+ * A single matching instruction in a compiled path segment.
+ */
+struct glob_op_t
+{
+  /** One of GLOB_OP_LITERAL, GLOB_OP_ANY, GLOB_OP_STAR or GLOB_OP_CLASS */
+  unsigned char kind;
+
+  /** The character to match for a literal */
+  unsigned char c;
+
+  /** If a class should match everything *not* in [set] */
+  bool negate;
+
+  /** A bitmap of the 256 characters a class matches */
+  unsigned char set[ 32 ];
+};
+
+#define GLOB_OP_LITERAL 0
+#define GLOB_OP_ANY     1
+#define GLOB_OP_STAR    2
+#define GLOB_OP_CLASS   3
+
+/**
+ * One '/'-delimited piece of a pattern.
+ */
+struct glob_segment_t
+{
+  /** The compiled matching program for this segment */
+  glob_op_t* ops;
+
+  /** The number of [ops] */
+  size_t count;
+
+  /**
+   * If the segment has no magic characters, this is the name it
+   * names (with escapes removed), otherwise NULL.
+   */
+  char* literal;
+
+  /** If this segment is `**` (zero or more directories) */
+  bool recursive;
+
+  /** If this segment explicitly starts with a '.' (and so may match dotfiles) */
+  bool dot;
+};
+
+/**
+ * A pathname pattern, compiled once so it can be matched against
+ * many directory entries.
+ */
+struct glob_pattern_t
+{
+  /** If the pattern starts at the root directory */
+  bool absolute;
+
+  /** If the pattern ended with a '/' (and so only matches directories) */
+  bool directory;
+
+  /** The segments of the path */
+  glob_segment_t* segments;
+
+  /** The number of [segments] */
+  size_t count;
+};
+
+/**
+ * A directory listing held by a [dircache_t].
+ */
+struct dircache_entry_t
+{
+  /** The path this listing was read from */
+  char* path;
+
+  /** The modification time of the directory when it was read */
+  struct timespec mtime;
+
+  /**
+   * The names in the directory, stored back to back as a d_type byte
+   * followed by the NUL-terminated name.
+   */
+  buffer_t names;
+
+  /** The number of names in [names] */
+  size_t count;
+};
+
+/**
+ * A cache of directory listings. One is kept for the lifetime of a
+ * single command, so several globs over the same directory only read
+ * it once (unless it was modified in between).
+ */
+struct dircache_t
+{
+  /** The cached listings */
+  dircache_entry_t* entries;
+
+  /** The number of [entries] */
+  size_t count;
+
+  /** The number of [entries] allocated */
+  size_t capacity;
+
+  /** Scratch space handed to getdents64 */
+  char* dents;
+};
+
+/**
+ * Returns [true] if the word contains any unescaped glob characters.
+ */
+bool glob_has_magic( const char* word );
+
+/**
+ * Compiles the given pattern. Characters can be escaped with a
+ * backslash to be matched literally.
+ */
+void glob_pattern_compile( glob_pattern_t*, const char* pattern );
+
+/**
+ * Frees the compiled pattern.
+ */
+void glob_pattern_destroy( glob_pattern_t* );
+
+/**
+ * Expands the pattern against the file system. Every match is
+ * appended (NUL-terminated) onto [out], and the offset of each
+ * is appended onto [offsets] as a size_t. Matches are sorted.
+ *
+ * Returns the number of matches.
+ */
+size_t glob_expand( const glob_pattern_t*, dircache_t*,
+                    buffer_t* out, buffer_t* offsets );
+
+/**
+ * Initializes an empty directory cache.
+ */
+void dircache_init( dircache_t* );
+
+/**
+ * Frees all of the listings in the cache.
+ */
+void dircache_destroy( dircache_t* );
+
+/**
+ * Gets the listing for the directory at [path], reading it if it
+ * isn't cached or has been modified since it was. Returns NULL if
+ * the directory can't be read.
+ */
+const dircache_entry_t* dircache_list( dircache_t*, const char* path );
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_PROMPT_H__
+#define __MSH_PROMPT_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include "buffer.h"
+
+// what the prompt is without PS1
+#define PROMPT_DEFAULT "msh> "
+
+// how many directories' git branches are remembered
+#define PROMPT_CACHE_SIZE 16
+
+typedef struct prompt_git_t prompt_git_t;
+typedef struct prompt_t prompt_t;
+
+/**
+ * The git branch of a directory, as last worked out by the worker.
+ */
+struct prompt_git_t
+{
+  /** The directory */
+  char* directory;
+
+  /** The repository's HEAD file (or NULL if it isn't in one) */
+  char* head;
+
+  /** When [head] was last changed (i.e. the branch switched) */
+  struct timespec changed;
+
+  /** The branch (or a short commit, if it's detached) */
+  char branch[ 128 ];
+
+  /** The next (less recently used) directory */
+  prompt_git_t* next;
+};
+
+/**
+ * Renders PS1, which can have these in it:
+ *
+ *   \w  the working directory (with ~ for $HOME)  \W  just its name
+ *   \?  the last command's status                 \j  the number of running jobs
+ *   \g  the git branch                            \u  the user
+ *   \h  the host name (up to the first `.`)       \$  # for root, else $
+ *   \n  a new line    \e  an escape (for colors)  \\  a backslash
+ *
+ * Everything but the git branch is cheap, and rendered right away.
+ * Branches are worked out by a worker thread, and cached by directory
+ * (as long as their HEAD file hasn't changed since), so the prompt
+ * never waits on one. When a new one comes in, [ready] becomes
+ * readable, and the prompt can be redrawn with it.
+ */
+struct prompt_t
+{
+  /** The worker (only started once there's something for it to do) */
+  pthread_t worker;
+
+  /** If [worker] has been started */
+  bool started;
+
+  /** Guards [request], [stopping] and [cache] */
+  pthread_mutex_t lock;
+
+  /** Signalled when there's a request (or the worker should stop) */
+  pthread_cond_t wake;
+
+  /** The directory the worker should look at next (or NULL) */
+  char* request;
+
+  /** If the worker should exit */
+  bool stopping;
+
+  /** An eventfd, readable when the worker has finished a request */
+  int ready;
+
+  /** The branches, most recently used first */
+  prompt_git_t* cache;
+
+  /** The prompt as it was last drawn */
+  buffer_t drawn;
+
+  /** The number of lines [drawn] takes up, after the first */
+  unsigned int lines;
+};
+
+/**
+ * Initializes the prompt (without starting the worker).
+ */
+void prompt_init( prompt_t* );
+
+/**
+ * Stops the worker, and frees the prompt.
+ */
+void prompt_destroy( prompt_t* );
+
+/**
+ * Draws the prompt, given the last command's status and the number of
+ * running jobs. Returns [true] if a segment is still being worked out (i.e.
+ * it's worth waiting on [ready] to redraw it).
+ */
+bool prompt_draw( prompt_t*, int status, unsigned int jobs );
+
+/**
+ * Takes the worker's result (once [ready] is readable), and redraws
+ * the prompt over the old one if that changed it. Returns [true] if a
+ * segment is still being worked out.
+ */
+bool prompt_redraw( prompt_t*, int status, unsigned int jobs );
+
+/**
+ * Erases the prompt that was drawn, so something else can be written
+ * where it was (and the prompt drawn again after it).
+ */
+void prompt_clear( prompt_t* );
+
+#endif
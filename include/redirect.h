@@ -0,0 +1,109 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_REDIRECT_H__
+#define __MSH_REDIRECT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct redirect_t redirect_t;
+typedef struct redirect_saved_t redirect_saved_t;
+
+/** `[n]< path` */
+#define REDIRECT_READ   0
+
+/** `[n]> path` */
+#define REDIRECT_WRITE  1
+
+/** `[n]>> path` */
+#define REDIRECT_APPEND 2
+
+/** `[n]>& m` and `[n]<& m` */
+#define REDIRECT_DUP    3
+
+/** `[n]>& -` */
+#define REDIRECT_CLOSE  4
+
+/**
+ * Here-documents and here-strings, i.e. `<< DELIM` (or `<<- DELIM`)
+ * and `<<< word`
+ */
+#define REDIRECT_DATA   5
+
+/** The most file descriptors a built-in's redirections can replace */
+#define REDIRECT_MAX_SAVED 16
+
+/**
+ * A single redirection of one of the command's file descriptors.
+ */
+struct redirect_t
+{
+  /** One of the REDIRECT_* kinds */
+  int kind;
+
+  /** The file descriptor being replaced */
+  int fd;
+
+  /** The descriptor to duplicate, for REDIRECT_DUP */
+  int source;
+
+  /**
+   * The path of the file for READ/WRITE/APPEND, or the bytes to
+   * feed in for DATA (owned by this structure).
+   */
+  char* path;
+
+  /** The number of bytes in [path], for DATA */
+  size_t length;
+};
+
+/**
+ * The original descriptors replaced by [redirect_apply_saved], so a
+ * built-in can run redirected inside the shell itself.
+ */
+struct redirect_saved_t
+{
+  /** The descriptors that were replaced */
+  int fds[ REDIRECT_MAX_SAVED ];
+
+  /** Duplicates of what they pointed to before (or -1 if closed) */
+  int saved[ REDIRECT_MAX_SAVED ];
+
+  /** The number of saved descriptors */
+  unsigned int count;
+};
+
+/**
+ * Frees the data held by the redirect.
+ */
+void redirect_destroy( redirect_t* );
+
+/**
+ * Checks if the (raw) token is a redirection operator. If so, this
+ * returns [true], and fills in the [kind] and [fd] it redirects.
+ * Here-documents are reported with [heredoc] set.
+ */
+bool redirect_parse_operator( const char* token, int* kind, int* fd,
+                              bool* heredoc );
+
+/**
+ * Applies the redirection to the current process. Returns [false]
+ * (after printing why) if it could not be applied.
+ */
+bool redirect_apply( const redirect_t* );
+
+/**
+ * Applies the redirection, first remembering what the descriptor
+ * referred to, so it can be put back with [redirect_restore].
+ */
+bool redirect_apply_saved( const redirect_t*, redirect_saved_t* );
+
+/**
+ * Puts back every descriptor replaced by [redirect_apply_saved].
+ */
+void redirect_restore( redirect_saved_t* );
+
+#endif
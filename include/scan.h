@@ -0,0 +1,68 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_SCAN_H__
+#define __MSH_SCAN_H__
+
+#include <stdbool.h>
+
+/**
+ * The ways the scanner can look at a line, from slowest to fastest.
+ */
+typedef enum scan_level_t
+{
+  /** A byte at a time */
+  SCAN_SCALAR,
+
+  /** 16 bytes at a time, with SSE2 */
+  SCAN_SSE2,
+
+  /** 32 bytes at a time, with AVX2 */
+  SCAN_AVX2
+} scan_level_t;
+
+/**
+ * Returns the fastest level this CPU can do (which is what's used,
+ * unless [scan_use] says otherwise).
+ */
+scan_level_t scan_best( void );
+
+/**
+ * Returns the level in use.
+ */
+scan_level_t scan_level( void );
+
+/**
+ * Uses a particular level (e.g. to benchmark one against another).
+ * Returns [false] if this CPU can't do it.
+ */
+bool scan_use( scan_level_t );
+
+/**
+ * Returns the name of a level (i.e. "avx2").
+ */
+const char* scan_name( scan_level_t );
+
+/**
+ * Skips any whitespace (spaces, tabs and line endings) at the start
+ * of [text], returning the first byte which isn't.
+ */
+const char* scan_blanks( const char* text );
+
+/**
+ * Returns the first byte in [text] (outside of quotes) which could end
+ * a word or change how the rest of it's read, i.e. whitespace, a
+ * quote, a backslash, a substitution, an operator or the end.
+ */
+const char* scan_word( const char* text );
+
+/**
+ * Returns the first byte in [text] (inside quotes, of the given kind)
+ * which could matter, i.e. the closing quote, the end, or inside
+ * double quotes, a substitution.
+ */
+const char* scan_quoted( const char* text, char quote );
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_SERVER_H__
+#define __MSH_SERVER_H__
+
+#include <stdint.h>
+
+// the longest command line a client can send
+#define SERVER_MAX_LINE ( 64 * 1024 )
+
+// the descriptors sent along with each command (stdin, stdout, stderr)
+#define SERVER_FDS 3
+
+typedef struct server_frame_t server_frame_t;
+
+/**
+ * What a frame holds.
+ */
+typedef enum server_frame_type_t
+{
+  /**
+   * Client => server: a command line to run (the payload), sent with
+   * the descriptors it's to be run with (SERVER_FDS of them)
+   */
+  SERVER_RUN = 1,
+
+  /** Server => client: the command finished, with the (int32) status */
+  SERVER_STATUS = 2,
+
+  /** Server => client: the command ended the session (e.g. `exit`) */
+  SERVER_BYE = 3
+} server_frame_type_t;
+
+/**
+ * The header every frame starts with, followed by [length] bytes of
+ * payload. Both are in the host's byte order, since the socket is
+ * only ever local.
+ */
+struct server_frame_t
+{
+  /** A server_frame_type_t */
+  uint32_t type;
+
+  /** The size of the payload */
+  uint32_t length;
+};
+
+/**
+ * Serves sessions on a Unix socket at [path] until the server is
+ * interrupted (or terminated). Each client gets a session of its
+ * own, forked from the server, so it has its own working directory,
+ * variables and job table. The commands it runs write straight to
+ * the descriptors the client sent, so none of their output goes
+ * through the server. Returns the server's exit status.
+ */
+int server_run( const char* path );
+
+/**
+ * Connects to the server at [path] and runs each of the [count]
+ * commands in a session (or each line of stdin, if there are none),
+ * with this process' stdout and stderr. Returns the status of the
+ * last command to finish.
+ */
+int server_connect( const char* path, char** commands, int count );
+
+#endif
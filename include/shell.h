@@ -10,6 +10,17 @@
 #include "command.h"
 #include "handlers.h"
 #include "generic.h"
+#include "buffer.h"
+#include "function.h"
+#include "arith.h"
+#include "job.h"
+#include "spawn.h"
+#include "histring.h"
+#include "zygote.h"
+#include "mux.h"
+#include "prompt.h"
+#include "snapshot.h"
+#include "frecency.h"
 
 typedef struct shell_t shell_t;
 
@@ -21,12 +32,93 @@ struct shell_t
   /** A list of all pids run by the shell. */
   list_t(pid_t)* pid_history;
 
-  /** A list of all pids running in the background */
-  list_t(pid_t)* background_pids;
+  /**
+   * The snapshot the shell was restored from (or NULL), whose history
+   * comes before [cmd_history] and [pid_history]
+   */
+  snapshot_t* restored;
+
+  /**
+   * The history shared with other sessions (named by
+   * MSH_SHARED_HISTORY), or NULL if it isn't
+   */
+  histring_t* shared_history;
+
+  /** The jobs running (or stopped) in the background */
+  job_table_t jobs;
 
   /** The pid for the current foreground process (or zero for none). */
   pid_t current_pid;
 
+  /** The attributes [current_pid] was started with (i.e. its timeout) */
+  spawn_t current_spawn;
+
+  /** The exit status of the last command to finish (i.e. `$?`) */
+  int last_status;
+
+  /** The aliases defined with `alias` */
+  function_table_t aliases;
+
+  /** The functions defined with `name() { ... }` */
+  function_table_t functions;
+
+  /**
+   * The arguments of the function currently being run (i.e. `$1`,
+   * `$2`, ...), or NULL outside of any function.
+   */
+  const command_t* arguments;
+
+  /**
+   * If `return` has been run, so the rest of the function currently
+   * being run is skipped
+   */
+  bool returning;
+
+  /** How deeply aliases and functions are currently nested */
+  unsigned int depth;
+
+  /**
+   * The attributes every process the shell starts is given, i.e.
+   * the limits set by `ulimit` (or a bare `affinity`)
+   */
+  spawn_t spawn;
+
+  /** Compiled arithmetic expressions, by their source text */
+  arith_cache_t arith;
+
+  /**
+   * The helper which starts programs for the shell (if MSH_ZYGOTE is
+   * set), or NULL to fork them directly
+   */
+  zygote_t* zygote;
+
+  /**
+   * What collects the background jobs' output (if MSH_MUX_JOBS is
+   * set), or NULL to let them write to the terminal themselves
+   */
+  mux_t* mux;
+
+  /**
+   * The processes started for process substitutions (as pid_t's),
+   * until they're reaped
+   */
+  buffer_t substitutions;
+
+  /**
+   * The shell's ends of the process substitutions' pipes (as int's),
+   * until the command they were for has been started
+   */
+  buffer_t substituted;
+
+  /** The directories visited (in any session), for `j` */
+  frecency_t dirs;
+
+  /** The directories saved by `pushd`, the most recent first */
+  list_t(string)* dir_stack;
+
+  /** What draws the prompt (from PS1) */
+  prompt_t prompt;
+
   /** The signal handler, for SIGTSTP and SIGINT */
   handler_t handler;
 };
@@ -43,6 +135,18 @@ void shell_init( shell_t* );
  */
 void shell_destroy( shell_t* );
 
+/**
+ * Restores the history, working directory and jobs saved (with
+ * `snapshot save`) in the snapshot at [path] into a newly initialized
+ * shell. The history is left in the snapshot until it's used, so this
+ * takes about as long however much there is of it. Jobs are only kept
+ * if they're still this process's children (i.e. if the shell was
+ * exec'd over the one which saved them).
+ *
+ * Returns [false] (after telling the user why) if it couldn't be read.
+ */
+bool shell_restore( shell_t*, const char* path );
+
 /**
  * Marks the given shell as the "active" shell, such
  * that static methods (such as the signal handler)
@@ -57,19 +161,35 @@ void shell_set_active( const shell_t* );
 void shell_suspend( shell_t* );
 
 /**
- * Resumes the last process the shell suspended, only
- * if it is not currently running any process in the
- * foreground. This will then return the pid of the
- * resumed process.
+ * Resumes the given job (or, if NULL, the last one the
+ * shell suspended), only if it is not currently running
+ * any process in the foreground. This will then return
+ * the pid of the resumed process.
  */
-pid_t shell_resume( shell_t* );
+pid_t shell_resume( shell_t*, job_t* job );
 
 /**
  * Causes the thread to block, waiting for the
- * [current_pid] to stop.
+ * [current_pid] to stop. If it runs out of time, its
+ * process group is sent its timeout signal (and then,
+ * after the grace period, SIGKILL).
  */
 void shell_wait( shell_t* );
 
+/**
+ * Reaps any background jobs which have finished, telling
+ * the user about them, without blocking.
+ */
+void shell_reap( shell_t* );
+
+/**
+ * Prints the prompt (see prompt_t for what PS1 can have in it). Until
+ * the user enters something, it's redrawn as slower segments of it
+ * are worked out, and if the background jobs' output is being
+ * collected, that's shown above it.
+ */
+void shell_prompt( shell_t* );
+
 /**
  * Runs the command on the given shell.
  * If the command causes a process to be run, then
@@ -80,5 +200,31 @@ void shell_wait( shell_t* );
  */
 bool shell_run_command( shell_t*, command_t* command );
 
+/**
+ * Runs the given (raw) command on the shell, without recording it
+ * in the history. Function definitions, `;` lists and aliases are all
+ * handled here, before the command is expanded and run.
+ *
+ * This will return [false] if the shell session should terminate.
+ */
+bool shell_execute( shell_t*, const command_t* command );
+
+/**
+ * Runs the given command line, appending everything it writes to
+ * stdout onto [out]. Built-ins are run inside the shell itself, so
+ * this only forks for external commands.
+ */
+void shell_capture( shell_t*, const char* line, buffer_t* out );
+
+/**
+ * Starts the given command line for a process substitution, connected
+ * to the shell by a pipe: it reads from the pipe if [output] is set
+ * (i.e. for a `>(...)`), otherwise it writes to it. Returns the shell's
+ * end of the pipe, which the next command the shell starts inherits
+ * (and the shell closes once it has), or -1 if it couldn't be started.
+ * The process is reaped along with the background jobs.
+ */
+int shell_substitute( shell_t*, const char* line, bool output );
+
 #endif
 
@@ -0,0 +1,163 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_SNAPSHOT_H__
+#define __MSH_SNAPSHOT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "command.h"
+#include "generic.h"
+#include "job.h"
+
+// identifies a file as being one of our snapshots ("MSHS")
+#define SNAPSHOT_MAGIC 0x4D534853
+#define SNAPSHOT_VERSION 1
+
+// written as is, so a snapshot from a machine with the other byte
+// order reads back as something else
+#define SNAPSHOT_ORDER 0x01020304
+
+typedef struct snapshot_header_t snapshot_header_t;
+typedef struct snapshot_command_t snapshot_command_t;
+typedef struct snapshot_job_t snapshot_job_t;
+typedef struct snapshot_t snapshot_t;
+
+/**
+ * The start of a snapshot file. Every offset is from the start of the
+ * file, and every section starts on an 8 byte boundary.
+ */
+struct snapshot_header_t
+{
+  /** SNAPSHOT_MAGIC, SNAPSHOT_VERSION and SNAPSHOT_ORDER */
+  uint32_t magic, version, order;
+
+  /** The size of this header, as the writer had it */
+  uint32_t header_size;
+
+  /** The size of the whole file */
+  uint64_t size;
+
+  /** Where each section starts, and how many entries are in it */
+  uint64_t commands_offset, commands;
+  uint64_t refs_offset, refs;
+  uint64_t jobs_offset, jobs;
+  uint64_t pids_offset, pids;
+
+  /** Where the strings (each NUL terminated) start, and their size */
+  uint64_t pool_offset, pool_size;
+
+  /** The working directory, as an offset into the strings */
+  uint64_t cwd;
+};
+
+/**
+ * A command in the history.
+ */
+struct snapshot_command_t
+{
+  /** The line entered, as an offset into the strings */
+  uint64_t string;
+
+  /**
+   * The first of the command's entries in the refs (its tokens and
+   * then the bodies of its here-documents, each an offset into the
+   * strings)
+   */
+  uint64_t refs;
+
+  /** How many tokens and here-documents the command has */
+  uint32_t token_count, heredoc_count;
+};
+
+/**
+ * A job which was in the table.
+ */
+struct snapshot_job_t
+{
+  /** The job's id, process and state (a job_state_t) */
+  uint32_t id;
+  int32_t pid;
+  uint32_t state;
+
+  /** (unused, and zero) */
+  uint32_t reserved;
+};
+
+/**
+ * A snapshot, mapped into memory. Nothing is read out of it until it's
+ * asked for, so opening one costs the same however much history it
+ * has (besides checking it over).
+ */
+struct snapshot_t
+{
+  /** The whole file, as it was mapped */
+  void* map;
+  size_t size;
+
+  /** Each of its sections */
+  const snapshot_header_t* header;
+  const snapshot_command_t* commands;
+  const uint64_t* refs;
+  const snapshot_job_t* jobs;
+  const int32_t* pids;
+  const char* pool;
+};
+
+/**
+ * Maps in the snapshot at [path], and checks that everything in it
+ * is where it should be. Returns [false] (after telling the user why)
+ * if it isn't a snapshot this version can read.
+ */
+bool snapshot_open( snapshot_t*, const char* path );
+
+/**
+ * Unmaps the snapshot.
+ */
+void snapshot_close( snapshot_t* );
+
+/**
+ * The number of commands and pids in the snapshot's history.
+ */
+size_t snapshot_commands( const snapshot_t* );
+size_t snapshot_pids( const snapshot_t* );
+
+/**
+ * Gets the line of the [index]th command in the history. This points
+ * into the snapshot itself, so it only lasts as long as that does.
+ */
+const char* snapshot_command_string( const snapshot_t*, size_t index );
+
+/**
+ * Makes a new (heap allocated) command from the [index]th one in the
+ * history, with the same tokens (so without parsing it again).
+ */
+command_t* snapshot_command( const snapshot_t*, size_t index );
+
+/**
+ * Gets the [index]th pid in the history.
+ */
+pid_t snapshot_pid( const snapshot_t*, size_t index );
+
+/**
+ * Gets the working directory when the snapshot was taken.
+ */
+const char* snapshot_cwd( const snapshot_t* );
+
+/**
+ * Writes a snapshot to [path] (replacing it all at once, so nothing
+ * ever sees half of one). The history is everything in [before] (if
+ * not NULL, i.e. what the shell was restored from) followed by
+ * [commands] and [pids]. Returns [false] (after telling the user why)
+ * if it couldn't be written.
+ */
+bool snapshot_save( const char* path, const snapshot_t* before,
+                    const list_t(command_t)* commands,
+                    const list_t(pid_t)* pids,
+                    const job_table_t* jobs, const char* cwd );
+
+#endif
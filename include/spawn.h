@@ -0,0 +1,152 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_SPAWN_H__
+#define __MSH_SPAWN_H__
+
+#include <stdbool.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+// how long a timed out process has to exit before it's killed outright
+#define SPAWN_DEFAULT_GRACE 5.0
+
+// which halves of a resource limit are set
+#define SPAWN_LIMIT_SOFT 1
+#define SPAWN_LIMIT_HARD 2
+
+typedef struct spawn_t spawn_t;
+typedef struct spawn_limit_t spawn_limit_t;
+
+/**
+ * The attributes a child process is given between being forked
+ * and exec'ing its program, so setting them doesn't take a wrapper
+ * process (e.g. taskset or nice) of its own.
+ */
+struct spawn_t
+{
+  /** If the child is put in a process group of its own */
+  bool group;
+
+  /** If the child's group is given the terminal (i.e. the foreground) */
+  bool terminal;
+
+  /** If the child is pinned to the CPUs in [affinity] */
+  bool pinned;
+
+  /** The CPUs the child may run on */
+  cpu_set_t affinity;
+
+  /** How much the child's niceness is raised (or lowered) by */
+  int nice;
+
+  /** Which halves of each limit are set (SPAWN_LIMIT_*), by resource */
+  unsigned char limits_set[ RLIM_NLIMITS ];
+
+  /** The resource limits, by resource */
+  struct rlimit limits[ RLIM_NLIMITS ];
+
+  /** How many seconds the child may run in the foreground (or zero) */
+  double timeout;
+
+  /** The signal sent to the child's group when it runs out of time */
+  int timeout_signal;
+
+  /** How many seconds after [timeout_signal] it's sent SIGKILL (or zero) */
+  double grace;
+};
+
+/**
+ * A resource limit which can be set with `ulimit`.
+ */
+struct spawn_limit_t
+{
+  /** The `ulimit` option for it, e.g. 'n' */
+  char option;
+
+  /** The RLIMIT_* resource */
+  int resource;
+
+  /** The size of the unit it's given in, in its own unit */
+  rlim_t unit;
+
+  /** What it is, for people */
+  const char* description;
+};
+
+/**
+ * Initializes the attributes to change nothing at all.
+ */
+void spawn_init( spawn_t* );
+
+/**
+ * Applies the attributes to the calling process (i.e. the child,
+ * after it's forked). The parent should do the same with
+ * [spawn_adopt], so the two don't race to set up the child's group.
+ * Returns [false] (after telling the user why) if any of them
+ * couldn't be applied.
+ */
+bool spawn_apply( const spawn_t* );
+
+/**
+ * Sets up the process group of a child that was just forked with the
+ * attributes, from the parent's side.
+ */
+void spawn_adopt( const spawn_t*, pid_t child );
+
+/**
+ * Parses a duration, i.e. a number of seconds with an optional
+ * s, m, h or d suffix (e.g. 1.5m). Returns [false] if it's malformed.
+ */
+bool spawn_parse_duration( const char* text, double* seconds );
+
+/**
+ * Parses a signal, by its name (TERM or SIGTERM) or number. Returns
+ * zero if it isn't one.
+ */
+int spawn_parse_signal( const char* text );
+
+/**
+ * Sets the given halves (SPAWN_LIMIT_*) of a resource's limit.
+ */
+void spawn_set_limit( spawn_t*, int resource, unsigned char halves,
+                      rlim_t value );
+
+/**
+ * Gets the given half of a resource's limit, as set in the
+ * attributes, or as the calling process has it if it isn't set.
+ */
+rlim_t spawn_get_limit( const spawn_t*, int resource, unsigned char half );
+
+/**
+ * Gets the limit with the given `ulimit` option, or NULL if there
+ * isn't one.
+ */
+const spawn_limit_t* spawn_find_limit( char option );
+
+/**
+ * Gets every limit, terminated by one with a zero [option].
+ */
+const spawn_limit_t* spawn_all_limits();
+
+/**
+ * Parses a list of CPUs, e.g. `0-3,8`. Returns [false] (after
+ * telling the user why) if it's malformed.
+ */
+bool spawn_parse_cpus( const char* text, cpu_set_t* cpus );
+
+/**
+ * Formats a set of CPUs the same way they're parsed, e.g. `0-3,8`.
+ */
+void spawn_format_cpus( const cpu_set_t* cpus, char* out, size_t size );
+
+/**
+ * Pins every thread of a running process to the given CPUs. Returns
+ * [false] (after telling the user why) if it couldn't.
+ */
+bool spawn_pin( pid_t pid, const cpu_set_t* cpus );
+
+#endif
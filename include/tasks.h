@@ -0,0 +1,155 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_TASKS_H__
+#define __MSH_TASKS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct task_t task_t;
+typedef struct task_deque_t task_deque_t;
+typedef struct task_worker_t task_worker_t;
+
+/**
+ * Where a task is up to.
+ */
+typedef enum task_state_t
+{
+  /** Waiting on (some of) its dependencies */
+  TASK_WAITING,
+
+  /** In a worker's deque, ready to be started */
+  TASK_READY,
+
+  /** Being run by a worker */
+  TASK_RUNNING,
+
+  /** Finished, successfully */
+  TASK_DONE,
+
+  /** Finished, with a non-zero status */
+  TASK_FAILED,
+
+  /** Never run, since something it depends on failed */
+  TASK_SKIPPED
+} task_state_t;
+
+/**
+ * A named command (or a few, run in turn) from a task file, i.e.
+ *
+ *     NAME: [DEPENDENCY]...
+ *         COMMAND
+ *         ...
+ */
+struct task_t
+{
+  /** What it's called */
+  char* name;
+
+  /** The line in the file it was declared on */
+  unsigned int line;
+
+  /** Its commands (none, for one which just groups others) */
+  char** commands;
+  unsigned int command_count;
+
+  /**
+   * The names of the tasks it depends on, as written (until they're
+   * looked up)
+   */
+  char** needs;
+  unsigned int need_count;
+
+  /** The tasks which depend on it (offsets into the graph's tasks) */
+  unsigned int* dependents;
+  unsigned int dependent_count;
+
+  /** How many of its dependencies haven't finished yet */
+  unsigned int pending;
+
+  /**
+   * How long the longest chain of tasks from this one to the end of
+   * the graph is (counting itself), i.e. how urgent it is to start
+   */
+  unsigned int rank;
+
+  /** Where it's up to */
+  task_state_t state;
+
+  /** Its process, while it's running */
+  pid_t pid;
+
+  /** The worker which ran it */
+  unsigned int worker;
+
+  /** Its exit status, once it's finished */
+  int status;
+
+  /** When it was started and finished (monotonic, in nanoseconds) */
+  int64_t started, finished;
+
+  /**
+   * The longest any chain of tasks ending with this one took to run
+   * (adding up how long each took), and the dependency on that chain
+   * (or -1 if it doesn't have any)
+   */
+  int64_t chain;
+  int critical;
+};
+
+/**
+ * The ready tasks one worker owns. The worker takes the newest from
+ * the bottom (the most urgent of those it last made ready), and the
+ * others steal the oldest from the top.
+ */
+struct task_deque_t
+{
+  /** The tasks (offsets into the graph's tasks) */
+  unsigned int* items;
+
+  /** The oldest task and one past the newest */
+  unsigned int top, bottom;
+};
+
+/**
+ * One of the (up to N) tasks being run at once.
+ */
+struct task_worker_t
+{
+  /** The tasks made ready by the ones this worker ran */
+  task_deque_t deque;
+
+  /** The task being run (or -1 while idle) */
+  int task;
+
+  /** How many tasks it has run, and for how long in all */
+  unsigned int runs;
+  int64_t busy;
+
+  /** How many of them it stole from another worker */
+  unsigned int steals;
+};
+
+/**
+ * Runs the tasks in the file at [path], each one once every task it
+ * depends on has finished successfully, with up to [jobs] of them
+ * running at once. Each task's commands are run in a shell of its
+ * own, stopping at the first one which fails.
+ *
+ * Ready tasks go into the deque of the worker which finished their
+ * last dependency (which starts the most urgent of them itself), and
+ * an idle worker with nothing of its own steals from whichever other
+ * worker has the most urgent task waiting, so tasks on the critical
+ * path are started first. Once everything's finished, how busy the
+ * workers were kept is reported.
+ *
+ * Returns 0 if every task succeeded, 1 if any failed, or 2 if the
+ * file couldn't be read (or has a cycle in it).
+ */
+int tasks_run( const char* path, unsigned int jobs );
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#ifndef __MSH_ZYGOTE_H__
+#define __MSH_ZYGOTE_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "command.h"
+#include "spawn.h"
+
+// the largest launch request the helper takes (anything bigger is
+// started by the shell itself)
+#define ZYGOTE_MAX_REQUEST ( 128 * 1024 )
+
+typedef struct zygote_child_t zygote_child_t;
+typedef struct zygote_t zygote_t;
+
+/**
+ * What the helper last said about one of its children.
+ */
+typedef enum zygote_state_t
+{
+  ZYGOTE_RUNNING,
+  ZYGOTE_STOPPED,
+  ZYGOTE_EXITED
+} zygote_state_t;
+
+/**
+ * A process the helper started for us, which hasn't been waited on
+ * (for the last time) yet.
+ */
+struct zygote_child_t
+{
+  /** The child's process */
+  pid_t pid;
+
+  /** If it's running, stopped or gone */
+  zygote_state_t state;
+
+  /** Its status from waitpid, if it's stopped or gone */
+  int status;
+
+  /** The next child (in the order they were started) */
+  zygote_child_t* next;
+};
+
+/**
+ * A helper process forked while the shell is still tiny, which starts
+ * programs on the shell's behalf. Forking it costs the same however
+ * big the shell grows, since the helper never does.
+ *
+ * The helper can't be waited on like a child of the shell's own, so it
+ * reports each of its children's statuses back, and [zygote_waitpid]
+ * stands in for waitpid.
+ */
+struct zygote_t
+{
+  /** The helper process */
+  pid_t pid;
+
+  /** Our end of the socketpair to it (or -1 if it's gone) */
+  int socket;
+
+  /** The environment the helper was forked with, to send changes from */
+  char** environment;
+
+  /** The children which haven't been waited on yet */
+  zygote_child_t* children;
+};
+
+/**
+ * Forks the helper. Returns [false] (after telling the user why) if
+ * it couldn't be.
+ */
+bool zygote_start( zygote_t* );
+
+/**
+ * Tells the helper to exit, and waits for it to.
+ */
+void zygote_stop( zygote_t* );
+
+/**
+ * Has the helper start the (expanded) command with the given
+ * attributes, and with the shell's current stdin, stdout and stderr,
+ * working directory and environment. [pid] is set to the child's pid
+ * (or -1, if the helper couldn't fork).
+ *
+ * Returns [false] if the helper can't take it at all (e.g. it's gone),
+ * in which case the shell should start it itself.
+ */
+bool zygote_spawn( zygote_t*, const command_t* command, const spawn_t* spawn,
+                   pid_t* pid );
+
+/**
+ * Checks if [pid] was started by the helper (and not yet waited on).
+ */
+bool zygote_owns( zygote_t*, pid_t pid );
+
+/**
+ * Waits on a child the helper started, the same as waitpid (with only
+ * WNOHANG and WUNTRACED as options).
+ */
+pid_t zygote_waitpid( zygote_t*, pid_t pid, int* status, int options );
+
+/**
+ * Forgets that a child was stopped, since it's just been continued
+ * (so a stale stop isn't taken for a new one).
+ */
+void zygote_continued( zygote_t*, pid_t pid );
+
+#endif
@@ -0,0 +1,806 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "arith.h"
+
+//
+// Instructions
+//
+
+enum
+{
+  ARITH_PUSH,           // push [value]
+  ARITH_LOAD,           // push [variable]
+  ARITH_STORE,          // [variable] = top (which is left on the stack)
+  ARITH_PRE_INCREMENT,  // [variable] += [value], then push it
+  ARITH_POST_INCREMENT, // push [variable], then [variable] += [value]
+  ARITH_NEGATE,
+  ARITH_NOT,
+  ARITH_COMPLEMENT,
+  ARITH_BOOL,           // top = top != 0
+  ARITH_ADD,
+  ARITH_SUBTRACT,
+  ARITH_MULTIPLY,
+  ARITH_DIVIDE,
+  ARITH_MODULO,
+  ARITH_POWER,
+  ARITH_SHIFT_LEFT,
+  ARITH_SHIFT_RIGHT,
+  ARITH_LESS,
+  ARITH_LESS_EQUAL,
+  ARITH_GREATER,
+  ARITH_GREATER_EQUAL,
+  ARITH_EQUAL,
+  ARITH_NOT_EQUAL,
+  ARITH_AND,
+  ARITH_XOR,
+  ARITH_OR,
+  ARITH_JUMP,           // go to [value]
+  ARITH_JUMP_FALSE,     // pop, and go to [value] if it was zero
+  ARITH_JUMP_TRUE       // pop, and go to [value] if it wasn't zero
+};
+
+//
+// Tokens
+//
+
+enum
+{
+  TOKEN_END,
+  TOKEN_ERROR,
+  TOKEN_NUMBER,
+  TOKEN_NAME,
+  TOKEN_OPEN,
+  TOKEN_CLOSE,
+  TOKEN_QUESTION,
+  TOKEN_COLON,
+  TOKEN_NOT,
+  TOKEN_TILDE,
+  TOKEN_INCREMENT,
+  TOKEN_DECREMENT,
+  TOKEN_LOGICAL_AND,
+  TOKEN_LOGICAL_OR,
+  TOKEN_ASSIGN,
+
+  // everything from here on is a binary operator (or an
+  // assignment version of one), see g_arith_binary
+  TOKEN_PLUS,
+  TOKEN_MINUS,
+  TOKEN_STAR,
+  TOKEN_SLASH,
+  TOKEN_PERCENT,
+  TOKEN_POWER,
+  TOKEN_SHIFT_LEFT,
+  TOKEN_SHIFT_RIGHT,
+  TOKEN_LESS,
+  TOKEN_LESS_EQUAL,
+  TOKEN_GREATER,
+  TOKEN_GREATER_EQUAL,
+  TOKEN_EQUAL,
+  TOKEN_NOT_EQUAL,
+  TOKEN_AND,
+  TOKEN_XOR,
+  TOKEN_OR,
+  TOKEN_PLUS_ASSIGN,
+  TOKEN_MINUS_ASSIGN,
+  TOKEN_STAR_ASSIGN,
+  TOKEN_SLASH_ASSIGN,
+  TOKEN_PERCENT_ASSIGN
+};
+
+/**
+ * The spelling of every operator token, longest first so the
+ * scanner always takes the longest match.
+ */
+static const struct
+{
+  const char* text;
+  int token;
+} g_arith_operators[] = {
+  { "**", TOKEN_POWER },         { "<<", TOKEN_SHIFT_LEFT },
+  { ">>", TOKEN_SHIFT_RIGHT },   { "<=", TOKEN_LESS_EQUAL },
+  { ">=", TOKEN_GREATER_EQUAL }, { "==", TOKEN_EQUAL },
+  { "!=", TOKEN_NOT_EQUAL },     { "&&", TOKEN_LOGICAL_AND },
+  { "||", TOKEN_LOGICAL_OR },    { "++", TOKEN_INCREMENT },
+  { "--", TOKEN_DECREMENT },     { "+=", TOKEN_PLUS_ASSIGN },
+  { "-=", TOKEN_MINUS_ASSIGN },  { "*=", TOKEN_STAR_ASSIGN },
+  { "/=", TOKEN_SLASH_ASSIGN },  { "%=", TOKEN_PERCENT_ASSIGN },
+  { "+", TOKEN_PLUS },           { "-", TOKEN_MINUS },
+  { "*", TOKEN_STAR },           { "/", TOKEN_SLASH },
+  { "%", TOKEN_PERCENT },        { "<", TOKEN_LESS },
+  { ">", TOKEN_GREATER },        { "&", TOKEN_AND },
+  { "^", TOKEN_XOR },            { "|", TOKEN_OR },
+  { "!", TOKEN_NOT },            { "~", TOKEN_TILDE },
+  { "(", TOKEN_OPEN },           { ")", TOKEN_CLOSE },
+  { "?", TOKEN_QUESTION },       { ":", TOKEN_COLON },
+  { "=", TOKEN_ASSIGN },
+  { NULL, TOKEN_END }
+};
+
+/**
+ * The instruction and binding power of each binary operator token,
+ * indexed from TOKEN_PLUS. Assignment versions have no power of
+ * their own, since they're all parsed as assignments.
+ */
+static const struct
+{
+  unsigned char code;
+  unsigned char power;
+  bool right;
+} g_arith_binary[] = {
+  { ARITH_ADD,           12, false }, // +
+  { ARITH_SUBTRACT,      12, false }, // -
+  { ARITH_MULTIPLY,      13, false }, // *
+  { ARITH_DIVIDE,        13, false }, // /
+  { ARITH_MODULO,        13, false }, // %
+  { ARITH_POWER,         14, true  }, // **
+  { ARITH_SHIFT_LEFT,    11, false }, // <<
+  { ARITH_SHIFT_RIGHT,   11, false }, // >>
+  { ARITH_LESS,          10, false }, // <
+  { ARITH_LESS_EQUAL,    10, false }, // <=
+  { ARITH_GREATER,       10, false }, // >
+  { ARITH_GREATER_EQUAL, 10, false }, // >=
+  { ARITH_EQUAL,          9, false }, // ==
+  { ARITH_NOT_EQUAL,      9, false }, // !=
+  { ARITH_AND,            8, false }, // &
+  { ARITH_XOR,            7, false }, // ^
+  { ARITH_OR,             6, false }, // |
+  { ARITH_ADD,            0, false }, // +=
+  { ARITH_SUBTRACT,       0, false }, // -=
+  { ARITH_MULTIPLY,       0, false }, // *=
+  { ARITH_DIVIDE,         0, false }, // /=
+  { ARITH_MODULO,         0, false }  // %=
+};
+
+// binding powers of everything which isn't in the table above
+#define POWER_ASSIGN      2
+#define POWER_TERNARY     3
+#define POWER_LOGICAL_OR  4
+#define POWER_LOGICAL_AND 5
+#define POWER_UNARY       15
+#define POWER_POSTFIX     16
+
+//
+// Parser
+//
+
+/**
+ * The state of a single compilation.
+ */
+typedef struct arith_parser_t
+{
+  /** The next character to scan */
+  const char* text;
+
+  /** The current token */
+  int token;
+
+  /** The value of the current token, if it's a number */
+  int64_t number;
+
+  /** The name of the current token, if it's a variable */
+  const char* name;
+  size_t name_length;
+
+  /** The program being built */
+  arith_program_t* program;
+
+  /** The number of ops allocated in the program */
+  size_t capacity;
+
+  /** The first error encountered (or NULL if none) */
+  const char* error;
+} arith_parser_t;
+
+/**
+ * Scans the next token.
+ */
+static void arith_next( arith_parser_t* this )
+{
+  while ( isspace( ( unsigned char ) *this->text ) )
+  {
+    this->text++;
+  }
+
+  const char* text = this->text;
+
+  if ( *text == '\0' )
+  {
+    this->token = TOKEN_END;
+    return;
+  }
+
+  if ( isdigit( ( unsigned char ) *text ) )
+  {
+    char* end;
+    this->number = strtoll( text, &end, 0 );
+    this->token = isalnum( ( unsigned char ) *end ) ? TOKEN_ERROR : TOKEN_NUMBER;
+    this->text = end;
+    return;
+  }
+
+  // variables may (but don't need to) be written with their `$`
+  if ( *text == '$' ) text++;
+  if ( *text == '_' || isalpha( ( unsigned char ) *text ) )
+  {
+    this->name = text;
+    while ( *text == '_' || isalnum( ( unsigned char ) *text ) )
+    {
+      text++;
+    }
+
+    this->name_length = text - this->name;
+    this->token = TOKEN_NAME;
+    this->text = text;
+    return;
+  }
+
+  unsigned int i;
+  for ( i = 0; g_arith_operators[ i ].text != NULL; i++ )
+  {
+    size_t length = strlen( g_arith_operators[ i ].text );
+    if ( strncmp( text, g_arith_operators[ i ].text, length ) == 0 )
+    {
+      this->token = g_arith_operators[ i ].token;
+      this->text = text + length;
+      return;
+    }
+  }
+
+  this->token = TOKEN_ERROR;
+}
+
+/**
+ * Appends an instruction, returning its index.
+ */
+static size_t arith_emit( arith_parser_t* this, unsigned char code,
+                          unsigned int variable, int64_t value )
+{
+  arith_program_t* program = this->program;
+
+  if ( program->count == this->capacity )
+  {
+    this->capacity = this->capacity == 0 ? 16 : this->capacity * 2;
+    program->ops = realloc( program->ops, this->capacity * sizeof( arith_op_t ) );
+  }
+
+  arith_op_t* op = &program->ops[ program->count ];
+  op->code = code;
+  op->variable = variable;
+  op->value = value;
+
+  return program->count++;
+}
+
+/**
+ * Finds (or adds) the current token's name in the program's variables.
+ */
+static unsigned int arith_variable( arith_parser_t* this )
+{
+  arith_program_t* program = this->program;
+
+  unsigned int i;
+  for ( i = 0; i < program->variable_count; i++ )
+  {
+    if ( strlen( program->variables[ i ] ) == this->name_length
+      && strncmp( program->variables[ i ], this->name, this->name_length ) == 0 )
+    {
+      return i;
+    }
+  }
+
+  program->variables = realloc( program->variables,
+                                ( i + 1 ) * sizeof( char* ) );
+  program->variables[ i ] = strndup( this->name, this->name_length );
+  program->variable_count += 1;
+
+  return i;
+}
+
+/**
+ * Checks that everything emitted since [start] is a single variable
+ * (so it can be assigned to), reporting an error if not.
+ */
+static bool arith_lvalue( arith_parser_t* this, size_t start )
+{
+  if ( this->program->count == start + 1
+    && this->program->ops[ start ].code == ARITH_LOAD )
+  {
+    return true;
+  }
+
+  if ( this->error == NULL )
+  {
+    this->error = "attempted assignment to non-variable";
+  }
+  return false;
+}
+
+static void arith_expression( arith_parser_t* this, int power );
+
+/**
+ * Parses an operand, along with any prefix operators on it.
+ */
+static void arith_prefix( arith_parser_t* this )
+{
+  size_t start = this->program->count;
+  int token = this->token;
+
+  switch ( token )
+  {
+    case TOKEN_NUMBER:
+      arith_emit( this, ARITH_PUSH, 0, this->number );
+      arith_next( this );
+      break;
+
+    case TOKEN_NAME:
+      arith_emit( this, ARITH_LOAD, arith_variable( this ), 0 );
+      arith_next( this );
+      break;
+
+    case TOKEN_OPEN:
+      arith_next( this );
+      arith_expression( this, 0 );
+      if ( this->token != TOKEN_CLOSE && this->error == NULL )
+      {
+        this->error = "missing ')'";
+      }
+      arith_next( this );
+      break;
+
+    case TOKEN_PLUS:
+      arith_next( this );
+      arith_expression( this, POWER_UNARY );
+      break;
+
+    case TOKEN_MINUS:
+    case TOKEN_NOT:
+    case TOKEN_TILDE:
+      arith_next( this );
+      arith_expression( this, POWER_UNARY );
+      arith_emit( this, token == TOKEN_MINUS ? ARITH_NEGATE
+                      : token == TOKEN_NOT ? ARITH_NOT
+                      : ARITH_COMPLEMENT, 0, 0 );
+      break;
+
+    case TOKEN_INCREMENT:
+    case TOKEN_DECREMENT:
+      arith_next( this );
+      arith_expression( this, POWER_UNARY );
+      if ( arith_lvalue( this, start ) )
+      {
+        arith_op_t* op = &this->program->ops[ start ];
+        op->code = ARITH_PRE_INCREMENT;
+        op->value = token == TOKEN_INCREMENT ? 1 : -1;
+      }
+      break;
+
+    default:
+      if ( this->error == NULL )
+      {
+        this->error = token == TOKEN_END ? "expected an operand"
+                                         : "syntax error";
+      }
+      break;
+  }
+}
+
+/**
+ * Parses an expression, consuming operators that bind more tightly
+ * than [power], and emitting the postfix program for it.
+ */
+static void arith_expression( arith_parser_t* this, int power )
+{
+  size_t start = this->program->count;
+  arith_prefix( this );
+
+  while ( this->error == NULL )
+  {
+    int token = this->token;
+
+    if ( token == TOKEN_INCREMENT || token == TOKEN_DECREMENT )
+    {
+      if ( POWER_POSTFIX <= power ) break;
+      if ( !arith_lvalue( this, start ) ) break;
+
+      arith_op_t* op = &this->program->ops[ start ];
+      op->code = ARITH_POST_INCREMENT;
+      op->value = token == TOKEN_INCREMENT ? 1 : -1;
+      arith_next( this );
+    }
+    else if ( token == TOKEN_ASSIGN || token >= TOKEN_PLUS_ASSIGN )
+    {
+      // assignments are right associative
+      if ( POWER_ASSIGN < power ) break;
+      if ( !arith_lvalue( this, start ) ) break;
+
+      unsigned int variable = this->program->ops[ start ].variable;
+
+      // plain assignments don't need the old value
+      if ( token == TOKEN_ASSIGN )
+      {
+        this->program->count = start;
+      }
+
+      arith_next( this );
+      arith_expression( this, POWER_ASSIGN - 1 );
+
+      if ( token != TOKEN_ASSIGN )
+      {
+        arith_emit( this, g_arith_binary[ token - TOKEN_PLUS ].code, 0, 0 );
+      }
+      arith_emit( this, ARITH_STORE, variable, 0 );
+    }
+    else if ( token == TOKEN_QUESTION )
+    {
+      if ( POWER_TERNARY < power ) break;
+      arith_next( this );
+
+      size_t skip_then = arith_emit( this, ARITH_JUMP_FALSE, 0, 0 );
+      arith_expression( this, 0 );
+
+      if ( this->token != TOKEN_COLON )
+      {
+        if ( this->error == NULL ) this->error = "missing ':'";
+        break;
+      }
+      arith_next( this );
+
+      size_t skip_else = arith_emit( this, ARITH_JUMP, 0, 0 );
+      this->program->ops[ skip_then ].value = this->program->count;
+      arith_expression( this, POWER_TERNARY - 1 );
+      this->program->ops[ skip_else ].value = this->program->count;
+    }
+    else if ( token == TOKEN_LOGICAL_AND || token == TOKEN_LOGICAL_OR )
+    {
+      bool and = ( token == TOKEN_LOGICAL_AND );
+      int own = and ? POWER_LOGICAL_AND : POWER_LOGICAL_OR;
+      if ( own <= power ) break;
+      arith_next( this );
+
+      // short circuit: the right side only runs if it can matter
+      size_t skip_right = arith_emit( this, and ? ARITH_JUMP_FALSE
+                                                : ARITH_JUMP_TRUE, 0, 0 );
+      arith_expression( this, own );
+      arith_emit( this, ARITH_BOOL, 0, 0 );
+
+      size_t skip_constant = arith_emit( this, ARITH_JUMP, 0, 0 );
+      this->program->ops[ skip_right ].value = this->program->count;
+      arith_emit( this, ARITH_PUSH, 0, and ? 0 : 1 );
+      this->program->ops[ skip_constant ].value = this->program->count;
+    }
+    else if ( token >= TOKEN_PLUS && token < TOKEN_PLUS_ASSIGN )
+    {
+      int own = g_arith_binary[ token - TOKEN_PLUS ].power;
+      if ( own <= power ) break;
+      arith_next( this );
+
+      bool right = g_arith_binary[ token - TOKEN_PLUS ].right;
+      arith_expression( this, right ? own - 1 : own );
+      arith_emit( this, g_arith_binary[ token - TOKEN_PLUS ].code, 0, 0 );
+    }
+    else
+    {
+      break;
+    }
+  }
+}
+
+/**
+ * Frees a program.
+ */
+static void arith_program_destroy( arith_program_t* this )
+{
+  unsigned int i;
+  for ( i = 0; i < this->variable_count; i++ )
+  {
+    free( this->variables[ i ] );
+  }
+
+  free( this->variables );
+  free( this->ops );
+  free( this->source );
+  free( this );
+}
+
+/**
+ * Compiles [source] into a new program, or returns NULL if it
+ * is malformed.
+ */
+static arith_program_t* arith_program_compile( const char* source )
+{
+  arith_program_t* program = calloc( 1, sizeof( *program ) );
+  program->source = strdup( source );
+
+  arith_parser_t parser;
+  parser.text = source;
+  parser.program = program;
+  parser.capacity = 0;
+  parser.error = NULL;
+
+  arith_next( &parser );
+
+  // an empty expression is just zero
+  if ( parser.token == TOKEN_END )
+  {
+    arith_emit( &parser, ARITH_PUSH, 0, 0 );
+  }
+  else
+  {
+    arith_expression( &parser, 0 );
+  }
+
+  if ( parser.error == NULL && parser.token != TOKEN_END )
+  {
+    parser.error = "syntax error";
+  }
+
+  if ( parser.error != NULL )
+  {
+    printf( "%s: %s\n", source, parser.error );
+    arith_program_destroy( program );
+    return NULL;
+  }
+
+  return program;
+}
+
+//
+// Cache
+//
+
+void arith_cache_init( arith_cache_t* this )
+{
+  memset( this->slots, 0, sizeof( this->slots ) );
+}
+
+void arith_cache_destroy( arith_cache_t* this )
+{
+  unsigned int i;
+  for ( i = 0; i < ARITH_CACHE_SIZE; i++ )
+  {
+    if ( this->slots[ i ] != NULL )
+    {
+      arith_program_destroy( this->slots[ i ] );
+    }
+  }
+
+  arith_cache_init( this );
+}
+
+const arith_program_t* arith_compile( arith_cache_t* this, const char* source )
+{
+  // FNV-1a picks the slot; a new program just evicts whatever was there
+  unsigned int hash = 2166136261u;
+  const char* current;
+  for ( current = source; *current != '\0'; current++ )
+  {
+    hash ^= ( unsigned char ) *current;
+    hash *= 16777619u;
+  }
+
+  arith_program_t** slot = &this->slots[ hash & ( ARITH_CACHE_SIZE - 1 ) ];
+  if ( *slot != NULL && strcmp( ( *slot )->source, source ) == 0 )
+  {
+    return *slot;
+  }
+
+  arith_program_t* program = arith_program_compile( source );
+  if ( program == NULL ) return NULL;
+
+  if ( *slot != NULL )
+  {
+    arith_program_destroy( *slot );
+  }
+  *slot = program;
+
+  return program;
+}
+
+//
+// Evaluation
+//
+
+/**
+ * Reads a variable as an integer (anything unset or non-numeric is 0).
+ */
+static int64_t arith_load( const char* name )
+{
+  const char* value = getenv( name );
+  if ( value == NULL ) return 0;
+
+  char* end;
+  int64_t number = strtoll( value, &end, 0 );
+
+  while ( isspace( ( unsigned char ) *end ) )
+  {
+    end++;
+  }
+
+  return *end == '\0' ? number : 0;
+}
+
+static void arith_store( const char* name, int64_t value )
+{
+  char text[ 32 ];
+  snprintf( text, sizeof( text ), "%lld", ( long long ) value );
+  setenv( name, text, 1 );
+}
+
+// the stack depth which is handled without allocating
+#define ARITH_SMALL_STACK 64
+
+bool arith_run( const arith_program_t* this, int64_t* result )
+{
+  // the stack can never be deeper than the number of instructions
+  int64_t small[ ARITH_SMALL_STACK ];
+  int64_t* stack = small;
+  if ( this->count > ARITH_SMALL_STACK )
+  {
+    stack = malloc( this->count * sizeof( int64_t ) );
+  }
+
+  const char* error = NULL;
+  size_t top = 0;
+  size_t pc = 0;
+
+  while ( pc < this->count && error == NULL )
+  {
+    const arith_op_t* op = &this->ops[ pc++ ];
+    const char* name = this->variables == NULL ? NULL
+                     : this->variables[ op->variable ];
+
+    // binary operators work on the top two values
+    uint64_t a = top >= 2 ? ( uint64_t ) stack[ top - 2 ] : 0;
+    uint64_t b = top >= 1 ? ( uint64_t ) stack[ top - 1 ] : 0;
+    int64_t left = ( int64_t ) a;
+    int64_t right = ( int64_t ) b;
+
+    switch ( op->code )
+    {
+      case ARITH_PUSH:
+        stack[ top++ ] = op->value;
+        break;
+
+      case ARITH_LOAD:
+        stack[ top++ ] = arith_load( name );
+        break;
+
+      case ARITH_STORE:
+        arith_store( name, stack[ top - 1 ] );
+        break;
+
+      case ARITH_PRE_INCREMENT:
+      case ARITH_POST_INCREMENT:
+      {
+        int64_t old = arith_load( name );
+        int64_t new = ( int64_t ) ( ( uint64_t ) old + ( uint64_t ) op->value );
+        arith_store( name, new );
+        stack[ top++ ] = op->code == ARITH_PRE_INCREMENT ? new : old;
+        break;
+      }
+
+      case ARITH_NEGATE:
+        stack[ top - 1 ] = ( int64_t ) ( 0 - b );
+        break;
+
+      case ARITH_NOT:
+        stack[ top - 1 ] = right == 0;
+        break;
+
+      case ARITH_COMPLEMENT:
+        stack[ top - 1 ] = ~right;
+        break;
+
+      case ARITH_BOOL:
+        stack[ top - 1 ] = right != 0;
+        break;
+
+      case ARITH_JUMP:
+        pc = op->value;
+        break;
+
+      case ARITH_JUMP_FALSE:
+        top -= 1;
+        if ( right == 0 ) pc = op->value;
+        break;
+
+      case ARITH_JUMP_TRUE:
+        top -= 1;
+        if ( right != 0 ) pc = op->value;
+        break;
+
+      default:
+      {
+        int64_t value = 0;
+
+        switch ( op->code )
+        {
+          case ARITH_ADD:           value = ( int64_t ) ( a + b ); break;
+          case ARITH_SUBTRACT:      value = ( int64_t ) ( a - b ); break;
+          case ARITH_MULTIPLY:      value = ( int64_t ) ( a * b ); break;
+          case ARITH_SHIFT_LEFT:    value = ( int64_t ) ( a << ( b & 63 ) ); break;
+          case ARITH_SHIFT_RIGHT:   value = left >> ( b & 63 ); break;
+          case ARITH_LESS:          value = left < right; break;
+          case ARITH_LESS_EQUAL:    value = left <= right; break;
+          case ARITH_GREATER:       value = left > right; break;
+          case ARITH_GREATER_EQUAL: value = left >= right; break;
+          case ARITH_EQUAL:         value = left == right; break;
+          case ARITH_NOT_EQUAL:     value = left != right; break;
+          case ARITH_AND:           value = left & right; break;
+          case ARITH_XOR:           value = left ^ right; break;
+          case ARITH_OR:            value = left | right; break;
+
+          case ARITH_DIVIDE:
+          case ARITH_MODULO:
+            if ( right == 0 )
+            {
+              error = "division by zero";
+            }
+            // the one overflowing division wraps instead of trapping
+            else if ( right == -1 )
+            {
+              value = op->code == ARITH_DIVIDE ? ( int64_t ) ( 0 - a ) : 0;
+            }
+            else
+            {
+              value = op->code == ARITH_DIVIDE ? left / right : left % right;
+            }
+            break;
+
+          case ARITH_POWER:
+            if ( right < 0 )
+            {
+              error = "exponent less than 0";
+              break;
+            }
+
+            value = 1;
+            while ( b > 0 )
+            {
+              if ( b & 1 ) value = ( int64_t ) ( ( uint64_t ) value * a );
+              a *= a;
+              b >>= 1;
+            }
+            break;
+        }
+
+        top -= 1;
+        stack[ top - 1 ] = value;
+        break;
+      }
+    }
+  }
+
+  if ( error == NULL )
+  {
+    *result = top > 0 ? stack[ top - 1 ] : 0;
+  }
+  else
+  {
+    printf( "%s: %s\n", this->source, error );
+  }
+
+  if ( stack != small )
+  {
+    free( stack );
+  }
+
+  return error == NULL;
+}
+
+bool arith_evaluate( arith_cache_t* this, const char* source, int64_t* result )
+{
+  const arith_program_t* program = arith_compile( this, source );
+  if ( program == NULL ) return false;
+
+  return arith_run( program, result );
+}
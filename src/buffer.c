@@ -0,0 +1,58 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "buffer.h"
+
+void buffer_init( buffer_t* this )
+{
+  this->data = NULL;
+  this->size = 0;
+  this->capacity = 0;
+}
+
+void buffer_destroy( buffer_t* this )
+{
+  free( this->data );
+  buffer_init( this );
+}
+
+char* buffer_reserve( buffer_t* this, size_t extra )
+{
+  if ( this->size + extra > this->capacity )
+  {
+    size_t capacity = this->capacity == 0 ? 256 : this->capacity;
+    while ( capacity < this->size + extra )
+    {
+      capacity *= 2;
+    }
+
+    this->data = realloc( this->data, capacity );
+    this->capacity = capacity;
+  }
+
+  return this->data + this->size;
+}
+
+void buffer_append( buffer_t* this, const void* data, size_t length )
+{
+  memcpy( buffer_reserve( this, length ), data, length );
+  this->size += length;
+}
+
+size_t buffer_append_string( buffer_t* this, const char* string )
+{
+  size_t offset = this->size;
+  buffer_append( this, string, strlen( string ) + 1 );
+  return offset;
+}
+
+char* buffer_release( buffer_t* this )
+{
+  char* data = this->data;
+  buffer_init( this );
+  return data;
+}
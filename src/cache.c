@@ -0,0 +1,411 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "buffer.h"
+
+// XXH64's primes
+#define CACHE_PRIME1 0x9E3779B185EBCA87ULL
+#define CACHE_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define CACHE_PRIME3 0x165667B19E3779F9ULL
+#define CACHE_PRIME4 0x85EBCA77C2B2AE63ULL
+#define CACHE_PRIME5 0x27D4EB2F165667C5ULL
+
+// the seeds for each half of a key
+#define CACHE_SEED_LOW 0
+#define CACHE_SEED_HIGH 0x6D7368
+
+static inline uint64_t cache_rotate( uint64_t value, unsigned int bits )
+{
+  return ( value << bits ) | ( value >> ( 64 - bits ) );
+}
+
+static inline uint64_t cache_read64( const unsigned char* data )
+{
+  uint64_t value;
+  memcpy( &value, data, sizeof( value ) );
+  return value;
+}
+
+static inline uint32_t cache_read32( const unsigned char* data )
+{
+  uint32_t value;
+  memcpy( &value, data, sizeof( value ) );
+  return value;
+}
+
+static inline uint64_t cache_round( uint64_t accumulator, uint64_t input )
+{
+  accumulator += input * CACHE_PRIME2;
+  return cache_rotate( accumulator, 31 ) * CACHE_PRIME1;
+}
+
+static inline uint64_t cache_merge( uint64_t hash, uint64_t accumulator )
+{
+  hash ^= cache_round( 0, accumulator );
+  return hash * CACHE_PRIME1 + CACHE_PRIME4;
+}
+
+uint64_t cache_hash( const void* data, size_t length, uint64_t seed )
+{
+  const unsigned char* at = data;
+  const unsigned char* end = at + length;
+  uint64_t hash;
+
+  // (32 bytes at a time, in four independent lanes)
+  if ( length >= 32 )
+  {
+    uint64_t lanes[ 4 ] =
+    {
+      seed + CACHE_PRIME1 + CACHE_PRIME2, seed + CACHE_PRIME2, seed, seed - CACHE_PRIME1
+    };
+
+    for ( ; end - at >= 32; at += 32 )
+    {
+      lanes[ 0 ] = cache_round( lanes[ 0 ], cache_read64( at ) );
+      lanes[ 1 ] = cache_round( lanes[ 1 ], cache_read64( at + 8 ) );
+      lanes[ 2 ] = cache_round( lanes[ 2 ], cache_read64( at + 16 ) );
+      lanes[ 3 ] = cache_round( lanes[ 3 ], cache_read64( at + 24 ) );
+    }
+
+    hash = cache_rotate( lanes[ 0 ], 1 ) + cache_rotate( lanes[ 1 ], 7 )
+         + cache_rotate( lanes[ 2 ], 12 ) + cache_rotate( lanes[ 3 ], 18 );
+
+    unsigned int lane;
+    for ( lane = 0; lane < 4; lane++ ) hash = cache_merge( hash, lanes[ lane ] );
+  }
+  else
+  {
+    hash = seed + CACHE_PRIME5;
+  }
+
+  hash += length;
+
+  for ( ; end - at >= 8; at += 8 )
+  {
+    hash ^= cache_round( 0, cache_read64( at ) );
+    hash = cache_rotate( hash, 27 ) * CACHE_PRIME1 + CACHE_PRIME4;
+  }
+  if ( end - at >= 4 )
+  {
+    hash ^= cache_read32( at ) * CACHE_PRIME1;
+    hash = cache_rotate( hash, 23 ) * CACHE_PRIME2 + CACHE_PRIME3;
+    at += 4;
+  }
+  for ( ; at < end; at++ )
+  {
+    hash ^= *at * CACHE_PRIME5;
+    hash = cache_rotate( hash, 11 ) * CACHE_PRIME1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= CACHE_PRIME2;
+  hash ^= hash >> 29;
+  hash *= CACHE_PRIME3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+/**
+ * Adds a field to what's hashed for a key, with its length first (so
+ * no two lists of fields run together into the same bytes).
+ */
+static void cache_add( buffer_t* material, const void* data, size_t length )
+{
+  uint64_t size = length;
+  buffer_append( material, &size, sizeof( size ) );
+  buffer_append( material, data, length );
+}
+
+static void cache_add_string( buffer_t* material, const char* string )
+{
+  // (a missing one is different to an empty one)
+  if ( string == NULL )
+  {
+    buffer_append( material, "\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF", 8 );
+    return;
+  }
+
+  cache_add( material, string, strlen( string ) );
+}
+
+/**
+ * Adds an input file to what's hashed for a key: a hash of its
+ * contents, or (if [mtime] is set) its size and when it was modified.
+ */
+static void cache_add_input( buffer_t* material, const char* path, bool mtime )
+{
+  cache_add_string( material, path );
+
+  struct stat info;
+  int fd = open( path, O_RDONLY | O_CLOEXEC );
+  if ( fd == -1 || fstat( fd, &info ) < 0 )
+  {
+    if ( fd != -1 ) close( fd );
+    cache_add_string( material, NULL );
+    return;
+  }
+
+  uint64_t digest[ 2 ];
+  if ( mtime )
+  {
+    digest[ 0 ] = info.st_size;
+    digest[ 1 ] = ( uint64_t ) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+  }
+  else
+  {
+    void* map = info.st_size > 0
+      ? mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 )
+      : MAP_FAILED;
+    const void* contents = map != MAP_FAILED ? map : "";
+    size_t size = map != MAP_FAILED ? ( size_t ) info.st_size : 0;
+
+    digest[ 0 ] = cache_hash( contents, size, CACHE_SEED_LOW );
+    digest[ 1 ] = cache_hash( contents, size, CACHE_SEED_HIGH );
+
+    if ( map != MAP_FAILED ) munmap( map, info.st_size );
+  }
+
+  close( fd );
+  cache_add( material, digest, sizeof( digest ) );
+}
+
+/**
+ * Calls [add] for each of the comma separated names in [list].
+ */
+static void cache_add_list( buffer_t* material, const char* list, bool mtime,
+                            void ( *add )( buffer_t*, const char*, bool ) )
+{
+  if ( list == NULL ) return;
+
+  char* names = strdup( list );
+  char* save;
+  char* name;
+  for ( name = strtok_r( names, ",", &save ); name != NULL;
+        name = strtok_r( NULL, ",", &save ) )
+  {
+    add( material, name, mtime );
+  }
+  free( names );
+}
+
+static void cache_add_variable( buffer_t* material, const char* name, bool mtime )
+{
+  ( void )( mtime );
+
+  cache_add_string( material, name );
+  cache_add_string( material, getenv( name ) );
+}
+
+void cache_key( cache_key_t* this, const command_t* command, unsigned int first,
+                const char* inputs, const char* env, bool mtime )
+{
+  buffer_t material;
+  buffer_init( &material );
+
+  char cwd[ PATH_MAX ];
+  cache_add_string( &material, "msh-cache" );
+  cache_add_string( &material, getcwd( cwd, sizeof( cwd ) ) );
+  cache_add_string( &material, getenv( "PATH" ) );
+
+  // (the sections are kept apart by how many fields are in each)
+  uint64_t count = command->tokens->size - first;
+  buffer_append( &material, &count, sizeof( count ) );
+
+  const list_node_t(string)* node = command->tokens->head;
+  unsigned int index;
+  for ( index = 0; node != NULL; node = node->next, index++ )
+  {
+    if ( index >= first ) cache_add_string( &material, node->data );
+  }
+
+  count = command->assignments->size;
+  buffer_append( &material, &count, sizeof( count ) );
+  for ( node = command->assignments->head; node != NULL; node = node->next )
+  {
+    cache_add_string( &material, node->data );
+  }
+
+  cache_add_string( &material, "env" );
+  cache_add_list( &material, env, mtime, &cache_add_variable );
+  cache_add_string( &material, "inputs" );
+  cache_add_list( &material, inputs, mtime, &cache_add_input );
+
+  snprintf( this->hex, sizeof( this->hex ), "%016llx%016llx",
+            ( unsigned long long ) cache_hash( material.data, material.size, CACHE_SEED_HIGH ),
+            ( unsigned long long ) cache_hash( material.data, material.size, CACHE_SEED_LOW ) );
+
+  buffer_destroy( &material );
+}
+
+/**
+ * Gets the directory entries are kept in (MSH_CACHE_DIR, or else msh
+ * under the user's cache directory), making it if it doesn't exist.
+ * Returns [false] if there isn't one.
+ */
+static bool cache_directory( char* path, size_t size )
+{
+  const char* dir = getenv( "MSH_CACHE_DIR" );
+  const char* xdg = getenv( "XDG_CACHE_HOME" );
+  const char* home = getenv( "HOME" );
+  int length;
+
+  if ( dir != NULL && *dir != '\0' )
+  {
+    length = snprintf( path, size, "%s", dir );
+  }
+  else if ( xdg != NULL && *xdg != '\0' )
+  {
+    length = snprintf( path, size, "%s/msh", xdg );
+  }
+  else if ( home != NULL && *home != '\0' )
+  {
+    // (~/.cache may not be there yet either)
+    snprintf( path, size, "%s/.cache", home );
+    mkdir( path, 0700 );
+    length = snprintf( path, size, "%s/.cache/msh", home );
+  }
+  else
+  {
+    return false;
+  }
+
+  if ( length < 0 || ( size_t ) length >= size ) return false;
+
+  return mkdir( path, 0700 ) == 0 || errno == EEXIST;
+}
+
+/**
+ * Writes all of [data] to [fd].
+ */
+static bool cache_write( int fd, const void* data, size_t length )
+{
+  size_t written = 0;
+  while ( written < length )
+  {
+    ssize_t count = write( fd, ( const char* ) data + written, length - written );
+    if ( count < 0 && errno == EINTR ) continue;
+    if ( count <= 0 ) return false;
+    written += count;
+  }
+
+  return true;
+}
+
+bool cache_replay( const cache_key_t* key, int* status )
+{
+  char dir[ PATH_MAX ];
+  char path[ PATH_MAX ];
+  if ( !cache_directory( dir, sizeof( dir ) )
+    || snprintf( path, sizeof( path ), "%s/%s", dir, key->hex ) >= ( int ) sizeof( path ) )
+  {
+    return false;
+  }
+
+  int fd = open( path, O_RDONLY | O_CLOEXEC );
+  if ( fd == -1 ) return false;
+
+  struct stat info;
+  void* map = MAP_FAILED;
+  if ( fstat( fd, &info ) == 0 && info.st_size >= ( off_t ) sizeof( cache_header_t ) )
+  {
+    map = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  }
+  close( fd );
+
+  if ( map == MAP_FAILED ) return false;
+
+  const cache_header_t* header = map;
+  const char* at = ( const char* ) map + sizeof( *header );
+  const char* end = ( const char* ) map + info.st_size;
+
+  // (a damaged entry is just treated as a miss, before anything's written)
+  bool valid = header->magic == CACHE_MAGIC && header->version == CACHE_VERSION;
+  while ( valid && at < end )
+  {
+    cache_chunk_t chunk;
+    valid = end - at >= ( ptrdiff_t ) sizeof( chunk );
+    if ( !valid ) break;
+
+    memcpy( &chunk, at, sizeof( chunk ) );
+    at += sizeof( chunk ) + chunk.length;
+    valid = ( chunk.fd == 1 || chunk.fd == 2 ) && at <= end;
+  }
+
+  if ( valid )
+  {
+    for ( at = ( const char* ) map + sizeof( *header ); at < end; )
+    {
+      cache_chunk_t chunk;
+      memcpy( &chunk, at, sizeof( chunk ) );
+      cache_write( chunk.fd, at + sizeof( chunk ), chunk.length );
+      at += sizeof( chunk ) + chunk.length;
+    }
+
+    *status = header->status;
+  }
+
+  munmap( map, info.st_size );
+  return valid;
+}
+
+bool cache_begin( cache_entry_t* this, const cache_key_t* key )
+{
+  char dir[ PATH_MAX ];
+  if ( !cache_directory( dir, sizeof( dir ) )
+    || snprintf( this->path, sizeof( this->path ), "%s/%s", dir, key->hex )
+       >= ( int ) sizeof( this->path )
+    || snprintf( this->temp, sizeof( this->temp ), "%s/.%s.XXXXXX", dir, key->hex )
+       >= ( int ) sizeof( this->temp ) )
+  {
+    return false;
+  }
+
+  this->fd = mkostemp( this->temp, O_CLOEXEC );
+  if ( this->fd == -1 ) return false;
+
+  // (the status is filled in once it's known)
+  cache_header_t header = { CACHE_MAGIC, CACHE_VERSION, 0, 0 };
+  this->failed = !cache_write( this->fd, &header, sizeof( header ) );
+  return true;
+}
+
+void cache_record( cache_entry_t* this, int fd, const void* data, size_t length )
+{
+  cache_chunk_t chunk = { fd, length };
+
+  this->failed = this->failed
+              || !cache_write( this->fd, &chunk, sizeof( chunk ) )
+              || !cache_write( this->fd, data, length );
+}
+
+void cache_commit( cache_entry_t* this, int status )
+{
+  cache_header_t header = { CACHE_MAGIC, CACHE_VERSION, status, 0 };
+  if ( pwrite( this->fd, &header, sizeof( header ), 0 ) != sizeof( header ) )
+  {
+    this->failed = true;
+  }
+
+  if ( close( this->fd ) < 0 || this->failed || rename( this->temp, this->path ) < 0 )
+  {
+    unlink( this->temp );
+  }
+}
+
+void cache_abort( cache_entry_t* this )
+{
+  close( this->fd );
+  unlink( this->temp );
+}
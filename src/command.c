@@ -11,12 +11,22 @@
 #include <string.h>
 #include <signal.h>
 #include "command.h"
+#include "buffer.h"
+#include "redirect.h"
+#include "spawn.h"
+#include "scan.h"
+#include "memstats.h"
 #include "clib/memory.h"
 
 void command_init( command_t* this )
 {
   this->string = NULL;
   this->tokens = list_u(string);
+  this->arena = NULL;
+  this->heredocs = list_u(string);
+  this->redirects = list_u(redirect_t);
+  this->assignments = list_u(string);
+  this->references = 1;
 }
 
 void command_copy( command_t* this, const command_t* src )
@@ -25,116 +35,566 @@ void command_copy( command_t* this, const command_t* src )
   command_init( this );
 
   // duplicate the source string
-  this->string = strdup( src->string );
-
-  typeof(this->tokens->fun) vtable = this->tokens->fun;
+  this->string = mem_strdup( MEM_STRINGS, src->string );
 
   // copy each item from the source list
   unsigned int index = 0;
   while ( index < src->tokens->size )
   {
-    char* token = strdup( vtable->get( src->tokens, index ) );
-    vtable->enqueue( this->tokens, token );
+    char* token = mem_strdup( MEM_TOKENS, list_string_get( src->tokens, index ) );
+    list_string_enqueue( this->tokens, token );
+    index += 1;
+  }
+
+  // and each of the here-document bodies
+  index = 0;
+  while ( index < src->heredocs->size )
+  {
+    char* body = mem_strdup( MEM_STRINGS, list_string_get( src->heredocs, index ) );
+    list_string_enqueue( this->heredocs, body );
     index += 1;
   }
 }
 
+command_t* command_retain( const command_t* this )
+{
+  command_t* shared = ( command_t* ) this;
+  shared->references += 1;
+  return shared;
+}
+
+void command_release( command_t* this )
+{
+  if ( --this->references > 0 ) return;
+
+  command_destroy( this );
+  free( this );
+}
+
 void command_destroy( command_t* this )
 {
-  free( this->string );
+  // tokens (and assignments) in an arena are freed all at once,
+  // otherwise they each belong to us
+  if ( this->arena == NULL )
+  {
+    while ( this->tokens->size > 0 )
+    {
+      mem_free( MEM_TOKENS, this->tokens->fun->pop( this->tokens ) );
+    }
+
+    while ( this->assignments->size > 0 )
+    {
+      mem_free( MEM_TOKENS, this->assignments->fun->pop( this->assignments ) );
+    }
+  }
+
+  while ( this->heredocs->size > 0 )
+  {
+    mem_free( MEM_STRINGS, this->heredocs->fun->pop( this->heredocs ) );
+  }
+
+  while ( this->redirects->size > 0 )
+  {
+    redirect_t* redirect = this->redirects->fun->pop( this->redirects );
+    redirect_destroy( redirect );
+    free( redirect );
+  }
+
+  mem_free( MEM_TOKENS, this->arena );
+  mem_free( MEM_STRINGS, this->string );
   delete( this->tokens );
+  delete( this->heredocs );
+  delete( this->redirects );
+  delete( this->assignments );
 }
 
-void command_read( command_t* this )
+/**
+ * Removes the quotes from a here-document's delimiter.
+ */
+static char* command_unquote( const char* token )
 {
-  printf( "msh> " );
+  char* word = calloc( strlen( token ) + 1, sizeof( char ) );
+  char* current = word;
 
-  // temporary list of all the characters in the string
-  list_t(char) string = list(char);
+  for ( ; *token != '\0'; token++ )
+  {
+    if ( *token == '"' || *token == '\'' ) continue;
+    if ( *token == '\\' && token[ 1 ] != '\0' ) token++;
+    *current++ = *token;
+  }
 
-#define BUFFER_SIZE 255
-  int length = 0; 
-  char buff[ BUFFER_SIZE ];
-  bool in_quote = false;
+  return word;
+}
 
-  while ( !feof( stdin ) )
+/**
+ * Reads the body of every here-document in the command from the
+ * user, up until the line matching its delimiter (with the tabs at
+ * the start of each line, and of the delimiter's, stripped for a
+ * `<<-`).
+ */
+static void command_read_heredocs( command_t* this )
+{
+  unsigned int index;
+  for ( index = 0; index + 1 < this->tokens->size; index++ )
   {
-    char c = getc( stdin );
+    int kind, fd;
+    bool heredoc;
+    const char* token = list_string_get( this->tokens, index );
+    if ( !redirect_parse_operator( token, &kind, &fd, &heredoc )
+      || !heredoc )
+    {
+      continue;
+    }
+
+    bool strip = token[ strlen( token ) - 1 ] == '-';
+    char* delimiter = command_unquote( list_string_get( this->tokens, index + 1 ) );
+    bool delimited = false;
+    buffer_t body;
+    buffer_init( &body );
 
-    // clear the buffer if we're on a new word
-    if ( length == 0 )
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+
+    // (the prompts would only get in the way of a script's output)
+    bool prompt = isatty( STDIN_FILENO );
+    if ( prompt ) printf( "> " );
+    while ( ( length = getline( &line, &capacity, stdin ) ) >= 0 )
     {
-      memset( buff, 0, BUFFER_SIZE );
+      const char* start = line;
+      while ( strip && *start == '\t' )
+      {
+        start++;
+      }
+
+      size_t content = length - ( start - line );
+      while ( content > 0
+           && ( start[ content - 1 ] == '\n' || start[ content - 1 ] == '\r' ) )
+      {
+        content -= 1;
+      }
+
+      if ( content == strlen( delimiter )
+        && strncmp( start, delimiter, content ) == 0 )
+      {
+        delimited = true;
+        break;
+      }
+
+      buffer_append( &body, start, content );
+      buffer_append( &body, "\n", 1 );
+      if ( prompt ) printf( "> " );
     }
-    else if ( length == BUFFER_SIZE - 1 )
+    buffer_append( &body, "", 1 );
+
+    if ( !delimited )
     {
-      printf( "Token starting with %s is too long\n", buff );
+      printf( "warning: here-document ended by end of input (wanted `%s')\n",
+              delimiter );
     }
 
-    // capture everything between two (unescaped) quotes
-    if ( c == '"' )
+    char* text = buffer_release( &body );
+    mem_adopt( MEM_STRINGS, text );
+    list_string_enqueue( this->heredocs, text );
+    free( line );
+    free( delimiter );
+  }
+}
+
+/**
+ * Keeps reading lines while the command has unclosed braces (i.e. a
+ * function definition spanning several lines). Each line is its own
+ * command within the braces.
+ */
+static void command_read_continuation( command_t* this )
+{
+  for ( ;; )
+  {
+    int depth = 0;
+    unsigned int index;
+    for ( index = 0; index < this->tokens->size; index++ )
     {
-      // toggle the state
-      in_quote ^= true;
+      const char* token = this->tokens->fun->get( this->tokens, index );
+      if ( strcmp( token, "{" ) == 0 ) depth += 1;
+      if ( strcmp( token, "}" ) == 0 ) depth -= 1;
     }
-    // whitespace denotes the end of a token (but only outside quotes)
-    else if ( !in_quote && ( c == ' ' || c == '\t' || c == '\n' || c == '\r' ) )
+
+    if ( depth <= 0 ) return;
+
+    // (as with a here-document, only a terminal is prompted)
+    if ( isatty( STDIN_FILENO ) ) printf( "> " );
+
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t length = getline( &line, &capacity, stdin );
+    if ( length < 0 )
     {
-      // allocate the word on the stack
-      char* word = calloc( sizeof( char ), length + 1 );
-      memcpy( word, buff, length );
+      free( line );
+      return;
+    }
 
-      // add the word to the list
-      this->tokens->fun->enqueue( this->tokens, word );
+    while ( length > 0
+         && ( line[ length - 1 ] == '\n' || line[ length - 1 ] == '\r' ) )
+    {
+      length -= 1;
+      line[ length ] = '\0';
+    }
 
-      // reset the length to 0
-      length = 0;
+    // the line break ends the previous command (unless it was
+    // just the opening brace)
+    const char* last = this->tokens->fun->get( this->tokens,
+                                               this->tokens->size - 1 );
+    bool opening = strcmp( last, "{" ) == 0;
+    if ( !opening )
+    {
+      this->tokens->fun->enqueue( this->tokens, mem_strdup( MEM_TOKENS, ";" ) );
     }
-    // just add any other printable char onto the buffer
-    else if ( c >= 32 )
+    command_parse( this, line );
+
+    char* string = NULL;
+    asprintf( &string, "%s%s %s", this->string, opening ? "" : ";", line );
+    mem_adopt( MEM_STRINGS, string );
+    mem_free( MEM_STRINGS, this->string );
+    this->string = string;
+
+    free( line );
+  }
+}
+
+void command_read( command_t* this )
+{
+  char* line = NULL;
+  size_t capacity = 0;
+  ssize_t length = getline( &line, &capacity, stdin );
+
+  // end of input, so act as if the user asked to leave
+  if ( length < 0 )
+  {
+    printf( "\n" );
+    free( line );
+    line = strdup( "exit" );
+    length = strlen( line );
+  }
+
+  // the line ending isn't part of the command
+  while ( length > 0
+       && ( line[ length - 1 ] == '\n' || line[ length - 1 ] == '\r' ) )
+  {
+    length -= 1;
+    line[ length ] = '\0';
+  }
+
+  mem_adopt( MEM_STRINGS, line );
+  this->string = line;
+  command_parse( this, line );
+  command_read_continuation( this );
+  command_read_heredocs( this );
+}
+
+/**
+ * Whitespace denotes the end of a token (but only outside quotes).
+ */
+static bool command_is_blank( char c )
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/**
+ * Returns the length of the redirection operator starting at [text],
+ * or 0 if there isn't one.
+ */
+static size_t command_operator_length( const char* text )
+{
+  if ( text[ 0 ] == '<' )
+  {
+    if ( text[ 1 ] == '<' ) return text[ 2 ] == '<' || text[ 2 ] == '-' ? 3 : 2;
+    if ( text[ 1 ] == '&' ) return 2;
+    return 1;
+  }
+  else if ( text[ 0 ] == '>' )
+  {
+    if ( text[ 1 ] == '>' || text[ 1 ] == '&' || text[ 1 ] == '|' ) return 2;
+    return 1;
+  }
+  else if ( text[ 0 ] == '&' && text[ 1 ] == '>' )
+  {
+    return text[ 2 ] == '>' ? 3 : 2;
+  }
+
+  return 0;
+}
+
+const char* command_skip_substitution( const char* text )
+{
+  // backticks don't nest, so they just run to the next one
+  if ( *text == '`' )
+  {
+    const char* current = text + 1;
+    for ( ; *current != '\0'; current++ )
     {
-      buff[ length ] = c;
-      length += 1;
+      if ( *current == '\\' && current[ 1 ] != '\0' )
+      {
+        current++;
+      }
+      else if ( *current == '`' )
+      {
+        return current + 1;
+      }
     }
+    return current;
+  }
 
-    // if we found a newline, then that also means we end the line
-    if ( c == '\r' || c == '\n' )
+  // $( ... ) (or <( ... ) or >( ... )) runs to the matching paren
+  const char* current = text + 2;
+  unsigned int depth = 1;
+  char quote = '\0';
+
+  for ( ; *current != '\0'; current++ )
+  {
+    if ( quote != '\0' )
     {
-      break;
+      if ( *current == quote ) quote = '\0';
     }
-    else
+    else if ( *current == '"' || *current == '\'' )
     {
-      string.fun->enqueue( &string, c );
+      quote = *current;
     }
+    else if ( *current == '\\' && current[ 1 ] != '\0' )
+    {
+      current++;
+    }
+    else if ( *current == '(' )
+    {
+      depth += 1;
+    }
+    else if ( *current == ')' )
+    {
+      depth -= 1;
+      if ( depth == 0 ) return current + 1;
+    }
+  }
+
+  return current;
+}
+
+void command_parse( command_t* this, const char* line )
+{
+  const char* current = line;
+
+  for ( ;; )
+  {
+    current = scan_blanks( current );
+    if ( *current == '\0' ) break;
+
+    const char* start = current;
+    char quote = '\0';
+
+    for ( ; *current != '\0'; current++ )
+    {
+      // go straight to the next byte that could matter (most of a word
+      // is plain characters, which are classified a block at a time)
+      current = quote != '\0' ? scan_quoted( current, quote ) : scan_word( current );
+      if ( *current == '\0' ) break;
+
+      // substitutions are part of the word, whatever is inside them
+      if ( quote != '\'' && ( *current == '`'
+        || ( current[ 0 ] == '$' && current[ 1 ] == '(' ) ) )
+      {
+        current = command_skip_substitution( current ) - 1;
+      }
+      // as are process substitutions (which aren't redirections, even
+      // though they start with one's operator)
+      else if ( quote == '\0' && ( *current == '<' || *current == '>' )
+             && current[ 1 ] == '(' )
+      {
+        current = command_skip_substitution( current ) - 1;
+      }
+      // capture everything between two quotes
+      else if ( quote != '\0' )
+      {
+        if ( *current == quote ) quote = '\0';
+      }
+      else if ( *current == '"' || *current == '\'' )
+      {
+        quote = *current;
+      }
+      else if ( *current == '\\' && current[ 1 ] != '\0' )
+      {
+        current++;
+      }
+      else if ( command_is_blank( *current ) )
+      {
+        break;
+      }
+      // semicolons separate commands, so are always their own token
+      else if ( *current == ';' )
+      {
+        if ( current == start ) current++;
+        break;
+      }
+      // redirection operators are always tokens of their own, except
+      // that they take along a file descriptor number written before them
+      else if ( command_operator_length( current ) > 0 )
+      {
+        const char* digit = start;
+        while ( digit < current && *digit >= '0' && *digit <= '9' )
+        {
+          digit++;
+        }
+
+        if ( digit == current )
+        {
+          current += command_operator_length( current );
+        }
+        break;
+      }
+    }
+
+    char* word = mem_strndup( MEM_TOKENS, start, current - start );
+    this->tokens->fun->enqueue( this->tokens, word );
+  }
+}
+
+void command_slice( command_t* this, const command_t* src,
+                    unsigned int from, unsigned int to )
+{
+  command_init( this );
+
+  // skip past any here-documents used before the slice
+  unsigned int heredoc = 0;
+  unsigned int index;
+  for ( index = 0; index < to; index++ )
+  {
+    int kind, fd;
+    bool is_heredoc;
+    const char* token = list_string_get( src->tokens, index );
+    if ( !redirect_parse_operator( token, &kind, &fd, &is_heredoc )
+      || !is_heredoc )
+    {
+      continue;
+    }
+
+    if ( index >= from && heredoc < src->heredocs->size )
+    {
+      char* body = mem_strdup( MEM_STRINGS, list_string_get( src->heredocs, heredoc ) );
+      list_string_enqueue( this->heredocs, body );
+    }
+    heredoc += 1;
+  }
+
+  buffer_t string;
+  buffer_init( &string );
+
+  for ( index = from; index < to; index++ )
+  {
+    const char* token = list_string_get( src->tokens, index );
+    list_string_enqueue( this->tokens, mem_strdup( MEM_TOKENS, token ) );
+
+    if ( index > from ) buffer_append( &string, " ", 1 );
+    buffer_append( &string, token, strlen( token ) );
   }
-#undef BUFFER_SIZE
+  buffer_append( &string, "", 1 );
 
-  // consolidate string into a single char*
-  this->string = calloc( sizeof( char ), string.size + 1 );
-  char* current = this->string;
-  while ( string.size > 0 )
+  this->string = buffer_release( &string );
+  mem_adopt( MEM_STRINGS, this->string );
+}
+
+bool command_split( const command_t* this, list_t(command_t)* into )
+{
+  unsigned int from = 0;
+  unsigned int index;
+
+  // most commands aren't lists, so don't copy anything for them (and
+  // a `&` at the very end belongs to the command itself)
+  bool split = false;
+  for ( index = 0; !split && index < this->tokens->size; index++ )
   {
-    *current = string.fun->pop( &string );
-    current++;
+    const char* token = this->tokens->fun->get( this->tokens, index );
+    split = strcmp( token, ";" ) == 0
+         || ( strcmp( token, "&" ) == 0 && index + 1 < this->tokens->size );
+  }
+
+  if ( !split ) return false;
+
+  for ( index = 0; index <= this->tokens->size; index++ )
+  {
+    // the `&` stays on the end of its command, to run it in the background
+    unsigned int end = index;
+    if ( index < this->tokens->size )
+    {
+      const char* token = this->tokens->fun->get( this->tokens, index );
+      if ( strcmp( token, "&" ) == 0 ) end = index + 1;
+      else if ( strcmp( token, ";" ) != 0 ) continue;
+    }
+
+    if ( end > from )
+    {
+      command_t* command = malloc( sizeof( *command ) );
+      command_slice( command, this, from, end );
+      into->fun->enqueue( into, command );
+    }
+    from = index + 1;
   }
 
-  string.fun->destroy( &string );
+  return true;
 }
 
 const char* command_get_name( const command_t* this )
 {
+  if ( this->tokens->size == 0 ) return NULL;
+
   return this->tokens->fun->get( this->tokens, 0 );
 }
 
-pid_t command_exec( const command_t* this )
+bool command_redirect( const command_t* this )
 {
-  pid_t child_pid = fork();
+  unsigned int index;
+  for ( index = 0; index < this->redirects->size; index++ )
+  {
+    if ( !redirect_apply( this->redirects->fun->get( this->redirects, index ) ) )
+    {
+      return false;
+    }
+  }
 
-  if ( child_pid == -1 )
+  return true;
+}
+
+void command_assign( const command_t* this )
+{
+  unsigned int index;
+  for ( index = 0; index < this->assignments->size; index++ )
   {
-    perror( "Failed to start child process " );
+    const char* assignment =
+      this->assignments->fun->get( this->assignments, index );
+    const char* equals = strchr( assignment, '=' );
+
+    char* name = strndup( assignment, equals - assignment );
+    setenv( name, equals + 1, 1 );
+    free( name );
   }
-  else if ( child_pid == 0 )
+}
+
+void command_execv( const command_t* this )
+{
+  // undo the shell's own signal setup, since blocked and ignored
+  // signals would otherwise carry over into the program
+  sigset_t none;
+  sigemptyset( &none );
+  sigprocmask( SIG_SETMASK, &none, NULL );
+  signal( SIGTTOU, SIG_DFL );
+
+  // (the child only ever leaves through _exit, as exit would flush the
+  // shell's stdio buffers, and rewind a shared stdin to where the shell
+  // had read up to, so a script would be read over again)
+  if ( !command_redirect( this ) )
+  {
+    fflush( stdout );
+    _exit( 1 );
+  }
+
+  command_assign( this );
+
   {
 #define SEARCH_PATH_COUNT 4
     char* search_paths[ SEARCH_PATH_COUNT ] = {
@@ -183,10 +643,35 @@ pid_t command_exec( const command_t* this )
     // I could deallocate the strdup'd tokens, but at this point
     // we're literally just going to suicide, so the OS can clean up
     // our memory
-    exit( 1 );
+    fflush( stdout );
+    _exit( 1 );
 
 #undef SEARCH_PATH_COUNT
   }
+}
+
+pid_t command_exec( const command_t* this, const spawn_t* spawn )
+{
+  pid_t child_pid = fork();
+
+  if ( child_pid == -1 )
+  {
+    perror( "Failed to start child process " );
+  }
+  else if ( child_pid == 0 )
+  {
+    if ( spawn != NULL && !spawn_apply( spawn ) )
+    {
+      fflush( stdout );
+      _exit( 1 );
+    }
+
+    command_execv( this );
+  }
+  else if ( spawn != NULL )
+  {
+    spawn_adopt( spawn, child_pid );
+  }
 
   return child_pid;
 }
@@ -0,0 +1,714 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "expand.h"
+#include "shell.h"
+#include "memstats.h"
+
+/**
+ * The state of the field currently being built from a word. A single
+ * word can be split into several fields by unquoted substitutions.
+ */
+typedef struct expansion_field_t
+{
+  /** The offset in the arena the field starts at */
+  size_t start;
+
+  /** If unquoted substitutions should be split into fields */
+  bool split;
+
+  /** If the field had any quotes (so it's kept, even if empty) */
+  bool quoted;
+
+  /** If the field has any unquoted glob characters */
+  bool magic;
+
+  /** If the word has been split into several fields (so isn't globbed) */
+  bool fields;
+} expansion_field_t;
+
+void expansion_init( expansion_t* this, shell_t* shell )
+{
+  this->shell = shell;
+  dircache_init( &this->dircache );
+  buffer_init( &this->arena );
+  buffer_init( &this->offsets );
+  buffer_init( &this->assignments );
+  buffer_init( &this->pattern );
+  this->failed = false;
+}
+
+void expansion_destroy( expansion_t* this )
+{
+  dircache_destroy( &this->dircache );
+  buffer_destroy( &this->arena );
+  buffer_destroy( &this->offsets );
+  buffer_destroy( &this->assignments );
+  buffer_destroy( &this->pattern );
+}
+
+/**
+ * Appends a character onto the glob pattern (escaped if it was
+ * quoted, so it only ever matches itself).
+ */
+static void expansion_pattern( expansion_t* this, expansion_field_t* field,
+                               char c, bool quoted )
+{
+  bool meta = ( c == '*' || c == '?' || c == '[' || c == '\\' );
+
+  if ( quoted && meta )
+  {
+    buffer_append( &this->pattern, "\\", 1 );
+  }
+  else if ( meta && c != '\\' )
+  {
+    field->magic = true;
+  }
+
+  buffer_append( &this->pattern, &c, 1 );
+}
+
+/**
+ * Appends a single character of a word.
+ */
+static void expansion_put( expansion_t* this, expansion_field_t* field,
+                           char c, bool quoted )
+{
+  buffer_append( &this->arena, &c, 1 );
+  expansion_pattern( this, field, c, quoted );
+}
+
+/**
+ * Finishes the current field, appending it (or whatever it globs
+ * to) onto the arguments.
+ */
+static void expansion_end_field( expansion_t* this, expansion_field_t* field )
+{
+  // unquoted fields which expanded to nothing are dropped entirely
+  if ( this->arena.size == field->start && !field->quoted ) return;
+
+  buffer_append( &this->arena, "", 1 );
+  buffer_append( &this->pattern, "", 1 );
+
+  if ( field->magic && !field->fields )
+  {
+    glob_pattern_t pattern;
+    glob_pattern_compile( &pattern, this->pattern.data );
+    size_t matches = glob_expand( &pattern, &this->dircache,
+                                  &this->arena, &this->offsets );
+    glob_pattern_destroy( &pattern );
+
+    // patterns which match nothing are left as they are
+    if ( matches > 0 ) return;
+  }
+
+  buffer_append( &this->offsets, &field->start, sizeof( field->start ) );
+}
+
+/**
+ * Handles the text the arena gained since [from] as the result of an
+ * expansion. If it was unquoted, it's split into fields in place,
+ * by turning each run of whitespace into a single terminator.
+ */
+static void expansion_insert( expansion_t* this, expansion_field_t* field,
+                              size_t from, bool quoted )
+{
+  char* data = this->arena.data;
+  size_t end = this->arena.size;
+
+  size_t index;
+  for ( index = from; index < end; index++ )
+  {
+    expansion_pattern( this, field, data[ index ], quoted );
+  }
+
+  if ( quoted || !field->split ) return;
+
+  size_t read = from;
+  size_t write = from;
+  while ( read < end )
+  {
+    char c = data[ read ];
+    if ( c != ' ' && c != '\t' && c != '\n' )
+    {
+      data[ write++ ] = data[ read++ ];
+      continue;
+    }
+
+    while ( read < end
+         && ( data[ read ] == ' ' || data[ read ] == '\t' || data[ read ] == '\n' ) )
+    {
+      read++;
+    }
+
+    // there's always room for the terminator, since we just
+    // skipped at least one character
+    if ( write > field->start || field->quoted )
+    {
+      data[ write++ ] = '\0';
+      buffer_append( &this->offsets, &field->start, sizeof( field->start ) );
+    }
+
+    field->start = write;
+    field->quoted = false;
+    field->fields = true;
+  }
+
+  this->arena.size = write;
+}
+
+/**
+ * Appends the value of the variable whose name is the [length] chars
+ * at [name].
+ */
+static void expansion_variable( expansion_t* this, expansion_field_t* field,
+                                const char* name, size_t length, bool quoted )
+{
+  size_t from = this->arena.size;
+
+  const command_t* arguments = this->shell->arguments;
+  unsigned int count = arguments == NULL ? 0 : arguments->tokens->size;
+
+  if ( length == 1 && name[ 0 ] == '?' )
+  {
+    char status[ 16 ];
+    snprintf( status, sizeof( status ), "%d", this->shell->last_status );
+    buffer_append( &this->arena, status, strlen( status ) );
+  }
+  else if ( length == 1 && name[ 0 ] == '#' )
+  {
+    char size[ 16 ];
+    snprintf( size, sizeof( size ), "%u", count > 0 ? count - 1 : 0 );
+    buffer_append( &this->arena, size, strlen( size ) );
+  }
+  // all of the function's arguments, separated by spaces
+  else if ( length == 1 && ( name[ 0 ] == '@' || name[ 0 ] == '*' ) )
+  {
+    unsigned int index;
+    for ( index = 1; index < count; index++ )
+    {
+      const char* argument = arguments->tokens->fun->get( arguments->tokens, index );
+      if ( index > 1 ) buffer_append( &this->arena, " ", 1 );
+      buffer_append( &this->arena, argument, strlen( argument ) );
+    }
+  }
+  // a single argument of the function
+  else if ( isdigit( ( unsigned char ) name[ 0 ] ) )
+  {
+    unsigned int index = strtoul( name, NULL, 10 );
+    if ( index > 0 && index < count )
+    {
+      const char* argument = arguments->tokens->fun->get( arguments->tokens, index );
+      buffer_append( &this->arena, argument, strlen( argument ) );
+    }
+  }
+  else
+  {
+    char* key = strndup( name, length );
+    const char* value = getenv( key );
+    free( key );
+
+    if ( value != NULL )
+    {
+      buffer_append( &this->arena, value, strlen( value ) );
+    }
+  }
+
+  expansion_insert( this, field, from, quoted );
+}
+
+/**
+ * Runs the command substitution whose command is the [length] chars at
+ * [text], capturing its output straight into the arena.
+ */
+static void expansion_substitute( expansion_t* this, expansion_field_t* field,
+                                  const char* text, size_t length,
+                                  bool backtick, bool quoted )
+{
+  char* line = calloc( length + 1, sizeof( char ) );
+
+  // inside backticks, a backslash escapes the characters that
+  // would otherwise end the substitution
+  size_t i, used = 0;
+  for ( i = 0; i < length; i++ )
+  {
+    if ( backtick && text[ i ] == '\\' && i + 1 < length
+      && strchr( "`$\\", text[ i + 1 ] ) != NULL )
+    {
+      i++;
+    }
+    line[ used++ ] = text[ i ];
+  }
+
+  size_t from = this->arena.size;
+  shell_capture( this->shell, line, &this->arena );
+  free( line );
+
+  // trailing newlines are never part of the result
+  while ( this->arena.size > from
+       && this->arena.data[ this->arena.size - 1 ] == '\n' )
+  {
+    this->arena.size -= 1;
+  }
+
+  expansion_insert( this, field, from, quoted );
+}
+
+/**
+ * Evaluates the arithmetic expression which is the [length] chars
+ * at [text], appending its value.
+ */
+static void expansion_arithmetic( expansion_t* this, expansion_field_t* field,
+                                  const char* text, size_t length, bool quoted )
+{
+  char* source = strndup( text, length );
+
+  int64_t result;
+  if ( arith_evaluate( &this->shell->arith, source, &result ) )
+  {
+    size_t from = this->arena.size;
+    char value[ 32 ];
+    snprintf( value, sizeof( value ), "%lld", ( long long ) result );
+    buffer_append( &this->arena, value, strlen( value ) );
+    expansion_insert( this, field, from, quoted );
+  }
+  else
+  {
+    this->failed = true;
+  }
+
+  free( source );
+}
+
+/**
+ * Starts the process substitution (`<(...)` or `>(...)`) at [text],
+ * appending the path its pipe can be opened by, and returns a pointer
+ * just past it.
+ */
+static const char* expansion_process( expansion_t* this, expansion_field_t* field,
+                                      const char* text )
+{
+  const char* end = command_skip_substitution( text );
+
+  // (like a command substitution, it needn't be closed)
+  size_t length = end - ( text + 2 );
+  if ( length > 0 && end[ -1 ] == ')' ) length -= 1;
+
+  char* line = strndup( text + 2, length );
+  int fd = shell_substitute( this->shell, line, text[ 0 ] == '>' );
+  free( line );
+
+  if ( fd < 0 )
+  {
+    this->failed = true;
+    return end;
+  }
+
+  // the path is never split, or globbed
+  size_t from = this->arena.size;
+  char path[ 32 ];
+  snprintf( path, sizeof( path ), "/dev/fd/%d", fd );
+  buffer_append( &this->arena, path, strlen( path ) );
+  expansion_insert( this, field, from, true );
+
+  return end;
+}
+
+/**
+ * Expands the `$` (or backtick) expression starting at [text], and
+ * returns a pointer just past it.
+ */
+static const char* expansion_dollar( expansion_t* this, expansion_field_t* field,
+                                     const char* text, bool quoted )
+{
+  if ( text[ 0 ] == '$' && text[ 1 ] == '(' && text[ 2 ] == '(' )
+  {
+    const char* end = command_skip_substitution( text );
+    size_t length = end - ( text + 3 );
+
+    // $(( ... )) ends with two parens, which aren't part of it
+    if ( length >= 2 && end[ -1 ] == ')' && end[ -2 ] == ')' )
+    {
+      expansion_arithmetic( this, field, text + 3, length - 2, quoted );
+      return end;
+    }
+  }
+
+  if ( text[ 0 ] == '`' || text[ 1 ] == '(' )
+  {
+    const char* end = command_skip_substitution( text );
+    bool backtick = ( text[ 0 ] == '`' );
+    const char* inner = text + ( backtick ? 1 : 2 );
+
+    // the closing paren (or backtick) isn't part of the command, and
+    // unterminated substitutions just run to the end of the word
+    size_t length = end - inner;
+    if ( length > 0 && end[ -1 ] == ( backtick ? '`' : ')' ) )
+    {
+      length -= 1;
+    }
+
+    expansion_substitute( this, field, inner, length, backtick, quoted );
+    return end;
+  }
+  else if ( text[ 1 ] == '{' )
+  {
+    const char* close = strchr( text, '}' );
+    if ( close != NULL )
+    {
+      expansion_variable( this, field, text + 2, close - text - 2, quoted );
+      return close + 1;
+    }
+  }
+  else if ( text[ 1 ] == '?' || text[ 1 ] == '#' || text[ 1 ] == '@'
+         || text[ 1 ] == '*' || isdigit( ( unsigned char ) text[ 1 ] ) )
+  {
+    expansion_variable( this, field, text + 1, 1, quoted );
+    return text + 2;
+  }
+  else if ( text[ 1 ] == '_' || isalpha( ( unsigned char ) text[ 1 ] ) )
+  {
+    const char* end = text + 1;
+    while ( *end == '_' || isalnum( ( unsigned char ) *end ) )
+    {
+      end++;
+    }
+
+    expansion_variable( this, field, text + 1, end - text - 1, quoted );
+    return end;
+  }
+
+  // a lone '$' is just a dollar sign
+  expansion_put( this, field, '$', true );
+  return text + 1;
+}
+
+/**
+ * Expands a single raw token, appending the resulting field(s).
+ * If [split] is false, the token always results in exactly one field.
+ */
+static void expansion_word( expansion_t* this, const char* token, bool split )
+{
+  expansion_field_t field;
+  field.start = this->arena.size;
+  field.split = split;
+  field.quoted = false;
+  field.magic = false;
+  field.fields = false;
+
+  this->pattern.size = 0;
+
+  char quote = '\0';
+
+  const char* current = token;
+  while ( *current != '\0' )
+  {
+    char c = *current;
+
+    if ( quote == '\'' )
+    {
+      if ( c != quote ) expansion_put( this, &field, c, true );
+      else quote = '\0';
+    }
+    else if ( c == '`' || ( c == '$' && current[ 1 ] != '\0' ) )
+    {
+      current = expansion_dollar( this, &field, current, quote != '\0' );
+      continue;
+    }
+    else if ( quote == '"' )
+    {
+      if ( c == '"' )
+      {
+        quote = '\0';
+      }
+      // only a few characters can be escaped inside double quotes
+      else if ( c == '\\' && current[ 1 ] != '\0'
+             && strchr( "$`\"\\", current[ 1 ] ) != NULL )
+      {
+        current++;
+        expansion_put( this, &field, *current, true );
+      }
+      else
+      {
+        expansion_put( this, &field, c, true );
+      }
+    }
+    else if ( ( c == '<' || c == '>' ) && current[ 1 ] == '(' )
+    {
+      current = expansion_process( this, &field, current );
+      continue;
+    }
+    else if ( c == '"' || c == '\'' )
+    {
+      quote = c;
+      field.quoted = true;
+    }
+    else if ( c == '\\' && current[ 1 ] != '\0' )
+    {
+      current++;
+      expansion_put( this, &field, *current, true );
+    }
+    else
+    {
+      expansion_put( this, &field, c, false );
+    }
+
+    current++;
+  }
+
+  expansion_end_field( this, &field );
+}
+
+/**
+ * Expands a here-document's body, the same as inside double quotes
+ * (except that a `"` is just a `"`), returning the result.
+ */
+static char* expansion_heredoc( expansion_t* this, const char* body )
+{
+  expansion_field_t field;
+  field.start = this->arena.size;
+  field.split = false;
+  field.quoted = true;
+  field.magic = false;
+  field.fields = false;
+
+  this->pattern.size = 0;
+
+  const char* current = body;
+  while ( *current != '\0' )
+  {
+    char c = *current;
+
+    if ( c == '`' || ( c == '$' && current[ 1 ] != '\0' ) )
+    {
+      current = expansion_dollar( this, &field, current, true );
+      continue;
+    }
+    // an escaped newline joins the lines
+    else if ( c == '\\' && current[ 1 ] == '\n' )
+    {
+      current++;
+    }
+    else if ( c == '\\' && current[ 1 ] != '\0'
+           && strchr( "$`\\", current[ 1 ] ) != NULL )
+    {
+      current++;
+      expansion_put( this, &field, *current, true );
+    }
+    else
+    {
+      expansion_put( this, &field, c, true );
+    }
+
+    current++;
+  }
+
+  // (it's not one of the command's words, so it's taken back out)
+  char* text = strndup( this->arena.data + field.start,
+                        this->arena.size - field.start );
+  this->arena.size = field.start;
+
+  return text;
+}
+
+/**
+ * Checks if the raw token is a `NAME=value` assignment.
+ */
+static bool expansion_is_assignment( const char* token )
+{
+  if ( *token != '_' && !isalpha( ( unsigned char ) *token ) ) return false;
+
+  while ( *token == '_' || isalnum( ( unsigned char ) *token ) )
+  {
+    token++;
+  }
+
+  return *token == '=';
+}
+
+/**
+ * Expands the target of the redirection operator at [index] into a
+ * redirect for [dst]. Returns [false] if the redirect is malformed.
+ */
+static bool expansion_redirect( expansion_t* this, const command_t* src,
+                                command_t* dst, unsigned int index,
+                                unsigned int* heredoc_index )
+{
+  const char* operator = src->tokens->fun->get( src->tokens, index );
+
+  redirect_t* redirect = calloc( 1, sizeof( *redirect ) );
+  bool heredoc;
+  redirect_parse_operator( operator, &redirect->kind, &redirect->fd, &heredoc );
+
+  if ( index + 1 >= src->tokens->size )
+  {
+    printf( "%s: missing redirection target\n", operator );
+    free( redirect );
+    return false;
+  }
+
+  if ( heredoc )
+  {
+    const char* body = "";
+    if ( *heredoc_index < src->heredocs->size )
+    {
+      body = src->heredocs->fun->get( src->heredocs, *heredoc_index );
+    }
+    *heredoc_index += 1;
+
+    // only a body whose delimiter was quoted (even in part) is taken
+    // as it is, otherwise it's expanded
+    const char* delimiter = src->tokens->fun->get( src->tokens, index + 1 );
+    if ( strpbrk( delimiter, "'\"\\" ) != NULL )
+    {
+      redirect->path = strdup( body );
+    }
+    else
+    {
+      redirect->path = expansion_heredoc( this, body );
+    }
+    redirect->length = strlen( redirect->path );
+    dst->redirects->fun->enqueue( dst->redirects, redirect );
+    return true;
+  }
+
+  // expand the target like any other word, then take it back out
+  // of the arguments
+  size_t arena_size = this->arena.size;
+  size_t offsets_size = this->offsets.size;
+
+  expansion_word( this, src->tokens->fun->get( src->tokens, index + 1 ), true );
+
+  size_t words = ( this->offsets.size - offsets_size ) / sizeof( size_t );
+  const char* target = "";
+  if ( words > 0 )
+  {
+    target = this->arena.data + *( size_t* ) ( this->offsets.data + offsets_size );
+  }
+
+  bool ok = true;
+  if ( words != 1 )
+  {
+    printf( "%s: ambiguous redirect\n", operator );
+    ok = false;
+  }
+  else if ( redirect->kind == REDIRECT_DATA )
+  {
+    // here-strings get a trailing newline, like a one line here-document
+    redirect->length = strlen( target ) + 1;
+    redirect->path = calloc( redirect->length + 1, sizeof( char ) );
+    memcpy( redirect->path, target, redirect->length - 1 );
+    redirect->path[ redirect->length - 1 ] = '\n';
+  }
+  else if ( redirect->kind == REDIRECT_DUP )
+  {
+    char* end;
+    redirect->source = strtol( target, &end, 10 );
+
+    if ( strcmp( target, "-" ) == 0 )
+    {
+      redirect->kind = REDIRECT_CLOSE;
+    }
+    else if ( *target == '\0' || *end != '\0' )
+    {
+      printf( "%s: bad file descriptor\n", target );
+      ok = false;
+    }
+  }
+  else
+  {
+    redirect->path = strdup( target );
+  }
+
+  this->arena.size = arena_size;
+  this->offsets.size = offsets_size;
+
+  if ( !ok )
+  {
+    redirect_destroy( redirect );
+    free( redirect );
+    return false;
+  }
+
+  dst->redirects->fun->enqueue( dst->redirects, redirect );
+  return true;
+}
+
+bool expansion_expand( expansion_t* this, const command_t* src, command_t* dst )
+{
+  this->arena.size = 0;
+  this->offsets.size = 0;
+  this->assignments.size = 0;
+  this->failed = false;
+
+  command_init( dst );
+  dst->string = mem_strdup( MEM_STRINGS, src->string );
+
+  bool ok = true;
+  bool leading = true;
+  unsigned int heredoc_index = 0;
+
+  unsigned int index;
+  for ( index = 0; ok && index < src->tokens->size; index++ )
+  {
+    const char* token = src->tokens->fun->get( src->tokens, index );
+
+    int kind, fd;
+    bool heredoc;
+    if ( redirect_parse_operator( token, &kind, &fd, &heredoc ) )
+    {
+      ok = expansion_redirect( this, src, dst, index, &heredoc_index );
+
+      // the operator's target isn't an argument
+      index += 1;
+    }
+    // assignments before the command's name are never split, and
+    // are kept separate from the arguments
+    else if ( leading && expansion_is_assignment( token ) )
+    {
+      size_t offsets_size = this->offsets.size;
+      expansion_word( this, token, false );
+
+      buffer_append( &this->assignments, this->offsets.data + offsets_size,
+                     sizeof( size_t ) );
+      this->offsets.size = offsets_size;
+    }
+    else
+    {
+      leading = false;
+      expansion_word( this, token, true );
+    }
+  }
+
+  // the arena can only be pointed into once it stops growing
+  size_t count = this->offsets.size / sizeof( size_t );
+  const size_t* offsets = ( const size_t* ) this->offsets.data;
+
+  dst->arena = buffer_release( &this->arena );
+  mem_adopt( MEM_TOKENS, dst->arena );
+
+  ok = ok && !this->failed;
+
+  size_t i;
+  for ( i = 0; ok && i < count; i++ )
+  {
+    dst->tokens->fun->enqueue( dst->tokens, dst->arena + offsets[ i ] );
+  }
+
+  count = this->assignments.size / sizeof( size_t );
+  offsets = ( const size_t* ) this->assignments.data;
+  for ( i = 0; ok && i < count; i++ )
+  {
+    dst->assignments->fun->enqueue( dst->assignments, dst->arena + offsets[ i ] );
+  }
+
+  return ok;
+}
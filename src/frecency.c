@@ -0,0 +1,552 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "frecency.h"
+
+// how many records (and bytes of paths) a new table has room for
+#define FRECENCY_INITIAL_RECORDS 256
+#define FRECENCY_INITIAL_POOL 16384
+
+// the bit in a path's characters which says it has uppercase ones (it
+// shares one with '@' and '`', which are rare enough in paths)
+#define FRECENCY_UPPER ( ( uint64_t ) 1 )
+
+// what the ranks are scaled by when they're aged, and the rank a
+// directory is forgotten below
+#define FRECENCY_AGING 0.99f
+#define FRECENCY_MIN_RANK 1.0f
+
+/**
+ * A directory which matched a query.
+ */
+typedef struct frecency_match_t
+{
+  /** How it ranks against the others */
+  double score;
+
+  /** Its path (an offset into the paths) */
+  uint64_t path;
+} frecency_match_t;
+
+static inline frecency_header_t* frecency_header( const frecency_t* this )
+{
+  return this->map;
+}
+
+static inline frecency_record_t* frecency_records( const frecency_t* this )
+{
+  return ( frecency_record_t* )( ( char* ) this->map + sizeof( frecency_header_t ) );
+}
+
+static inline char* frecency_pool( const frecency_t* this )
+{
+  return ( char* ) this->map + frecency_header( this )->pool_offset;
+}
+
+/**
+ * Works out which characters [text] has, ignoring case, as a bit each
+ * (a few share one, but that only lets through the odd path which
+ * then doesn't match). FRECENCY_UPPER is set as well if any of them
+ * are uppercase.
+ */
+static uint64_t frecency_chars( const char* text, size_t length )
+{
+  uint64_t chars = 0;
+
+  size_t index;
+  for ( index = 0; index < length; index++ )
+  {
+    unsigned char c = text[ index ];
+    chars |= ( uint64_t ) 1 << ( tolower( c ) & 63 );
+    if ( isupper( c ) ) chars |= FRECENCY_UPPER;
+  }
+
+  return chars;
+}
+
+void frecency_init( frecency_t* this )
+{
+  this->path = NULL;
+  this->fd = -1;
+  this->map = NULL;
+  this->size = 0;
+  this->failed = false;
+
+  const char* file = getenv( "MSH_DIRS_FILE" );
+  const char* xdg = getenv( "XDG_DATA_HOME" );
+  const char* home = getenv( "HOME" );
+  int length = 0;
+
+  if ( file != NULL )
+  {
+    if ( *file != '\0' ) this->path = strdup( file );
+  }
+  else if ( xdg != NULL && *xdg != '\0' )
+  {
+    length = asprintf( &this->path, "%s/msh/dirs", xdg );
+  }
+  else if ( home != NULL && *home != '\0' )
+  {
+    length = asprintf( &this->path, "%s/.local/share/msh/dirs", home );
+  }
+
+  if ( length < 0 ) this->path = NULL;
+}
+
+void frecency_destroy( frecency_t* this )
+{
+  if ( this->map != NULL ) munmap( this->map, this->size );
+  if ( this->fd != -1 ) close( this->fd );
+  free( this->path );
+
+  this->path = NULL;
+  this->fd = -1;
+  this->map = NULL;
+  this->size = 0;
+}
+
+/**
+ * Makes each of the directories [path] is in (if they aren't already).
+ */
+static void frecency_mkdirs( const char* path )
+{
+  char* copy = strdup( path );
+
+  char* slash;
+  for ( slash = strchr( copy + 1, '/' ); slash != NULL; slash = strchr( slash + 1, '/' ) )
+  {
+    *slash = '\0';
+    mkdir( copy, 0700 );
+    *slash = '/';
+  }
+
+  free( copy );
+}
+
+/**
+ * Maps [size] bytes of the file (or nothing, if it's too small to be
+ * a table), in place of whatever was mapped before.
+ */
+static bool frecency_remap( frecency_t* this, size_t size )
+{
+  if ( this->map != NULL ) munmap( this->map, this->size );
+  this->map = NULL;
+  this->size = 0;
+
+  if ( size < sizeof( frecency_header_t ) ) return true;
+
+  void* map = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0 );
+  if ( map == MAP_FAILED ) return false;
+
+  this->map = map;
+  this->size = size;
+  return true;
+}
+
+/**
+ * Lays out a new (empty) table in the file.
+ */
+static bool frecency_create( frecency_t* this )
+{
+  frecency_header_t header;
+  memset( &header, 0, sizeof( header ) );
+  header.magic = FRECENCY_MAGIC;
+  header.version = FRECENCY_VERSION;
+  header.capacity = FRECENCY_INITIAL_RECORDS;
+  header.pool_offset = sizeof( header )
+                     + FRECENCY_INITIAL_RECORDS * sizeof( frecency_record_t );
+
+  return ftruncate( this->fd, header.pool_offset + FRECENCY_INITIAL_POOL ) == 0
+      && pwrite( this->fd, &header, sizeof( header ), 0 ) == sizeof( header );
+}
+
+/**
+ * Checks the mapped file is a table (of this version), and that its
+ * sections fit in it.
+ */
+static bool frecency_check( const frecency_t* this )
+{
+  const frecency_header_t* header = frecency_header( this );
+
+  return header->magic == FRECENCY_MAGIC
+      && header->version == FRECENCY_VERSION
+      && header->count <= header->capacity
+      && header->pool_offset == sizeof( *header )
+                              + ( uint64_t ) header->capacity * sizeof( frecency_record_t )
+      && header->pool_offset <= this->size
+      && header->pool_used <= this->size - header->pool_offset;
+}
+
+/**
+ * Opens the table (if it isn't already), and locks it with the given
+ * flock [operation], remapping it if another session has grown it
+ * since (or laying it out, if it's new and this is the first session
+ * to write to it). Returns [false] if it can't be used, in which case
+ * it isn't left locked.
+ */
+static bool frecency_lock( frecency_t* this, int operation )
+{
+  if ( this->path == NULL || this->failed ) return false;
+
+  if ( this->fd == -1 )
+  {
+    frecency_mkdirs( this->path );
+    this->fd = open( this->path, O_RDWR | O_CREAT | O_CLOEXEC, 0600 );
+    if ( this->fd == -1 )
+    {
+      perror( this->path );
+      this->failed = true;
+      return false;
+    }
+  }
+
+  while ( flock( this->fd, operation ) < 0 )
+  {
+    if ( errno != EINTR ) return false;
+  }
+
+  struct stat info;
+  bool ok = fstat( this->fd, &info ) == 0;
+
+  if ( ok && info.st_size == 0 && operation == LOCK_EX )
+  {
+    ok = frecency_create( this ) && fstat( this->fd, &info ) == 0;
+  }
+  if ( ok && ( size_t ) info.st_size != this->size )
+  {
+    ok = frecency_remap( this, info.st_size );
+  }
+
+  // (an empty table, which hasn't been written to yet, has nothing in it)
+  if ( ok && this->map != NULL && !frecency_check( this ) )
+  {
+    printf( "%s: not a table of directories (or from another version of msh)\n",
+            this->path );
+    this->failed = true;
+    ok = false;
+  }
+
+  if ( !ok || this->map == NULL )
+  {
+    flock( this->fd, LOCK_UN );
+    return false;
+  }
+
+  return true;
+}
+
+static void frecency_unlock( frecency_t* this )
+{
+  flock( this->fd, LOCK_UN );
+}
+
+/**
+ * Gets the path of [record], or NULL if it isn't one in the paths.
+ */
+static const char* frecency_path( const frecency_t* this,
+                                  const frecency_record_t* record )
+{
+  const frecency_header_t* header = frecency_header( this );
+  const char* pool = frecency_pool( this );
+
+  if ( record->path >= header->pool_used
+    || record->length >= header->pool_used - record->path
+    || pool[ record->path + record->length ] != '\0' )
+  {
+    return NULL;
+  }
+
+  return pool + record->path;
+}
+
+/**
+ * Finds the record for [dir], or NULL if it hasn't been visited.
+ */
+static frecency_record_t* frecency_find( const frecency_t* this, const char* dir,
+                                         size_t length, uint64_t chars )
+{
+  frecency_record_t* records = frecency_records( this );
+  uint32_t count = frecency_header( this )->count;
+
+  uint32_t index;
+  for ( index = 0; index < count; index++ )
+  {
+    frecency_record_t* record = &records[ index ];
+    if ( record->length != length || record->chars != chars ) continue;
+
+    const char* path = frecency_path( this, record );
+    if ( path != NULL && memcmp( path, dir, length ) == 0 ) return record;
+  }
+
+  return NULL;
+}
+
+/**
+ * Makes room for one more record, whose path is [length] long. The
+ * file grows for more paths, and the paths are moved up (after it's
+ * grown) for more records.
+ */
+static bool frecency_reserve( frecency_t* this, size_t length )
+{
+  frecency_header_t* header = frecency_header( this );
+  uint32_t capacity = header->capacity;
+  uint64_t pool_room = this->size - header->pool_offset;
+
+  if ( header->count < capacity && header->pool_used + length + 1 <= pool_room )
+  {
+    return true;
+  }
+
+  if ( header->count >= capacity ) capacity *= 2;
+  while ( header->pool_used + length + 1 > pool_room ) pool_room *= 2;
+
+  uint64_t pool_offset = sizeof( *header )
+                       + ( uint64_t ) capacity * sizeof( frecency_record_t );
+  uint64_t moved_from = header->pool_offset;
+  uint64_t used = header->pool_used;
+
+  if ( ftruncate( this->fd, pool_offset + pool_room ) < 0
+    || !frecency_remap( this, pool_offset + pool_room ) )
+  {
+    perror( this->path );
+    return false;
+  }
+
+  header = frecency_header( this );
+  memmove( ( char* ) this->map + pool_offset, ( char* ) this->map + moved_from, used );
+  header->pool_offset = pool_offset;
+  header->capacity = capacity;
+
+  return true;
+}
+
+/**
+ * Removes the record at [index] (the last record takes its place).
+ */
+static void frecency_remove( frecency_t* this, uint32_t index )
+{
+  frecency_header_t* header = frecency_header( this );
+  frecency_record_t* records = frecency_records( this );
+
+  header->total -= records[ index ].rank;
+  header->pool_garbage += records[ index ].length + 1;
+  records[ index ] = records[ --header->count ];
+}
+
+/**
+ * Copies the paths which are still used down over the forgotten ones.
+ */
+static void frecency_compact( frecency_t* this )
+{
+  frecency_header_t* header = frecency_header( this );
+  frecency_record_t* records = frecency_records( this );
+  char* pool = frecency_pool( this );
+
+  char* copy = malloc( header->pool_used );
+  uint64_t used = 0;
+
+  uint32_t index;
+  for ( index = 0; index < header->count; index++ )
+  {
+    const char* path = frecency_path( this, &records[ index ] );
+    if ( path == NULL ) continue;
+
+    memcpy( copy + used, path, records[ index ].length + 1 );
+    records[ index ].path = used;
+    used += records[ index ].length + 1;
+  }
+
+  memcpy( pool, copy, used );
+  free( copy );
+
+  header->pool_used = used;
+  header->pool_garbage = 0;
+}
+
+/**
+ * Scales every rank down, forgetting the directories which drop below
+ * FRECENCY_MIN_RANK (so the table doesn't just keep growing).
+ */
+static void frecency_age( frecency_t* this )
+{
+  frecency_header_t* header = frecency_header( this );
+  frecency_record_t* records = frecency_records( this );
+
+  header->total = 0;
+
+  uint32_t index = 0;
+  while ( index < header->count )
+  {
+    records[ index ].rank *= FRECENCY_AGING;
+    header->total += records[ index ].rank;
+
+    if ( records[ index ].rank < FRECENCY_MIN_RANK )
+    {
+      frecency_remove( this, index );
+    }
+    else
+    {
+      index++;
+    }
+  }
+
+  if ( header->pool_garbage > header->pool_used / 2 ) frecency_compact( this );
+}
+
+void frecency_visit( frecency_t* this, const char* dir )
+{
+  if ( !frecency_lock( this, LOCK_EX ) ) return;
+
+  size_t length = strlen( dir );
+  uint64_t chars = frecency_chars( dir, length );
+
+  frecency_record_t* record = frecency_find( this, dir, length, chars );
+  if ( record == NULL && frecency_reserve( this, length ) )
+  {
+    frecency_header_t* header = frecency_header( this );
+
+    record = &frecency_records( this )[ header->count ];
+    record->path = header->pool_used;
+    record->length = length;
+    record->rank = 0;
+    record->chars = chars;
+
+    memcpy( frecency_pool( this ) + header->pool_used, dir, length + 1 );
+    header->pool_used += length + 1;
+    header->count += 1;
+  }
+
+  if ( record != NULL )
+  {
+    frecency_header_t* header = frecency_header( this );
+
+    record->rank += 1;
+    record->time = time( NULL );
+    header->total += 1;
+
+    if ( header->total > FRECENCY_MAX_TOTAL ) frecency_age( this );
+  }
+
+  frecency_unlock( this );
+}
+
+void frecency_forget( frecency_t* this, const char* dir )
+{
+  if ( !frecency_lock( this, LOCK_EX ) ) return;
+
+  size_t length = strlen( dir );
+  frecency_record_t* record =
+    frecency_find( this, dir, length, frecency_chars( dir, length ) );
+
+  if ( record != NULL ) frecency_remove( this, record - frecency_records( this ) );
+
+  frecency_unlock( this );
+}
+
+/**
+ * Weighs a directory's rank by how long ago it was last visited.
+ */
+static double frecency_score( const frecency_record_t* record, int64_t now )
+{
+  int64_t age = now - record->time;
+
+  if ( age < 60 * 60 ) return record->rank * 4.0;
+  if ( age < 24 * 60 * 60 ) return record->rank * 2.0;
+  if ( age < 7 * 24 * 60 * 60 ) return record->rank / 2.0;
+  return record->rank / 4.0;
+}
+
+/**
+ * Checks [path] has each of [words] in it, in order.
+ */
+static bool frecency_matches( const char* path, const char* const* words,
+                              size_t count, bool fold )
+{
+  size_t index;
+  for ( index = 0; index < count; index++ )
+  {
+    const char* found = fold ? strcasestr( path, words[ index ] )
+                             : strstr( path, words[ index ] );
+    if ( found == NULL ) return false;
+
+    path = found + strlen( words[ index ] );
+  }
+
+  return true;
+}
+
+size_t frecency_query( frecency_t* this, const char* const* words, size_t count,
+                       size_t max, buffer_t* out )
+{
+  if ( max == 0 || !frecency_lock( this, LOCK_SH ) ) return 0;
+
+  const frecency_header_t* header = frecency_header( this );
+  const frecency_record_t* records = frecency_records( this );
+  const char* pool = frecency_pool( this );
+  int64_t now = time( NULL );
+
+  uint64_t chars = 0;
+  size_t index;
+  for ( index = 0; index < count; index++ )
+  {
+    chars |= frecency_chars( words[ index ], strlen( words[ index ] ) );
+  }
+
+  // the best [max] so far, from the highest score down
+  frecency_match_t* matches = malloc( max * sizeof( *matches ) );
+  size_t found = 0;
+
+  // exact matches first, and only if there aren't any, ignoring case
+  int fold;
+  for ( fold = 0; fold <= 1 && found == 0; fold++ )
+  {
+    uint64_t wanted = fold ? chars & ~FRECENCY_UPPER : chars;
+
+    uint32_t record;
+    for ( record = 0; record < header->count; record++ )
+    {
+      if ( ( records[ record ].chars & wanted ) != wanted ) continue;
+
+      // (the path is only read if it'd make the cut)
+      double score = frecency_score( &records[ record ], now );
+      if ( found == max && score <= matches[ max - 1 ].score ) continue;
+
+      const char* path = frecency_path( this, &records[ record ] );
+      if ( path == NULL || !frecency_matches( path, words, count, fold ) ) continue;
+
+      size_t at = found < max ? found++ : max - 1;
+      while ( at > 0 && matches[ at - 1 ].score < score )
+      {
+        matches[ at ] = matches[ at - 1 ];
+        at--;
+      }
+
+      matches[ at ].score = score;
+      matches[ at ].path = records[ record ].path;
+    }
+  }
+
+  for ( index = 0; index < found; index++ )
+  {
+    buffer_append_string( out, pool + matches[ index ].path );
+  }
+
+  free( matches );
+  frecency_unlock( this );
+
+  return found;
+}
@@ -0,0 +1,120 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include "function.h"
+#include "clib/memory.h"
+
+/**
+ * Hashes a name into a bucket index (FNV-1a).
+ */
+static unsigned int function_hash( const char* name )
+{
+  unsigned int hash = 2166136261u;
+
+  for ( ; *name != '\0'; name++ )
+  {
+    hash ^= ( unsigned char ) *name;
+    hash *= 16777619u;
+  }
+
+  return hash & ( FUNCTION_TABLE_SIZE - 1 );
+}
+
+/**
+ * Frees a function, and every command in its body.
+ */
+static void function_destroy( function_t* this )
+{
+  while ( this->body->size > 0 )
+  {
+    command_t* command = this->body->fun->pop( this->body );
+    command_destroy( command );
+    free( command );
+  }
+
+  delete( this->body );
+  free( this->name );
+  free( this->text );
+  free( this );
+}
+
+void function_table_init( function_table_t* this )
+{
+  memset( this->buckets, 0, sizeof( this->buckets ) );
+  this->size = 0;
+}
+
+void function_table_destroy( function_table_t* this )
+{
+  unsigned int i;
+  for ( i = 0; i < FUNCTION_TABLE_SIZE; i++ )
+  {
+    while ( this->buckets[ i ] != NULL )
+    {
+      function_t* next = this->buckets[ i ]->next;
+      function_destroy( this->buckets[ i ] );
+      this->buckets[ i ] = next;
+    }
+  }
+
+  this->size = 0;
+}
+
+void function_table_set( function_table_t* this, const char* name,
+                         const char* text, list_t(command_t)* body )
+{
+  function_table_remove( this, name );
+
+  function_t* function = malloc( sizeof( *function ) );
+  function->name = strdup( name );
+  function->text = strdup( text );
+  function->body = body;
+
+  unsigned int bucket = function_hash( name );
+  function->next = this->buckets[ bucket ];
+  this->buckets[ bucket ] = function;
+
+  this->size += 1;
+}
+
+const function_t* function_table_get( const function_table_t* this,
+                                      const char* name )
+{
+  const function_t* current = this->buckets[ function_hash( name ) ];
+
+  for ( ; current != NULL; current = current->next )
+  {
+    if ( strcmp( current->name, name ) == 0 )
+    {
+      return current;
+    }
+  }
+
+  return NULL;
+}
+
+bool function_table_remove( function_table_t* this, const char* name )
+{
+  function_t** link = &this->buckets[ function_hash( name ) ];
+
+  for ( ; *link != NULL; link = &( *link )->next )
+  {
+    if ( strcmp( ( *link )->name, name ) == 0 )
+    {
+      function_t* function = *link;
+      *link = function->next;
+      function_destroy( function );
+
+      this->size -= 1;
+      return true;
+    }
+  }
+
+  return false;
+}
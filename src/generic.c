@@ -1,24 +1,36 @@
 #include "generic.h"
 
+// n.b. lists are statically dispatched unless VTABLE_DISPATCH is defined
+// for them (in both places), in which case these are what emit their methods
+
 #include <sys/types.h>
 #define IMPLEMENTATION_ONLY
 #define TYPE pid_t
 #define COPY_VALUE
+#define POOLED
 #include "clib/list.h"
 
 #define IMPLEMENTATION_ONLY
 #define TYPE int
 #define COPY_VALUE
+#define POOLED
 #include "clib/list.h"
 
 #define IMPLEMENTATION_ONLY
 #define TYPE string
 #define COPY_VALUE
+#define POOLED
 #include "clib/list.h"
 
 #define IMPLEMENTATION_ONLY
 #define TYPE char
 #define COPY_VALUE
+#define POOLED
+#include "clib/list.h"
+
+#include "redirect.h"
+#define IMPLEMENTATION_ONLY
+#define TYPE redirect_t
 #include "clib/list.h"
 
 #include "command.h"
@@ -11,6 +11,8 @@
 
 void handler_init( handler_t* this, void ( *sig_handler )( int ) )
 {
+  memset( &this->action, 0, sizeof( this->action ) );
+  sigemptyset( &this->action.sa_mask );
   this->action.sa_handler = sig_handler;
 
   if ( sigaction( SIGINT, &this->action, NULL ) < 0 )
@@ -22,6 +24,11 @@ void handler_init( handler_t* this, void ( *sig_handler )( int ) )
   {
     perror( "sigaction: " );
   }
+
+  if ( sigaction( SIGCHLD, &this->action, NULL ) < 0 )
+  {
+    perror( "sigaction: " );
+  }
 }
 
 void handler_destroy( handler_t* this )
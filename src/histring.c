@@ -0,0 +1,228 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "histring.h"
+
+_Static_assert( sizeof( histring_slot_t ) == HISTRING_SLOT_SIZE,
+                "a slot must be exactly HISTRING_SLOT_SIZE" );
+_Static_assert( ( HISTRING_CAPACITY & ( HISTRING_CAPACITY - 1 ) ) == 0,
+                "the capacity must be a power of two" );
+
+// how long to wait on another session that's still creating the
+// segment, in milliseconds
+#define HISTRING_CREATE_WAIT 1000
+
+// the size of the whole segment (the slots start on their own page)
+#define HISTRING_SLOTS_OFFSET 4096
+#define HISTRING_SIZE \
+  ( HISTRING_SLOTS_OFFSET + ( size_t ) HISTRING_CAPACITY * HISTRING_SLOT_SIZE )
+
+/**
+ * Sleeps for a millisecond, while waiting on another session.
+ */
+static void histring_pause()
+{
+  struct timespec pause = { 0, 1000000 };
+  nanosleep( &pause, NULL );
+}
+
+/**
+ * Opens the segment, creating (and sizing) it if it doesn't exist.
+ * [created] is set if it was created by us, in which case the caller
+ * fills in the header. Returns -1 on failure.
+ */
+static int histring_create( const char* path, bool* created )
+{
+  *created = false;
+
+  for ( ;; )
+  {
+    int fd = shm_open( path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600 );
+    if ( fd != -1 )
+    {
+      if ( ftruncate( fd, HISTRING_SIZE ) < 0 )
+      {
+        close( fd );
+        shm_unlink( path );
+        return -1;
+      }
+
+      *created = true;
+      return fd;
+    }
+    if ( errno != EEXIST ) return -1;
+
+    fd = shm_open( path, O_RDWR | O_CLOEXEC, 0 );
+    if ( fd != -1 ) return fd;
+
+    // (it was removed in between, so try creating it again)
+    if ( errno != ENOENT ) return -1;
+  }
+}
+
+histring_t* histring_open( const char* name )
+{
+  if ( name[ 0 ] == '\0' || strchr( name, '/' ) != NULL )
+  {
+    printf( "%s: not a shared history name\n", name );
+    return NULL;
+  }
+
+  char path[ 256 ];
+  snprintf( path, sizeof( path ), "/%s", name );
+
+  bool created;
+  int fd = histring_create( path, &created );
+  if ( fd == -1 )
+  {
+    perror( "shared history" );
+    return NULL;
+  }
+
+  // whoever created it may not have sized it yet
+  struct stat info;
+  info.st_size = 0;
+
+  int waited = 0;
+  while ( fstat( fd, &info ) == 0 && info.st_size < ( off_t ) HISTRING_SIZE
+       && waited++ < HISTRING_CREATE_WAIT )
+  {
+    histring_pause();
+  }
+
+  if ( info.st_size != HISTRING_SIZE )
+  {
+    printf( "%s: not a shared history segment\n", name );
+    close( fd );
+    return NULL;
+  }
+
+  void* map = mmap( NULL, HISTRING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    fd, 0 );
+  close( fd );
+
+  if ( map == MAP_FAILED )
+  {
+    perror( "shared history" );
+    return NULL;
+  }
+
+  histring_header_t* header = map;
+
+  // a new segment is all zeroes, i.e. an empty ring, so the header is
+  // all there is to set up (with the magic number last, to say it's
+  // ready)
+  if ( created )
+  {
+    header->version = HISTRING_VERSION;
+    header->capacity = HISTRING_CAPACITY;
+    header->slot_size = HISTRING_SLOT_SIZE;
+    atomic_store_explicit( &header->magic, HISTRING_MAGIC, memory_order_release );
+  }
+
+  waited = 0;
+  while ( atomic_load_explicit( &header->magic, memory_order_acquire ) == 0
+       && waited++ < HISTRING_CREATE_WAIT )
+  {
+    histring_pause();
+  }
+
+  if ( atomic_load_explicit( &header->magic, memory_order_acquire ) != HISTRING_MAGIC
+    || header->version != HISTRING_VERSION
+    || header->capacity != HISTRING_CAPACITY
+    || header->slot_size != HISTRING_SLOT_SIZE )
+  {
+    printf( "%s: not a shared history segment (or an incompatible one)\n", name );
+    munmap( map, HISTRING_SIZE );
+    return NULL;
+  }
+
+  histring_t* this = malloc( sizeof( *this ) );
+  this->header = header;
+  this->slots = ( histring_slot_t* ) ( ( char* ) map + HISTRING_SLOTS_OFFSET );
+  this->name = strdup( name );
+  return this;
+}
+
+void histring_close( histring_t* this )
+{
+  munmap( this->header, HISTRING_SIZE );
+  free( this->name );
+  free( this );
+}
+
+bool histring_append( histring_t* this, const char* text )
+{
+  uint64_t sequence = atomic_fetch_add_explicit( &this->header->next, 1,
+                                                 memory_order_relaxed );
+  histring_slot_t* slot = &this->slots[ sequence & ( HISTRING_CAPACITY - 1 ) ];
+
+  // claim the slot by marking it as being written, unless a writer
+  // from further around the ring already has
+  uint64_t writing = 2 * ( sequence + 1 ) - 1;
+  uint64_t current = atomic_load_explicit( &slot->sequence, memory_order_relaxed );
+  do
+  {
+    if ( current >= writing ) return false;
+  }
+  while ( !atomic_compare_exchange_weak_explicit( &slot->sequence, &current,
+                                                  writing,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed ) );
+
+  // (readers that see the new contents must also see the mark)
+  atomic_thread_fence( memory_order_release );
+
+  size_t length = strlen( text );
+  slot->pid = getpid();
+  slot->length = length;
+  slot->time = time( NULL );
+  memcpy( slot->text, text, length < HISTRING_TEXT ? length : HISTRING_TEXT );
+
+  // publish it, unless we were lapped while copying it in
+  return atomic_compare_exchange_strong_explicit( &slot->sequence, &writing,
+                                                  writing + 1,
+                                                  memory_order_release,
+                                                  memory_order_relaxed );
+}
+
+uint64_t histring_next( const histring_t* this )
+{
+  return atomic_load_explicit( &this->header->next, memory_order_acquire );
+}
+
+bool histring_read( const histring_t* this, uint64_t sequence,
+                    histring_entry_t* entry )
+{
+  histring_slot_t* slot = &this->slots[ sequence & ( HISTRING_CAPACITY - 1 ) ];
+  uint64_t published = 2 * ( sequence + 1 );
+
+  if ( atomic_load_explicit( &slot->sequence, memory_order_acquire ) != published )
+  {
+    return false;
+  }
+
+  size_t length = slot->length;
+  entry->sequence = sequence;
+  entry->pid = slot->pid;
+  entry->time = slot->time;
+  entry->truncated = length > HISTRING_TEXT;
+  if ( entry->truncated ) length = HISTRING_TEXT;
+  memcpy( entry->text, slot->text, length );
+  entry->text[ length ] = '\0';
+
+  // if it changed while we copied it, what we have could be torn
+  atomic_thread_fence( memory_order_acquire );
+  return atomic_load_explicit( &slot->sequence, memory_order_relaxed ) == published;
+}
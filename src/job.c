@@ -0,0 +1,135 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "job.h"
+#include "memstats.h"
+
+void job_table_init( job_table_t* this )
+{
+  this->head = NULL;
+  this->size = 0;
+}
+
+void job_table_destroy( job_table_t* this )
+{
+  while ( this->head != NULL )
+  {
+    job_t* job = this->head;
+
+    // stopped jobs die just as well to SIGKILL, so there's no need
+    // to continue them first (and the whole group gets it, so as to
+    // not leave any orphaned processes)
+    kill( -job->pid, SIGKILL );
+    waitpid( job->pid, NULL, 0 );
+
+    job_table_remove( this, job );
+  }
+}
+
+job_t* job_table_add( job_table_t* this, pid_t pid, job_state_t state )
+{
+  job_t* job = mem_malloc( MEM_JOBS, sizeof( *job ) );
+  job->pid = pid;
+  job->state = state;
+  job->next = NULL;
+  job->id = 1;
+  job->name = NULL;
+  job->input = -1;
+  job->output = -1;
+  buffer_init( &job->pending );
+  job->start = 0;
+
+  // ids only ever increase along the table, so the new job goes last
+  job_t** link = &this->head;
+  while ( *link != NULL )
+  {
+    job->id = ( *link )->id + 1;
+    link = &( *link )->next;
+  }
+  *link = job;
+
+  this->size += 1;
+  return job;
+}
+
+job_t* job_table_get( const job_table_t* this, unsigned int id )
+{
+  job_t* job;
+  for ( job = this->head; job != NULL; job = job->next )
+  {
+    if ( job->id == id ) return job;
+  }
+
+  return NULL;
+}
+
+job_t* job_table_last( const job_table_t* this, job_state_t state )
+{
+  job_t* last = NULL;
+
+  job_t* job;
+  for ( job = this->head; job != NULL; job = job->next )
+  {
+    if ( job->state == state ) last = job;
+  }
+
+  return last;
+}
+
+job_t* job_table_named( const job_table_t* this, const char* name )
+{
+  job_t* job;
+  for ( job = this->head; job != NULL; job = job->next )
+  {
+    if ( job->name != NULL && strcmp( job->name, name ) == 0 ) return job;
+  }
+
+  return NULL;
+}
+
+job_t* job_table_parse( const job_table_t* this, const char* spec )
+{
+  if ( spec[ 0 ] == '%' ) spec++;
+
+  char* end;
+  unsigned long id = strtoul( spec, &end, 10 );
+  job_t* job = NULL;
+
+  if ( end == spec || *end != '\0' )
+  {
+    printf( "%s: not a job id\n", spec );
+  }
+  else if ( ( job = job_table_get( this, id ) ) == NULL )
+  {
+    printf( "%%%lu: no such job\n", id );
+  }
+
+  return job;
+}
+
+void job_table_remove( job_table_t* this, job_t* job )
+{
+  job_t** link = &this->head;
+  while ( *link != job )
+  {
+    link = &( *link )->next;
+  }
+
+  *link = job->next;
+  this->size -= 1;
+
+  if ( job->input >= 0 ) close( job->input );
+  if ( job->output >= 0 ) close( job->output );
+  if ( job->name != NULL ) mem_free( MEM_JOBS, job->name );
+  buffer_destroy( &job->pending );
+
+  mem_free( MEM_JOBS, job );
+}
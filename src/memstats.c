@@ -0,0 +1,191 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdatomic.h>
+#include <malloc.h>
+#include <pthread.h>
+#include "memstats.h"
+
+static const char* const mem_tag_names[ MEM_TAGS ] =
+{
+  "lists", "tokens", "strings", "history", "jobs"
+};
+
+const char* mem_tag_name( mem_tag_t tag )
+{
+  return tag < MEM_TAGS ? mem_tag_names[ tag ] : "?";
+}
+
+#ifdef MEMSTATS
+
+/**
+ * One thread's counters. Only the thread itself ever changes them, so
+ * they're atomic just so `memstats` can read them from another one
+ * (and relaxed loads and stores of them are plain moves).
+ */
+typedef struct mem_thread_t mem_thread_t;
+struct mem_thread_t
+{
+  _Atomic int64_t live_bytes[ MEM_TAGS ];
+  _Atomic int64_t live_count[ MEM_TAGS ];
+  _Atomic int64_t peak_bytes[ MEM_TAGS ];
+  _Atomic int64_t total_count[ MEM_TAGS ];
+
+  /** The next thread's counters */
+  mem_thread_t* next;
+};
+
+// every thread's counters (which outlive their threads, since what
+// they allocated may not have been freed yet)
+static mem_thread_t* mem_threads = NULL;
+static pthread_mutex_t mem_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// this thread's counters (or NULL, until it first allocates)
+static _Thread_local mem_thread_t* mem_local = NULL;
+
+/**
+ * Adds [value] to one of this thread's counters.
+ */
+static inline int64_t mem_add( _Atomic int64_t* counter, int64_t value )
+{
+  int64_t result = atomic_load_explicit( counter, memory_order_relaxed ) + value;
+  atomic_store_explicit( counter, result, memory_order_relaxed );
+  return result;
+}
+
+/**
+ * Returns this thread's counters, making them the first time.
+ */
+static mem_thread_t* mem_thread( void )
+{
+  if ( mem_local != NULL ) return mem_local;
+
+  mem_thread_t* counters = calloc( 1, sizeof( *counters ) );
+
+  pthread_mutex_lock( &mem_threads_lock );
+  counters->next = mem_threads;
+  mem_threads = counters;
+  pthread_mutex_unlock( &mem_threads_lock );
+
+  mem_local = counters;
+  return counters;
+}
+
+/**
+ * Counts an allocation of [size] bytes against [tag] (or, if [count]
+ * is negative, takes one off).
+ */
+static void mem_count( mem_tag_t tag, size_t size, int count )
+{
+  mem_thread_t* counters = mem_thread();
+
+  int64_t live = mem_add( &counters->live_bytes[ tag ], count * ( int64_t ) size );
+  mem_add( &counters->live_count[ tag ], count );
+
+  if ( count > 0 )
+  {
+    mem_add( &counters->total_count[ tag ], 1 );
+    if ( live > atomic_load_explicit( &counters->peak_bytes[ tag ], memory_order_relaxed ) )
+    {
+      atomic_store_explicit( &counters->peak_bytes[ tag ], live, memory_order_relaxed );
+    }
+  }
+}
+
+void* mem_malloc( mem_tag_t tag, size_t size )
+{
+  void* pointer = malloc( size );
+  mem_adopt( tag, pointer );
+  return pointer;
+}
+
+void* mem_calloc( mem_tag_t tag, size_t count, size_t size )
+{
+  void* pointer = calloc( count, size );
+  mem_adopt( tag, pointer );
+  return pointer;
+}
+
+char* mem_strdup( mem_tag_t tag, const char* string )
+{
+  char* copy = strdup( string );
+  mem_adopt( tag, copy );
+  return copy;
+}
+
+char* mem_strndup( mem_tag_t tag, const char* string, size_t length )
+{
+  char* copy = strndup( string, length );
+  mem_adopt( tag, copy );
+  return copy;
+}
+
+void mem_free( mem_tag_t tag, void* pointer )
+{
+  if ( pointer == NULL ) return;
+
+  mem_count( tag, malloc_usable_size( pointer ), -1 );
+  free( pointer );
+}
+
+void mem_adopt( mem_tag_t tag, void* pointer )
+{
+  if ( pointer == NULL ) return;
+
+  mem_count( tag, malloc_usable_size( pointer ), 1 );
+}
+
+void mem_retag( mem_tag_t from, mem_tag_t to, void* pointer )
+{
+  if ( pointer == NULL || from == to ) return;
+
+  size_t size = malloc_usable_size( pointer );
+  mem_count( from, size, -1 );
+  mem_count( to, size, 1 );
+
+  // (it isn't a new allocation, just a moved one)
+  mem_add( &mem_thread()->total_count[ to ], -1 );
+}
+
+bool mem_snapshot( mem_stats_t stats[ MEM_TAGS ] )
+{
+  memset( stats, 0, sizeof( mem_stats_t ) * MEM_TAGS );
+
+  pthread_mutex_lock( &mem_threads_lock );
+
+  // (peaks are each thread's own, added up, so they're exact as long
+  // as only one thread allocates under a tag)
+  const mem_thread_t* counters;
+  for ( counters = mem_threads; counters != NULL; counters = counters->next )
+  {
+    unsigned int tag;
+    for ( tag = 0; tag < MEM_TAGS; tag++ )
+    {
+      stats[ tag ].live_bytes += atomic_load_explicit( &counters->live_bytes[ tag ],
+                                                       memory_order_relaxed );
+      stats[ tag ].live_count += atomic_load_explicit( &counters->live_count[ tag ],
+                                                       memory_order_relaxed );
+      stats[ tag ].peak_bytes += atomic_load_explicit( &counters->peak_bytes[ tag ],
+                                                       memory_order_relaxed );
+      stats[ tag ].total_count += atomic_load_explicit( &counters->total_count[ tag ],
+                                                        memory_order_relaxed );
+    }
+  }
+
+  pthread_mutex_unlock( &mem_threads_lock );
+  return true;
+}
+
+#else
+
+bool mem_snapshot( mem_stats_t stats[ MEM_TAGS ] )
+{
+  memset( stats, 0, sizeof( mem_stats_t ) * MEM_TAGS );
+  return false;
+}
+
+#endif
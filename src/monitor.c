@@ -0,0 +1,469 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "monitor.h"
+
+// how much of each /proc file is read (they're only read as far as
+// the fields we need)
+#define MONITOR_STAT_READ 512
+#define MONITOR_STATM_READ 64
+#define MONITOR_IO_READ 64
+#define MONITOR_CHILDREN_READ 4096
+
+/**
+ * Opens /proc/<pid>/<file> to be re-read by each sample.
+ */
+static int monitor_open( pid_t pid, const char* file )
+{
+  char path[ PATH_MAX ];
+  snprintf( path, sizeof( path ), "/proc/%d/%s", pid, file );
+  return open( path, O_RDONLY | O_CLOEXEC );
+}
+
+/**
+ * Reads the start of an open /proc file (from the beginning, since
+ * /proc regenerates it on every read at offset zero) into [buffer],
+ * NUL-terminating it. Returns [false] if the process is gone.
+ */
+static bool monitor_read( int fd, char* buffer, size_t size )
+{
+  if ( fd == -1 ) return false;
+
+  ssize_t length = pread( fd, buffer, size - 1, 0 );
+  if ( length <= 0 ) return false;
+
+  buffer[ length ] = '\0';
+  return true;
+}
+
+/**
+ * Gets the entry's record of the given process, opening its files if
+ * it's new to the group (with its CPU time taken as a starting point,
+ * so none of it counts towards the first sample).
+ */
+static monitor_process_t* monitor_process( monitor_entry_t* this, pid_t pid )
+{
+  unsigned int i;
+  for ( i = 0; i < this->count; i++ )
+  {
+    if ( this->processes[ i ].pid == pid ) return &this->processes[ i ];
+  }
+
+  if ( this->count == this->capacity )
+  {
+    this->capacity = this->capacity == 0 ? 4 : this->capacity * 2;
+    this->processes = realloc( this->processes,
+                               this->capacity * sizeof( monitor_process_t ) );
+  }
+
+  char children[ 64 ];
+  snprintf( children, sizeof( children ), "task/%d/children", pid );
+
+  monitor_process_t* process = &this->processes[ this->count++ ];
+  process->pid = pid;
+  process->stat_fd = monitor_open( pid, "stat" );
+  process->statm_fd = monitor_open( pid, "statm" );
+  process->io_fd = monitor_open( pid, "io" );
+  process->children_fd = monitor_open( pid, children );
+  process->ticks = ULLONG_MAX;
+  process->seen = false;
+
+  return process;
+}
+
+/**
+ * Closes a process' files.
+ */
+static void monitor_process_close( monitor_process_t* this )
+{
+  if ( this->stat_fd != -1 ) close( this->stat_fd );
+  if ( this->statm_fd != -1 ) close( this->statm_fd );
+  if ( this->io_fd != -1 ) close( this->io_fd );
+  if ( this->children_fd != -1 ) close( this->children_fd );
+}
+
+/**
+ * Samples a single process of the entry's group, adding what it's
+ * using onto the entry's totals (and its CPU time since the last
+ * sample onto [ticks]), and its children onto [pending]. Returns
+ * [false] if it's gone, or isn't in the group after all.
+ */
+static bool monitor_sample_process( monitor_entry_t* this,
+                                    monitor_process_t* process,
+                                    unsigned long long* ticks,
+                                    buffer_t* pending )
+{
+  char buffer[ MONITOR_CHILDREN_READ ];
+
+  if ( !monitor_read( process->stat_fd, buffer, MONITOR_STAT_READ ) )
+  {
+    return false;
+  }
+
+  // the name is in parentheses, and can contain anything (even
+  // parentheses), so the fields are only counted after the last one
+  char* open = strchr( buffer, '(' );
+  char* close = strrchr( buffer, ')' );
+  if ( open == NULL || close == NULL ) return false;
+
+  char state = '?';
+  int group = 0;
+  unsigned long long utime = 0, stime = 0;
+  sscanf( close + 2, "%c %*d %d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+          &state, &group, &utime, &stime );
+
+  // (a child which has made a group of its own is its own business,
+  // e.g. one of a nested shell's jobs)
+  if ( group != this->pid && process->pid != this->pid ) return false;
+
+  if ( process->pid == this->pid )
+  {
+    size_t length = close - open - 1;
+    if ( length >= sizeof( this->name ) ) length = sizeof( this->name ) - 1;
+    memcpy( this->name, open + 1, length );
+    this->name[ length ] = '\0';
+    this->state = state;
+  }
+  else if ( this->state == '-' || this->state == 'Z' )
+  {
+    // the leader's gone, so the group's state is that of whoever's left
+    this->state = state;
+  }
+
+  unsigned long long used = utime + stime;
+  if ( process->ticks != ULLONG_MAX && used > process->ticks )
+  {
+    *ticks += used - process->ticks;
+  }
+  process->ticks = used;
+
+  if ( monitor_read( process->statm_fd, buffer, MONITOR_STATM_READ ) )
+  {
+    unsigned long long pages = 0;
+    sscanf( buffer, "%*u %llu", &pages );
+    this->rss += pages * sysconf( _SC_PAGESIZE );
+  }
+
+  // (io is only readable by whoever could ptrace the process, so it
+  // may not be there at all)
+  if ( monitor_read( process->io_fd, buffer, MONITOR_IO_READ ) )
+  {
+    unsigned long long reads = 0, writes = 0;
+    sscanf( buffer, "rchar: %llu wchar: %llu", &reads, &writes );
+    this->read_bytes += reads;
+    this->write_bytes += writes;
+  }
+
+  if ( monitor_read( process->children_fd, buffer, sizeof( buffer ) ) )
+  {
+    char* current = buffer;
+    char* end;
+    long child;
+    while ( ( child = strtol( current, &end, 10 ) ) > 0 )
+    {
+      pid_t pid = child;
+      buffer_append( pending, &pid, sizeof( pid ) );
+      current = end;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Takes a sample of a single entry, [elapsed] seconds after its last
+ * one, by walking its group down from its leader.
+ */
+static void monitor_sample_entry( monitor_entry_t* this, double elapsed )
+{
+  this->state = '-';
+  this->rss = 0;
+  this->read_bytes = 0;
+  this->write_bytes = 0;
+
+  unsigned int i;
+  for ( i = 0; i < this->count; i++ )
+  {
+    this->processes[ i ].seen = false;
+  }
+
+  unsigned long long ticks = 0;
+  buffer_t pending;
+  buffer_init( &pending );
+  buffer_append( &pending, &this->pid, sizeof( this->pid ) );
+
+  while ( pending.size > 0 )
+  {
+    pending.size -= sizeof( pid_t );
+    pid_t pid = *( pid_t* ) ( pending.data + pending.size );
+
+    monitor_process_t* process = monitor_process( this, pid );
+    if ( !process->seen )
+    {
+      process->seen = monitor_sample_process( this, process, &ticks, &pending );
+    }
+  }
+  buffer_destroy( &pending );
+
+  // whatever's no longer in the group is forgotten
+  i = 0;
+  while ( i < this->count )
+  {
+    if ( this->processes[ i ].seen )
+    {
+      i++;
+      continue;
+    }
+
+    monitor_process_close( &this->processes[ i ] );
+    this->processes[ i ] = this->processes[ --this->count ];
+  }
+
+  this->alive = this->count > 0;
+  this->cpu = elapsed > 0
+    ? ticks * 100.0 / ( sysconf( _SC_CLK_TCK ) * elapsed )
+    : 0;
+}
+
+/**
+ * Formats a number of bytes for people to read, e.g. 1.5M.
+ */
+static void monitor_format_size( char* out, size_t size,
+                                 unsigned long long bytes )
+{
+  static const char units[] = "BKMGT";
+
+  double value = bytes;
+  unsigned int unit = 0;
+  while ( value >= 1024 && unit + 1 < sizeof( units ) - 1 )
+  {
+    value /= 1024;
+    unit += 1;
+  }
+
+  if ( unit == 0 )
+  {
+    snprintf( out, size, "%lluB", bytes );
+  }
+  else
+  {
+    snprintf( out, size, "%.1f%c", value, units[ unit ] );
+  }
+}
+
+/**
+ * Appends a line to the frame, clearing whatever was left on the
+ * terminal's line from the previous frame.
+ */
+static void monitor_line( monitor_t* this, const char* line )
+{
+  buffer_append( &this->frame, line, strlen( line ) );
+  if ( this->in_place )
+  {
+    buffer_append( &this->frame, "\x1B[K", 3 );
+  }
+  buffer_append( &this->frame, "\n", 1 );
+  this->lines += 1;
+}
+
+void monitor_init( monitor_t* this, const job_table_t* jobs )
+{
+  this->entries = calloc( jobs->size + 1, sizeof( monitor_entry_t ) );
+  this->count = 0;
+  this->lines = 0;
+  this->in_place = isatty( STDOUT_FILENO );
+  buffer_init( &this->frame );
+
+  const job_t* job;
+  for ( job = jobs->head; job != NULL; job = job->next )
+  {
+    monitor_entry_t* entry = &this->entries[ this->count++ ];
+    entry->id = job->id;
+    entry->pid = job->pid;
+    entry->processes = NULL;
+    entry->count = 0;
+    entry->capacity = 0;
+    strcpy( entry->name, "?" );
+
+    monitor_sample_entry( entry, 0 );
+  }
+
+  clock_gettime( CLOCK_MONOTONIC, &this->sampled );
+}
+
+void monitor_destroy( monitor_t* this )
+{
+  unsigned int i;
+  for ( i = 0; i < this->count; i++ )
+  {
+    monitor_entry_t* entry = &this->entries[ i ];
+
+    unsigned int j;
+    for ( j = 0; j < entry->count; j++ )
+    {
+      monitor_process_close( &entry->processes[ j ] );
+    }
+    free( entry->processes );
+  }
+
+  free( this->entries );
+  buffer_destroy( &this->frame );
+}
+
+bool monitor_sample( monitor_t* this )
+{
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  double elapsed = ( now.tv_sec - this->sampled.tv_sec )
+                 + ( now.tv_nsec - this->sampled.tv_nsec ) / 1e9;
+  this->sampled = now;
+
+  bool any = false;
+
+  unsigned int i;
+  for ( i = 0; i < this->count; i++ )
+  {
+    monitor_sample_entry( &this->entries[ i ], elapsed );
+
+    // zombies are as good as gone, they just haven't been reaped yet
+    if ( this->entries[ i ].alive && this->entries[ i ].state != 'Z' )
+    {
+      any = true;
+    }
+  }
+
+  return any;
+}
+
+void monitor_draw( monitor_t* this )
+{
+  this->frame.size = 0;
+
+  // go back up over the last frame, and draw on top of it
+  if ( this->in_place && this->lines > 0 )
+  {
+    char up[ 32 ];
+    int length = snprintf( up, sizeof( up ), "\x1B[%uA\r", this->lines );
+    buffer_append( &this->frame, up, length );
+  }
+  this->lines = 0;
+
+  char line[ 128 ];
+  snprintf( line, sizeof( line ), "%-5s %7s %1s %6s %8s %8s %8s %s",
+            "JOB", "PID", "S", "CPU%", "RSS", "READ", "WRITE", "COMMAND" );
+  monitor_line( this, line );
+
+  unsigned int i;
+  for ( i = 0; i < this->count; i++ )
+  {
+    const monitor_entry_t* entry = &this->entries[ i ];
+
+    char id[ 16 ], rss[ 16 ], reads[ 16 ], writes[ 16 ], name[ 32 ];
+    snprintf( id, sizeof( id ), "[%u]", entry->id );
+
+    // (the rest of the group is counted in, but only its leader named)
+    if ( entry->count > 1 )
+    {
+      snprintf( name, sizeof( name ), "%s (+%u)", entry->name, entry->count - 1 );
+    }
+    else
+    {
+      snprintf( name, sizeof( name ), "%s", entry->name );
+    }
+    monitor_format_size( rss, sizeof( rss ), entry->rss );
+    monitor_format_size( reads, sizeof( reads ), entry->read_bytes );
+    monitor_format_size( writes, sizeof( writes ), entry->write_bytes );
+
+    snprintf( line, sizeof( line ), "%-5s %7d %c %6.1f %8s %8s %8s %s",
+              id, entry->pid, entry->state, entry->cpu,
+              rss, reads, writes, name );
+    monitor_line( this, line );
+  }
+
+  // without a terminal to draw over, frames are just separated
+  if ( !this->in_place )
+  {
+    monitor_line( this, "" );
+  }
+
+  // the whole frame goes out in one write, so it's never seen half drawn
+  fflush( stdout );
+
+  size_t written = 0;
+  while ( written < this->frame.size )
+  {
+    ssize_t count = write( STDOUT_FILENO, this->frame.data + written,
+                           this->frame.size - written );
+    if ( count < 0 && errno == EINTR ) continue;
+    if ( count <= 0 ) break;
+    written += count;
+  }
+}
+
+void monitor_run( const job_table_t* jobs, double interval, unsigned int frames )
+{
+  int timer = timerfd_create( CLOCK_MONOTONIC, TFD_CLOEXEC );
+  if ( timer == -1 )
+  {
+    perror( "timerfd_create" );
+    return;
+  }
+
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = ( time_t ) interval;
+  spec.it_interval.tv_nsec = ( long ) ( ( interval - spec.it_interval.tv_sec ) * 1e9 );
+  spec.it_value = spec.it_interval;
+  timerfd_settime( timer, 0, &spec, NULL );
+
+  monitor_t monitor;
+  monitor_init( &monitor, jobs );
+  monitor_draw( &monitor );
+  unsigned int drawn = 1;
+
+  // only a terminal is watched for enter, a script's next lines
+  // shouldn't be mistaken for the user wanting to stop
+  struct pollfd fds[ 2 ] = {
+    { .fd = timer, .events = POLLIN },
+    { .fd = STDIN_FILENO, .events = POLLIN }
+  };
+  nfds_t count = isatty( STDIN_FILENO ) ? 2 : 1;
+
+  while ( frames == 0 || drawn < frames )
+  {
+    // (^C interrupts the poll, which stops the monitor too)
+    if ( poll( fds, count, -1 ) < 0 ) break;
+
+    if ( count > 1 && fds[ 1 ].revents != 0 )
+    {
+      // swallow the line, so it isn't run as a command afterwards
+      char discard[ 256 ];
+      read( STDIN_FILENO, discard, sizeof( discard ) );
+      break;
+    }
+
+    uint64_t expirations;
+    if ( read( timer, &expirations, sizeof( expirations ) ) < 0 ) continue;
+
+    bool alive = monitor_sample( &monitor );
+    monitor_draw( &monitor );
+    drawn += 1;
+
+    if ( !alive ) break;
+  }
+
+  monitor_destroy( &monitor );
+  close( timer );
+}
@@ -3,16 +3,62 @@
  * Id:   1001311620
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <string.h>
 #include "command.h"
 #include "shell.h"
+#include "server.h"
+#include "tasks.h"
 
-int main()
+int main( int argc, char** argv )
 {
+  // msh --serve SOCKET => serve sessions to clients
+  if ( argc == 3 && strcmp( argv[ 1 ], "--serve" ) == 0 )
+  {
+    return server_run( argv[ 2 ] );
+  }
+  // msh --connect SOCKET [COMMAND]... => run commands in a session
+  if ( argc >= 3 && strcmp( argv[ 1 ], "--connect" ) == 0 )
+  {
+    return server_connect( argv[ 2 ], argv + 3, argc - 3 );
+  }
+  // msh --tasks FILE [-j N] => run the tasks in FILE, N at a time
+  if ( ( argc == 3 || argc == 5 ) && strcmp( argv[ 1 ], "--tasks" ) == 0 )
+  {
+    long jobs = sysconf( _SC_NPROCESSORS_ONLN );
+    if ( argc == 5 )
+    {
+      jobs = strcmp( argv[ 3 ], "-j" ) == 0 ? strtol( argv[ 4 ], NULL, 10 ) : 0;
+    }
+    if ( jobs > 0 )
+    {
+      return tasks_run( argv[ 2 ], jobs );
+    }
+  }
+  // msh --restore FILE => carry on from a `snapshot save FILE`
+  const char* restore = NULL;
+  if ( argc == 3 && strcmp( argv[ 1 ], "--restore" ) == 0 )
+  {
+    restore = argv[ 2 ];
+  }
+  else if ( argc > 1 )
+  {
+    printf( "usage: msh [--serve SOCKET | --connect SOCKET [COMMAND]..."
+            " | --restore FILE | --tasks FILE [-j N]]\n" );
+    return 2;
+  }
+
   shell_t* shell = malloc( sizeof( *shell ) );
   shell_init( shell );
   shell_set_active( shell );
 
+  // (if it can't be, this is just a new session)
+  if ( restore != NULL )
+  {
+    shell_restore( shell, restore );
+  }
+
   // never have to worry about deleting the command,a
   // as its ownership is passed off into the shell
   // by shell_run_command.
@@ -20,8 +66,11 @@ int main()
   do
   {
     shell_wait( shell );
+    shell_reap( shell );
     fflush( stdout );
 
+    shell_prompt( shell );
+
     command = malloc( sizeof( *command ) );
     command_init( command );
     command_read( command );
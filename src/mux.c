@@ -0,0 +1,351 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mux.h"
+#include "memstats.h"
+
+/**
+ * Writes all of [data] to stdout.
+ */
+static void mux_write( const char* data, size_t length )
+{
+  size_t written = 0;
+  while ( written < length )
+  {
+    ssize_t count = write( STDOUT_FILENO, data + written, length - written );
+    if ( count < 0 && errno == EINTR ) continue;
+    if ( count <= 0 ) break;
+    written += count;
+  }
+}
+
+/**
+ * Keeps a line in the job's ring, dropping its oldest output to make
+ * room if needed.
+ */
+static void mux_keep( mux_job_t* job, const char* data, size_t length )
+{
+  // (only the end of anything bigger than the whole ring would survive)
+  if ( length > MUX_RING_SIZE )
+  {
+    data += length - MUX_RING_SIZE;
+    length = MUX_RING_SIZE;
+  }
+
+  // copy it in (in two pieces, if it wraps around the end)
+  size_t end = ( job->ring_start + job->ring_size ) % MUX_RING_SIZE;
+  size_t first = MUX_RING_SIZE - end < length ? MUX_RING_SIZE - end : length;
+  memcpy( job->ring + end, data, first );
+  memcpy( job->ring, data + first, length - first );
+
+  job->ring_size += length;
+  if ( job->ring_size > MUX_RING_SIZE )
+  {
+    job->ring_start = ( job->ring_start + job->ring_size - MUX_RING_SIZE )
+                    % MUX_RING_SIZE;
+    job->ring_size = MUX_RING_SIZE;
+  }
+}
+
+/**
+ * Queues up a single line of a job's output (without its line
+ * ending), and keeps it in the job's ring.
+ */
+static void mux_line( mux_t* this, mux_job_t* job, unsigned int stream,
+                      const char* data, size_t length )
+{
+  char tag[ 32 ];
+  int size = snprintf( tag, sizeof( tag ), stream == 0 ? "[%u] " : "[%u]! ",
+                       job->id );
+
+  buffer_append( &this->out, tag, size );
+  buffer_append( &this->out, data, length );
+  buffer_append( &this->out, "\n", 1 );
+
+  mux_keep( job, data, length );
+  mux_keep( job, "\n", 1 );
+}
+
+/**
+ * Splits what was read from a stream into lines, holding on to the
+ * last one if it isn't finished yet.
+ */
+static void mux_split( mux_t* this, mux_job_t* job, unsigned int stream,
+                       const char* data, size_t length )
+{
+  buffer_t* partial = &job->streams[ stream ].partial;
+
+  const char* end;
+  while ( ( end = memchr( data, '\n', length ) ) != NULL )
+  {
+    size_t line = end - data;
+
+    if ( partial->size > 0 )
+    {
+      buffer_append( partial, data, line );
+      mux_line( this, job, stream, partial->data, partial->size );
+      partial->size = 0;
+    }
+    else
+    {
+      mux_line( this, job, stream, data, line );
+    }
+
+    data += line + 1;
+    length -= line + 1;
+  }
+
+  buffer_append( partial, data, length );
+
+  // a line that never ends still has to come out at some point
+  if ( partial->size >= MUX_LINE_MAX )
+  {
+    mux_line( this, job, stream, partial->data, partial->size );
+    partial->size = 0;
+  }
+}
+
+/**
+ * Closes one of a job's pipes, letting out whatever was left of its
+ * last line.
+ */
+static void mux_close( mux_t* this, mux_job_t* job, unsigned int stream )
+{
+  mux_stream_t* current = &job->streams[ stream ];
+
+  if ( current->partial.size > 0 )
+  {
+    mux_line( this, job, stream, current->partial.data, current->partial.size );
+    current->partial.size = 0;
+  }
+
+  if ( current->fd != -1 )
+  {
+    close( current->fd );
+    current->fd = -1;
+  }
+}
+
+/**
+ * Frees a job, closing its pipes.
+ */
+static void mux_free( mux_job_t* job )
+{
+  unsigned int stream;
+  for ( stream = 0; stream < 2; stream++ )
+  {
+    if ( job->streams[ stream ].fd != -1 ) close( job->streams[ stream ].fd );
+    buffer_destroy( &job->streams[ stream ].partial );
+  }
+
+  mem_free( MEM_JOBS, job->ring );
+  mem_free( MEM_JOBS, job );
+}
+
+void mux_init( mux_t* this )
+{
+  this->jobs = NULL;
+  buffer_init( &this->out );
+  this->chunk = malloc( MUX_READ_SIZE );
+}
+
+void mux_destroy( mux_t* this )
+{
+  while ( this->jobs != NULL )
+  {
+    mux_job_t* job = this->jobs;
+    this->jobs = job->next;
+    mux_free( job );
+  }
+
+  buffer_destroy( &this->out );
+  free( this->chunk );
+}
+
+bool mux_pipes( int read[ 2 ], int write[ 2 ] )
+{
+  int out[ 2 ], err[ 2 ];
+
+  if ( pipe2( out, O_CLOEXEC ) < 0 )
+  {
+    perror( "pipe" );
+    return false;
+  }
+  if ( pipe2( err, O_CLOEXEC ) < 0 )
+  {
+    perror( "pipe" );
+    close( out[ 0 ] );
+    close( out[ 1 ] );
+    return false;
+  }
+
+  read[ 0 ] = out[ 0 ];
+  read[ 1 ] = err[ 0 ];
+  write[ 0 ] = out[ 1 ];
+  write[ 1 ] = err[ 1 ];
+
+  // (draining must never block the shell)
+  fcntl( read[ 0 ], F_SETFL, O_NONBLOCK );
+  fcntl( read[ 1 ], F_SETFL, O_NONBLOCK );
+
+  return true;
+}
+
+void mux_add( mux_t* this, unsigned int id, const int read[ 2 ] )
+{
+  // whatever was kept of an older job with the same id goes
+  mux_job_t** link = &this->jobs;
+  while ( *link != NULL )
+  {
+    if ( ( *link )->id == id )
+    {
+      mux_job_t* old = *link;
+      *link = old->next;
+      mux_free( old );
+    }
+    else
+    {
+      link = &( *link )->next;
+    }
+  }
+
+  mux_job_t* job = mem_malloc( MEM_JOBS, sizeof( *job ) );
+  job->id = id;
+  job->ring = mem_malloc( MEM_JOBS, MUX_RING_SIZE );
+  job->ring_start = 0;
+  job->ring_size = 0;
+
+  unsigned int stream;
+  for ( stream = 0; stream < 2; stream++ )
+  {
+    job->streams[ stream ].fd = read[ stream ];
+    buffer_init( &job->streams[ stream ].partial );
+  }
+
+  job->next = this->jobs;
+  this->jobs = job;
+}
+
+unsigned int mux_poll_fds( const mux_t* this, struct pollfd* fds, unsigned int max )
+{
+  unsigned int count = 0;
+
+  const mux_job_t* job;
+  for ( job = this->jobs; job != NULL; job = job->next )
+  {
+    unsigned int stream;
+    for ( stream = 0; stream < 2 && count < max; stream++ )
+    {
+      if ( job->streams[ stream ].fd == -1 ) continue;
+
+      fds[ count ].fd = job->streams[ stream ].fd;
+      fds[ count ].events = POLLIN;
+      fds[ count ].revents = 0;
+      count += 1;
+    }
+  }
+
+  return count;
+}
+
+unsigned int mux_count( const mux_t* this )
+{
+  unsigned int count = 0;
+
+  const mux_job_t* job;
+  for ( job = this->jobs; job != NULL; job = job->next )
+  {
+    count += ( job->streams[ 0 ].fd != -1 ) + ( job->streams[ 1 ].fd != -1 );
+  }
+
+  return count;
+}
+
+bool mux_drain( mux_t* this )
+{
+  bool changed = false;
+
+  mux_job_t* job;
+  for ( job = this->jobs; job != NULL; job = job->next )
+  {
+    unsigned int stream;
+    for ( stream = 0; stream < 2; stream++ )
+    {
+      while ( job->streams[ stream ].fd != -1 )
+      {
+        ssize_t length = read( job->streams[ stream ].fd, this->chunk,
+                               MUX_READ_SIZE );
+
+        if ( length > 0 )
+        {
+          mux_split( this, job, stream, this->chunk, length );
+        }
+        else if ( length == 0 || errno != EINTR )
+        {
+          // (the end of the pipe, i.e. the job is finished with it)
+          if ( length == 0 || errno != EAGAIN )
+          {
+            mux_close( this, job, stream );
+            changed = true;
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  if ( this->out.size > 0 )
+  {
+    // (anything the shell printed itself comes first)
+    fflush( stdout );
+    mux_write( this->out.data, this->out.size );
+    this->out.size = 0;
+    changed = true;
+  }
+
+  return changed;
+}
+
+bool mux_replay( const mux_t* this, unsigned int id )
+{
+  const mux_job_t* job;
+  for ( job = this->jobs; job != NULL && job->id != id; job = job->next );
+
+  if ( job == NULL ) return false;
+
+  size_t start = job->ring_start;
+  size_t size = job->ring_size;
+
+  // if the ring has come around, the oldest line is probably only the
+  // end of one, so it's skipped
+  if ( size == MUX_RING_SIZE )
+  {
+    while ( size > 0 && job->ring[ start ] != '\n' )
+    {
+      start = ( start + 1 ) % MUX_RING_SIZE;
+      size -= 1;
+    }
+    if ( size > 0 )
+    {
+      start = ( start + 1 ) % MUX_RING_SIZE;
+      size -= 1;
+    }
+  }
+
+  fflush( stdout );
+
+  size_t first = MUX_RING_SIZE - start < size ? MUX_RING_SIZE - start : size;
+  mux_write( job->ring + start, first );
+  mux_write( job->ring, size - first );
+
+  return true;
+}
@@ -0,0 +1,726 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "pathglob.h"
+
+// how much we ask the kernel for per getdents64 call; big enough that
+// even huge directories are read in a handful of syscalls
+#define DENTS_SIZE ( 1 << 20 )
+
+/**
+ * The layout the kernel writes for getdents64 (glibc doesn't
+ * export this).
+ */
+struct linux_dirent64
+{
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+//
+// Pattern compilation
+//
+
+bool glob_has_magic( const char* word )
+{
+  for ( ; *word != '\0'; word++ )
+  {
+    if ( *word == '\\' && word[ 1 ] != '\0' )
+    {
+      word++;
+    }
+    else if ( *word == '*' || *word == '?' || *word == '[' )
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Tries to compile the bracket expression starting at [text] (which
+ * points at the '['). Returns a pointer to the closing ']', or NULL if
+ * the expression isn't terminated (in which case the '[' is literal).
+ */
+static const char* glob_compile_class( glob_op_t* op, const char* text,
+                                       const char* end )
+{
+  const char* current = text + 1;
+
+  memset( op, 0, sizeof( *op ) );
+  op->kind = GLOB_OP_CLASS;
+
+  if ( current < end && ( *current == '!' || *current == '^' ) )
+  {
+    op->negate = true;
+    current++;
+  }
+
+  // a ']' right at the start is a member, not the terminator
+  bool first = true;
+  for ( ; current < end; current++ )
+  {
+    if ( *current == ']' && !first )
+    {
+      return current;
+    }
+    first = false;
+
+    unsigned char low = *current;
+    if ( low == '\\' && current + 1 < end )
+    {
+      low = *++current;
+    }
+
+    unsigned char high = low;
+    if ( current + 2 < end && current[ 1 ] == '-' && current[ 2 ] != ']' )
+    {
+      high = current[ 2 ];
+      current += 2;
+    }
+
+    unsigned int c;
+    for ( c = low; c <= high; c++ )
+    {
+      op->set[ c >> 3 ] |= 1 << ( c & 7 );
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Compiles the segment of the pattern between [text] and [end].
+ */
+static void glob_compile_segment( glob_segment_t* this, const char* text,
+                                  const char* end )
+{
+  size_t length = end - text;
+
+  this->ops = calloc( length + 1, sizeof( glob_op_t ) );
+  this->count = 0;
+  this->literal = NULL;
+  this->recursive = ( length == 2 && text[ 0 ] == '*' && text[ 1 ] == '*' );
+  this->dot = ( length > 0 && text[ 0 ] == '.' );
+
+  bool magic = false;
+  const char* current = text;
+  for ( ; current < end; current++ )
+  {
+    glob_op_t* op = &this->ops[ this->count ];
+
+    if ( *current == '\\' && current + 1 < end )
+    {
+      current++;
+      op->kind = GLOB_OP_LITERAL;
+      op->c = *current;
+    }
+    else if ( *current == '?' )
+    {
+      op->kind = GLOB_OP_ANY;
+      magic = true;
+    }
+    else if ( *current == '*' )
+    {
+      // runs of stars are the same as a single star
+      if ( this->count > 0 && op[ -1 ].kind == GLOB_OP_STAR ) continue;
+      op->kind = GLOB_OP_STAR;
+      magic = true;
+    }
+    else if ( *current == '[' )
+    {
+      const char* close = glob_compile_class( op, current, end );
+      if ( close == NULL )
+      {
+        memset( op, 0, sizeof( *op ) );
+        op->kind = GLOB_OP_LITERAL;
+        op->c = '[';
+      }
+      else
+      {
+        current = close;
+        magic = true;
+      }
+    }
+    else
+    {
+      op->kind = GLOB_OP_LITERAL;
+      op->c = *current;
+    }
+
+    this->count += 1;
+  }
+
+  // segments without any magic are just names, so we can skip
+  // listing the directory entirely for them
+  if ( !magic )
+  {
+    this->literal = calloc( this->count + 1, sizeof( char ) );
+    size_t i;
+    for ( i = 0; i < this->count; i++ )
+    {
+      this->literal[ i ] = this->ops[ i ].c;
+    }
+  }
+}
+
+void glob_pattern_compile( glob_pattern_t* this, const char* pattern )
+{
+  this->absolute = ( pattern[ 0 ] == '/' );
+  this->directory = false;
+  this->segments = NULL;
+  this->count = 0;
+
+  size_t capacity = 0;
+  const char* current = pattern;
+  while ( *current != '\0' )
+  {
+    // skip over any separators
+    while ( *current == '/' )
+    {
+      current++;
+    }
+
+    if ( *current == '\0' )
+    {
+      this->directory = ( current != pattern );
+      break;
+    }
+
+    const char* end = current;
+    while ( *end != '\0' && *end != '/' )
+    {
+      if ( *end == '\\' && end[ 1 ] != '\0' ) end++;
+      end++;
+    }
+
+    if ( this->count == capacity )
+    {
+      capacity = capacity == 0 ? 4 : capacity * 2;
+      this->segments = realloc( this->segments,
+                                capacity * sizeof( glob_segment_t ) );
+    }
+
+    glob_compile_segment( &this->segments[ this->count ], current, end );
+    this->count += 1;
+
+    current = end;
+  }
+}
+
+void glob_pattern_destroy( glob_pattern_t* this )
+{
+  size_t i;
+  for ( i = 0; i < this->count; i++ )
+  {
+    free( this->segments[ i ].ops );
+    free( this->segments[ i ].literal );
+  }
+
+  free( this->segments );
+  memset( this, 0, sizeof( *this ) );
+}
+
+//
+// Matching
+//
+
+static bool glob_op_matches( const glob_op_t* op, unsigned char c )
+{
+  switch ( op->kind )
+  {
+    case GLOB_OP_LITERAL:
+      return op->c == c;
+
+    case GLOB_OP_ANY:
+      return true;
+
+    case GLOB_OP_CLASS:
+      return ( ( op->set[ c >> 3 ] >> ( c & 7 ) ) & 1 ) != op->negate;
+
+    default:
+      return false;
+  }
+}
+
+/**
+ * Matches a name against a compiled segment. This only ever has to
+ * remember the most recent star, so it runs in O(ops * name) at worst
+ * without any recursion.
+ */
+static bool glob_segment_matches( const glob_segment_t* this, const char* name )
+{
+  // dotfiles only match if the segment explicitly asks for them
+  if ( name[ 0 ] == '.' && !this->dot ) return false;
+
+  size_t op = 0;
+  const char* current = name;
+
+  size_t star_op = SIZE_MAX;
+  const char* star_name = NULL;
+
+  while ( *current != '\0' )
+  {
+    if ( op < this->count && this->ops[ op ].kind == GLOB_OP_STAR )
+    {
+      star_op = op++;
+      star_name = current;
+    }
+    else if ( op < this->count
+           && glob_op_matches( &this->ops[ op ], *current ) )
+    {
+      op++;
+      current++;
+    }
+    else if ( star_op != SIZE_MAX )
+    {
+      // let the last star swallow one more character and retry
+      op = star_op + 1;
+      current = ++star_name;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  while ( op < this->count && this->ops[ op ].kind == GLOB_OP_STAR )
+  {
+    op++;
+  }
+
+  return op == this->count;
+}
+
+//
+// Directory cache
+//
+
+void dircache_init( dircache_t* this )
+{
+  this->entries = NULL;
+  this->count = 0;
+  this->capacity = 0;
+  this->dents = NULL;
+}
+
+void dircache_destroy( dircache_t* this )
+{
+  size_t i;
+  for ( i = 0; i < this->count; i++ )
+  {
+    free( this->entries[ i ].path );
+    buffer_destroy( &this->entries[ i ].names );
+  }
+
+  free( this->entries );
+  free( this->dents );
+  dircache_init( this );
+}
+
+/**
+ * Reads the whole directory at [fd] into [entry], in as few syscalls
+ * as possible. Names are packed straight into the entry's buffer, so
+ * there is no allocation per file.
+ */
+static bool dircache_read( dircache_t* this, dircache_entry_t* entry, int fd )
+{
+  if ( this->dents == NULL )
+  {
+    this->dents = malloc( DENTS_SIZE );
+  }
+
+  entry->names.size = 0;
+  entry->count = 0;
+
+  for ( ;; )
+  {
+    long read = syscall( SYS_getdents64, fd, this->dents, DENTS_SIZE );
+    if ( read < 0 ) return false;
+    if ( read == 0 ) break;
+
+    long offset = 0;
+    while ( offset < read )
+    {
+      struct linux_dirent64* dent =
+        ( struct linux_dirent64* ) ( this->dents + offset );
+      offset += dent->d_reclen;
+
+      const char* name = dent->d_name;
+      if ( name[ 0 ] == '.'
+        && ( name[ 1 ] == '\0' || ( name[ 1 ] == '.' && name[ 2 ] == '\0' ) ) )
+      {
+        continue;
+      }
+
+      size_t length = strlen( name ) + 1;
+      char* slot = buffer_reserve( &entry->names, length + 1 );
+      slot[ 0 ] = ( char ) dent->d_type;
+      memcpy( slot + 1, name, length );
+      entry->names.size += length + 1;
+      entry->count += 1;
+    }
+  }
+
+  return true;
+}
+
+const dircache_entry_t* dircache_list( dircache_t* this, const char* path )
+{
+  int fd = open( path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+  if ( fd < 0 ) return NULL;
+
+  struct stat info;
+  if ( fstat( fd, &info ) < 0 )
+  {
+    close( fd );
+    return NULL;
+  }
+
+  // look for a listing we've already got
+  dircache_entry_t* entry = NULL;
+  size_t i;
+  for ( i = 0; i < this->count; i++ )
+  {
+    if ( strcmp( this->entries[ i ].path, path ) == 0 )
+    {
+      entry = &this->entries[ i ];
+      break;
+    }
+  }
+
+  if ( entry != NULL
+    && entry->mtime.tv_sec == info.st_mtim.tv_sec
+    && entry->mtime.tv_nsec == info.st_mtim.tv_nsec )
+  {
+    close( fd );
+    return entry;
+  }
+
+  if ( entry == NULL )
+  {
+    if ( this->count == this->capacity )
+    {
+      this->capacity = this->capacity == 0 ? 4 : this->capacity * 2;
+      this->entries = realloc( this->entries,
+                               this->capacity * sizeof( dircache_entry_t ) );
+    }
+
+    entry = &this->entries[ this->count ];
+    entry->path = strdup( path );
+    buffer_init( &entry->names );
+    entry->count = 0;
+    this->count += 1;
+  }
+
+  entry->mtime = info.st_mtim;
+  bool ok = dircache_read( this, entry, fd );
+  close( fd );
+
+  if ( !ok )
+  {
+    // never let a partial listing be reused
+    entry->mtime.tv_sec = 0;
+    entry->mtime.tv_nsec = 0;
+    return NULL;
+  }
+
+  return entry;
+}
+
+//
+// Expansion
+//
+
+/**
+ * State shared by every level of the recursive expansion.
+ */
+typedef struct glob_walk_t
+{
+  const glob_pattern_t* pattern;
+  dircache_t* cache;
+  buffer_t* out;
+  buffer_t* offsets;
+  size_t matches;
+  char path[ PATH_MAX ];
+} glob_walk_t;
+
+static void glob_walk( glob_walk_t* this, size_t length, size_t segment );
+
+/**
+ * Records the current path as a match.
+ */
+static void glob_emit( glob_walk_t* this, size_t length )
+{
+  // (e.g. `**` matching zero directories, with nothing before it)
+  if ( length == 0 ) return;
+
+  size_t offset = this->out->size;
+
+  buffer_append( this->out, this->path, length );
+  if ( this->pattern->directory )
+  {
+    buffer_append( this->out, "/", 1 );
+  }
+  buffer_append( this->out, "", 1 );
+
+  buffer_append( this->offsets, &offset, sizeof( offset ) );
+  this->matches += 1;
+}
+
+/**
+ * Appends [name] onto the path (which currently has [length] chars),
+ * returning the new length, or 0 if it wouldn't fit.
+ */
+static size_t glob_join( glob_walk_t* this, size_t length, const char* name )
+{
+  size_t name_length = strlen( name );
+
+  if ( length > 0 && this->path[ length - 1 ] != '/' )
+  {
+    if ( length + 1 >= PATH_MAX ) return 0;
+    this->path[ length++ ] = '/';
+  }
+
+  if ( length + name_length >= PATH_MAX ) return 0;
+  memcpy( this->path + length, name, name_length + 1 );
+
+  return length + name_length;
+}
+
+/**
+ * Determines if the entry (at the current path) is a directory,
+ * only stat-ing when the file system didn't tell us.
+ */
+static bool glob_is_directory( glob_walk_t* this, unsigned char type )
+{
+  if ( type == DT_DIR ) return true;
+  if ( type != DT_UNKNOWN && type != DT_LNK ) return false;
+
+  struct stat info;
+  return stat( this->path, &info ) == 0 && S_ISDIR( info.st_mode );
+}
+
+/**
+ * Calls [visit] for each (non-hidden) entry of the current directory
+ * in turn, with the path set to it, telling it if the entry is a
+ * directory (symlinks to them never count, or we could loop forever).
+ */
+static void glob_walk_entries( glob_walk_t* this, size_t length, size_t segment,
+                               void ( *visit )( glob_walk_t*, size_t, size_t, bool ) )
+{
+  const dircache_entry_t* listing =
+    dircache_list( this->cache, length == 0 ? "." : this->path );
+  if ( listing == NULL ) return;
+
+  // the listing may move if the cache grows during recursion, so
+  // walk it by offset rather than by pointer
+  size_t index = listing - this->cache->entries;
+  size_t offset = 0;
+  size_t i;
+  for ( i = 0; i < this->cache->entries[ index ].count; i++ )
+  {
+    const char* record = this->cache->entries[ index ].names.data + offset;
+    offset += strlen( record + 1 ) + 2;
+
+    unsigned char type = record[ 0 ];
+    const char* name = record + 1;
+    if ( name[ 0 ] == '.' ) continue;
+
+    size_t joined = glob_join( this, length, name );
+    if ( joined == 0 ) continue;
+
+    bool directory = type == DT_DIR
+      || ( type == DT_UNKNOWN && glob_is_directory( this, type ) );
+    visit( this, joined, segment, directory );
+
+    this->path[ length ] = '\0';
+  }
+}
+
+/**
+ * Matches everything under a trailing `**`: the entry itself (if it's
+ * a directory, when only those are wanted), and everything under it.
+ */
+static void glob_visit_all( glob_walk_t* this, size_t length, size_t segment,
+                            bool directory )
+{
+  if ( directory || !this->pattern->directory )
+  {
+    glob_emit( this, length );
+  }
+
+  if ( directory )
+  {
+    glob_walk_entries( this, length, segment, &glob_visit_all );
+  }
+}
+
+/**
+ * Matches the rest of the pattern under each subdirectory of a `**`.
+ */
+static void glob_visit_recursive( glob_walk_t* this, size_t length,
+                                  size_t segment, bool directory )
+{
+  if ( directory )
+  {
+    glob_walk( this, length, segment + 1 );
+    glob_walk_entries( this, length, segment, &glob_visit_recursive );
+  }
+}
+
+/**
+ * Expands `**` at [segment]: zero directories, then every (non-hidden)
+ * subdirectory, recursively. On the end of the pattern it matches the
+ * files in them too, as well as the directory it starts from (with a
+ * `/` on the end, as bash has it, though a `**` with nothing before it
+ * has no empty match).
+ */
+static void glob_walk_recursive( glob_walk_t* this, size_t length,
+                                 size_t segment )
+{
+  if ( segment + 1 < this->pattern->count )
+  {
+    glob_walk( this, length, segment + 1 );
+    glob_walk_entries( this, length, segment, &glob_visit_recursive );
+    return;
+  }
+
+  if ( length > 0 )
+  {
+    // (a directory pattern gets its `/` from glob_emit)
+    bool slash = this->path[ length - 1 ] != '/' && !this->pattern->directory
+              && length + 1 < PATH_MAX;
+    if ( slash ) this->path[ length ] = '/';
+    glob_emit( this, length + slash );
+    this->path[ length ] = '\0';
+  }
+
+  glob_walk_entries( this, length, segment, &glob_visit_all );
+}
+
+static void glob_walk( glob_walk_t* this, size_t length, size_t segment )
+{
+  if ( segment == this->pattern->count )
+  {
+    glob_emit( this, length );
+    return;
+  }
+
+  const glob_segment_t* current = &this->pattern->segments[ segment ];
+  bool last = ( segment + 1 == this->pattern->count );
+
+  if ( current->recursive )
+  {
+    glob_walk_recursive( this, length, segment );
+    return;
+  }
+
+  // literal names don't need the directory listed at all
+  if ( current->literal != NULL )
+  {
+    size_t joined = glob_join( this, length, current->literal );
+    if ( joined == 0 ) return;
+
+    struct stat info;
+    if ( last && !this->pattern->directory )
+    {
+      if ( lstat( this->path, &info ) == 0 )
+      {
+        glob_emit( this, joined );
+      }
+    }
+    else if ( stat( this->path, &info ) == 0 && S_ISDIR( info.st_mode ) )
+    {
+      glob_walk( this, joined, segment + 1 );
+    }
+
+    this->path[ length ] = '\0';
+    return;
+  }
+
+  const dircache_entry_t* listing =
+    dircache_list( this->cache, length == 0 ? "." : this->path );
+  if ( listing == NULL ) return;
+
+  size_t index = listing - this->cache->entries;
+  size_t offset = 0;
+  size_t i;
+  for ( i = 0; i < this->cache->entries[ index ].count; i++ )
+  {
+    const char* record = this->cache->entries[ index ].names.data + offset;
+    offset += strlen( record + 1 ) + 2;
+
+    unsigned char type = record[ 0 ];
+    const char* name = record + 1;
+    if ( !glob_segment_matches( current, name ) ) continue;
+
+    size_t joined = glob_join( this, length, name );
+    if ( joined == 0 ) continue;
+
+    if ( last && !this->pattern->directory )
+    {
+      glob_emit( this, joined );
+    }
+    else if ( glob_is_directory( this, type ) )
+    {
+      glob_walk( this, joined, segment + 1 );
+    }
+
+    this->path[ length ] = '\0';
+  }
+}
+
+static int glob_compare( const void* a, const void* b, void* data )
+{
+  const char* base = data;
+  return strcmp( base + *( const size_t* ) a, base + *( const size_t* ) b );
+}
+
+size_t glob_expand( const glob_pattern_t* pattern, dircache_t* cache,
+                    buffer_t* out, buffer_t* offsets )
+{
+  glob_walk_t* walk = malloc( sizeof( *walk ) );
+  walk->pattern = pattern;
+  walk->cache = cache;
+  walk->out = out;
+  walk->offsets = offsets;
+  walk->matches = 0;
+
+  size_t first = offsets->size;
+
+  size_t length = 0;
+  if ( pattern->absolute )
+  {
+    walk->path[ 0 ] = '/';
+    length = 1;
+  }
+  walk->path[ length ] = '\0';
+
+  glob_walk( walk, length, 0 );
+
+  size_t matches = walk->matches;
+  free( walk );
+
+  qsort_r( offsets->data + first, matches, sizeof( size_t ),
+           &glob_compare, out->data );
+
+  return matches;
+}
@@ -0,0 +1,518 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pwd.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include "prompt.h"
+
+/**
+ * Reads (up to [size] - 1 bytes of) a small file into [into], without
+ * its trailing whitespace. Returns [false] if it couldn't be read.
+ */
+static bool prompt_read_file( const char* path, char* into, size_t size )
+{
+  int fd = open( path, O_RDONLY | O_CLOEXEC );
+  if ( fd < 0 ) return false;
+
+  ssize_t length;
+  do length = read( fd, into, size - 1 );
+  while ( length < 0 && errno == EINTR );
+  close( fd );
+
+  if ( length < 0 ) return false;
+
+  while ( length > 0 && ( into[ length - 1 ] == '\n' || into[ length - 1 ] == ' ' ) )
+  {
+    length -= 1;
+  }
+  into[ length ] = '\0';
+
+  return true;
+}
+
+/**
+ * Finds the HEAD file of the repository [directory] is in, by looking
+ * for a `.git` in it and each of its parents. Returns NULL if there
+ * isn't one.
+ */
+static char* prompt_find_head( const char* directory )
+{
+  char path[ PATH_MAX ];
+  snprintf( path, sizeof( path ), "%s", directory );
+
+  for ( ;; )
+  {
+    size_t length = strlen( path );
+    char git[ PATH_MAX + 16 ];
+    snprintf( git, sizeof( git ), "%s/.git", length == 1 ? "" : path );
+
+    struct stat info;
+    if ( stat( git, &info ) == 0 )
+    {
+      char* head = NULL;
+
+      if ( S_ISDIR( info.st_mode ) )
+      {
+        asprintf( &head, "%s/HEAD", git );
+        return head;
+      }
+
+      // worktrees and submodules have a file pointing at the real one
+      char link[ PATH_MAX ];
+      if ( prompt_read_file( git, link, sizeof( link ) )
+        && strncmp( link, "gitdir: ", 8 ) == 0 )
+      {
+        const char* target = link + 8;
+        if ( *target == '/' ) asprintf( &head, "%s/HEAD", target );
+        else asprintf( &head, "%s/%s/HEAD", length == 1 ? "" : path, target );
+        return head;
+      }
+    }
+
+    // up to the parent (and no further than the root)
+    char* slash = strrchr( path, '/' );
+    if ( slash == NULL || length == 1 ) return NULL;
+    if ( slash == path ) slash[ 1 ] = '\0';
+    else *slash = '\0';
+  }
+}
+
+/**
+ * Works out the git branch of [directory]. This is what the worker
+ * does, and is the only part of the prompt which can be slow (e.g. on
+ * a network file system).
+ */
+static prompt_git_t* prompt_look( char* directory )
+{
+  prompt_git_t* git = calloc( 1, sizeof( *git ) );
+  git->directory = directory;
+  git->head = prompt_find_head( directory );
+
+  struct stat info;
+  char contents[ 256 ];
+
+  if ( git->head == NULL
+    || stat( git->head, &info ) < 0
+    || !prompt_read_file( git->head, contents, sizeof( contents ) ) )
+  {
+    return git;
+  }
+
+  git->changed = info.st_mtim;
+
+  // `ref: refs/heads/NAME` is on a branch, and a bare hash is detached
+  if ( strncmp( contents, "ref: refs/heads/", 16 ) == 0 )
+  {
+    snprintf( git->branch, sizeof( git->branch ), "%.*s",
+              ( int ) sizeof( git->branch ) - 1, contents + 16 );
+  }
+  else if ( strncmp( contents, "ref: ", 5 ) == 0 )
+  {
+    snprintf( git->branch, sizeof( git->branch ), "%.*s",
+              ( int ) sizeof( git->branch ) - 1, contents + 5 );
+  }
+  else
+  {
+    snprintf( git->branch, sizeof( git->branch ), "%.7s", contents );
+  }
+
+  return git;
+}
+
+/**
+ * Frees a cached branch.
+ */
+static void prompt_git_free( prompt_git_t* git )
+{
+  free( git->directory );
+  free( git->head );
+  free( git );
+}
+
+/**
+ * Puts a branch the worker worked out at the front of the cache (in
+ * place of any older one for the same directory), dropping the least
+ * recently used if the cache is full. Expects [lock] to be held.
+ */
+static void prompt_remember( prompt_t* this, prompt_git_t* git )
+{
+  unsigned int count = 1;
+
+  prompt_git_t** link = &this->cache;
+  while ( *link != NULL )
+  {
+    prompt_git_t* current = *link;
+
+    if ( strcmp( current->directory, git->directory ) == 0
+      || count >= PROMPT_CACHE_SIZE )
+    {
+      *link = current->next;
+      prompt_git_free( current );
+    }
+    else
+    {
+      count += 1;
+      link = &current->next;
+    }
+  }
+
+  git->next = this->cache;
+  this->cache = git;
+}
+
+/**
+ * The worker, which takes one directory at a time to work out the
+ * branch of, and signals [ready] after each.
+ */
+static void* prompt_work( void* data )
+{
+  prompt_t* this = data;
+
+  pthread_mutex_lock( &this->lock );
+  while ( !this->stopping )
+  {
+    if ( this->request == NULL )
+    {
+      pthread_cond_wait( &this->wake, &this->lock );
+      continue;
+    }
+
+    char* directory = this->request;
+    this->request = NULL;
+
+    pthread_mutex_unlock( &this->lock );
+    prompt_git_t* git = prompt_look( directory );
+    pthread_mutex_lock( &this->lock );
+
+    prompt_remember( this, git );
+
+    uint64_t one = 1;
+    write( this->ready, &one, sizeof( one ) );
+  }
+  pthread_mutex_unlock( &this->lock );
+
+  return NULL;
+}
+
+/**
+ * Starts the worker, if it hasn't been already. Returns [false] if it
+ * couldn't be (so there's no branch to wait for).
+ */
+static bool prompt_start( prompt_t* this )
+{
+  if ( this->started ) return true;
+
+  this->ready = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+  if ( this->ready < 0 )
+  {
+    perror( "eventfd" );
+    return false;
+  }
+
+  // signals are for the shell's own thread to handle
+  sigset_t all, saved;
+  sigfillset( &all );
+  pthread_sigmask( SIG_SETMASK, &all, &saved );
+  int error = pthread_create( &this->worker, NULL, prompt_work, this );
+  pthread_sigmask( SIG_SETMASK, &saved, NULL );
+
+  if ( error != 0 )
+  {
+    printf( "msh: prompt: %s\n", strerror( error ) );
+    close( this->ready );
+    this->ready = -1;
+    return false;
+  }
+
+  this->started = true;
+  return true;
+}
+
+/**
+ * Appends the branch [directory] is on, as it was last worked out.
+ * Returns [true] if that might be out of date (and the worker has been
+ * asked to work it out again).
+ */
+static bool prompt_branch( prompt_t* this, const char* directory, buffer_t* out )
+{
+  char branch[ sizeof( ( ( prompt_git_t* ) NULL )->branch ) ] = "";
+  char* head = NULL;
+  struct timespec changed = { 0, 0 };
+  bool found = false;
+
+  pthread_mutex_lock( &this->lock );
+
+  prompt_git_t** link;
+  for ( link = &this->cache; *link != NULL; link = &( *link )->next )
+  {
+    prompt_git_t* git = *link;
+    if ( strcmp( git->directory, directory ) != 0 ) continue;
+
+    strcpy( branch, git->branch );
+    head = git->head != NULL ? strdup( git->head ) : NULL;
+    changed = git->changed;
+    found = true;
+
+    // (to the front, as the most recently used)
+    *link = git->next;
+    git->next = this->cache;
+    this->cache = git;
+    break;
+  }
+
+  pthread_mutex_unlock( &this->lock );
+
+  buffer_append( out, branch, strlen( branch ) );
+
+  // it's only certain if the branch hasn't been switched since (which
+  // would have rewritten HEAD); outside a repository, one could have
+  // been made since, so that's always checked again
+  struct stat info;
+  bool fresh = found && head != NULL
+            && stat( head, &info ) == 0
+            && info.st_mtim.tv_sec == changed.tv_sec
+            && info.st_mtim.tv_nsec == changed.tv_nsec;
+  free( head );
+
+  if ( fresh || !prompt_start( this ) ) return false;
+
+  pthread_mutex_lock( &this->lock );
+  free( this->request );
+  this->request = strdup( directory );
+  pthread_cond_signal( &this->wake );
+  pthread_mutex_unlock( &this->lock );
+
+  return true;
+}
+
+/**
+ * Renders PS1 into [out]. Returns [true] if a segment of it is still
+ * being worked out.
+ */
+static bool prompt_render( prompt_t* this, int status, unsigned int jobs,
+                           buffer_t* out )
+{
+  const char* format = getenv( "PS1" );
+  if ( format == NULL ) format = PROMPT_DEFAULT;
+
+  bool pending = false;
+  char* directory = NULL;
+  char scratch[ 256 ];
+
+  out->size = 0;
+
+  const char* current;
+  for ( current = format; *current != '\0'; current++ )
+  {
+    if ( *current != '\\' || current[ 1 ] == '\0' )
+    {
+      buffer_append( out, current, 1 );
+      continue;
+    }
+
+    current += 1;
+    const char* text = scratch;
+    scratch[ 0 ] = '\0';
+
+    // (the working directory is needed by a few of these)
+    if ( directory == NULL && strchr( "wWg", *current ) != NULL )
+    {
+      directory = getcwd( NULL, 0 );
+      if ( directory == NULL ) directory = strdup( "?" );
+    }
+
+    switch ( *current )
+    {
+      case 'w':
+      case 'W':
+      {
+        const char* home = getenv( "HOME" );
+        size_t length = home != NULL ? strlen( home ) : 0;
+        bool in_home = length > 1 && strncmp( directory, home, length ) == 0
+                    && ( directory[ length ] == '\0' || directory[ length ] == '/' );
+
+        if ( in_home && directory[ length ] == '\0' )
+        {
+          text = "~";
+        }
+        else if ( *current == 'W' )
+        {
+          const char* slash = strrchr( directory, '/' );
+          text = slash == NULL || slash[ 1 ] == '\0' ? directory : slash + 1;
+        }
+        else if ( in_home )
+        {
+          buffer_append( out, "~", 1 );
+          text = directory + length;
+        }
+        else
+        {
+          text = directory;
+        }
+        break;
+      }
+      case '?':
+        snprintf( scratch, sizeof( scratch ), "%d", status );
+        break;
+      case 'j':
+        snprintf( scratch, sizeof( scratch ), "%u", jobs );
+        break;
+      case 'g':
+        pending |= prompt_branch( this, directory, out );
+        break;
+      case 'u':
+      {
+        text = getenv( "USER" );
+        if ( text == NULL )
+        {
+          struct passwd* user = getpwuid( geteuid() );
+          text = user != NULL ? user->pw_name : "?";
+        }
+        break;
+      }
+      case 'h':
+        if ( gethostname( scratch, sizeof( scratch ) ) < 0 ) scratch[ 0 ] = '\0';
+        scratch[ sizeof( scratch ) - 1 ] = '\0';
+        scratch[ strcspn( scratch, "." ) ] = '\0';
+        break;
+      case '$':
+        text = geteuid() == 0 ? "#" : "$";
+        break;
+      case 'n':
+        text = "\n";
+        break;
+      case 'e':
+        text = "\x1B";
+        break;
+      case '\\':
+        text = "\\";
+        break;
+      case '[':
+      case ']':
+        // (bash's markers around escapes; nothing here needs them)
+        break;
+      default:
+        // anything else is left as it is
+        buffer_append( out, current - 1, 1 );
+        scratch[ 0 ] = *current;
+        scratch[ 1 ] = '\0';
+        break;
+    }
+
+    buffer_append( out, text, strlen( text ) );
+  }
+
+  free( directory );
+  return pending;
+}
+
+/**
+ * Writes [drawn], and counts the lines it takes.
+ */
+static void prompt_show( prompt_t* this )
+{
+  fwrite( this->drawn.data, 1, this->drawn.size, stdout );
+  fflush( stdout );
+
+  this->lines = 0;
+
+  size_t i;
+  for ( i = 0; i < this->drawn.size; i++ )
+  {
+    this->lines += this->drawn.data[ i ] == '\n';
+  }
+}
+
+void prompt_init( prompt_t* this )
+{
+  this->started = false;
+  pthread_mutex_init( &this->lock, NULL );
+  pthread_cond_init( &this->wake, NULL );
+  this->request = NULL;
+  this->stopping = false;
+  this->ready = -1;
+  this->cache = NULL;
+  buffer_init( &this->drawn );
+  this->lines = 0;
+}
+
+void prompt_destroy( prompt_t* this )
+{
+  if ( this->started )
+  {
+    pthread_mutex_lock( &this->lock );
+    this->stopping = true;
+    pthread_cond_signal( &this->wake );
+    pthread_mutex_unlock( &this->lock );
+
+    pthread_join( this->worker, NULL );
+    close( this->ready );
+    this->started = false;
+  }
+
+  while ( this->cache != NULL )
+  {
+    prompt_git_t* git = this->cache;
+    this->cache = git->next;
+    prompt_git_free( git );
+  }
+
+  free( this->request );
+  pthread_mutex_destroy( &this->lock );
+  pthread_cond_destroy( &this->wake );
+  buffer_destroy( &this->drawn );
+}
+
+bool prompt_draw( prompt_t* this, int status, unsigned int jobs )
+{
+  bool pending = prompt_render( this, status, jobs, &this->drawn );
+  prompt_show( this );
+  return pending;
+}
+
+bool prompt_redraw( prompt_t* this, int status, unsigned int jobs )
+{
+  uint64_t count;
+  if ( this->ready != -1 ) read( this->ready, &count, sizeof( count ) );
+
+  buffer_t next;
+  buffer_init( &next );
+  bool pending = prompt_render( this, status, jobs, &next );
+
+  // (the worker's found out nothing new, so there's no need to flicker)
+  if ( next.size == this->drawn.size
+    && memcmp( next.data, this->drawn.data, next.size ) == 0 )
+  {
+    buffer_destroy( &next );
+    return false;
+  }
+
+  prompt_clear( this );
+
+  buffer_destroy( &this->drawn );
+  this->drawn = next;
+  prompt_show( this );
+
+  return pending;
+}
+
+void prompt_clear( prompt_t* this )
+{
+  printf( "\r" );
+  if ( this->lines > 0 ) printf( "\x1B[%uA", this->lines );
+  printf( "\x1B[J" );
+  fflush( stdout );
+}
@@ -0,0 +1,266 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "redirect.h"
+
+// the [fd] used by `&>` and `&>>`, which replace both stdout and stderr
+#define REDIRECT_BOTH -1
+
+void redirect_destroy( redirect_t* this )
+{
+  free( this->path );
+  this->path = NULL;
+}
+
+bool redirect_parse_operator( const char* token, int* kind, int* fd,
+                              bool* heredoc )
+{
+  const char* current = token;
+
+  int number = -1;
+  if ( isdigit( ( unsigned char ) *current ) )
+  {
+    number = 0;
+    while ( isdigit( ( unsigned char ) *current ) )
+    {
+      number = number * 10 + ( *current - '0' );
+      current++;
+    }
+  }
+
+  *heredoc = false;
+
+  if ( strcmp( current, "<" ) == 0 )
+  {
+    *kind = REDIRECT_READ;
+    *fd = 0;
+  }
+  else if ( strcmp( current, "<&" ) == 0 )
+  {
+    *kind = REDIRECT_DUP;
+    *fd = 0;
+  }
+  else if ( strcmp( current, "<<" ) == 0 || strcmp( current, "<<-" ) == 0 )
+  {
+    *kind = REDIRECT_DATA;
+    *fd = 0;
+    *heredoc = true;
+  }
+  else if ( strcmp( current, "<<<" ) == 0 )
+  {
+    *kind = REDIRECT_DATA;
+    *fd = 0;
+  }
+  else if ( strcmp( current, ">" ) == 0 || strcmp( current, ">|" ) == 0 )
+  {
+    *kind = REDIRECT_WRITE;
+    *fd = 1;
+  }
+  else if ( strcmp( current, ">>" ) == 0 )
+  {
+    *kind = REDIRECT_APPEND;
+    *fd = 1;
+  }
+  else if ( strcmp( current, ">&" ) == 0 )
+  {
+    *kind = REDIRECT_DUP;
+    *fd = 1;
+  }
+  else if ( number == -1 && strcmp( current, "&>" ) == 0 )
+  {
+    *kind = REDIRECT_WRITE;
+    *fd = REDIRECT_BOTH;
+  }
+  else if ( number == -1 && strcmp( current, "&>>" ) == 0 )
+  {
+    *kind = REDIRECT_APPEND;
+    *fd = REDIRECT_BOTH;
+  }
+  else
+  {
+    return false;
+  }
+
+  if ( number != -1 )
+  {
+    *fd = number;
+  }
+
+  return true;
+}
+
+/**
+ * Creates an anonymous, in-memory file holding the given data, with
+ * its offset rewound to the start, so here-documents never touch the
+ * file system.
+ */
+static int redirect_open_data( const redirect_t* this )
+{
+  int fd = memfd_create( "msh-heredoc", MFD_CLOEXEC );
+  if ( fd < 0 ) return -1;
+
+  size_t written = 0;
+  while ( written < this->length )
+  {
+    ssize_t result = write( fd, this->path + written, this->length - written );
+    if ( result < 0 )
+    {
+      if ( errno == EINTR ) continue;
+      close( fd );
+      return -1;
+    }
+    written += result;
+  }
+
+  lseek( fd, 0, SEEK_SET );
+  return fd;
+}
+
+/**
+ * Points [target] at [fd]. dup2 won't clear close-on-exec if they're
+ * already the same descriptor, so that's done by hand.
+ */
+static bool redirect_install( int fd, int target )
+{
+  if ( fd == target )
+  {
+    return fcntl( fd, F_SETFD, 0 ) == 0;
+  }
+
+  return dup2( fd, target ) >= 0;
+}
+
+bool redirect_apply( const redirect_t* this )
+{
+  int fd;
+
+  switch ( this->kind )
+  {
+    case REDIRECT_READ:
+      fd = open( this->path, O_RDONLY | O_CLOEXEC );
+      break;
+
+    case REDIRECT_WRITE:
+      fd = open( this->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 );
+      break;
+
+    case REDIRECT_APPEND:
+      fd = open( this->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666 );
+      break;
+
+    case REDIRECT_DATA:
+      fd = redirect_open_data( this );
+      if ( fd < 0 )
+      {
+        perror( "memfd_create" );
+        return false;
+      }
+      break;
+
+    case REDIRECT_DUP:
+      if ( dup2( this->source, this->fd ) < 0 )
+      {
+        fprintf( stderr, "%d: %s\n", this->source, strerror( errno ) );
+        return false;
+      }
+      return true;
+
+    case REDIRECT_CLOSE:
+      close( this->fd );
+      return true;
+
+    default:
+      return false;
+  }
+
+  if ( fd < 0 )
+  {
+    perror( this->path );
+    return false;
+  }
+
+  bool ok;
+  if ( this->fd == REDIRECT_BOTH )
+  {
+    ok = redirect_install( fd, 1 ) && redirect_install( fd, 2 );
+  }
+  else
+  {
+    ok = redirect_install( fd, this->fd );
+  }
+
+  if ( fd != this->fd && ( this->fd != REDIRECT_BOTH || fd > 2 ) )
+  {
+    close( fd );
+  }
+
+  return ok;
+}
+
+/**
+ * Remembers what [fd] currently refers to.
+ */
+static void redirect_save( redirect_saved_t* this, int fd )
+{
+  if ( this->count == REDIRECT_MAX_SAVED ) return;
+
+  this->fds[ this->count ] = fd;
+  this->saved[ this->count ] = fcntl( fd, F_DUPFD_CLOEXEC, 10 );
+  this->count += 1;
+}
+
+bool redirect_apply_saved( const redirect_t* this, redirect_saved_t* saved )
+{
+  // anything the shell already buffered belongs to the old target
+  fflush( stdout );
+  fflush( stderr );
+
+  if ( this->fd == REDIRECT_BOTH )
+  {
+    redirect_save( saved, 1 );
+    redirect_save( saved, 2 );
+  }
+  else
+  {
+    redirect_save( saved, this->fd );
+  }
+
+  return redirect_apply( this );
+}
+
+void redirect_restore( redirect_saved_t* this )
+{
+  fflush( stdout );
+  fflush( stderr );
+
+  // undo them in reverse, so the oldest saved copy wins
+  while ( this->count > 0 )
+  {
+    this->count -= 1;
+
+    int fd = this->fds[ this->count ];
+    int saved = this->saved[ this->count ];
+
+    if ( saved >= 0 )
+    {
+      dup2( saved, fd );
+      close( saved );
+    }
+    else
+    {
+      close( fd );
+    }
+  }
+}
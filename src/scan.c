@@ -0,0 +1,413 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "scan.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// the vector versions read whole aligned blocks, which can start
+// before the text and run past its end (never into another page, so
+// that's safe, but it looks like an overflow to the address sanitizer)
+#if defined( __has_attribute )
+#if __has_attribute( no_sanitize_address )
+#define SCAN_BLOCKS __attribute__(( no_sanitize_address ))
+#endif
+#endif
+#ifndef SCAN_BLOCKS
+#define SCAN_BLOCKS
+#endif
+
+/**
+ * One implementation of each of the scans.
+ */
+typedef struct scan_ops_t
+{
+  const char* ( *blanks )( const char* );
+  const char* ( *word )( const char* );
+  const char* ( *quoted )( const char*, char );
+} scan_ops_t;
+
+//
+// A byte at a time
+//
+
+// what each byte is to the scans
+#define SCAN_BLANK 0x01
+#define SCAN_WORD 0x02
+#define SCAN_DOUBLE 0x04
+#define SCAN_SINGLE 0x08
+
+static const unsigned char scan_classes[ 256 ] =
+{
+  [ '\0' ] = SCAN_WORD | SCAN_DOUBLE | SCAN_SINGLE,
+  [ ' ' ] = SCAN_BLANK | SCAN_WORD, [ '\t' ] = SCAN_BLANK | SCAN_WORD,
+  [ '\n' ] = SCAN_BLANK | SCAN_WORD, [ '\r' ] = SCAN_BLANK | SCAN_WORD,
+  [ '"' ] = SCAN_WORD | SCAN_DOUBLE, [ '\'' ] = SCAN_WORD | SCAN_SINGLE,
+  [ '`' ] = SCAN_WORD | SCAN_DOUBLE, [ '$' ] = SCAN_WORD | SCAN_DOUBLE,
+  [ '\\' ] = SCAN_WORD, [ ';' ] = SCAN_WORD, [ '<' ] = SCAN_WORD,
+  [ '>' ] = SCAN_WORD, [ '&' ] = SCAN_WORD,
+};
+
+// how many bytes are looked at one at a time before a vector scan
+// (most words are short, and a block costs more than a few bytes)
+#define SCAN_PREFIX 8
+
+/**
+ * Returns the class a quote's scan stops on.
+ */
+static inline unsigned char scan_quote_class( char quote )
+{
+  return quote == '"' ? SCAN_DOUBLE : SCAN_SINGLE;
+}
+
+static const char* scan_blanks_scalar( const char* text )
+{
+  while ( scan_classes[ ( unsigned char ) *text ] & SCAN_BLANK ) text++;
+  return text;
+}
+
+static const char* scan_word_scalar( const char* text )
+{
+  while ( !( scan_classes[ ( unsigned char ) *text ] & SCAN_WORD ) ) text++;
+  return text;
+}
+
+static const char* scan_quoted_scalar( const char* text, char quote )
+{
+  unsigned char stop = scan_quote_class( quote );
+  while ( !( scan_classes[ ( unsigned char ) *text ] & stop ) ) text++;
+  return text;
+}
+
+static const scan_ops_t scan_scalar =
+{
+  scan_blanks_scalar, scan_word_scalar, scan_quoted_scalar
+};
+
+#ifdef SCAN_X86
+
+//
+// 16 bytes at a time (every x86-64 has SSE2)
+//
+// Each block is classified into a bitmask (one bit per byte), and the
+// lowest bit set is where the scan stops. The first block is the
+// aligned one [text] is in, with the bits before [text] shifted out.
+//
+
+__attribute__(( target( "sse2" ) ))
+static inline uint32_t scan_blank_mask_sse2( __m128i block )
+{
+  __m128i blank = _mm_or_si128(
+    _mm_or_si128( _mm_cmpeq_epi8( block, _mm_set1_epi8( ' ' ) ),
+                  _mm_cmpeq_epi8( block, _mm_set1_epi8( '\t' ) ) ),
+    _mm_or_si128( _mm_cmpeq_epi8( block, _mm_set1_epi8( '\n' ) ),
+                  _mm_cmpeq_epi8( block, _mm_set1_epi8( '\r' ) ) ) );
+
+  return ( uint32_t ) _mm_movemask_epi8( blank );
+}
+
+__attribute__(( target( "sse2" ) ))
+static inline uint32_t scan_word_mask_sse2( __m128i block )
+{
+  // (the ends of words, and everything the lexer has to look at)
+  __m128i quotes = _mm_or_si128(
+    _mm_or_si128( _mm_cmpeq_epi8( block, _mm_set1_epi8( '"' ) ),
+                  _mm_cmpeq_epi8( block, _mm_set1_epi8( '\'' ) ) ),
+    _mm_or_si128( _mm_cmpeq_epi8( block, _mm_set1_epi8( '\\' ) ),
+                  _mm_cmpeq_epi8( block, _mm_set1_epi8( '`' ) ) ) );
+  __m128i operators = _mm_or_si128(
+    _mm_or_si128( _mm_cmpeq_epi8( block, _mm_set1_epi8( ';' ) ),
+                  _mm_cmpeq_epi8( block, _mm_set1_epi8( '&' ) ) ),
+    _mm_or_si128( _mm_cmpeq_epi8( block, _mm_set1_epi8( '<' ) ),
+                  _mm_cmpeq_epi8( block, _mm_set1_epi8( '>' ) ) ) );
+  __m128i others = _mm_or_si128( _mm_cmpeq_epi8( block, _mm_set1_epi8( '$' ) ),
+                                 _mm_cmpeq_epi8( block, _mm_setzero_si128() ) );
+
+  return scan_blank_mask_sse2( block )
+       | ( uint32_t ) _mm_movemask_epi8( _mm_or_si128( _mm_or_si128( quotes, operators ),
+                                                       others ) );
+}
+
+__attribute__(( target( "sse2" ) ))
+static inline uint32_t scan_quoted_mask_sse2( __m128i block, char quote )
+{
+  __m128i found = _mm_or_si128( _mm_cmpeq_epi8( block, _mm_set1_epi8( quote ) ),
+                                _mm_cmpeq_epi8( block, _mm_setzero_si128() ) );
+  if ( quote == '"' )
+  {
+    found = _mm_or_si128( found,
+      _mm_or_si128( _mm_cmpeq_epi8( block, _mm_set1_epi8( '`' ) ),
+                    _mm_cmpeq_epi8( block, _mm_set1_epi8( '$' ) ) ) );
+  }
+
+  return ( uint32_t ) _mm_movemask_epi8( found );
+}
+
+__attribute__(( target( "sse2" ) )) SCAN_BLOCKS
+static const char* scan_blanks_sse2( const char* text )
+{
+  uintptr_t offset = ( uintptr_t ) text & 15;
+  const __m128i* block = ( const __m128i* ) ( text - offset );
+
+  // (a NUL isn't blank, so this always stops)
+  uint32_t mask = ( ~scan_blank_mask_sse2( _mm_load_si128( block ) ) & 0xFFFF ) >> offset;
+  if ( mask != 0 ) return text + __builtin_ctz( mask );
+
+  for ( block++; ; block++ )
+  {
+    mask = ~scan_blank_mask_sse2( _mm_load_si128( block ) ) & 0xFFFF;
+    if ( mask != 0 ) return ( const char* ) block + __builtin_ctz( mask );
+  }
+}
+
+__attribute__(( target( "sse2" ) )) SCAN_BLOCKS
+static const char* scan_word_sse2( const char* text )
+{
+  uintptr_t offset = ( uintptr_t ) text & 15;
+  const __m128i* block = ( const __m128i* ) ( text - offset );
+
+  uint32_t mask = scan_word_mask_sse2( _mm_load_si128( block ) ) >> offset;
+  if ( mask != 0 ) return text + __builtin_ctz( mask );
+
+  for ( block++; ; block++ )
+  {
+    mask = scan_word_mask_sse2( _mm_load_si128( block ) );
+    if ( mask != 0 ) return ( const char* ) block + __builtin_ctz( mask );
+  }
+}
+
+__attribute__(( target( "sse2" ) )) SCAN_BLOCKS
+static const char* scan_quoted_sse2( const char* text, char quote )
+{
+  uintptr_t offset = ( uintptr_t ) text & 15;
+  const __m128i* block = ( const __m128i* ) ( text - offset );
+
+  uint32_t mask = scan_quoted_mask_sse2( _mm_load_si128( block ), quote ) >> offset;
+  if ( mask != 0 ) return text + __builtin_ctz( mask );
+
+  for ( block++; ; block++ )
+  {
+    mask = scan_quoted_mask_sse2( _mm_load_si128( block ), quote );
+    if ( mask != 0 ) return ( const char* ) block + __builtin_ctz( mask );
+  }
+}
+
+static const scan_ops_t scan_sse2 =
+{
+  scan_blanks_sse2, scan_word_sse2, scan_quoted_sse2
+};
+
+//
+// 32 bytes at a time, with AVX2
+//
+
+__attribute__(( target( "avx2" ) ))
+static inline uint32_t scan_blank_mask_avx2( __m256i block )
+{
+  __m256i blank = _mm256_or_si256(
+    _mm256_or_si256( _mm256_cmpeq_epi8( block, _mm256_set1_epi8( ' ' ) ),
+                     _mm256_cmpeq_epi8( block, _mm256_set1_epi8( '\t' ) ) ),
+    _mm256_or_si256( _mm256_cmpeq_epi8( block, _mm256_set1_epi8( '\n' ) ),
+                     _mm256_cmpeq_epi8( block, _mm256_set1_epi8( '\r' ) ) ) );
+
+  return ( uint32_t ) _mm256_movemask_epi8( blank );
+}
+
+/**
+ * Classifies a block by looking each byte's nibbles up in two tables
+ * (the way simdjson finds structural characters), which takes a few
+ * instructions however many characters are being looked for. A byte
+ * is one of them if the bits for its low and high nibbles overlap:
+ *
+ *   high 0: \0 \t \n \r (bit 0)   high 2: space " $ & ' (bit 1)
+ *   high 3: ; < > (bit 2)         high 5: \ (bit 3)   high 6: ` (bit 4)
+ */
+__attribute__(( target( "avx2" ) ))
+static inline uint32_t scan_word_mask_avx2( __m256i block )
+{
+  const __m256i low_table = _mm256_setr_epi8(
+    0x13, 0, 0x02, 0, 0x02, 0, 0x02, 0x02, 0, 0x01, 0x01, 0x04, 0x0C, 0x01, 0x04, 0,
+    0x13, 0, 0x02, 0, 0x02, 0, 0x02, 0x02, 0, 0x01, 0x01, 0x04, 0x0C, 0x01, 0x04, 0 );
+  const __m256i high_table = _mm256_setr_epi8(
+    0x01, 0, 0x02, 0x04, 0, 0x08, 0x10, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0x01, 0, 0x02, 0x04, 0, 0x08, 0x10, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
+  const __m256i nibble = _mm256_set1_epi8( 0x0F );
+
+  __m256i low = _mm256_shuffle_epi8( low_table, _mm256_and_si256( block, nibble ) );
+  __m256i high = _mm256_shuffle_epi8( high_table,
+    _mm256_and_si256( _mm256_srli_epi16( block, 4 ), nibble ) );
+
+  __m256i none = _mm256_cmpeq_epi8( _mm256_and_si256( low, high ),
+                                    _mm256_setzero_si256() );
+
+  return ~( uint32_t ) _mm256_movemask_epi8( none );
+}
+
+__attribute__(( target( "avx2" ) ))
+static inline uint32_t scan_quoted_mask_avx2( __m256i block, char quote )
+{
+  __m256i found = _mm256_or_si256(
+    _mm256_cmpeq_epi8( block, _mm256_set1_epi8( quote ) ),
+    _mm256_cmpeq_epi8( block, _mm256_setzero_si256() ) );
+  if ( quote == '"' )
+  {
+    found = _mm256_or_si256( found,
+      _mm256_or_si256( _mm256_cmpeq_epi8( block, _mm256_set1_epi8( '`' ) ),
+                       _mm256_cmpeq_epi8( block, _mm256_set1_epi8( '$' ) ) ) );
+  }
+
+  return ( uint32_t ) _mm256_movemask_epi8( found );
+}
+
+__attribute__(( target( "avx2" ) )) SCAN_BLOCKS
+static const char* scan_blanks_avx2( const char* text )
+{
+  uintptr_t offset = ( uintptr_t ) text & 31;
+  const __m256i* block = ( const __m256i* ) ( text - offset );
+
+  uint32_t mask = ~scan_blank_mask_avx2( _mm256_load_si256( block ) ) >> offset;
+  if ( mask != 0 ) return text + __builtin_ctz( mask );
+
+  for ( block++; ; block++ )
+  {
+    mask = ~scan_blank_mask_avx2( _mm256_load_si256( block ) );
+    if ( mask != 0 ) return ( const char* ) block + __builtin_ctz( mask );
+  }
+}
+
+__attribute__(( target( "avx2" ) )) SCAN_BLOCKS
+static const char* scan_word_avx2( const char* text )
+{
+  uintptr_t offset = ( uintptr_t ) text & 31;
+  const __m256i* block = ( const __m256i* ) ( text - offset );
+
+  uint32_t mask = scan_word_mask_avx2( _mm256_load_si256( block ) ) >> offset;
+  if ( mask != 0 ) return text + __builtin_ctz( mask );
+
+  for ( block++; ; block++ )
+  {
+    mask = scan_word_mask_avx2( _mm256_load_si256( block ) );
+    if ( mask != 0 ) return ( const char* ) block + __builtin_ctz( mask );
+  }
+}
+
+__attribute__(( target( "avx2" ) )) SCAN_BLOCKS
+static const char* scan_quoted_avx2( const char* text, char quote )
+{
+  uintptr_t offset = ( uintptr_t ) text & 31;
+  const __m256i* block = ( const __m256i* ) ( text - offset );
+
+  uint32_t mask = scan_quoted_mask_avx2( _mm256_load_si256( block ), quote ) >> offset;
+  if ( mask != 0 ) return text + __builtin_ctz( mask );
+
+  for ( block++; ; block++ )
+  {
+    mask = scan_quoted_mask_avx2( _mm256_load_si256( block ), quote );
+    if ( mask != 0 ) return ( const char* ) block + __builtin_ctz( mask );
+  }
+}
+
+static const scan_ops_t scan_avx2 =
+{
+  scan_blanks_avx2, scan_word_avx2, scan_quoted_avx2
+};
+
+#endif
+
+// the implementation in use (picked the first time one's needed)
+static const scan_ops_t* scan_ops = NULL;
+static scan_level_t scan_current = SCAN_SCALAR;
+
+scan_level_t scan_best( void )
+{
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports( "avx2" ) ) return SCAN_AVX2;
+  if ( __builtin_cpu_supports( "sse2" ) ) return SCAN_SSE2;
+#endif
+  return SCAN_SCALAR;
+}
+
+bool scan_use( scan_level_t level )
+{
+  if ( level > scan_best() ) return false;
+
+  switch ( level )
+  {
+#ifdef SCAN_X86
+    case SCAN_AVX2: scan_ops = &scan_avx2; break;
+    case SCAN_SSE2: scan_ops = &scan_sse2; break;
+#endif
+    default: scan_ops = &scan_scalar; break;
+  }
+
+  scan_current = level;
+  return true;
+}
+
+/**
+ * Picks the fastest implementation, if one hasn't been already.
+ */
+static inline const scan_ops_t* scan_get( void )
+{
+  if ( scan_ops == NULL ) scan_use( scan_best() );
+  return scan_ops;
+}
+
+scan_level_t scan_level( void )
+{
+  scan_get();
+  return scan_current;
+}
+
+const char* scan_name( scan_level_t level )
+{
+  switch ( level )
+  {
+    case SCAN_AVX2: return "avx2";
+    case SCAN_SSE2: return "sse2";
+    default: return "scalar";
+  }
+}
+
+const char* scan_blanks( const char* text )
+{
+  unsigned int i;
+  for ( i = 0; i < SCAN_PREFIX; i++, text++ )
+  {
+    if ( !( scan_classes[ ( unsigned char ) *text ] & SCAN_BLANK ) ) return text;
+  }
+
+  return scan_get()->blanks( text );
+}
+
+const char* scan_word( const char* text )
+{
+  unsigned int i;
+  for ( i = 0; i < SCAN_PREFIX; i++, text++ )
+  {
+    if ( scan_classes[ ( unsigned char ) *text ] & SCAN_WORD ) return text;
+  }
+
+  return scan_get()->word( text );
+}
+
+const char* scan_quoted( const char* text, char quote )
+{
+  unsigned char stop = scan_quote_class( quote );
+
+  unsigned int i;
+  for ( i = 0; i < SCAN_PREFIX; i++, text++ )
+  {
+    if ( scan_classes[ ( unsigned char ) *text ] & stop ) return text;
+  }
+
+  return scan_get()->quoted( text, quote );
+}
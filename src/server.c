@@ -0,0 +1,503 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "server.h"
+#include "command.h"
+#include "shell.h"
+#include "memstats.h"
+
+// how many events the server takes from epoll at once
+#define SERVER_EVENTS 16
+
+/**
+ * Fills in the address of the socket at [path]. Returns [false]
+ * (after telling the user why) if the path is too long for one.
+ */
+static bool server_address( const char* path, struct sockaddr_un* address )
+{
+  memset( address, 0, sizeof( *address ) );
+  address->sun_family = AF_UNIX;
+
+  if ( strlen( path ) >= sizeof( address->sun_path ) )
+  {
+    printf( "%s: socket path is too long\n", path );
+    return false;
+  }
+
+  strcpy( address->sun_path, path );
+  return true;
+}
+
+/**
+ * Sends a frame, with the given descriptors attached to it (if any).
+ */
+static bool server_send( int fd, uint32_t type, const void* data,
+                         uint32_t length, const int* fds, int count )
+{
+  server_frame_t frame = { type, length };
+
+  struct iovec parts[ 2 ] = {
+    { .iov_base = &frame, .iov_len = sizeof( frame ) },
+    { .iov_base = ( void* ) data, .iov_len = length }
+  };
+
+  union
+  {
+    char buffer[ CMSG_SPACE( sizeof( int ) * SERVER_FDS ) ];
+    struct cmsghdr align;
+  } control;
+
+  struct msghdr message;
+  memset( &message, 0, sizeof( message ) );
+  message.msg_iov = parts;
+  message.msg_iovlen = length > 0 ? 2 : 1;
+
+  if ( count > 0 )
+  {
+    message.msg_control = control.buffer;
+    message.msg_controllen = CMSG_SPACE( sizeof( int ) * count );
+
+    struct cmsghdr* header = CMSG_FIRSTHDR( &message );
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN( sizeof( int ) * count );
+    memcpy( CMSG_DATA( header ), fds, sizeof( int ) * count );
+  }
+
+  // (the descriptors go with the first byte, so if the frame doesn't
+  // all go out at once, the rest of it is sent without them)
+  size_t total = sizeof( frame ) + length;
+  size_t sent = 0;
+  while ( sent < total )
+  {
+    ssize_t result = sendmsg( fd, &message, MSG_NOSIGNAL );
+    if ( result < 0 && errno == EINTR ) continue;
+    if ( result <= 0 ) return false;
+
+    sent += result;
+    message.msg_control = NULL;
+    message.msg_controllen = 0;
+
+    while ( message.msg_iovlen > 0 && ( size_t ) result >= message.msg_iov->iov_len )
+    {
+      result -= message.msg_iov->iov_len;
+      message.msg_iov++;
+      message.msg_iovlen--;
+    }
+    if ( message.msg_iovlen > 0 )
+    {
+      message.msg_iov->iov_base = ( char* ) message.msg_iov->iov_base + result;
+      message.msg_iov->iov_len -= result;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Reads exactly [length] bytes. Returns [false] if the other side
+ * hung up first.
+ */
+static bool server_recv_all( int fd, void* data, size_t length )
+{
+  size_t received = 0;
+  while ( received < length )
+  {
+    ssize_t result = recv( fd, ( char* ) data + received, length - received, 0 );
+    if ( result < 0 && errno == EINTR ) continue;
+    if ( result <= 0 ) return false;
+
+    received += result;
+  }
+
+  return true;
+}
+
+/**
+ * Receives a frame, and its payload (NUL-terminated, which the caller
+ * frees) and descriptors. Returns [false] if the other side hung up,
+ * or sent something that isn't a frame.
+ */
+static bool server_recv( int fd, server_frame_t* frame, char** payload,
+                         int* fds, int* count )
+{
+  union
+  {
+    char buffer[ CMSG_SPACE( sizeof( int ) * SERVER_FDS ) ];
+    struct cmsghdr align;
+  } control;
+
+  struct iovec part = { .iov_base = frame, .iov_len = sizeof( *frame ) };
+
+  struct msghdr message;
+  memset( &message, 0, sizeof( message ) );
+  message.msg_iov = &part;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof( control.buffer );
+
+  ssize_t result;
+  do
+  {
+    result = recvmsg( fd, &message, MSG_CMSG_CLOEXEC );
+  }
+  while ( result < 0 && errno == EINTR );
+
+  if ( result <= 0 ) return false;
+
+  *count = 0;
+
+  struct cmsghdr* header;
+  for ( header = CMSG_FIRSTHDR( &message ); header != NULL;
+        header = CMSG_NXTHDR( &message, header ) )
+  {
+    if ( header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS )
+    {
+      continue;
+    }
+
+    int received = ( header->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+    int* sent = ( int* ) CMSG_DATA( header );
+
+    int i;
+    for ( i = 0; i < received; i++ )
+    {
+      // (anything beyond what we asked for isn't wanted)
+      if ( fds != NULL && *count < SERVER_FDS ) fds[ ( *count )++ ] = sent[ i ];
+      else close( sent[ i ] );
+    }
+  }
+
+  bool ok = ( message.msg_flags & MSG_CTRUNC ) == 0
+         && server_recv_all( fd, ( char* ) frame + result, sizeof( *frame ) - result )
+         && frame->length <= SERVER_MAX_LINE;
+
+  *payload = NULL;
+  if ( ok )
+  {
+    *payload = malloc( frame->length + 1 );
+    ok = server_recv_all( fd, *payload, frame->length );
+    ( *payload )[ frame->length ] = '\0';
+  }
+
+  if ( !ok )
+  {
+    while ( *count > 0 ) close( fds[ --( *count ) ] );
+    free( *payload );
+    *payload = NULL;
+  }
+
+  return ok;
+}
+
+/**
+ * Serves a single client, with a shell of its own, until it hangs up
+ * (or runs `exit`). This runs in the process forked for the session.
+ */
+static void server_session( int client )
+{
+  // the client's output is interleaved with what its commands write
+  // themselves, so the shell's own can't sit in a buffer
+  setvbuf( stdout, NULL, _IOLBF, 0 );
+
+  int nothing = open( "/dev/null", O_RDWR | O_CLOEXEC );
+
+  shell_t shell;
+  shell_init( &shell );
+  shell_set_active( &shell );
+
+  bool running = true;
+  while ( running )
+  {
+    server_frame_t frame;
+    char* line;
+    int fds[ SERVER_FDS ];
+    int count;
+
+    if ( !server_recv( client, &frame, &line, fds, &count ) ) break;
+
+    if ( frame.type != SERVER_RUN || count != SERVER_FDS )
+    {
+      while ( count > 0 ) close( fds[ --count ] );
+      free( line );
+      break;
+    }
+
+    // the command runs with the client's descriptors, so whatever it
+    // writes goes straight to the client (without passing through us)
+    int i;
+    for ( i = 0; i < SERVER_FDS; i++ )
+    {
+      dup2( fds[ i ], i );
+      close( fds[ i ] );
+    }
+
+    command_t* command = malloc( sizeof( *command ) );
+    command_init( command );
+    mem_adopt( MEM_STRINGS, line );
+    command->string = line;
+    command_parse( command, line );
+
+    running = shell_run_command( &shell, command );
+    shell_wait( &shell );
+    shell_reap( &shell );
+    fflush( stdout );
+    fflush( stderr );
+
+    // don't hold on to the client's descriptors between commands,
+    // (e.g. a pipe it's reading wouldn't see the end of its input)
+    for ( i = 0; i < SERVER_FDS; i++ )
+    {
+      dup2( nothing, i );
+    }
+
+    int32_t status = shell.last_status;
+    if ( !server_send( client, running ? SERVER_STATUS : SERVER_BYE,
+                       &status, sizeof( status ), NULL, 0 ) )
+    {
+      break;
+    }
+  }
+
+  shell_destroy( &shell );
+  close( nothing );
+  close( client );
+}
+
+/**
+ * Takes over the socket at [path], if it's one a server left behind.
+ * Returns [false] (after telling the user why) if another server is
+ * still using it.
+ */
+static bool server_claim( const char* path, const struct sockaddr_un* address )
+{
+  int probe = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+  bool taken = connect( probe, ( const struct sockaddr* ) address,
+                        sizeof( *address ) ) == 0;
+  close( probe );
+
+  if ( taken )
+  {
+    printf( "%s: already being served\n", path );
+    return false;
+  }
+
+  struct stat info;
+  if ( lstat( path, &info ) == 0 && S_ISSOCK( info.st_mode ) )
+  {
+    unlink( path );
+  }
+
+  return true;
+}
+
+/**
+ * Accepts every client waiting on the socket, forking a session for
+ * each of them.
+ */
+static void server_accept( int listener, int epoll, int signals,
+                           const sigset_t* mask )
+{
+  for ( ;; )
+  {
+    int client = accept4( listener, NULL, NULL, SOCK_CLOEXEC );
+    if ( client < 0 )
+    {
+      if ( errno == EINTR ) continue;
+      if ( errno != EAGAIN && errno != EWOULDBLOCK ) perror( "accept" );
+      return;
+    }
+
+    pid_t pid = fork();
+    if ( pid == 0 )
+    {
+      close( listener );
+      close( epoll );
+      close( signals );
+      sigprocmask( SIG_SETMASK, mask, NULL );
+
+      server_session( client );
+      exit( 0 );
+    }
+    if ( pid < 0 )
+    {
+      perror( "fork" );
+    }
+
+    close( client );
+  }
+}
+
+int server_run( const char* path )
+{
+  struct sockaddr_un address;
+  if ( !server_address( path, &address ) ) return 1;
+  if ( !server_claim( path, &address ) ) return 1;
+
+  int listener = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0 );
+  if ( listener < 0
+    || bind( listener, ( struct sockaddr* ) &address, sizeof( address ) ) < 0
+    || listen( listener, SOMAXCONN ) < 0 )
+  {
+    perror( path );
+    if ( listener >= 0 ) close( listener );
+    return 1;
+  }
+
+  // sessions ending (and the server being asked to stop) come in as
+  // events, the same as clients connecting
+  sigset_t handled, mask;
+  sigemptyset( &handled );
+  sigaddset( &handled, SIGCHLD );
+  sigaddset( &handled, SIGINT );
+  sigaddset( &handled, SIGTERM );
+  sigprocmask( SIG_BLOCK, &handled, &mask );
+
+  int signals = signalfd( -1, &handled, SFD_CLOEXEC );
+  int epoll = epoll_create1( EPOLL_CLOEXEC );
+
+  struct epoll_event event = { .events = EPOLLIN };
+  event.data.fd = listener;
+  epoll_ctl( epoll, EPOLL_CTL_ADD, listener, &event );
+  event.data.fd = signals;
+  epoll_ctl( epoll, EPOLL_CTL_ADD, signals, &event );
+
+  bool serving = true;
+  while ( serving )
+  {
+    struct epoll_event events[ SERVER_EVENTS ];
+    int ready = epoll_wait( epoll, events, SERVER_EVENTS, -1 );
+    if ( ready < 0 && errno != EINTR )
+    {
+      perror( "epoll_wait" );
+      break;
+    }
+
+    int i;
+    for ( i = 0; i < ready; i++ )
+    {
+      if ( events[ i ].data.fd == listener )
+      {
+        server_accept( listener, epoll, signals, &mask );
+        continue;
+      }
+
+      struct signalfd_siginfo info;
+      if ( read( signals, &info, sizeof( info ) ) != sizeof( info ) ) continue;
+
+      if ( info.ssi_signo == SIGCHLD )
+      {
+        while ( waitpid( -1, NULL, WNOHANG ) > 0 );
+      }
+      else
+      {
+        // (sessions already going are left to finish with their clients)
+        serving = false;
+      }
+    }
+  }
+
+  close( epoll );
+  close( signals );
+  close( listener );
+  unlink( path );
+  sigprocmask( SIG_SETMASK, &mask, NULL );
+
+  return 0;
+}
+
+/**
+ * Runs a single command in the session. Returns [false] once the
+ * session is over.
+ */
+static bool server_connect_run( int server, const char* line, const int* fds,
+                                int* status )
+{
+  if ( !server_send( server, SERVER_RUN, line, strlen( line ), fds, SERVER_FDS ) )
+  {
+    perror( "send" );
+    *status = 1;
+    return false;
+  }
+
+  server_frame_t frame;
+  char* payload;
+  int count;
+  if ( !server_recv( server, &frame, &payload, NULL, &count )
+    || frame.length != sizeof( int32_t ) )
+  {
+    printf( "Lost the connection to the server\n" );
+    free( payload );
+    *status = 1;
+    return false;
+  }
+
+  int32_t result;
+  memcpy( &result, payload, sizeof( result ) );
+  free( payload );
+
+  *status = result;
+  return frame.type == SERVER_STATUS;
+}
+
+int server_connect( const char* path, char** commands, int count )
+{
+  struct sockaddr_un address;
+  if ( !server_address( path, &address ) ) return 1;
+
+  int server = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+  if ( server < 0
+    || connect( server, ( struct sockaddr* ) &address, sizeof( address ) ) < 0 )
+  {
+    perror( path );
+    return 1;
+  }
+
+  // commands read from stdin mustn't be able to read the ones after
+  // them, so they get nothing for their own input
+  int input = count > 0 ? STDIN_FILENO : open( "/dev/null", O_RDONLY | O_CLOEXEC );
+  int fds[ SERVER_FDS ] = { input, STDOUT_FILENO, STDERR_FILENO };
+  int status = 0;
+
+  if ( count > 0 )
+  {
+    int i;
+    for ( i = 0; i < count; i++ )
+    {
+      if ( !server_connect_run( server, commands[ i ], fds, &status ) ) break;
+    }
+  }
+  else
+  {
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    while ( ( length = getline( &line, &capacity, stdin ) ) >= 0 )
+    {
+      if ( length > 0 && line[ length - 1 ] == '\n' ) line[ length - 1 ] = '\0';
+      if ( !server_connect_run( server, line, fds, &status ) ) break;
+    }
+    free( line );
+    close( input );
+  }
+
+  close( server );
+  return status;
+}
@@ -7,9 +7,24 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <poll.h>
+#include <malloc.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
 #include <stdbool.h>
 #include "shell.h"
+#include "expand.h"
+#include "monitor.h"
+#include "memstats.h"
+#include "cache.h"
 #include "clib/memory.h"
 
 // terminal colors
@@ -22,6 +37,22 @@
 #define KCYN "\x1B[36m"
 #define KWHT "\x1B[37m"
 
+// the size of each read when capturing a command's output
+#define CAPTURE_READ_SIZE ( 64 * 1024 )
+
+// the size of each read of a coprocess's output
+#define COPROC_READ_SIZE ( 4 * 1024 )
+
+// how deeply aliases and functions can call each other
+#define SHELL_MAX_DEPTH 128
+
+// what `timeout` (and TMOUT_CMD) commands exit with, like coreutils
+#define SHELL_TIMEOUT_STATUS 124
+
+// how many of the best matching directories `j` looks through (and
+// `j -l` lists)
+#define SHELL_JUMP_MATCHES 32
+
 //
 // Static
 //
@@ -49,6 +80,10 @@ static void signal_handler( int signal )
       shell_suspend( g_active_shell );
       break;
 
+    // this only has to interrupt shell_wait, which takes it from there
+    case SIGCHLD:
+      break;
+
     // just forward all other signals to the current process's pgroup
     default:
       kill( -g_active_shell->current_pid, signal );
@@ -66,28 +101,184 @@ static void signal_handler( int signal )
  */
 bool shell_run_bi( shell_t*, const command_t* command );
 
+/**
+ * Finds the function for the built-in command with the
+ * given name, or NULL if there isn't one.
+ */
+void ( *shell_find_bi( const char* name ) )( shell_t*, const command_t* );
+
+/**
+ * Converts a status from waitpid into the `$?` value.
+ */
+int shell_exit_status( int status );
+
+/**
+ * Applies the command's redirections inside the shell itself,
+ * remembering the original descriptors in [saved]. Returns
+ * [false] if any of them couldn't be applied.
+ */
+bool shell_redirect_saved( const command_t*, redirect_saved_t* saved );
+
+/**
+ * Remembers a function if the (raw) command is a definition of one,
+ * i.e. `name() { ... }`. Returns [false] if it isn't a definition.
+ */
+bool shell_define( shell_t*, const command_t* command );
+
+/**
+ * Runs a function with the given (expanded) arguments.
+ */
+bool shell_call( shell_t*, const function_t* function, const command_t* args );
+
+/**
+ * Drops a reference to a command taken out of the history, counting
+ * its text and words as what they were before it was kept there if
+ * it was the last one.
+ */
+void shell_history_release( command_t* command );
+
+/**
+ * Gets the job named by the command's (optional) argument, e.g.
+ * `fg %2`, leaving [job] NULL if there's no argument. Returns
+ * [false] if the argument doesn't name a job.
+ */
+bool shell_job_argument( shell_t*, const command_t* command, job_t** job );
+
+/**
+ * Strips the spawn prefixes (`nice`, `affinity`, `ulimit` and
+ * `timeout`) off the
+ * front of the (expanded) command, adding what they ask for to
+ * [spawn]. Returns [false] if there's nothing left to run, either
+ * because a prefix was malformed, or because it was the whole
+ * command (e.g. a bare `ulimit -n 64`) and has been run already.
+ */
+bool shell_prefix( shell_t*, command_t* args, spawn_t* spawn );
+
+/**
+ * Expands the (raw) command and runs it as a single simple
+ * command, i.e. a function, built-in or program.
+ */
+bool shell_dispatch( shell_t*, const command_t* command );
+
+/**
+ * Runs an (expanded) `cached [--inputs FILES] [--env NAMES] [--mtime]
+ * COMMAND...`. If the command has been run the same way before (see
+ * cache_key), what it wrote and its status are replayed from the
+ * cache, without running anything. Otherwise it's run (and waited
+ * on), with what it writes recorded as it goes.
+ */
+void shell_cached( shell_t*, command_t* args, spawn_t* spawn );
+
+/**
+ * Runs an (expanded) `coproc NAME COMMAND...`, starting the program
+ * as a job whose stdin and stdout are pipes to and from the shell, for
+ * `cowrite` and `coread` to use for as long as it keeps running.
+ */
+void shell_coproc( shell_t*, command_t* args, spawn_t* spawn );
+
+/**
+ * Built-in shell command for defining (or printing) aliases.
+ */
+void shell_bi_alias( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for removing aliases.
+ */
+void shell_bi_unalias( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for evaluating arithmetic expressions.
+ */
+void shell_bi_let( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for leaving the function being run, with
+ * the given status (or that of the last command, without one).
+ */
+void shell_bi_return( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for listing the background jobs, or
+ * (with -v) watching the resources they use.
+ */
+void shell_bi_jobs( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for writing a line to a coprocess.
+ */
+void shell_bi_cowrite( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for reading a line from a coprocess, into
+ * a variable or (without one) to stdout.
+ */
+void shell_bi_coread( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for closing a coprocess's stdin, so it
+ * sees the end of its input.
+ */
+void shell_bi_coclose( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for printing how much memory the shell has
+ * allocated, for what (or, with -j, the same as JSON).
+ */
+void shell_bi_memstats( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for saving the shell's history, working
+ * directory and jobs, to be restored with `msh --restore FILE`.
+ */
+void shell_bi_snapshot( shell_t*, const command_t* command );
+
 /**
  * Built-in shell command for changing directories
  */
-void shell_bi_cd( const shell_t*, const command_t* command );
+void shell_bi_cd( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for jumping to the highest ranked directory
+ * (by how often and how recently it was visited) whose path has each
+ * of the given words in it, or with `-l`, listing all of them.
+ */
+void shell_bi_j( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for changing directory, saving the current
+ * one on the directory stack (or with no directory, swapping the
+ * current one with the one on top of it).
+ */
+void shell_bi_pushd( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for going back to the directory on top of
+ * the directory stack.
+ */
+void shell_bi_popd( shell_t*, const command_t* command );
+
+/**
+ * Built-in shell command for printing the directory stack.
+ */
+void shell_bi_dirs( shell_t*, const command_t* command );
 
 /**
  * Built-in shell command for printing the current
  * working directory
  */
-void shell_bi_pwd( const shell_t*, const command_t* command );
+void shell_bi_pwd( shell_t*, const command_t* command );
 
 /**
  * Built-in shell command for printing the shell's
  * history.
  */
-void shell_bi_history( const shell_t*, const command_t* command );
+void shell_bi_history( shell_t*, const command_t* command );
 
 /**
  * Built-in shell command for printing the shell's
  * pid history.
  */
-void shell_bi_showpids( const shell_t*, const command_t* command );
+void shell_bi_showpids( shell_t*, const command_t* command );
 
 /**
  * Built-in shell command for running a command from
@@ -95,37 +286,220 @@ void shell_bi_showpids( const shell_t*, const command_t* command );
  */
 void shell_bi_run_history( shell_t*, const command_t* command );
 
+/**
+ * A built-in shell command.
+ */
+typedef struct shell_bi_t
+{
+  /** The name the user runs it by */
+  const char* name;
+
+  /** The function which runs it */
+  void ( *run )( shell_t*, const command_t* command );
+
+  /**
+   * If it changes the shell's own state (e.g. its working directory
+   * or variables), so inside a `$(...)` it has to be run in a forked
+   * copy of the shell, where the change doesn't stick
+   */
+  bool stateful;
+} shell_bi_t;
+
+/** All of the built-in commands, terminated by an empty entry */
+static const shell_bi_t g_builtins[] = {
+  { "cd",       &shell_bi_cd,       true },
+  { "j",        &shell_bi_j,        true },
+  { "pushd",    &shell_bi_pushd,    true },
+  { "popd",     &shell_bi_popd,     true },
+  { "dirs",     &shell_bi_dirs,     false },
+  { "pwd",      &shell_bi_pwd,      false },
+  { "history",  &shell_bi_history,  false },
+  { "showpids", &shell_bi_showpids, false },
+  { "alias",    &shell_bi_alias,    true },
+  { "unalias",  &shell_bi_unalias,  true },
+  { "let",      &shell_bi_let,      true },
+  { "return",   &shell_bi_return,   true },
+  { "jobs",     &shell_bi_jobs,     false },
+  { "cowrite",  &shell_bi_cowrite,  false },
+  { "coread",   &shell_bi_coread,   false },
+  { "coclose",  &shell_bi_coclose,  true },
+  { "memstats", &shell_bi_memstats, false },
+  { "snapshot", &shell_bi_snapshot, false },
+  { NULL,       NULL,               false }
+};
+
 //
 // Definitions
 //
 
+/**
+ * Closes the shell's ends of the process substitutions' pipes from the
+ * [from]th on (i.e. those opened since then).
+ */
+static void shell_substituted_close( shell_t* this, size_t from )
+{
+  const int* fds = ( const int* ) this->substituted.data;
+  size_t count = this->substituted.size / sizeof( int );
+
+  size_t index;
+  for ( index = from; index < count; index++ )
+  {
+    close( fds[ index ] );
+  }
+
+  this->substituted.size = from * sizeof( int );
+}
+
+/**
+ * Reaps any process substitutions which have finished (or, if [all]
+ * is set, kills and reaps every one of them).
+ */
+static void shell_reap_substitutions( shell_t* this, bool all )
+{
+  pid_t* pids = ( pid_t* ) this->substitutions.data;
+  size_t count = this->substitutions.size / sizeof( pid_t );
+  size_t kept = 0;
+
+  size_t index;
+  for ( index = 0; index < count; index++ )
+  {
+    // (they're in groups of their own, like jobs)
+    if ( all ) kill( -pids[ index ], SIGKILL );
+
+    if ( waitpid( pids[ index ], NULL, all ? 0 : WNOHANG ) == 0 )
+    {
+      pids[ kept++ ] = pids[ index ];
+    }
+  }
+
+  this->substitutions.size = kept * sizeof( pid_t );
+}
+
 void shell_init( shell_t* this )
 {
   this->cmd_history = list_u(command_t);
   this->pid_history = list_u(pid_t);
-  this->background_pids = list_u(pid_t);
+  list_tag( this->cmd_history, MEM_HISTORY );
+  list_tag( this->pid_history, MEM_HISTORY );
+  this->restored = NULL;
+
+  const char* shared = getenv( "MSH_SHARED_HISTORY" );
+  this->shared_history = shared != NULL && *shared != '\0'
+    ? histring_open( shared )
+    : NULL;
 
   this->current_pid = ( pid_t ) 0;
+  this->last_status = 0;
+
+  job_table_init( &this->jobs );
+  function_table_init( &this->aliases );
+  function_table_init( &this->functions );
+  this->arguments = NULL;
+  this->returning = false;
+  this->depth = 0;
+
+  spawn_init( &this->spawn );
+  spawn_init( &this->current_spawn );
+  arith_cache_init( &this->arith );
+  prompt_init( &this->prompt );
+  buffer_init( &this->substitutions );
+  buffer_init( &this->substituted );
+  frecency_init( &this->dirs );
+  this->dir_stack = list_u(string);
 
   handler_init( &this->handler, &signal_handler );
+
+  // SIGCHLD is only ever let through while waiting on a process (so
+  // nothing else has to deal with being interrupted by it), and the
+  // shell has to be able to take the terminal back from its children
+  sigset_t child;
+  sigemptyset( &child );
+  sigaddset( &child, SIGCHLD );
+  sigprocmask( SIG_BLOCK, &child, NULL );
+  signal( SIGTTOU, SIG_IGN );
+
+  const char* mux = getenv( "MSH_MUX_JOBS" );
+  this->mux = NULL;
+  if ( mux != NULL && *mux != '\0' && strcmp( mux, "0" ) != 0 )
+  {
+    this->mux = malloc( sizeof( *this->mux ) );
+    mux_init( this->mux );
+  }
+
+  // (last, so the helper is forked while there's as little of the
+  // shell as there'll ever be)
+  const char* zygote = getenv( "MSH_ZYGOTE" );
+  this->zygote = NULL;
+  if ( zygote != NULL && *zygote != '\0' && strcmp( zygote, "0" ) != 0 )
+  {
+    this->zygote = malloc( sizeof( *this->zygote ) );
+    if ( !zygote_start( this->zygote ) )
+    {
+      free( this->zygote );
+      this->zygote = NULL;
+    }
+  }
 }
 
 void shell_destroy( shell_t* this )
 {
   // kill ALL background processes with SIGKILL so that we don't
   // leave anything behind
-  while ( this->background_pids->size > 0 )
+  job_table_destroy( &this->jobs );
+
+  // (as are any process substitutions still running)
+  shell_substituted_close( this, 0 );
+  shell_reap_substitutions( this, true );
+  buffer_destroy( &this->substitutions );
+  buffer_destroy( &this->substituted );
+
+  if ( this->zygote != NULL )
+  {
+    zygote_stop( this->zygote );
+    free( this->zygote );
+    this->zygote = NULL;
+  }
+
+  if ( this->mux != NULL )
+  {
+    mux_destroy( this->mux );
+    free( this->mux );
+    this->mux = NULL;
+  }
+
+  prompt_destroy( &this->prompt );
+  frecency_destroy( &this->dirs );
+
+  while ( this->dir_stack->size > 0 )
   {
-    pid_t pid = this->background_pids->fun->pop( this->background_pids );
+    mem_free( MEM_STRINGS, list_string_pop( this->dir_stack ) );
+  }
+  delete( this->dir_stack );
 
-    // here we make sure the entire process group gets it, so as to
-    // not leave any orphaned processes
-    kill( -pid, SIGKILL );
+  while ( this->cmd_history->size > 0 )
+  {
+    shell_history_release( list_command_t_pop( this->cmd_history ) );
   }
 
   delete( this->cmd_history );
   delete( this->pid_history );
-  delete( this->background_pids );
+
+  if ( this->restored != NULL )
+  {
+    snapshot_close( this->restored );
+    free( this->restored );
+    this->restored = NULL;
+  }
+
+  if ( this->shared_history != NULL )
+  {
+    histring_close( this->shared_history );
+    this->shared_history = NULL;
+  }
+
+  function_table_destroy( &this->aliases );
+  function_table_destroy( &this->functions );
+  arith_cache_destroy( &this->arith );
 
   this->current_pid = ( pid_t ) 0;
 
@@ -139,6 +513,48 @@ void shell_destroy( shell_t* this )
   }
 }
 
+bool shell_restore( shell_t* this, const char* path )
+{
+  snapshot_t* snapshot = malloc( sizeof( *snapshot ) );
+  if ( !snapshot_open( snapshot, path ) )
+  {
+    free( snapshot );
+    return false;
+  }
+
+  const char* cwd = snapshot_cwd( snapshot );
+  if ( chdir( cwd ) < 0 )
+  {
+    perror( cwd );
+  }
+
+  // a job can only be waited on by its parent, so anything which
+  // isn't ours any more has to be left where it is
+  uint64_t index;
+  for ( index = 0; index < snapshot->header->jobs; index++ )
+  {
+    const snapshot_job_t* saved = &snapshot->jobs[ index ];
+
+    siginfo_t info;
+    if ( waitid( P_PID, saved->pid, &info,
+                 WEXITED | WSTOPPED | WCONTINUED | WNOHANG | WNOWAIT ) < 0 )
+    {
+      printf( "[%u]  %d left behind (not a child of this shell)\n",
+              saved->id, saved->pid );
+      continue;
+    }
+
+    job_t* job = job_table_add( &this->jobs, saved->pid,
+                                saved->state == JOB_STOPPED ? JOB_STOPPED : JOB_RUNNING );
+
+    // (keeping its old id, as long as that keeps them in order)
+    if ( saved->id > job->id ) job->id = saved->id;
+  }
+
+  this->restored = snapshot;
+  return true;
+}
+
 void shell_set_active( const shell_t* this )
 {
   g_active_shell = ( shell_t* ) this;
@@ -151,286 +567,2878 @@ void shell_suspend( shell_t* this )
   
   // push it onto the stack of waiting processes
   pid_t pid = this->current_pid;
-  this->background_pids->fun->push( this->background_pids, pid );
+  job_t* job = job_table_add( &this->jobs, pid, JOB_STOPPED );
 
   // suspend the process and it's process group
   kill( -this->current_pid, SIGSTOP );
 
   // tell the user
-  printf( "\r[%d]  + %d suspended\n", this->background_pids->size, pid );
+  printf( "\r[%u]  + %d suspended\n", job->id, pid );
 
   this->current_pid = 0;
 }
 
-pid_t shell_resume( shell_t* this )
+pid_t shell_resume( shell_t* this, job_t* job )
 {
-  if ( this->background_pids->size == 0 )
+  if ( job == NULL )
+  {
+    job = job_table_last( &this->jobs, JOB_STOPPED );
+  }
+
+  if ( job == NULL )
   {
     printf( "No stopped jobs\n" );
     return ( pid_t ) 0;
   }
 
-  unsigned int size = this->background_pids->size;
-  pid_t pid = this->background_pids->fun->pop( this->background_pids );
-
   // notify the user
-  printf( "[%d]  - %d continued\n", size, pid );
+  printf( "[%u]  - %d continued\n", job->id, job->pid );
 
-  // tell the process to resume
-  // NOTE: -pid DOES NOT work here, it'll just do nothing.
-  kill( pid, SIGCONT );
+  // tell the process (and the rest of its group) to resume
+  kill( -job->pid, SIGCONT );
+  if ( this->zygote != NULL )
+  {
+    zygote_continued( this->zygote, job->pid );
+  }
+  job->state = JOB_RUNNING;
 
-  return pid;
+  return job->pid;
 }
 
-void shell_wait( shell_t* this )
+/**
+ * Checks if the shell is in control of the terminal, and so can
+ * hand it over to the processes it runs.
+ */
+static bool shell_has_terminal()
 {
-  // if we don't have an active process, then just don't
-  // do anything
-  if ( this->current_pid == 0 ) return;
+  return isatty( STDIN_FILENO ) && tcgetpgrp( STDIN_FILENO ) == getpgrp();
+}
 
-  // wait until the process exits
-  int status;
-  waitpid( this->current_pid, &status, 0 );
+/**
+ * Sets a timerfd to go off (once) after the given number of seconds.
+ */
+static void shell_arm( int timer, double seconds )
+{
+  struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+  spec.it_value.tv_sec = ( time_t ) seconds;
+  spec.it_value.tv_nsec = ( long ) ( ( seconds - spec.it_value.tv_sec ) * 1e9 );
 
-  // if the program died by signal, print the signal
-  if ( WIFSIGNALED( status ) )
+  // (a zero value would disarm it, rather than go off right away)
+  if ( spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0 )
   {
-    const char* signal_text = strsignal( WTERMSIG( status ) );
+    spec.it_value.tv_nsec = 1;
+  }
 
-    printf( KRED "! [%d] %s\n" KNRM, this->current_pid, signal_text );
-    printf( KRED "! " KNRM );
+  timerfd_settime( timer, 0, &spec, NULL );
+}
+
+/**
+ * Takes the next step in killing a process that's run out of time:
+ * first its timeout signal, then (after the grace period) SIGKILL.
+ * Returns the number of steps taken so far.
+ */
+static unsigned int shell_escalate( pid_t pid, const spawn_t* spawn,
+                                    unsigned int taken, int timer )
+{
+  int signal = taken == 0 ? spawn->timeout_signal : SIGKILL;
+
+  // the whole group gets it, so nothing it started is left behind
+  if ( kill( -pid, signal ) < 0 )
+  {
+    kill( pid, signal );
   }
 
-  // if the program emmitted a non-zero exit code
-  if ( WIFEXITED( status ) && WEXITSTATUS( status ) != 0 )
+  if ( taken == 0 && signal != SIGKILL && spawn->grace > 0 )
   {
-    printf( KRED "! " KNRM );
+    shell_arm( timer, spawn->grace );
   }
 
-  // child process is now dead
-  this->current_pid = ( pid_t ) 0;
+  return taken + 1;
 }
 
-bool shell_run_command( shell_t* this, command_t* command )
+/**
+ * Waits on one of the shell's processes, the same as waitpid, whether
+ * the shell or the helper started it.
+ */
+static pid_t shell_waitpid( shell_t* this, pid_t pid, int* status, int options )
 {
-  // absolutely do not run anything if there is still a
-  // foreground process
-  if ( this->current_pid != 0 ) return true;
+  if ( this->zygote != NULL && zygote_owns( this->zygote, pid ) )
+  {
+    return zygote_waitpid( this->zygote, pid, status, options );
+  }
 
-  // add the command to our history
-  this->cmd_history->fun->enqueue( this->cmd_history, command );
+  return waitpid( pid, status, options );
+}
 
-  const char* name = command_get_name( command );   
+void shell_wait( shell_t* this )
+{
+  // if we don't have an active process, then just don't
+  // do anything
+  if ( this->current_pid == 0 ) return;
 
-  if ( strcmp( name, "exit" ) == 0
-    || strcmp( name, "quit" ) == 0 )
-  {
-    return false;
-  }
-  else if ( strcmp( name, "fg" ) == 0 )
-  {
-    // resume the next suspended process, and set it as the
-    // foreground process (i.e. wait for it)
-    pid_t pid = shell_resume( this );
-    this->current_pid = pid;
-  }
-  else if ( strcmp( name, "bg" ) == 0 )
+  pid_t pid = this->current_pid;
+  spawn_t spawn = this->current_spawn;
+  spawn_init( &this->current_spawn );
+
+  // the process exiting makes its pidfd readable, and it running out
+  // of time makes the timer readable. it stopping only raises
+  // SIGCHLD, which is let through (only) while polling. if the helper
+  // started it, the helper tells us about both instead
+  bool remote = this->zygote != NULL && zygote_owns( this->zygote, pid );
+  int pidfd = remote ? -1 : syscall( SYS_pidfd_open, pid, 0 );
+  int timer = -1;
+  if ( spawn.timeout > 0 )
   {
-    // just resume it, don't set it as the foreground process
-    shell_resume( this );
+    timer = timerfd_create( CLOCK_MONOTONIC, TFD_CLOEXEC );
+    shell_arm( timer, spawn.timeout );
   }
-  // try to run a built-in command, if this fails, then
-  // finally try to run the command by searching paths
-  else if ( !shell_run_bi( this, command ) )
+
+  // the background jobs' output keeps coming in the meantime (and
+  // none of them can be started while waiting, so there's only ever
+  // fewer of their pipes than there are now)
+  nfds_t count = 2 + ( this->mux != NULL ? mux_count( this->mux ) : 0 );
+  struct pollfd* fds = calloc( count, sizeof( *fds ) );
+  fds[ 0 ].fd = remote ? this->zygote->socket : pidfd;
+  fds[ 0 ].events = POLLIN;
+  fds[ 1 ].fd = timer;
+  fds[ 1 ].events = POLLIN;
+
+  sigset_t unblocked;
+  sigprocmask( SIG_SETMASK, NULL, &unblocked );
+  sigdelset( &unblocked, SIGCHLD );
+
+  int status = 0;
+  bool changed = false;
+  unsigned int escalation = 0;
+
+  // (a ^Z the shell gets itself suspends the process, and clears
+  // [current_pid], without it ever changing state here)
+  while ( this->current_pid != 0 )
   {
-    // set the currently running process (in case a signal arrives,
-    // so the correct process will receive it)
-    pid_t pid = command_exec( command );
-    this->current_pid = pid;
-    this->pid_history->fun->enqueue( this->pid_history, pid );
-  }
+    pid_t result = shell_waitpid( this, pid, &status, WNOHANG | WUNTRACED );
+    if ( result == pid )
+    {
+      changed = true;
+      break;
+    }
+    if ( result < 0 && errno != EINTR ) break;
 
-  return true;  
-}
+    if ( this->mux != NULL )
+    {
+      count = 2 + mux_poll_fds( this->mux, fds + 2, count - 2 );
+    }
 
-//
-// Built-in Command definitions
-//
+    if ( ppoll( fds, count, NULL, &unblocked ) < 0 ) continue;
 
-bool shell_run_bi( shell_t* this, const command_t* command )
-{
-  const char* name = command_get_name( command );
+    if ( this->mux != NULL )
+    {
+      mux_drain( this->mux );
+    }
 
-  // just test the command's name against the built-in ones
+    uint64_t expirations;
+    if ( ( fds[ 1 ].revents & POLLIN ) != 0
+      && read( timer, &expirations, sizeof( expirations ) ) > 0 )
+    {
+      escalation = shell_escalate( pid, &spawn, escalation, timer );
+    }
+  }
 
-  if ( strcmp( name, "cd" ) == 0 )
+  if ( pidfd != -1 ) close( pidfd );
+  if ( timer != -1 ) close( timer );
+  free( fds );
+
+  // take the terminal back from the process' group
+  if ( spawn.terminal )
   {
-    shell_bi_cd( this, command );
-    return true;
+    tcsetpgrp( STDIN_FILENO, getpgrp() );
   }
-  else if ( strcmp( name, "pwd" ) == 0 )
+
+  if ( !changed )
   {
-    shell_bi_pwd( this, command );
-    return true;
+    this->current_pid = ( pid_t ) 0;
+    return;
   }
-  else if ( strcmp( name, "history" ) == 0 )
+
+  // stopped (e.g. by ^Z at the terminal) => it becomes a job
+  if ( WIFSTOPPED( status ) )
   {
-    shell_bi_history( this, command );
-    return true;
+    shell_suspend( this );
+    return;
   }
-  else if ( strcmp( name, "showpids" ) == 0 )
+
+  this->last_status = shell_exit_status( status );
+
+  if ( escalation > 0 )
   {
-    shell_bi_showpids( this, command );
-    return true;
+    this->last_status = SHELL_TIMEOUT_STATUS;
+    printf( KRED "! [%d] timed out after %gs\n" KNRM, pid, spawn.timeout );
+    printf( KRED "! " KNRM );
   }
-  else if ( name[ 0 ] == '!' )
+  // if the program died by signal, print the signal
+  else if ( WIFSIGNALED( status ) )
   {
-    shell_bi_run_history( this, command );
-    return true;
-  }
+    const char* signal_text = strsignal( WTERMSIG( status ) );
 
-  // couldn't find a command, so oh well
-  return false;
-}
+    printf( KRED "! [%d] %s\n" KNRM, this->current_pid, signal_text );
+    printf( KRED "! " KNRM );
+  }
 
-void shell_bi_cd( const shell_t* this, const command_t* command )
+  // if the program emmitted a non-zero exit code
+  if ( WIFEXITED( status ) && WEXITSTATUS( status ) != 0 )
+  {
+    printf( KRED "! " KNRM );
+  }
+
+  // child process is now dead
+  this->current_pid = ( pid_t ) 0;
+}
+
+/**
+ * Checks if a coprocess has written anything that hasn't been taken
+ * (by `coread`) yet, in which case it isn't reaped until it has been.
+ */
+static bool shell_coproc_unread( const job_t* job )
+{
+  if ( job->start < job->pending.size ) return true;
+  if ( job->output < 0 ) return false;
+
+  struct pollfd fd = { .fd = job->output, .events = POLLIN };
+  return poll( &fd, 1, 0 ) > 0 && ( fd.revents & POLLIN ) != 0;
+}
+
+void shell_reap( shell_t* this )
+{
+  // (a job's last lines come before it's reported as done)
+  if ( this->mux != NULL )
+  {
+    mux_drain( this->mux );
+  }
+
+  job_t* job = this->jobs.head;
+  while ( job != NULL )
+  {
+    job_t* next = job->next;
+
+    int status;
+    if ( !shell_coproc_unread( job )
+      && shell_waitpid( this, job->pid, &status, WNOHANG ) > 0 )
+    {
+      if ( WIFSIGNALED( status ) )
+      {
+        printf( "[%u]  + %d %s\n", job->id, job->pid,
+                strsignal( WTERMSIG( status ) ) );
+      }
+      else
+      {
+        printf( "[%u]  + %d done (%d)\n", job->id, job->pid,
+                WEXITSTATUS( status ) );
+      }
+
+      job_table_remove( &this->jobs, job );
+    }
+
+    job = next;
+  }
+
+  // (process substitutions just go quietly)
+  shell_reap_substitutions( this, false );
+}
+
+/**
+ * Counts the jobs which are running (rather than stopped).
+ */
+static unsigned int shell_running_jobs( const shell_t* this )
+{
+  unsigned int count = 0;
+
+  const job_t* job;
+  for ( job = this->jobs.head; job != NULL; job = job->next )
+  {
+    count += job->state == JOB_RUNNING;
+  }
+
+  return count;
+}
+
+void shell_prompt( shell_t* this )
+{
+  bool pending = prompt_draw( &this->prompt, this->last_status,
+                              shell_running_jobs( this ) );
+
+  // (without a terminal, the next command is already there to be read)
+  if ( !isatty( STDIN_FILENO ) ) return;
+
+  // until something's typed, the prompt is redrawn whenever a segment
+  // of it is worked out, or a job's output has to go where it was
+  for ( ;; )
+  {
+    unsigned int count = this->mux != NULL ? mux_count( this->mux ) : 0;
+    if ( !pending && count == 0 ) return;
+
+    struct pollfd* fds = calloc( count + 2, sizeof( *fds ) );
+    fds[ 0 ].fd = STDIN_FILENO;
+    fds[ 0 ].events = POLLIN;
+    fds[ 1 ].fd = pending ? this->prompt.ready : -1;
+    fds[ 1 ].events = POLLIN;
+    if ( this->mux != NULL ) mux_poll_fds( this->mux, fds + 2, count );
+
+    bool input = poll( fds, count + 2, -1 ) < 0 || fds[ 0 ].revents != 0;
+    bool redraw = fds[ 1 ].revents != 0;
+
+    bool output = false;
+    unsigned int i;
+    for ( i = 0; i < count; i++ ) output |= fds[ 2 + i ].revents != 0;
+    free( fds );
+
+    if ( input ) return;
+
+    if ( output )
+    {
+      // the output goes where the prompt was, and the prompt after it
+      prompt_clear( &this->prompt );
+      mux_drain( this->mux );
+      shell_reap( this );
+      pending = prompt_draw( &this->prompt, this->last_status,
+                             shell_running_jobs( this ) );
+    }
+    else if ( redraw )
+    {
+      pending = prompt_redraw( &this->prompt, this->last_status,
+                               shell_running_jobs( this ) );
+    }
+  }
+}
+
+bool shell_job_argument( shell_t* this, const command_t* command, job_t** job )
+{
+  *job = NULL;
+  if ( command->tokens->size < 2 ) return true;
+
+  *job = job_table_parse( &this->jobs, list_string_get( command->tokens, 1 ) );
+  return *job != NULL;
+}
+
+/**
+ * Handles `nice [-n] [N] ...`, returning the number of words it
+ * used (or zero if it's malformed).
+ */
+static unsigned int shell_prefix_nice( shell_t* this, const command_t* args,
+                                       spawn_t* spawn )
+{
+  // unused, just here for symmetry with the other prefixes
+  ( void )( this );
+
+  const list_t(string)* words = args->tokens;
+  unsigned int used = 1;
+  bool explicit = false;
+  int increment = 10;
+
+  if ( used < words->size && strcmp( list_string_get( words, used ), "-n" ) == 0 )
+  {
+    explicit = true;
+    used += 1;
+  }
+
+  if ( used < words->size )
+  {
+    const char* word = list_string_get( words, used );
+    char* end;
+    long value = strtol( word, &end, 10 );
+
+    if ( end != word && *end == '\0' )
+    {
+      increment = value;
+      used += 1;
+    }
+    else if ( explicit )
+    {
+      printf( "nice: %s: not a number\n", word );
+      return 0;
+    }
+  }
+
+  if ( used == words->size )
+  {
+    printf( "nice: missing command\n" );
+    return 0;
+  }
+
+  spawn->nice += increment;
+  return used;
+}
+
+/**
+ * Handles `affinity CPUS ...`, as well as pinning a job that's
+ * already running (`affinity CPUS %N`) and printing a job's CPUs
+ * (`affinity %N`). A bare `affinity CPUS` pins everything the
+ * shell starts from then on. Returns the number of words it used
+ * (or zero if it's malformed, or the whole command).
+ */
+static unsigned int shell_prefix_affinity( shell_t* this, const command_t* args,
+                                           spawn_t* spawn )
+{
+  const list_t(string)* words = args->tokens;
+  char text[ 256 ];
+  cpu_set_t cpus;
+
+  if ( words->size == 1 )
+  {
+    if ( this->spawn.pinned )
+    {
+      spawn_format_cpus( &this->spawn.affinity, text, sizeof( text ) );
+      printf( "%s\n", text );
+    }
+    else
+    {
+      printf( "affinity: not set\n" );
+    }
+    return 0;
+  }
+
+  const char* first = list_string_get( words, 1 );
+  if ( first[ 0 ] == '%' )
+  {
+    job_t* job = job_table_parse( &this->jobs, first );
+    if ( job == NULL ) return 0;
+
+    if ( sched_getaffinity( job->pid, sizeof( cpus ), &cpus ) < 0 )
+    {
+      perror( "affinity" );
+      return 0;
+    }
+
+    spawn_format_cpus( &cpus, text, sizeof( text ) );
+    printf( "[%u]  %d %s\n", job->id, job->pid, text );
+    this->last_status = 0;
+    return 0;
+  }
+
+  if ( !spawn_parse_cpus( first, &cpus ) ) return 0;
+
+  if ( words->size == 2 )
+  {
+    this->spawn.pinned = true;
+    this->spawn.affinity = cpus;
+    this->last_status = 0;
+    return 0;
+  }
+
+  const char* second = list_string_get( words, 2 );
+  if ( second[ 0 ] == '%' )
+  {
+    job_t* job = job_table_parse( &this->jobs, second );
+    if ( job != NULL && spawn_pin( job->pid, &cpus ) )
+    {
+      this->last_status = 0;
+    }
+    return 0;
+  }
+
+  spawn->pinned = true;
+  spawn->affinity = cpus;
+  return 2;
+}
+
+/**
+ * Handles `timeout [-s SIGNAL] [-k GRACE] DURATION ...`, returning
+ * the number of words it used (or zero if it's malformed).
+ */
+static unsigned int shell_prefix_timeout( shell_t* this, const command_t* args,
+                                          spawn_t* spawn )
+{
+  // unused, just here for symmetry with the other prefixes
+  ( void )( this );
+
+  const list_t(string)* words = args->tokens;
+
+  unsigned int used = 1;
+  while ( used + 1 < words->size )
+  {
+    const char* option = list_string_get( words, used );
+    const char* value = list_string_get( words, used + 1 );
+
+    if ( strcmp( option, "-s" ) == 0 )
+    {
+      if ( ( spawn->timeout_signal = spawn_parse_signal( value ) ) == 0 )
+      {
+        printf( "timeout: %s: not a signal\n", value );
+        return 0;
+      }
+    }
+    else if ( strcmp( option, "-k" ) == 0 )
+    {
+      if ( !spawn_parse_duration( value, &spawn->grace ) )
+      {
+        printf( "timeout: %s: not a duration\n", value );
+        return 0;
+      }
+    }
+    else
+    {
+      break;
+    }
+
+    used += 2;
+  }
+
+  if ( used + 1 >= words->size )
+  {
+    printf( "usage: timeout [-s SIGNAL] [-k GRACE] DURATION command\n" );
+    return 0;
+  }
+
+  const char* duration = list_string_get( words, used );
+  if ( !spawn_parse_duration( duration, &spawn->timeout ) )
+  {
+    printf( "timeout: %s: not a duration\n", duration );
+    return 0;
+  }
+
+  return used + 1;
+}
+
+/**
+ * Gives the attributes the shell-wide timeout, i.e. TMOUT_CMD (with
+ * TMOUT_SIGNAL and TMOUT_GRACE), if it's set.
+ */
+static void shell_default_timeout( spawn_t* spawn )
+{
+  const char* timeout = getenv( "TMOUT_CMD" );
+  const char* signal = getenv( "TMOUT_SIGNAL" );
+  const char* grace = getenv( "TMOUT_GRACE" );
+
+  if ( timeout == NULL || *timeout == '\0' ) return;
+
+  if ( !spawn_parse_duration( timeout, &spawn->timeout ) )
+  {
+    printf( "TMOUT_CMD: %s: not a duration\n", timeout );
+  }
+  if ( signal != NULL && *signal != '\0'
+    && ( spawn->timeout_signal = spawn_parse_signal( signal ) ) == 0 )
+  {
+    printf( "TMOUT_SIGNAL: %s: not a signal\n", signal );
+    spawn->timeout_signal = SIGTERM;
+  }
+  if ( grace != NULL && *grace != '\0'
+    && !spawn_parse_duration( grace, &spawn->grace ) )
+  {
+    printf( "TMOUT_GRACE: %s: not a duration\n", grace );
+  }
+}
+
+/**
+ * Prints a limit, in the units `ulimit` takes it in.
+ */
+static void shell_print_limit( const spawn_t* spawn, const spawn_limit_t* limit,
+                               unsigned char half, bool described )
+{
+  rlim_t value = spawn_get_limit( spawn, limit->resource, half );
+
+  if ( described )
+  {
+    printf( "%-26s (-%c) ", limit->description, limit->option );
+  }
+
+  if ( value == RLIM_INFINITY )
+  {
+    printf( "unlimited\n" );
+  }
+  else
+  {
+    printf( "%llu\n", ( unsigned long long ) ( value / limit->unit ) );
+  }
+}
+
+/**
+ * Handles `ulimit [-S|-H] [-a|-LIMIT] [VALUE] ...`. When there's
+ * nothing after it, the limit is set for everything the shell
+ * starts from then on (though never the shell itself). Returns the
+ * number of words it used (or zero if it's malformed, or the whole
+ * command).
+ */
+static unsigned int shell_prefix_ulimit( shell_t* this, const command_t* args,
+                                         spawn_t* spawn )
+{
+  const list_t(string)* words = args->tokens;
+  const spawn_limit_t* limit = spawn_find_limit( 'f' );
+  unsigned char halves = 0;
+  bool all = false;
+
+  unsigned int used = 1;
+  for ( ; used < words->size; used++ )
+  {
+    const char* word = list_string_get( words, used );
+    if ( word[ 0 ] != '-' || word[ 1 ] == '\0' ) break;
+
+    const char* option;
+    for ( option = word + 1; *option != '\0'; option++ )
+    {
+      if ( *option == 'S' ) halves |= SPAWN_LIMIT_SOFT;
+      else if ( *option == 'H' ) halves |= SPAWN_LIMIT_HARD;
+      else if ( *option == 'a' ) all = true;
+      else if ( ( limit = spawn_find_limit( *option ) ) == NULL )
+      {
+        printf( "ulimit: -%c: unknown limit\n", *option );
+        return 0;
+      }
+    }
+  }
+
+  const char* value = used < words->size ? list_string_get( words, used ) : "";
+  char* end = NULL;
+  unsigned long long number = strtoull( value, &end, 10 );
+  bool unlimited = strcmp( value, "unlimited" ) == 0;
+
+  // no value => print the limit(s)
+  if ( all || ( !unlimited && ( end == value || *end != '\0' ) ) )
+  {
+    unsigned char half = halves == SPAWN_LIMIT_HARD
+      ? SPAWN_LIMIT_HARD
+      : SPAWN_LIMIT_SOFT;
+
+    if ( all )
+    {
+      for ( limit = spawn_all_limits(); limit->option != 0; limit++ )
+      {
+        shell_print_limit( spawn, limit, half, true );
+      }
+    }
+    else
+    {
+      shell_print_limit( spawn, limit, half, false );
+    }
+
+    this->last_status = 0;
+    return used < words->size ? used : 0;
+  }
+  used += 1;
+
+  rlim_t amount = unlimited ? RLIM_INFINITY : ( rlim_t ) number * limit->unit;
+  if ( halves == 0 ) halves = SPAWN_LIMIT_SOFT | SPAWN_LIMIT_HARD;
+
+  if ( used == words->size )
+  {
+    spawn_set_limit( &this->spawn, limit->resource, halves, amount );
+    this->last_status = 0;
+    return 0;
+  }
+
+  spawn_set_limit( spawn, limit->resource, halves, amount );
+  return used;
+}
+
+bool shell_prefix( shell_t* this, command_t* args, spawn_t* spawn )
+{
+  for ( ;; )
+  {
+    const char* name = command_get_name( args );
+    unsigned int used;
+
+    if ( name == NULL ) return true;
+
+    // prefixes which don't get as far as a command are failures,
+    // unless they say otherwise
+    if ( strcmp( name, "nice" ) == 0 || strcmp( name, "affinity" ) == 0
+      || strcmp( name, "ulimit" ) == 0 || strcmp( name, "timeout" ) == 0 )
+    {
+      this->last_status = 1;
+    }
+
+    if ( strcmp( name, "nice" ) == 0 )
+    {
+      used = shell_prefix_nice( this, args, spawn );
+    }
+    else if ( strcmp( name, "affinity" ) == 0 )
+    {
+      used = shell_prefix_affinity( this, args, spawn );
+    }
+    else if ( strcmp( name, "ulimit" ) == 0 )
+    {
+      used = shell_prefix_ulimit( this, args, spawn );
+    }
+    else if ( strcmp( name, "timeout" ) == 0 )
+    {
+      used = shell_prefix_timeout( this, args, spawn );
+    }
+    else
+    {
+      return true;
+    }
+
+    if ( used == 0 ) return false;
+
+    // (the words live in the arena, so there's nothing to free)
+    while ( used-- > 0 )
+    {
+      list_string_pop( args->tokens );
+    }
+  }
+}
+
+/**
+ * Counts a command's text and words as part of the history once it's
+ * kept there (or, if [kept] is false, as what they were again).
+ */
+static void shell_history_retag( command_t* command, bool kept )
+{
+#ifdef MEMSTATS
+  mem_tag_t strings = kept ? MEM_STRINGS : MEM_HISTORY;
+  mem_tag_t tokens = kept ? MEM_TOKENS : MEM_HISTORY;
+  mem_tag_t to = kept ? MEM_HISTORY : MEM_STRINGS;
+
+  mem_retag( strings, to, command->string );
+
+  const list_node_t(string)* node;
+  for ( node = command->heredocs->head; node != NULL; node = node->next )
+  {
+    mem_retag( strings, to, node->data );
+  }
+
+  to = kept ? MEM_HISTORY : MEM_TOKENS;
+  for ( node = command->tokens->head; node != NULL; node = node->next )
+  {
+    mem_retag( tokens, to, node->data );
+  }
+#endif
+}
+
+void shell_history_release( command_t* command )
+{
+  if ( command->references == 1 )
+  {
+    shell_history_retag( command, false );
+  }
+
+  command_release( command );
+}
+
+bool shell_run_command( shell_t* this, command_t* command )
+{
+  // absolutely do not run anything if there is still a
+  // foreground process
+  if ( this->current_pid != 0 )
+  {
+    command_release( command );
+    return true;
+  }
+
+  // blank lines don't do anything, and aren't worth remembering
+  if ( command_get_name( command ) == NULL )
+  {
+    command_release( command );
+    return true;
+  }
+
+  // add the command to our history (unless it's being run again from
+  // there, in which case it's already counted as part of it)
+  if ( command->references == 1 )
+  {
+    shell_history_retag( command, true );
+  }
+  this->cmd_history->fun->enqueue( this->cmd_history, command );
+
+  // and the other sessions' (but only once `!` lookups have been
+  // resolved, to the command they ran)
+  if ( this->shared_history != NULL && command_get_name( command )[ 0 ] != '!' )
+  {
+    histring_append( this->shared_history, command->string );
+  }
+
+  return shell_execute( this, command );
+}
+
+/**
+ * Runs the command, the same as [shell_execute], except that the
+ * given alias (the one which produced the command) isn't expanded
+ * again, so aliases can refer to programs of the same name.
+ */
+static bool shell_execute_from( shell_t* this, const command_t* command,
+                                const function_t* from )
+{
+  // stop runaway recursion before it takes the shell down with it
+  if ( this->depth >= SHELL_MAX_DEPTH )
+  {
+    printf( "Aliases or functions nested too deeply\n" );
+    return true;
+  }
+  this->depth += 1;
+
+  bool running = true;
+  const char* name = command_get_name( command );
+  const function_t* alias = NULL;
+  list_t(command_t) commands = list(command_t);
+
+  if ( name == NULL || shell_define( this, command ) )
+  {
+    // nothing else to do
+  }
+  // lists of commands run one after another
+  else if ( command_split( command, &commands ) )
+  {
+    while ( commands.size > 0 )
+    {
+      command_t* next = commands.fun->pop( &commands );
+
+      // (a `return` skips the rest of them, as well)
+      if ( running && !this->returning )
+      {
+        running = shell_execute( this, next );
+        shell_wait( this );
+      }
+
+      command_destroy( next );
+      free( next );
+    }
+  }
+  // aliases just replace the name with their (pre-tokenized) text
+  else if ( ( alias = function_table_get( &this->aliases, name ) ) != NULL
+         && alias != from )
+  {
+    const command_t* text = alias->body->fun->get( alias->body, 0 );
+
+    command_t aliased;
+    command_copy( &aliased, text );
+    mem_free( MEM_STRINGS, aliased.string );
+    aliased.string = mem_strdup( MEM_STRINGS, command->string );
+
+    unsigned int index;
+    for ( index = 1; index < command->tokens->size; index++ )
+    {
+      const char* token = command->tokens->fun->get( command->tokens, index );
+      aliased.tokens->fun->enqueue( aliased.tokens, mem_strdup( MEM_TOKENS, token ) );
+    }
+    for ( index = 0; index < command->heredocs->size; index++ )
+    {
+      const char* body = command->heredocs->fun->get( command->heredocs, index );
+      aliased.heredocs->fun->enqueue( aliased.heredocs, mem_strdup( MEM_STRINGS, body ) );
+    }
+
+    running = shell_execute_from( this, &aliased, alias );
+    command_destroy( &aliased );
+  }
+  else
+  {
+    running = shell_dispatch( this, command );
+  }
+
+  commands.fun->destroy( &commands );
+  this->depth -= 1;
+
+  return running;
+}
+
+bool shell_execute( shell_t* this, const command_t* command )
+{
+  return shell_execute_from( this, command, NULL );
+}
+
+/**
+ * Starts a program, through the helper if there is one. The helper
+ * is only given the shell's stdin, stdout and stderr, so a program
+ * which needs anything else (i.e. redirects another descriptor, or
+ * has a process substitution) is forked by the shell itself.
+ */
+static pid_t shell_launch( shell_t* this, const command_t* args,
+                           const spawn_t* spawn )
+{
+  // (nor would it have the ends of any process substitutions' pipes)
+  bool remote = this->zygote != NULL && this->substituted.size == 0;
+
+  unsigned int index;
+  for ( index = 0; remote && index < args->redirects->size; index++ )
+  {
+    const redirect_t* redirect = args->redirects->fun->get( args->redirects, index );
+    remote = redirect->fd <= 2 && redirect->kind != REDIRECT_CLOSE;
+  }
+
+  if ( !remote ) return command_exec( args, spawn );
+
+  // the redirections are made here, and handed over as they are
+  redirect_saved_t saved;
+  saved.count = 0;
+
+  pid_t pid = -1;
+  bool redirected = shell_redirect_saved( args, &saved );
+  if ( redirected )
+  {
+    remote = zygote_spawn( this->zygote, args, spawn, &pid );
+  }
+  redirect_restore( &saved );
+
+  if ( !redirected )
+  {
+    this->last_status = 1;
+    return -1;
+  }
+
+  return remote ? pid : command_exec( args, spawn );
+}
+
+/**
+ * Starts a program in the background, as a new job. If the jobs'
+ * output is being collected, it gets pipes for its stdout and stderr
+ * (instead of the terminal) for the shell to drain.
+ */
+static void shell_background( shell_t* this, const command_t* args,
+                              const spawn_t* spawn )
+{
+  int read[ 2 ], write[ 2 ], saved[ 2 ];
+  bool piped = this->mux != NULL && mux_pipes( read, write );
+
+  // the pipes stand in for stdout and stderr while it's started
+  if ( piped )
+  {
+    fflush( stdout );
+    fflush( stderr );
+
+    int i;
+    for ( i = 0; i < 2; i++ )
+    {
+      saved[ i ] = fcntl( i + 1, F_DUPFD_CLOEXEC, 3 );
+      dup2( write[ i ], i + 1 );
+      close( write[ i ] );
+    }
+  }
+
+  pid_t pid = shell_launch( this, args, spawn );
+
+  if ( piped )
+  {
+    int i;
+    for ( i = 0; i < 2; i++ )
+    {
+      dup2( saved[ i ], i + 1 );
+      close( saved[ i ] );
+    }
+  }
+
+  this->pid_history->fun->enqueue( this->pid_history, pid );
+
+  if ( pid <= 0 )
+  {
+    if ( piped )
+    {
+      close( read[ 0 ] );
+      close( read[ 1 ] );
+    }
+    return;
+  }
+
+  job_t* job = job_table_add( &this->jobs, pid, JOB_RUNNING );
+  printf( "[%u] %d\n", job->id, pid );
+
+  if ( piped )
+  {
+    mux_add( this->mux, job->id, read );
+  }
+}
+
+void shell_coproc( shell_t* this, command_t* args, spawn_t* spawn )
+{
+  if ( args->tokens->size < 3 )
+  {
+    printf( "usage: coproc NAME COMMAND...\n" );
+    this->last_status = 2;
+    return;
+  }
+
+  // (the name of one which has finished can be used again)
+  shell_reap( this );
+
+  const char* name = list_string_get( args->tokens, 1 );
+  if ( job_table_named( &this->jobs, name ) != NULL )
+  {
+    printf( "coproc: %s is already running\n", name );
+    this->last_status = 1;
+    return;
+  }
+  char* copy = mem_strdup( MEM_JOBS, name );
+
+  // the rest is the command to run
+  unsigned int words;
+  for ( words = 0; words < 2; words++ )
+  {
+    char* word = list_string_pop( args->tokens );
+    if ( args->arena == NULL ) mem_free( MEM_TOKENS, word );
+  }
+
+  int input[ 2 ], output[ 2 ];
+  if ( pipe2( input, O_CLOEXEC ) < 0 )
+  {
+    input[ 0 ] = -1;
+  }
+  else if ( pipe2( output, O_CLOEXEC ) < 0 )
+  {
+    close( input[ 0 ] );
+    close( input[ 1 ] );
+    input[ 0 ] = -1;
+  }
+  if ( input[ 0 ] == -1 )
+  {
+    perror( "pipe" );
+    mem_free( MEM_JOBS, copy );
+    this->last_status = 1;
+    return;
+  }
+
+  // the pipes stand in for its stdin and stdout while it's started
+  // (and it gets a group of its own, but never the terminal, the same
+  // as any other job)
+  fflush( stdout );
+  int saved_in = fcntl( STDIN_FILENO, F_DUPFD_CLOEXEC, 3 );
+  int saved_out = fcntl( STDOUT_FILENO, F_DUPFD_CLOEXEC, 3 );
+  dup2( input[ 0 ], STDIN_FILENO );
+  dup2( output[ 1 ], STDOUT_FILENO );
+
+  spawn->group = true;
+  spawn->terminal = false;
+  pid_t pid = shell_launch( this, args, spawn );
+
+  dup2( saved_in, STDIN_FILENO );
+  dup2( saved_out, STDOUT_FILENO );
+  close( saved_in );
+  close( saved_out );
+  close( input[ 0 ] );
+  close( output[ 1 ] );
+
+  this->pid_history->fun->enqueue( this->pid_history, pid );
+
+  if ( pid <= 0 )
+  {
+    close( input[ 1 ] );
+    close( output[ 0 ] );
+    mem_free( MEM_JOBS, copy );
+    return;
+  }
+
+  job_t* job = job_table_add( &this->jobs, pid, JOB_RUNNING );
+  job->name = copy;
+  job->input = input[ 1 ];
+  job->output = output[ 0 ];
+
+  printf( "[%u] %d\n", job->id, pid );
+  this->last_status = 0;
+}
+
+bool shell_dispatch( shell_t* this, const command_t* command )
+{
+  // (any process substitutions it has are only for it)
+  size_t substituted = this->substituted.size / sizeof( int );
+
+  // expand what the user typed into the arguments we'll actually run
+  command_t args;
+  expansion_t expansion;
+  expansion_init( &expansion, this );
+  bool expanded = expansion_expand( &expansion, command, &args );
+  expansion_destroy( &expansion );
+
+  bool running = true;
+  const char* name = NULL;
+  const function_t* function = NULL;
+
+  // a `&` on the end runs the program in the background, as a job
+  // (it's checked before expansion, so a quoted one doesn't count)
+  bool background = command->tokens->size > 0
+    && strcmp( list_string_get( command->tokens, command->tokens->size - 1 ),
+               "&" ) == 0;
+
+  // programs run in the foreground get a process group of their own,
+  // which gets the terminal (if the shell has it to give)
+  spawn_t spawn = this->spawn;
+  spawn.group = true;
+  spawn.terminal = !background && shell_has_terminal();
+  if ( !background ) shell_default_timeout( &spawn );
+
+  if ( expanded && background && args.tokens->size > 0 )
+  {
+    char* word = list_string_pop_back( args.tokens );
+    if ( args.arena == NULL ) mem_free( MEM_TOKENS, word );
+  }
+
+  if ( !expanded )
+  {
+    // it was malformed, so there's nothing to run (which counts as
+    // it having failed)
+    this->last_status = 1;
+  }
+  else if ( !shell_prefix( this, &args, &spawn ) )
+  {
+    // the prefixes were all there was to it
+  }
+  else if ( ( name = command_get_name( &args ) ) == NULL )
+  {
+    // nothing but assignments, so they're for the shell itself
+    command_assign( &args );
+  }
+  // functions come first, so they can wrap anything else
+  else if ( ( function = function_table_get( &this->functions, name ) ) != NULL )
+  {
+    running = shell_call( this, function, &args );
+  }
+  else if ( strcmp( name, "exit" ) == 0
+         || strcmp( name, "quit" ) == 0 )
+  {
+    running = false;
+  }
+  else if ( strcmp( name, "fg" ) == 0 )
+  {
+    // resume the given (or next suspended) job, and set it as the
+    // foreground process (i.e. wait for it)
+    job_t* job = NULL;
+    if ( shell_job_argument( this, &args, &job ) )
+    {
+      if ( job == NULL ) job = job_table_last( &this->jobs, JOB_STOPPED );
+      if ( job == NULL ) job = job_table_last( &this->jobs, JOB_RUNNING );
+
+      if ( job != NULL && shell_has_terminal() )
+      {
+        tcsetpgrp( STDIN_FILENO, job->pid );
+        this->current_spawn.terminal = true;
+      }
+
+      pid_t pid = shell_resume( this, job );
+      if ( job != NULL ) job_table_remove( &this->jobs, job );
+      this->current_pid = pid;
+    }
+  }
+  else if ( strcmp( name, "bg" ) == 0 )
+  {
+    // just resume it, don't set it as the foreground process
+    job_t* job = NULL;
+    if ( shell_job_argument( this, &args, &job ) )
+    {
+      shell_resume( this, job );
+    }
+  }
+  // (cached commands are waited on there and then, even with a `&`)
+  else if ( strcmp( name, "cached" ) == 0 )
+  {
+    shell_cached( this, &args, &spawn );
+  }
+  // (a coprocess is always a job, with or without a `&`)
+  else if ( strcmp( name, "coproc" ) == 0 )
+  {
+    shell_coproc( this, &args, &spawn );
+  }
+  // try to run a built-in command, if this fails, then
+  // finally try to run the command by searching paths
+  else if ( shell_run_bi( this, &args ) )
+  {
+    // (built-ins run in the shell, even with a `&`)
+  }
+  else if ( background )
+  {
+    shell_background( this, &args, &spawn );
+  }
+  else
+  {
+    // set the currently running process (in case a signal arrives,
+    // so the correct process will receive it)
+    pid_t pid = shell_launch( this, &args, &spawn );
+    if ( pid > 0 )
+    {
+      this->current_pid = pid;
+      this->current_spawn = spawn;
+    }
+    else if ( spawn.terminal )
+    {
+      tcsetpgrp( STDIN_FILENO, getpgrp() );
+    }
+    this->pid_history->fun->enqueue( this->pid_history, pid );
+  }
+
+  shell_substituted_close( this, substituted );
+  command_destroy( &args );
+
+  return running;
+}
+
+/**
+ * Copies what a cached command writes to its pipes ([out] and [err])
+ * through to the shell's own stdout and stderr, recording it into
+ * [entry] (if not NULL) as it goes, until both are closed. If it runs
+ * out of time, it's killed the same as if it were being waited on.
+ * Returns [false] if it had to be.
+ */
+static bool shell_cached_copy( pid_t pid, const spawn_t* spawn, int out, int err,
+                               cache_entry_t* entry )
+{
+  struct pollfd fds[ 3 ] = { { out, POLLIN, 0 }, { err, POLLIN, 0 }, { -1, POLLIN, 0 } };
+  unsigned int open = 2;
+  unsigned int escalation = 0;
+
+  if ( spawn->timeout > 0 )
+  {
+    fds[ 2 ].fd = timerfd_create( CLOCK_MONOTONIC, TFD_CLOEXEC );
+    shell_arm( fds[ 2 ].fd, spawn->timeout );
+  }
+
+  char* data = malloc( CAPTURE_READ_SIZE );
+
+  while ( open > 0 )
+  {
+    if ( poll( fds, 3, -1 ) < 0 ) continue;
+
+    uint64_t expirations;
+    if ( ( fds[ 2 ].revents & POLLIN ) != 0
+      && read( fds[ 2 ].fd, &expirations, sizeof( expirations ) ) > 0 )
+    {
+      escalation = shell_escalate( pid, spawn, escalation, fds[ 2 ].fd );
+    }
+
+    unsigned int index;
+    for ( index = 0; index < 2; index++ )
+    {
+      if ( fds[ index ].fd == -1 || fds[ index ].revents == 0 ) continue;
+
+      ssize_t count = read( fds[ index ].fd, data, CAPTURE_READ_SIZE );
+      if ( count < 0 && errno == EINTR ) continue;
+
+      if ( count <= 0 )
+      {
+        close( fds[ index ].fd );
+        fds[ index ].fd = -1;
+        open -= 1;
+        continue;
+      }
+
+      // (stdout for the first pipe, stderr for the second)
+      ssize_t written = 0;
+      while ( written < count )
+      {
+        ssize_t step = write( index + 1, data + written, count - written );
+        if ( step < 0 && errno == EINTR ) continue;
+        if ( step <= 0 ) break;
+        written += step;
+      }
+
+      if ( entry != NULL ) cache_record( entry, index + 1, data, count );
+    }
+  }
+
+  free( data );
+  if ( fds[ 2 ].fd != -1 ) close( fds[ 2 ].fd );
+
+  return escalation == 0;
+}
+
+void shell_cached( shell_t* this, command_t* args, spawn_t* spawn )
+{
+  const char* inputs = NULL;
+  const char* env = NULL;
+  bool mtime = false;
+
+  unsigned int first = 1;
+  while ( first < args->tokens->size )
+  {
+    const char* option = list_string_get( args->tokens, first );
+    bool valued = first + 1 < args->tokens->size;
+
+    if ( strcmp( option, "--inputs" ) == 0 && valued )
+    {
+      inputs = list_string_get( args->tokens, first + 1 );
+      first += 2;
+    }
+    else if ( strcmp( option, "--env" ) == 0 && valued )
+    {
+      env = list_string_get( args->tokens, first + 1 );
+      first += 2;
+    }
+    else if ( strcmp( option, "--mtime" ) == 0 )
+    {
+      mtime = true;
+      first += 1;
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if ( first >= args->tokens->size )
+  {
+    printf( "usage: cached [--inputs FILES] [--env NAMES] [--mtime] COMMAND...\n" );
+    this->last_status = 2;
+    return;
+  }
+
+  cache_key_t key;
+  cache_key( &key, args, first, inputs, env, mtime );
+
+  // what it writes goes where the command would have written it, the
+  // same as a built-in's output (so a miss records what it wrote, not
+  // what was left after its own redirections, and a hit replays it to
+  // the same place)
+  redirect_saved_t saved;
+  saved.count = 0;
+
+  int status;
+  fflush( stdout );
+  bool redirected = shell_redirect_saved( args, &saved );
+  bool replayed = redirected && cache_replay( &key, &status );
+
+  if ( !redirected || replayed )
+  {
+    redirect_restore( &saved );
+    this->last_status = replayed ? status : 1;
+    return;
+  }
+
+  // otherwise, the rest is the command to run (the options are still
+  // needed until here, as [inputs] and [env] point at them)
+  while ( first-- > 0 )
+  {
+    char* word = list_string_pop( args->tokens );
+    if ( args->arena == NULL ) mem_free( MEM_TOKENS, word );
+  }
+
+  cache_entry_t entry;
+  bool recording = cache_begin( &entry, &key );
+
+  int out[ 2 ], err[ 2 ];
+  if ( pipe2( out, O_CLOEXEC ) < 0 )
+  {
+    out[ 0 ] = -1;
+  }
+  else if ( pipe2( err, O_CLOEXEC ) < 0 )
+  {
+    close( out[ 0 ] );
+    close( out[ 1 ] );
+    out[ 0 ] = -1;
+  }
+  if ( out[ 0 ] == -1 )
+  {
+    perror( "pipe" );
+    if ( recording ) cache_abort( &entry );
+    redirect_restore( &saved );
+    this->last_status = 1;
+    return;
+  }
+
+  // it starts with the pipes as its stdout and stderr (its redirections
+  // having been made already), and stays in the shell's group, since
+  // the shell isn't giving it the terminal
+  fflush( stdout );
+  fflush( stderr );
+  int saved_out = fcntl( STDOUT_FILENO, F_DUPFD_CLOEXEC, 3 );
+  int saved_err = fcntl( STDERR_FILENO, F_DUPFD_CLOEXEC, 3 );
+  dup2( out[ 1 ], STDOUT_FILENO );
+  dup2( err[ 1 ], STDERR_FILENO );
+
+  list_t(redirect_t)* redirects = args->redirects;
+  args->redirects = list_u(redirect_t);
+
+  spawn->group = false;
+  spawn->terminal = false;
+  pid_t pid = command_exec( args, spawn );
+
+  delete( args->redirects );
+  args->redirects = redirects;
+
+  dup2( saved_out, STDOUT_FILENO );
+  dup2( saved_err, STDERR_FILENO );
+  close( saved_out );
+  close( saved_err );
+  close( out[ 1 ] );
+  close( err[ 1 ] );
+
+  this->pid_history->fun->enqueue( this->pid_history, pid );
+
+  bool finished = shell_cached_copy( pid, spawn, out[ 0 ], err[ 0 ],
+                                     recording ? &entry : NULL );
+
+  status = 0;
+  while ( pid > 0 && waitpid( pid, &status, 0 ) < 0 && errno == EINTR );
+
+  // (only what it finished on its own is worth replaying)
+  bool keep = pid > 0 && finished && WIFEXITED( status );
+  if ( recording && keep )
+  {
+    cache_commit( &entry, WEXITSTATUS( status ) );
+  }
+  else if ( recording )
+  {
+    cache_abort( &entry );
+  }
+
+  redirect_restore( &saved );
+
+  this->last_status = pid > 0 ? shell_exit_status( status ) : 1;
+  if ( !finished )
+  {
+    this->last_status = SHELL_TIMEOUT_STATUS;
+    printf( KRED "! [%d] timed out after %gs\n" KNRM, pid, spawn->timeout );
+  }
+}
+
+bool shell_define( shell_t* this, const command_t* command )
+{
+  unsigned int size = command->tokens->size;
+
+  if ( size < 2 ) return false;
+
+  const char* first = list_string_get( command->tokens, 0 );
+  size_t length = strlen( first );
+  unsigned int body_start;
+  size_t name_length;
+
+  // name() { ... }
+  if ( length > 2 && strcmp( first + length - 2, "()" ) == 0
+    && strcmp( list_string_get( command->tokens, 1 ), "{" ) == 0 )
+  {
+    name_length = length - 2;
+    body_start = 2;
+  }
+  // name(){ ... }
+  else if ( length > 3 && strcmp( first + length - 3, "(){" ) == 0 )
+  {
+    name_length = length - 3;
+    body_start = 1;
+  }
+  // name () { ... }
+  else if ( size > 2 && strcmp( list_string_get( command->tokens, 1 ), "()" ) == 0
+         && strcmp( list_string_get( command->tokens, 2 ), "{" ) == 0 )
+  {
+    name_length = length;
+    body_start = 3;
+  }
+  else
+  {
+    return false;
+  }
+
+  if ( strcmp( list_string_get( command->tokens, size - 1 ), "}" ) != 0 )
+  {
+    printf( "%s: missing '}' at the end of the function\n", first );
+    return true;
+  }
+
+  size_t i;
+  for ( i = 0; i < name_length; i++ )
+  {
+    if ( first[ i ] != '_' && first[ i ] != '-' && !isalnum( ( unsigned char ) first[ i ] ) )
+    {
+      printf( "%.*s: not a valid function name\n", ( int ) name_length, first );
+      return true;
+    }
+  }
+
+  // tokenize (and split up) the body once, right now
+  command_t body;
+  command_slice( &body, command, body_start, size - 1 );
+
+  list_t(command_t)* commands = list_u(command_t);
+  if ( !command_split( &body, commands ) && body.tokens->size > 0 )
+  {
+    command_t* single = malloc( sizeof( *single ) );
+    command_copy( single, &body );
+    commands->fun->enqueue( commands, single );
+  }
+  command_destroy( &body );
+
+  char* name = strndup( first, name_length );
+  function_table_set( &this->functions, name, command->string, commands );
+  free( name );
+
+  return true;
+}
+
+bool shell_call( shell_t* this, const function_t* function, const command_t* args )
+{
+  redirect_saved_t saved;
+  saved.count = 0;
+
+  bool running = true;
+  if ( shell_redirect_saved( args, &saved ) )
+  {
+    const command_t* outer = this->arguments;
+    this->arguments = args;
+
+    unsigned int index;
+    for ( index = 0; running && !this->returning && index < function->body->size;
+          index++ )
+    {
+      running = shell_execute( this, function->body->fun->get( function->body, index ) );
+      shell_wait( this );
+    }
+
+    // (a `return` only leaves the innermost function)
+    this->returning = false;
+    this->arguments = outer;
+  }
+
+  redirect_restore( &saved );
+
+  return running;
+}
+
+int shell_exit_status( int status )
+{
+  if ( WIFSIGNALED( status ) )
+  {
+    return 128 + WTERMSIG( status );
+  }
+
+  return WEXITSTATUS( status );
+}
+
+/**
+ * Reads everything left in [fd] onto the end of the buffer, in large
+ * chunks right into it.
+ */
+static void shell_capture_read( int fd, buffer_t* out )
+{
+  for ( ;; )
+  {
+    char* into = buffer_reserve( out, CAPTURE_READ_SIZE );
+    ssize_t count = read( fd, into, CAPTURE_READ_SIZE );
+
+    if ( count < 0 && errno == EINTR ) continue;
+    if ( count <= 0 ) break;
+
+    out->size += count;
+  }
+}
+
+/**
+ * Sets up a forked copy of the shell (for a `$(...)` or a process
+ * substitution) to run a command on its own, with [inner] (one of
+ * [pipe_fds]) as its [target] descriptor, and neither end of the pipe
+ * left open otherwise.
+ */
+static void shell_fork_init( shell_t* this, const int pipe_fds[ 2 ], int inner,
+                             int target )
+{
+  dup2( inner, target );
+  close( pipe_fds[ 0 ] );
+  close( pipe_fds[ 1 ] );
+
+  // the helper is the shell's, not this copy's, to talk to (anything it
+  // started would have its exit reported to the wrong process, and what
+  // the shell started would have its exit taken from it)
+  this->zygote = NULL;
+}
+
+/**
+ * Runs an (expanded) command in a forked copy of the shell, whose
+ * stdin and stdout have already been set up (see shell_fork_init),
+ * exiting with its status.
+ */
+static void shell_subshell( shell_t* this, command_t* args, spawn_t* spawn,
+                            const char* name )
+{
+  // functions can run anything, so they get a whole
+  // subshell to write into the pipe from
+  const function_t* function = function_table_get( &this->functions, name );
+  if ( function != NULL )
+  {
+    shell_call( this, function, args );
+    shell_wait( this );
+    fflush( stdout );
+    _exit( this->last_status );
+  }
+
+  // (as does a cached command, so it can be replayed into it)
+  if ( strcmp( name, "cached" ) == 0 )
+  {
+    shell_cached( this, args, spawn );
+    fflush( stdout );
+    _exit( this->last_status );
+  }
+
+  if ( shell_run_bi( this, args ) )
+  {
+    fflush( stdout );
+    _exit( this->last_status );
+  }
+
+  if ( !spawn_apply( spawn ) ) _exit( 1 );
+  command_execv( args );
+}
+
+/**
+ * Checks if the (expanded) command is a built-in which can be run
+ * inside the shell itself when its output is being captured, i.e.
+ * one which only prints, and has no assignments (which would stick).
+ * Anything else is run in a forked copy of the shell, so a `$(cd /)`
+ * can't change where the shell itself is.
+ */
+static bool shell_bi_in_capture( const command_t* args, const char* name )
+{
+  if ( args->assignments->size > 0 ) return false;
+
+  const shell_bi_t* builtin;
+  for ( builtin = g_builtins; builtin->name != NULL; builtin++ )
+  {
+    if ( strcmp( name, builtin->name ) == 0 ) return !builtin->stateful;
+  }
+
+  // (which includes `!N`, since it could run anything)
+  return false;
+}
+
+void shell_capture( shell_t* this, const char* line, buffer_t* out )
+{
+  size_t substituted = this->substituted.size / sizeof( int );
+
+  command_t command;
+  command_init( &command );
+  command.string = mem_strdup( MEM_STRINGS, line );
+  command_parse( &command, line );
+
+  command_t args;
+  expansion_t expansion;
+  expansion_init( &expansion, this );
+  bool expanded = expansion_expand( &expansion, &command, &args );
+  expansion_destroy( &expansion );
+
+  spawn_t spawn = this->spawn;
+  const char* name = NULL;
+
+  if ( !expanded || !shell_prefix( this, &args, &spawn ) )
+  {
+    // there's nothing to run
+  }
+  else if ( ( name = command_get_name( &args ) ) == NULL )
+  {
+    // (assignments on their own would only have been made in the
+    // subshell, so they're not made at all)
+  }
+  else if ( shell_bi_in_capture( &args, name ) )
+  {
+    // built-ins run in the shell, so their stdout is swapped for a
+    // file in memory (rather than a pipe, which they could fill up
+    // with nothing reading it) for as long as they're running, which
+    // their own redirections are still made on top of
+    int capture = memfd_create( "msh-capture", MFD_CLOEXEC );
+    if ( capture < 0 )
+    {
+      perror( "memfd_create" );
+    }
+    else
+    {
+      fflush( stdout );
+      int saved = fcntl( STDOUT_FILENO, F_DUPFD_CLOEXEC, 3 );
+      dup2( capture, STDOUT_FILENO );
+
+      shell_run_bi( this, &args );
+
+      fflush( stdout );
+      dup2( saved, STDOUT_FILENO );
+      close( saved );
+
+      lseek( capture, 0, SEEK_SET );
+      shell_capture_read( capture, out );
+      close( capture );
+    }
+  }
+  else
+  {
+    int pipe_fds[ 2 ];
+    if ( pipe2( pipe_fds, O_CLOEXEC ) < 0 )
+    {
+      perror( "pipe" );
+    }
+    else
+    {
+      fflush( stdout );
+      pid_t pid = fork();
+
+      if ( pid == 0 )
+      {
+        shell_fork_init( this, pipe_fds, pipe_fds[ 1 ], STDOUT_FILENO );
+        shell_subshell( this, &args, &spawn, name );
+      }
+      close( pipe_fds[ 1 ] );
+      shell_substituted_close( this, substituted );
+
+      shell_capture_read( pipe_fds[ 0 ], out );
+      close( pipe_fds[ 0 ] );
+
+      int status;
+      if ( pid > 0 && waitpid( pid, &status, 0 ) > 0 )
+      {
+        this->last_status = shell_exit_status( status );
+      }
+    }
+  }
+
+  shell_substituted_close( this, substituted );
+  command_destroy( &args );
+  command_destroy( &command );
+}
+
+int shell_substitute( shell_t* this, const char* line, bool output )
+{
+  int pipe_fds[ 2 ];
+  if ( pipe2( pipe_fds, O_CLOEXEC ) < 0 )
+  {
+    perror( "pipe" );
+    return -1;
+  }
+
+  // its end of the pipe is its stdin for a `>(...)`, otherwise stdout
+  int inner = output ? pipe_fds[ 0 ] : pipe_fds[ 1 ];
+  int outer = output ? pipe_fds[ 1 ] : pipe_fds[ 0 ];
+
+  fflush( stdout );
+  pid_t pid = fork();
+
+  if ( pid == 0 )
+  {
+    // it gets a group of its own (so it's never given the terminal out
+    // from under the command it's for), and only its own end of its own
+    // pipe, so the others see the end of their input when they should
+    setpgid( 0, 0 );
+    shell_fork_init( this, pipe_fds, inner,
+                     output ? STDIN_FILENO : STDOUT_FILENO );
+    shell_substituted_close( this, 0 );
+
+    command_t command;
+    command_init( &command );
+    command.string = mem_strdup( MEM_STRINGS, line );
+    command_parse( &command, line );
+
+    command_t args;
+    expansion_t expansion;
+    expansion_init( &expansion, this );
+    bool expanded = expansion_expand( &expansion, &command, &args );
+    expansion_destroy( &expansion );
+
+    spawn_t spawn = this->spawn;
+    const char* name = NULL;
+
+    if ( !expanded || !shell_prefix( this, &args, &spawn ) )
+    {
+      _exit( 1 );
+    }
+    else if ( ( name = command_get_name( &args ) ) == NULL )
+    {
+      _exit( 0 );
+    }
+
+    shell_subshell( this, &args, &spawn, name );
+  }
+
+  close( inner );
+
+  if ( pid < 0 )
+  {
+    perror( "fork" );
+    close( outer );
+    return -1;
+  }
+
+  // the command it's for inherits the other end
+  fcntl( outer, F_SETFD, 0 );
+  buffer_append( &this->substituted, &outer, sizeof( outer ) );
+  buffer_append( &this->substitutions, &pid, sizeof( pid ) );
+
+  return outer;
+}
+
+//
+// Built-in Command definitions
+//
+
+void ( *shell_find_bi( const char* name ) )( shell_t*, const command_t* )
+{
+  // just test the command's name against the built-in ones
+  const shell_bi_t* builtin;
+  for ( builtin = g_builtins; builtin->name != NULL; builtin++ )
+  {
+    if ( strcmp( name, builtin->name ) == 0 )
+    {
+      return builtin->run;
+    }
+  }
+
+  if ( name[ 0 ] == '!' )
+  {
+    return &shell_bi_run_history;
+  }
+
+  return NULL;
+}
+
+bool shell_run_bi( shell_t* this, const command_t* command )
+{
+  void ( *run )( shell_t*, const command_t* ) =
+    shell_find_bi( command_get_name( command ) );
+
+  // couldn't find a command, so oh well
+  if ( run == NULL ) return false;
+
+  // assignments before a built-in stick around in the shell
+  command_assign( command );
+
+  // built-ins run inside the shell itself, so their redirections
+  // have to be undone once they're finished
+  redirect_saved_t saved;
+  saved.count = 0;
+
+  if ( shell_redirect_saved( command, &saved ) )
+  {
+    run( this, command );
+  }
+
+  redirect_restore( &saved );
+
+  return true;
+}
+
+bool shell_redirect_saved( const command_t* command, redirect_saved_t* saved )
+{
+  unsigned int index;
+  for ( index = 0; index < command->redirects->size; index++ )
+  {
+    const redirect_t* redirect =
+      command->redirects->fun->get( command->redirects, index );
+
+    if ( !redirect_apply_saved( redirect, saved ) )
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Changes the shell's working directory, keeping PWD and OLDPWD up to
+ * date and recording the visit (for `j`). Returns [false] (after
+ * telling the user why) if it couldn't.
+ */
+static bool shell_chdir( shell_t* this, const char* dir )
+{
+  char old[ PATH_MAX ];
+  bool known = getcwd( old, sizeof( old ) ) != NULL;
+
+  if ( dir == NULL || chdir( dir ) < 0 )
+  {
+    perror( dir == NULL ? "cd" : dir );
+    this->last_status = 1;
+    return false;
+  }
+
+  if ( known ) setenv( "OLDPWD", old, 1 );
+
+  char cwd[ PATH_MAX ];
+  if ( getcwd( cwd, sizeof( cwd ) ) != NULL )
+  {
+    setenv( "PWD", cwd, 1 );
+    frecency_visit( &this->dirs, cwd );
+  }
+
+  this->last_status = 0;
+  return true;
+}
+
+void shell_bi_cd( shell_t* this, const command_t* command )
+{
+  const char* dir; 
+
+  if ( command->tokens->size < 2 )
+  {
+    dir = getenv( "HOME" );
+    if ( dir == NULL )
+    {
+      printf( "cd: HOME not set\n" );
+      this->last_status = 1;
+      return;
+    }
+  }
+  else
+  {
+    dir = command->tokens->fun->get( command->tokens, 1 );
+  }
+
+  // `cd -` goes back to where the last cd came from (and says where)
+  if ( strcmp( dir, "-" ) == 0 )
+  {
+    dir = getenv( "OLDPWD" );
+    if ( dir == NULL )
+    {
+      printf( "cd: OLDPWD not set\n" );
+      this->last_status = 1;
+      return;
+    }
+
+    char* previous = strdup( dir );
+    if ( shell_chdir( this, previous ) ) printf( "%s\n", previous );
+    free( previous );
+    return;
+  }
+
+  shell_chdir( this, dir );
+}
+
+void shell_bi_j( shell_t* this, const command_t* command )
+{
+  unsigned int first = 1;
+  bool list = command->tokens->size > 1
+    && strcmp( list_string_get( command->tokens, 1 ), "-l" ) == 0;
+  if ( list ) first += 1;
+
+  if ( first >= command->tokens->size )
+  {
+    printf( "usage: j [-l] WORD...\n" );
+    this->last_status = 2;
+    return;
+  }
+
+  unsigned int count = command->tokens->size - first;
+  const char** words = malloc( count * sizeof( *words ) );
+
+  unsigned int index;
+  for ( index = 0; index < count; index++ )
+  {
+    words[ index ] = list_string_get( command->tokens, first + index );
+  }
+
+  buffer_t paths;
+  buffer_init( &paths );
+  size_t found = frecency_query( &this->dirs, words, count,
+                                 SHELL_JUMP_MATCHES, &paths );
+  free( words );
+
+  char cwd[ PATH_MAX ];
+  if ( getcwd( cwd, sizeof( cwd ) ) == NULL ) cwd[ 0 ] = '\0';
+
+  // the best match which isn't where the shell already is, and still
+  // exists (those that don't are forgotten along the way)
+  const char* path = paths.data;
+  bool jumped = false;
+  size_t match;
+  for ( match = 0; match < found && !jumped; match++, path += strlen( path ) + 1 )
+  {
+    struct stat info;
+
+    if ( list )
+    {
+      printf( "%s\n", path );
+    }
+    else if ( strcmp( path, cwd ) == 0 )
+    {
+      continue;
+    }
+    else if ( stat( path, &info ) < 0 || !S_ISDIR( info.st_mode ) )
+    {
+      frecency_forget( &this->dirs, path );
+    }
+    else if ( shell_chdir( this, path ) )
+    {
+      printf( "%s\n", path );
+      jumped = true;
+    }
+  }
+
+  buffer_destroy( &paths );
+
+  if ( !list && !jumped )
+  {
+    printf( "j: no directory matches\n" );
+    this->last_status = 1;
+  }
+  else if ( list )
+  {
+    this->last_status = found > 0 ? 0 : 1;
+  }
+}
+
+void shell_bi_dirs( shell_t* this, const command_t* command )
+{
+  ( void )( command );
+
+  char cwd[ PATH_MAX ];
+  printf( "%s", getcwd( cwd, sizeof( cwd ) ) != NULL ? cwd : "?" );
+
+  const list_node_t(string)* node;
+  for ( node = this->dir_stack->head; node != NULL; node = node->next )
+  {
+    printf( " %s", node->data );
+  }
+  printf( "\n" );
+
+  this->last_status = 0;
+}
+
+void shell_bi_pushd( shell_t* this, const command_t* command )
+{
+  char cwd[ PATH_MAX ];
+  if ( getcwd( cwd, sizeof( cwd ) ) == NULL )
+  {
+    perror( "pushd" );
+    this->last_status = 1;
+    return;
+  }
+
+  // with no directory, the top of the stack is swapped for the current one
+  char* dir;
+  if ( command->tokens->size < 2 )
+  {
+    if ( this->dir_stack->size == 0 )
+    {
+      printf( "pushd: no other directory\n" );
+      this->last_status = 1;
+      return;
+    }
+
+    dir = list_string_pop( this->dir_stack );
+  }
+  else
+  {
+    dir = mem_strdup( MEM_STRINGS, list_string_get( command->tokens, 1 ) );
+  }
+
+  if ( shell_chdir( this, dir ) )
+  {
+    list_string_push( this->dir_stack, mem_strdup( MEM_STRINGS, cwd ) );
+    mem_free( MEM_STRINGS, dir );
+    shell_bi_dirs( this, command );
+  }
+  else if ( command->tokens->size < 2 )
+  {
+    list_string_push( this->dir_stack, dir );
+  }
+  else
+  {
+    mem_free( MEM_STRINGS, dir );
+  }
+}
+
+void shell_bi_popd( shell_t* this, const command_t* command )
+{
+  if ( this->dir_stack->size == 0 )
+  {
+    printf( "popd: directory stack empty\n" );
+    this->last_status = 1;
+    return;
+  }
+
+  // (it's left on the stack if it can't be gone back to)
+  char* dir = list_string_pop( this->dir_stack );
+  if ( shell_chdir( this, dir ) )
+  {
+    mem_free( MEM_STRINGS, dir );
+    shell_bi_dirs( this, command );
+  }
+  else
+  {
+    list_string_push( this->dir_stack, dir );
+  }
+}
+
+void shell_bi_pwd( shell_t* this, const command_t* command )
+{
+  // unused, just here for symmetry
+  ( void )( this );
+  ( void )( command );
+
+  char cwd[ 1024 ]; // I really hope it's not longer than this
+  if ( getcwd( cwd, sizeof( cwd ) ) != NULL ) 
+  {
+    printf( "%s\n", cwd );
+  }
+  else
+  {
+    perror( "getcwd() error\n" );
+  }
+}
+
+/**
+ * Prints the last 15 commands in the shared history, from every
+ * session, by their sequence numbers (for `!+N`).
+ */
+static void shell_history_all( shell_t* this )
+{
+  if ( this->shared_history == NULL )
+  {
+    printf( "history: no shared history (set MSH_SHARED_HISTORY)\n" );
+    this->last_status = 1;
+    return;
+  }
+
+  uint64_t next = histring_next( this->shared_history );
+  uint64_t sequence = next > 15 ? next - 15 : 0;
+
+  histring_entry_t entry;
+  for ( ; sequence < next; sequence++ )
+  {
+    // (commands still being written, or already overwritten, are skipped)
+    if ( !histring_read( this->shared_history, sequence, &entry ) ) continue;
+
+    printf( "%llu: [%d] %s%s\n", ( unsigned long long ) entry.sequence,
+            entry.pid, entry.text, entry.truncated ? "..." : "" );
+  }
+}
+
+/**
+ * The number of commands in the history (counting any restored from
+ * a snapshot, which come first).
+ */
+static size_t shell_history_size( const shell_t* this )
+{
+  size_t restored = this->restored != NULL ? snapshot_commands( this->restored ) : 0;
+  return restored + this->cmd_history->size;
+}
+
+/**
+ * Gets the line of the [index]th command in the history.
+ */
+static const char* shell_history_string( const shell_t* this, size_t index )
+{
+  size_t restored = this->restored != NULL ? snapshot_commands( this->restored ) : 0;
+  if ( index < restored )
+  {
+    return snapshot_command_string( this->restored, index );
+  }
+
+  return list_command_t_get( this->cmd_history, index - restored )->string;
+}
+
+/**
+ * Gets a reference to the [index]th command in the history (made from
+ * the snapshot, if it was restored), or returns NULL (after telling
+ * the user) if there isn't one.
+ */
+static command_t* shell_history_lookup( const shell_t* this, size_t index,
+                                        const char* name )
+{
+  if ( index >= shell_history_size( this ) )
+  {
+    printf( "%s: not in the history\n", name );
+    return NULL;
+  }
+
+  size_t restored = this->restored != NULL ? snapshot_commands( this->restored ) : 0;
+  if ( index < restored )
+  {
+    return snapshot_command( this->restored, index );
+  }
+
+  return command_retain( list_command_t_get( this->cmd_history, index - restored ) );
+}
+
+/**
+ * The number of pids in the history, and the [index]th of them
+ * (the same as for commands).
+ */
+static size_t shell_pid_history_size( const shell_t* this )
+{
+  size_t restored = this->restored != NULL ? snapshot_pids( this->restored ) : 0;
+  return restored + this->pid_history->size;
+}
+
+static pid_t shell_pid_history_get( const shell_t* this, size_t index )
+{
+  size_t restored = this->restored != NULL ? snapshot_pids( this->restored ) : 0;
+  if ( index < restored )
+  {
+    return snapshot_pid( this->restored, index );
+  }
+
+  return list_pid_t_get( this->pid_history, index - restored );
+}
+
+void shell_bi_history( shell_t* this, const command_t* command )
+{
+  this->last_status = 0;
+
+  if ( command->tokens->size > 1 )
+  {
+    if ( command->tokens->size == 2
+      && strcmp( list_string_get( command->tokens, 1 ), "-a" ) == 0 )
+    {
+      shell_history_all( this );
+    }
+    else
+    {
+      printf( "usage: history [-a]\n" );
+      this->last_status = 2;
+    }
+    return;
+  }
+
+  size_t size = shell_history_size( this );
+  size_t count = 15;
+
+  if ( size < count )
+  {
+    count = size;
+  }
+
+  // jump ahead to the first element we should print
+  size_t offset = size - count;
+
+  size_t index = offset;
+  for ( ; index < size; index++ )
+  {
+    printf( "%zu: %s\n", index - offset, shell_history_string( this, index ) );
+  }
+}
+
+void shell_bi_showpids( shell_t* this, const command_t* command )
 {
-  // unused, just here for symmetry
-  ( void )( this );
+  size_t size = shell_pid_history_size( this );
+  size_t count = 10;
 
-  const char* dir; 
+  if ( size < count )
+  {
+    count = size;
+  }
 
-  if ( command->tokens->size < 2 )
+  // jump ahead to the first element we should print
+  size_t index = size - count;
+
+  size_t offset = index;
+
+  for ( ; index < size; index++ )
   {
-    dir = getenv( "HOME" );
+    pid_t pid = shell_pid_history_get( this, index );
+    printf( "%zu: %d\n", index - offset, pid );
+  }
+}
+
+/**
+ * Looks up a command in the shared history for `!!` (the most recent
+ * one from any session) or `!+N` (the one with sequence number N).
+ * Returns NULL (after telling the user why) if it isn't there.
+ */
+static command_t* shell_shared_lookup( shell_t* this, const char* name )
+{
+  histring_entry_t entry;
+  bool found = false;
+
+  if ( strcmp( name, "!!" ) == 0 )
+  {
+    // (the newest few may still be being written, so go back past them)
+    uint64_t next = histring_next( this->shared_history );
+    uint64_t sequence = next;
+    while ( !found && sequence > 0 && next - sequence < HISTRING_CAPACITY )
+    {
+      found = histring_read( this->shared_history, --sequence, &entry );
+    }
   }
   else
   {
-    dir = command->tokens->fun->get( command->tokens, 1 );
+    found = histring_read( this->shared_history,
+                           strtoull( name + 2, NULL, 0 ), &entry );
+  }
+
+  if ( !found )
+  {
+    printf( "%s: not in the shared history\n", name );
+    return NULL;
+  }
+  if ( entry.truncated )
+  {
+    printf( "%s: too long to run from the shared history\n", name );
+    return NULL;
   }
 
-  chdir( dir );
+  command_t* newcmd = malloc( sizeof( *newcmd ) );
+  command_init( newcmd );
+  newcmd->string = mem_strdup( MEM_STRINGS, entry.text );
+  command_parse( newcmd, newcmd->string );
+  return newcmd;
 }
 
-void shell_bi_pwd( const shell_t* this, const command_t* command )
+void shell_bi_run_history( shell_t* this, const command_t* command )
 {
-  // unused, just here for symmetry
-  ( void )( this );
-  ( void )( command );
+  size_t index;
+  command_t* newcmd;
 
-  char cwd[ 1024 ]; // I really hope it's not longer than this
-  if ( getcwd( cwd, sizeof( cwd ) ) != NULL ) 
+  const char* name = command_get_name( command );
+
+  // `!!` and `!+<num>` come from every session's commands, if they're
+  // being shared
+  if ( this->shared_history != NULL
+    && ( strcmp( name, "!!" ) == 0 || name[ 1 ] == '+' ) )
   {
-    printf( "%s\n", cwd );
+    newcmd = shell_shared_lookup( this, name );
   }
   else
   {
-    perror( "getcwd() error\n" );
+    size_t size = shell_history_size( this );
+
+    // !! => the item before this one
+    if ( strcmp( name, "!!" ) == 0 )
+    {
+      index = size - 2;
+    }
+    // !+<num> => absolute offset
+    else if ( name[ 1 ] == '+' )
+    {
+      index = strtol( name + 2, NULL, 0 );
+    }
+    // !<num> => offset since 15th-to-last item
+    else
+    {
+      // start at the 15th-to-last item
+      if ( size <= 15 )
+      {
+        index = 0;
+      }
+      else
+      {
+        index = size - 16;
+      }
+
+      // then add our offset from the user
+      index += strtol( name + 1, NULL, 0 );
+    }
+
+    // the original command is run again as it is (it's never changed
+    // once it's in the history), so this only takes a reference to it
+    newcmd = shell_history_lookup( this, index, name );
+  }
+
+  // remove the most recent command (i.e. the one that got us
+  // here) from the command history, so it will be replaced
+  // by the actual item that was run (or, if there's nothing it
+  // could run, isn't worth remembering)
+  shell_history_release( list_command_t_pop_back( this->cmd_history ) );
+
+  if ( newcmd == NULL )
+  {
+    this->last_status = 1;
+    return;
   }
+
+  // (indirectly) recursively let this new command be executed
+  shell_run_command( this, newcmd );
+
+  // what to do with the result?
+  // I guess just do nothing, because if we somehow previously
+  // ran a command to exit, then we wouldn't have said item in
+  // our history, as the shell would've exited
 }
 
-void shell_bi_history( const shell_t* this, const command_t* command )
+
+void shell_bi_alias( shell_t* this, const command_t* command )
 {
-  unsigned int count = 15;
+  // no arguments => print them all
+  if ( command->tokens->size < 2 )
+  {
+    unsigned int bucket;
+    for ( bucket = 0; bucket < FUNCTION_TABLE_SIZE; bucket++ )
+    {
+      const function_t* alias = this->aliases.buckets[ bucket ];
+      for ( ; alias != NULL; alias = alias->next )
+      {
+        printf( "alias %s='%s'\n", alias->name, alias->text );
+      }
+    }
+    return;
+  }
 
-  if ( this->cmd_history->size < count )
+  unsigned int index;
+  for ( index = 1; index < command->tokens->size; index++ )
   {
-    count = this->cmd_history->size;
+    const char* argument = list_string_get( command->tokens, index );
+    const char* equals = strchr( argument, '=' );
+
+    // just a name => print that one
+    if ( equals == NULL )
+    {
+      const function_t* alias = function_table_get( &this->aliases, argument );
+      if ( alias == NULL )
+      {
+        printf( "alias: %s: not found\n", argument );
+      }
+      else
+      {
+        printf( "alias %s='%s'\n", alias->name, alias->text );
+      }
+      continue;
+    }
+
+    // tokenize the text once, now, rather than every time it's used
+    command_t* text = malloc( sizeof( *text ) );
+    command_init( text );
+    text->string = mem_strdup( MEM_STRINGS, equals + 1 );
+    command_parse( text, text->string );
+
+    list_t(command_t)* body = list_u(command_t);
+    body->fun->enqueue( body, text );
+
+    char* name = strndup( argument, equals - argument );
+    function_table_set( &this->aliases, name, equals + 1, body );
+    free( name );
   }
+}
 
-  // jump ahead to the first element we should print
-  unsigned int offset = this->cmd_history->size - count;
+void shell_bi_unalias( shell_t* this, const command_t* command )
+{
+  unsigned int index;
+  for ( index = 1; index < command->tokens->size; index++ )
+  {
+    const char* name = command->tokens->fun->get( command->tokens, index );
+    if ( !function_table_remove( &this->aliases, name ) )
+    {
+      printf( "unalias: %s: not found\n", name );
+    }
+  }
+}
 
-  typeof( this->cmd_history->fun->get ) get = this->cmd_history->fun->get;
+void shell_bi_let( shell_t* this, const command_t* command )
+{
+  int64_t result = 0;
+  bool ok = command->tokens->size > 1;
 
-  int index = offset;
-  for ( ; index < this->cmd_history->size; index++ )
+  unsigned int index;
+  for ( index = 1; ok && index < command->tokens->size; index++ )
   {
-    const command_t* command = get( this->cmd_history, index );
-    printf( "%d: %s\n", index - offset, command->string );
+    const char* expression = command->tokens->fun->get( command->tokens, index );
+    ok = arith_evaluate( &this->arith, expression, &result );
   }
+
+  // like the test command, a zero result means failure
+  this->last_status = ( ok && result != 0 ) ? 0 : 1;
 }
 
-void shell_bi_showpids( const shell_t* this, const command_t* command )
+void shell_bi_return( shell_t* this, const command_t* command )
 {
-  unsigned int count = 10;
+  if ( this->arguments == NULL )
+  {
+    printf( "return: can only return from a function\n" );
+    this->last_status = 1;
+    return;
+  }
 
-  if ( this->pid_history->size < count )
+  if ( command->tokens->size > 2 )
   {
-    count = this->pid_history->size;
+    printf( "usage: return [N]\n" );
+    this->last_status = 2;
+    return;
   }
 
-  // jump ahead to the first element we should print
-  unsigned int index = this->pid_history->size - count;
+  if ( command->tokens->size == 2 )
+  {
+    const char* status = list_string_get( command->tokens, 1 );
+
+    char* end;
+    long value = strtol( status, &end, 10 );
+    if ( end == status || *end != '\0' )
+    {
+      printf( "return: %s: not a number\n", status );
+      value = 2;
+    }
+
+    // (the same as an exit status, it's only ever 0 to 255)
+    this->last_status = value & 0xFF;
+  }
+
+  this->returning = true;
+}
+
+/**
+ * Shows again what's been kept of a job's output (`jobs -o %N`). This
+ * works for jobs which have already finished, too.
+ */
+static void shell_job_output( shell_t* this, const char* spec )
+{
+  if ( this->mux == NULL )
+  {
+    printf( "jobs: output isn't being kept (set MSH_MUX_JOBS)\n" );
+    this->last_status = 1;
+    return;
+  }
 
-  typeof( this->pid_history->fun->get ) get = this->pid_history->fun->get;
+  const char* number = spec[ 0 ] == '%' ? spec + 1 : spec;
+  char* end;
+  unsigned long id = strtoul( number, &end, 10 );
+  if ( end == number || *end != '\0' )
+  {
+    printf( "%s: not a job id\n", spec );
+    this->last_status = 2;
+    return;
+  }
 
-  unsigned int offset = index;
+  // (catch up on anything it's written since)
+  mux_drain( this->mux );
 
-  for ( ; index < this->pid_history->size; index++ )
+  this->last_status = 0;
+  if ( !mux_replay( this->mux, id ) )
   {
-    pid_t pid = get( this->pid_history, index );
-    printf( "%d: %d\n", index - offset, pid );
+    printf( "%%%lu: no output kept\n", id );
+    this->last_status = 1;
   }
 }
 
-void shell_bi_run_history( shell_t* this, const command_t* command )
+void shell_bi_jobs( shell_t* this, const command_t* command )
 {
+  bool verbose = false;
+  double interval = 1;
+  unsigned int frames = 0;
+  const char* output = NULL;
+
   unsigned int index;
+  for ( index = 1; index < command->tokens->size; index++ )
+  {
+    const char* option = list_string_get( command->tokens, index );
+    const char* value = index + 1 < command->tokens->size
+      ? list_string_get( command->tokens, index + 1 )
+      : NULL;
 
-  const char* name = command_get_name( command );
+    if ( strcmp( option, "-v" ) == 0 )
+    {
+      verbose = true;
+    }
+    else if ( strcmp( option, "-i" ) == 0 && value != NULL
+           && ( interval = atof( value ) ) > 0 )
+    {
+      index += 1;
+    }
+    else if ( strcmp( option, "-n" ) == 0 && value != NULL )
+    {
+      frames = strtoul( value, NULL, 10 );
+      index += 1;
+    }
+    else if ( strcmp( option, "-o" ) == 0 && value != NULL )
+    {
+      output = value;
+      index += 1;
+    }
+    else
+    {
+      printf( "usage: jobs [-v [-i SECONDS] [-n FRAMES]] [-o %%N]\n" );
+      this->last_status = 2;
+      return;
+    }
+  }
 
-  // !! => last item
-  if ( strcmp( name, "!!" ) == 0 )
+  if ( output != NULL )
+  {
+    shell_job_output( this, output );
+    return;
+  }
+
+  // don't show anything which has already finished
+  shell_reap( this );
+  this->last_status = 0;
+
+  if ( this->jobs.size == 0 )
   {
-    index = this->cmd_history->size - 1;
+    printf( "No jobs\n" );
   }
-  // !+<num> => absolute offset
-  else if ( name[ 1 ] == '+' )
+  else if ( verbose )
   {
-    index = strtol( name + 2, NULL, 0 );
+    monitor_run( &this->jobs, interval, frames );
   }
-  // !<num> => offset since 15th-to-last item
   else
   {
-    // start at the 15th-to-last item
-    if ( this->cmd_history->size <= 15 )
+    const job_t* job;
+    for ( job = this->jobs.head; job != NULL; job = job->next )
+    {
+      printf( "[%u]  %-8s %d%s%s\n", job->id,
+              job->state == JOB_RUNNING ? "Running" : "Stopped", job->pid,
+              job->name != NULL ? "  coproc " : "",
+              job->name != NULL ? job->name : "" );
+    }
+  }
+}
+
+void shell_bi_snapshot( shell_t* this, const command_t* command )
+{
+  if ( command->tokens->size != 3
+    || strcmp( list_string_get( command->tokens, 1 ), "save" ) != 0 )
+  {
+    printf( "usage: snapshot save FILE\n" );
+    this->last_status = 2;
+    return;
+  }
+
+  // (there's no point restoring jobs which have already finished)
+  shell_reap( this );
+
+  char cwd[ PATH_MAX ];
+  if ( getcwd( cwd, sizeof( cwd ) ) == NULL )
+  {
+    perror( "snapshot" );
+    this->last_status = 1;
+    return;
+  }
+
+  bool saved = snapshot_save( list_string_get( command->tokens, 2 ),
+                              this->restored, this->cmd_history,
+                              this->pid_history, &this->jobs, cwd );
+  this->last_status = saved ? 0 : 1;
+}
+
+/**
+ * Gets the coprocess named by the command's first argument, returning
+ * NULL (after telling the user why) if there isn't one.
+ */
+static job_t* shell_coproc_argument( shell_t* this, const command_t* command )
+{
+  const char* name = list_string_get( command->tokens, 1 );
+  job_t* job = job_table_named( &this->jobs, name );
+
+  if ( job == NULL )
+  {
+    printf( "%s: no such coprocess\n", name );
+    this->last_status = 1;
+  }
+
+  return job;
+}
+
+/**
+ * Writes all of [data] to a coprocess's stdin. Returns [false] if it
+ * can't be (i.e. it's finished, or the user gave up waiting on it).
+ */
+static bool shell_coproc_write( int fd, const char* data, size_t length )
+{
+  // a coprocess which has gone away mustn't take the shell with it, so
+  // SIGPIPE is held off while writing, and discarded if it was raised
+  sigset_t pipe, old;
+  sigemptyset( &pipe );
+  sigaddset( &pipe, SIGPIPE );
+  pthread_sigmask( SIG_BLOCK, &pipe, &old );
+
+  ssize_t written = 1;
+  while ( length > 0 && written > 0 )
+  {
+    written = write( fd, data, length );
+    if ( written > 0 )
+    {
+      data += written;
+      length -= written;
+    }
+  }
+
+  if ( written < 0 && errno == EPIPE )
+  {
+    struct timespec none = { 0, 0 };
+    sigtimedwait( &pipe, NULL, &none );
+  }
+
+  pthread_sigmask( SIG_SETMASK, &old, NULL );
+  return length == 0;
+}
+
+void shell_bi_cowrite( shell_t* this, const command_t* command )
+{
+  if ( command->tokens->size < 2 )
+  {
+    printf( "usage: cowrite NAME [WORDS...]\n" );
+    this->last_status = 2;
+    return;
+  }
+
+  job_t* job = shell_coproc_argument( this, command );
+  if ( job == NULL ) return;
+
+  if ( job->input < 0 )
+  {
+    printf( "%s: input closed\n", job->name );
+    this->last_status = 1;
+    return;
+  }
+
+  // the words go to it as one line (as `echo` would have written them)
+  buffer_t line;
+  buffer_init( &line );
+
+  unsigned int index;
+  for ( index = 2; index < command->tokens->size; index++ )
+  {
+    const char* word = list_string_get( command->tokens, index );
+    if ( index > 2 ) buffer_append( &line, " ", 1 );
+    buffer_append( &line, word, strlen( word ) );
+  }
+  buffer_append( &line, "\n", 1 );
+
+  this->last_status = 0;
+  if ( !shell_coproc_write( job->input, line.data, line.size ) )
+  {
+    printf( "%s: couldn't be written to\n", job->name );
+    this->last_status = 1;
+  }
+
+  buffer_destroy( &line );
+}
+
+void shell_bi_coread( shell_t* this, const command_t* command )
+{
+  if ( command->tokens->size < 2 || command->tokens->size > 3 )
+  {
+    printf( "usage: coread NAME [VAR]\n" );
+    this->last_status = 2;
+    return;
+  }
+
+  job_t* job = shell_coproc_argument( this, command );
+  if ( job == NULL ) return;
+
+  buffer_t* pending = &job->pending;
+  char* newline = NULL;
+  size_t scanned = job->start;
+  bool finished = job->output < 0;
+
+  // a whole line may have come in with the last one, otherwise it's
+  // read until there is one (or it's finished, and there won't be)
+  while ( !finished
+       && ( scanned == pending->size
+         || ( newline = memchr( pending->data + scanned, '\n',
+                                pending->size - scanned ) ) == NULL ) )
+  {
+    // (what's left is only ever part of a line, so this is cheap)
+    if ( job->start > 0 )
     {
-      index = 0;
+      memmove( pending->data, pending->data + job->start,
+               pending->size - job->start );
+      pending->size -= job->start;
+      job->start = 0;
+    }
+    scanned = pending->size;
+
+    char* space = buffer_reserve( pending, COPROC_READ_SIZE );
+    ssize_t count = read( job->output, space, COPROC_READ_SIZE );
+
+    if ( count > 0 )
+    {
+      pending->size += count;
+    }
+    else if ( count < 0 && errno == EINTR )
+    {
+      // the user gave up waiting (what's been read is kept)
+      this->last_status = 1;
+      return;
     }
     else
     {
-      index = this->cmd_history->size - 16;
+      close( job->output );
+      job->output = -1;
+      finished = true;
     }
+  }
 
-    // then add our offset from the user
-    index += strtol( name + 1, NULL, 0 );
+  // once it's finished, whatever it wrote after its last newline is
+  // the last line, and after that there's nothing left (as with `read`)
+  if ( newline == NULL )
+  {
+    if ( job->start == pending->size )
+    {
+      this->last_status = 1;
+      return;
+    }
+    newline = buffer_reserve( pending, 1 );
   }
 
-  // the original command we need to duplicate
-  const command_t* srccmd = this->cmd_history->fun->get( 
-      this->cmd_history, 
-      index 
-  );
+  *newline = '\0';
+  const char* line = pending->data + job->start;
+  job->start = newline + 1 - pending->data;
 
-  // make a duplicate of the srccmd
-  command_t* newcmd = malloc( sizeof( command_t* ) );
-  command_copy( newcmd, srccmd );
+  if ( command->tokens->size == 3 )
+  {
+    setenv( list_string_get( command->tokens, 2 ), line, 1 );
+  }
+  else
+  {
+    printf( "%s\n", line );
+  }
 
-  // remove the most recent command (i.e. the one that got us
-  // here) from the command history, so it will be replaced
-  // by the actual item that was run
-  command_t* oldcmd = this->cmd_history->fun->pop_back( this->cmd_history );
-  command_destroy( oldcmd );
-  free( oldcmd );
+  if ( job->start >= pending->size )
+  {
+    pending->size = 0;
+    job->start = 0;
+  }
+  this->last_status = 0;
+}
 
-  // (indirectly) recursively let this new command be executed
-  shell_run_command( this, newcmd );
+void shell_bi_coclose( shell_t* this, const command_t* command )
+{
+  if ( command->tokens->size != 2 )
+  {
+    printf( "usage: coclose NAME\n" );
+    this->last_status = 2;
+    return;
+  }
 
-  // what to do with the result?
-  // I guess just do nothing, because if we somehow previously
-  // ran a command to exit, then we wouldn't have said item in
-  // our history, as the shell would've exited
+  job_t* job = shell_coproc_argument( this, command );
+  if ( job == NULL ) return;
+
+  if ( job->input >= 0 )
+  {
+    close( job->input );
+    job->input = -1;
+  }
+  this->last_status = 0;
 }
 
+void shell_bi_memstats( shell_t* this, const command_t* command )
+{
+  bool json = command->tokens->size == 2
+           && strcmp( list_string_get( command->tokens, 1 ), "-j" ) == 0;
+
+  if ( command->tokens->size > 2 || ( command->tokens->size == 2 && !json ) )
+  {
+    printf( "usage: memstats [-j]\n" );
+    this->last_status = 2;
+    return;
+  }
+
+  mem_stats_t stats[ MEM_TAGS ];
+  bool counted = mem_snapshot( stats );
+
+  // (what malloc has handed out in all, tagged or not)
+  struct mallinfo2 heap = mallinfo2();
+
+  this->last_status = 0;
+
+  if ( json )
+  {
+    printf( "{\"counted\":%s,\"heap_bytes\":%zu,\"tags\":{",
+            counted ? "true" : "false", heap.uordblks );
+
+    unsigned int tag;
+    for ( tag = 0; tag < MEM_TAGS; tag++ )
+    {
+      printf( "%s\"%s\":{\"live_bytes\":%lld,\"live\":%lld,"
+              "\"peak_bytes\":%lld,\"allocations\":%lld}",
+              tag > 0 ? "," : "", mem_tag_name( tag ),
+              ( long long ) stats[ tag ].live_bytes,
+              ( long long ) stats[ tag ].live_count,
+              ( long long ) stats[ tag ].peak_bytes,
+              ( long long ) stats[ tag ].total_count );
+    }
+
+    printf( "}}\n" );
+    return;
+  }
+
+  if ( !counted )
+  {
+    printf( "memstats: allocations aren't counted in this build\n" );
+    printf( "heap in use: %zu bytes\n", heap.uordblks );
+    return;
+  }
+
+  printf( "%-10s %12s %10s %12s %12s\n", "tag", "live bytes", "live",
+          "peak bytes", "allocations" );
+
+  mem_stats_t total = { 0, 0, 0, 0 };
+
+  unsigned int tag;
+  for ( tag = 0; tag < MEM_TAGS; tag++ )
+  {
+    printf( "%-10s %12lld %10lld %12lld %12lld\n", mem_tag_name( tag ),
+            ( long long ) stats[ tag ].live_bytes,
+            ( long long ) stats[ tag ].live_count,
+            ( long long ) stats[ tag ].peak_bytes,
+            ( long long ) stats[ tag ].total_count );
+
+    total.live_bytes += stats[ tag ].live_bytes;
+    total.live_count += stats[ tag ].live_count;
+    total.total_count += stats[ tag ].total_count;
+  }
+
+  printf( "%-10s %12lld %10lld %12s %12lld\n", "total",
+          ( long long ) total.live_bytes, ( long long ) total.live_count, "",
+          ( long long ) total.total_count );
+  printf( "heap in use: %zu bytes (%lld not tagged)\n", heap.uordblks,
+          ( long long ) heap.uordblks - ( long long ) total.live_bytes );
+}
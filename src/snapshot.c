@@ -0,0 +1,389 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "memstats.h"
+
+/**
+ * Rounds an offset up to the start of the next section.
+ */
+static inline uint64_t snapshot_align( uint64_t offset )
+{
+  return ( offset + 7 ) & ~( uint64_t ) 7;
+}
+
+/**
+ * Gets a section of [count] entries of [size] bytes at [offset], or
+ * NULL if any of it would be outside of the file (or misaligned).
+ */
+static const void* snapshot_section( const snapshot_t* this, uint64_t offset,
+                                     uint64_t count, size_t size )
+{
+  if ( offset % 8 != 0 || offset < sizeof( snapshot_header_t )
+    || offset > this->size )
+  {
+    return NULL;
+  }
+  if ( count > ( this->size - offset ) / size ) return NULL;
+
+  return ( const char* ) this->map + offset;
+}
+
+/**
+ * Fixes up the pointers to each section, then checks every offset in
+ * them is one into the strings (which can't run off the end, as the
+ * last of them is NUL terminated). There's nothing else to read, so
+ * this is all opening a snapshot does.
+ */
+static bool snapshot_check( snapshot_t* this )
+{
+  const snapshot_header_t* header = this->header;
+
+  if ( header->magic != SNAPSHOT_MAGIC || header->order != SNAPSHOT_ORDER
+    || header->version != SNAPSHOT_VERSION
+    || header->header_size != sizeof( snapshot_header_t )
+    || header->size != this->size )
+  {
+    return false;
+  }
+
+  this->commands = snapshot_section( this, header->commands_offset,
+                                     header->commands, sizeof( snapshot_command_t ) );
+  this->refs = snapshot_section( this, header->refs_offset,
+                                 header->refs, sizeof( uint64_t ) );
+  this->jobs = snapshot_section( this, header->jobs_offset,
+                                 header->jobs, sizeof( snapshot_job_t ) );
+  this->pids = snapshot_section( this, header->pids_offset,
+                                 header->pids, sizeof( int32_t ) );
+  this->pool = snapshot_section( this, header->pool_offset,
+                                 header->pool_size, 1 );
+
+  if ( this->commands == NULL || this->refs == NULL || this->jobs == NULL
+    || this->pids == NULL || this->pool == NULL )
+  {
+    return false;
+  }
+
+  uint64_t pool_size = header->pool_size;
+  if ( pool_size == 0 || this->pool[ pool_size - 1 ] != '\0' ) return false;
+  if ( header->cwd >= pool_size ) return false;
+
+  uint64_t index;
+  for ( index = 0; index < header->commands; index++ )
+  {
+    const snapshot_command_t* command = &this->commands[ index ];
+    uint64_t count = ( uint64_t ) command->token_count + command->heredoc_count;
+
+    if ( command->string >= pool_size || command->refs > header->refs
+      || count > header->refs - command->refs )
+    {
+      return false;
+    }
+  }
+
+  for ( index = 0; index < header->refs; index++ )
+  {
+    if ( this->refs[ index ] >= pool_size ) return false;
+  }
+
+  return true;
+}
+
+bool snapshot_open( snapshot_t* this, const char* path )
+{
+  int fd = open( path, O_RDONLY | O_CLOEXEC );
+  if ( fd == -1 )
+  {
+    perror( path );
+    return false;
+  }
+
+  struct stat info;
+  if ( fstat( fd, &info ) < 0 )
+  {
+    perror( path );
+    close( fd );
+    return false;
+  }
+  if ( info.st_size < ( off_t ) sizeof( snapshot_header_t ) )
+  {
+    printf( "%s: not a snapshot\n", path );
+    close( fd );
+    return false;
+  }
+
+  this->size = info.st_size;
+  this->map = mmap( NULL, this->size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+
+  if ( this->map == MAP_FAILED )
+  {
+    perror( path );
+    return false;
+  }
+
+  this->header = this->map;
+  if ( !snapshot_check( this ) )
+  {
+    printf( "%s: not a snapshot (or from another version of msh)\n", path );
+    munmap( this->map, this->size );
+    return false;
+  }
+
+  return true;
+}
+
+void snapshot_close( snapshot_t* this )
+{
+  munmap( this->map, this->size );
+  this->map = NULL;
+  this->size = 0;
+}
+
+size_t snapshot_commands( const snapshot_t* this )
+{
+  return this->header->commands;
+}
+
+size_t snapshot_pids( const snapshot_t* this )
+{
+  return this->header->pids;
+}
+
+const char* snapshot_command_string( const snapshot_t* this, size_t index )
+{
+  return this->pool + this->commands[ index ].string;
+}
+
+command_t* snapshot_command( const snapshot_t* this, size_t index )
+{
+  const snapshot_command_t* source = &this->commands[ index ];
+  const uint64_t* refs = this->refs + source->refs;
+
+  command_t* command = malloc( sizeof( *command ) );
+  command_init( command );
+  command->string = mem_strdup( MEM_STRINGS, this->pool + source->string );
+
+  uint32_t ref;
+  for ( ref = 0; ref < source->token_count; ref++ )
+  {
+    list_string_enqueue( command->tokens,
+                         mem_strdup( MEM_TOKENS, this->pool + refs[ ref ] ) );
+  }
+
+  refs += source->token_count;
+  for ( ref = 0; ref < source->heredoc_count; ref++ )
+  {
+    list_string_enqueue( command->heredocs,
+                         mem_strdup( MEM_STRINGS, this->pool + refs[ ref ] ) );
+  }
+
+  return command;
+}
+
+pid_t snapshot_pid( const snapshot_t* this, size_t index )
+{
+  return this->pids[ index ];
+}
+
+const char* snapshot_cwd( const snapshot_t* this )
+{
+  return this->pool + this->header->cwd;
+}
+
+/**
+ * Copies a string onto the end of the pool, returning its offset.
+ */
+static uint64_t snapshot_put( char* pool, uint64_t* used, const char* string )
+{
+  uint64_t offset = *used;
+  size_t length = strlen( string ) + 1;
+
+  memcpy( pool + offset, string, length );
+  *used += length;
+  return offset;
+}
+
+/**
+ * Copies each string in [strings] onto the end of the pool, with
+ * their offsets going onto the end of the refs.
+ */
+static void snapshot_put_all( char* pool, uint64_t* used, uint64_t* refs,
+                              uint64_t* ref, const list_t(string)* strings )
+{
+  const list_node_t(string)* node;
+  for ( node = strings->head; node != NULL; node = node->next )
+  {
+    refs[ ( *ref )++ ] = snapshot_put( pool, used, node->data );
+  }
+}
+
+/**
+ * Adds up the size of every string in [strings].
+ */
+static uint64_t snapshot_measure( const list_t(string)* strings )
+{
+  uint64_t size = 0;
+
+  const list_node_t(string)* node;
+  for ( node = strings->head; node != NULL; node = node->next )
+  {
+    size += strlen( node->data ) + 1;
+  }
+
+  return size;
+}
+
+bool snapshot_save( const char* path, const snapshot_t* before,
+                    const list_t(command_t)* commands,
+                    const list_t(pid_t)* pids,
+                    const job_table_t* jobs, const char* cwd )
+{
+  // what was restored is copied over as it is (so its offsets are
+  // still right), with everything since going after it
+  snapshot_header_t header;
+  memset( &header, 0, sizeof( header ) );
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.order = SNAPSHOT_ORDER;
+  header.header_size = sizeof( header );
+
+  if ( before != NULL )
+  {
+    header.commands = before->header->commands;
+    header.refs = before->header->refs;
+    header.pids = before->header->pids;
+    header.pool_size = before->header->pool_size;
+  }
+
+  const list_node_t(command_t)* node;
+  for ( node = commands->head; node != NULL; node = node->next )
+  {
+    const command_t* command = node->data;
+
+    header.commands += 1;
+    header.refs += command->tokens->size + command->heredocs->size;
+    header.pool_size += strlen( command->string ) + 1
+                      + snapshot_measure( command->tokens )
+                      + snapshot_measure( command->heredocs );
+  }
+
+  header.pids += pids->size;
+  header.jobs = jobs->size;
+  header.pool_size += strlen( cwd ) + 1;
+
+  header.commands_offset = snapshot_align( sizeof( header ) );
+  header.refs_offset = snapshot_align( header.commands_offset
+                       + header.commands * sizeof( snapshot_command_t ) );
+  header.jobs_offset = snapshot_align( header.refs_offset
+                       + header.refs * sizeof( uint64_t ) );
+  header.pids_offset = snapshot_align( header.jobs_offset
+                       + header.jobs * sizeof( snapshot_job_t ) );
+  header.pool_offset = snapshot_align( header.pids_offset
+                       + header.pids * sizeof( int32_t ) );
+  header.size = header.pool_offset + header.pool_size;
+
+  // written off to the side, then moved over the old one in one go
+  char temp[ PATH_MAX ];
+  if ( snprintf( temp, sizeof( temp ), "%s.XXXXXX", path ) >= ( int ) sizeof( temp ) )
+  {
+    printf( "%s: path too long\n", path );
+    return false;
+  }
+
+  int fd = mkostemp( temp, O_CLOEXEC );
+  if ( fd == -1 )
+  {
+    perror( path );
+    return false;
+  }
+
+  char* map = MAP_FAILED;
+  if ( ftruncate( fd, header.size ) == 0 )
+  {
+    map = mmap( NULL, header.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  }
+  if ( map == MAP_FAILED )
+  {
+    perror( path );
+    close( fd );
+    unlink( temp );
+    return false;
+  }
+
+  snapshot_command_t* records = ( snapshot_command_t* )( map + header.commands_offset );
+  uint64_t* refs = ( uint64_t* )( map + header.refs_offset );
+  snapshot_job_t* saved_jobs = ( snapshot_job_t* )( map + header.jobs_offset );
+  int32_t* saved_pids = ( int32_t* )( map + header.pids_offset );
+  char* pool = map + header.pool_offset;
+
+  uint64_t command = 0, ref = 0, pid = 0, used = 0;
+
+  if ( before != NULL )
+  {
+    command = before->header->commands;
+    ref = before->header->refs;
+    pid = before->header->pids;
+    used = before->header->pool_size;
+
+    memcpy( records, before->commands, command * sizeof( *records ) );
+    memcpy( refs, before->refs, ref * sizeof( *refs ) );
+    memcpy( saved_pids, before->pids, pid * sizeof( *saved_pids ) );
+    memcpy( pool, before->pool, used );
+  }
+
+  for ( node = commands->head; node != NULL; node = node->next, command++ )
+  {
+    const command_t* source = node->data;
+
+    records[ command ].string = snapshot_put( pool, &used, source->string );
+    records[ command ].refs = ref;
+    records[ command ].token_count = source->tokens->size;
+    records[ command ].heredoc_count = source->heredocs->size;
+
+    snapshot_put_all( pool, &used, refs, &ref, source->tokens );
+    snapshot_put_all( pool, &used, refs, &ref, source->heredocs );
+  }
+
+  const list_node_t(pid_t)* pid_node;
+  for ( pid_node = pids->head; pid_node != NULL; pid_node = pid_node->next )
+  {
+    saved_pids[ pid++ ] = pid_node->data;
+  }
+
+  const job_t* job;
+  for ( job = jobs->head; job != NULL; job = job->next, saved_jobs++ )
+  {
+    saved_jobs->id = job->id;
+    saved_jobs->pid = job->pid;
+    saved_jobs->state = job->state;
+  }
+
+  header.cwd = snapshot_put( pool, &used, cwd );
+
+  memcpy( map, &header, sizeof( header ) );
+  munmap( map, header.size );
+
+  bool written = fsync( fd ) == 0;
+  written = close( fd ) == 0 && written;
+
+  if ( !written || rename( temp, path ) < 0 )
+  {
+    perror( path );
+    unlink( temp );
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,303 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <strings.h>
+#include <unistd.h>
+#include "spawn.h"
+
+/** The limits `ulimit` knows about (sizes are in KiB, like bash) */
+static const spawn_limit_t g_limits[] = {
+  { 'c', RLIMIT_CORE,    1024, "core file size (KiB)" },
+  { 'd', RLIMIT_DATA,    1024, "data segment size (KiB)" },
+  { 'f', RLIMIT_FSIZE,   1024, "file size (KiB)" },
+  { 'l', RLIMIT_MEMLOCK, 1024, "locked memory (KiB)" },
+  { 'n', RLIMIT_NOFILE,  1,    "open files" },
+  { 's', RLIMIT_STACK,   1024, "stack size (KiB)" },
+  { 't', RLIMIT_CPU,     1,    "cpu time (seconds)" },
+  { 'u', RLIMIT_NPROC,   1,    "processes" },
+  { 'v', RLIMIT_AS,      1024, "virtual memory (KiB)" },
+  { 0,   0,              0,    NULL }
+};
+
+void spawn_init( spawn_t* this )
+{
+  memset( this, 0, sizeof( *this ) );
+  this->timeout_signal = SIGTERM;
+  this->grace = SPAWN_DEFAULT_GRACE;
+}
+
+bool spawn_apply( const spawn_t* this )
+{
+  // (both sides do this, whichever runs first wins)
+  if ( this->group )
+  {
+    setpgid( 0, 0 );
+  }
+  if ( this->terminal )
+  {
+    tcsetpgrp( STDIN_FILENO, getpid() );
+  }
+
+  if ( this->pinned
+    && sched_setaffinity( 0, sizeof( this->affinity ), &this->affinity ) < 0 )
+  {
+    perror( "affinity" );
+    return false;
+  }
+
+  if ( this->nice != 0 )
+  {
+    // (getpriority can legitimately return -1, so errno tells us
+    // if it failed)
+    errno = 0;
+    int priority = getpriority( PRIO_PROCESS, 0 );
+    if ( errno != 0
+      || setpriority( PRIO_PROCESS, 0, priority + this->nice ) < 0 )
+    {
+      perror( "nice" );
+      return false;
+    }
+  }
+
+  int resource;
+  for ( resource = 0; resource < RLIM_NLIMITS; resource++ )
+  {
+    if ( this->limits_set[ resource ] == 0 ) continue;
+
+    struct rlimit limit;
+    getrlimit( resource, &limit );
+
+    if ( this->limits_set[ resource ] & SPAWN_LIMIT_SOFT )
+    {
+      limit.rlim_cur = this->limits[ resource ].rlim_cur;
+    }
+    if ( this->limits_set[ resource ] & SPAWN_LIMIT_HARD )
+    {
+      limit.rlim_max = this->limits[ resource ].rlim_max;
+
+      // lowering the hard limit drags the soft one down with it
+      if ( limit.rlim_cur > limit.rlim_max ) limit.rlim_cur = limit.rlim_max;
+    }
+
+    if ( setrlimit( resource, &limit ) < 0 )
+    {
+      perror( "ulimit" );
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void spawn_adopt( const spawn_t* this, pid_t child )
+{
+  if ( this->group )
+  {
+    setpgid( child, child );
+  }
+  if ( this->terminal )
+  {
+    tcsetpgrp( STDIN_FILENO, child );
+  }
+}
+
+bool spawn_parse_duration( const char* text, double* seconds )
+{
+  char* end;
+  double value = strtod( text, &end );
+
+  if ( end == text || value < 0 ) return false;
+
+  switch ( *end )
+  {
+    case 'd': value *= 24;  // fall through
+    case 'h': value *= 60;  // fall through
+    case 'm': value *= 60;  // fall through
+    case 's': end++;        // fall through
+    default:  break;
+  }
+
+  if ( *end != '\0' ) return false;
+
+  *seconds = value;
+  return true;
+}
+
+int spawn_parse_signal( const char* text )
+{
+  char* end;
+  long number = strtol( text, &end, 10 );
+  if ( end != text && *end == '\0' )
+  {
+    return number > 0 && number < NSIG ? number : 0;
+  }
+
+  if ( strncasecmp( text, "SIG", 3 ) == 0 ) text += 3;
+
+  int signal;
+  for ( signal = 1; signal < NSIG; signal++ )
+  {
+    const char* name = sigabbrev_np( signal );
+    if ( name != NULL && strcasecmp( name, text ) == 0 ) return signal;
+  }
+
+  return 0;
+}
+
+void spawn_set_limit( spawn_t* this, int resource, unsigned char halves,
+                      rlim_t value )
+{
+  this->limits_set[ resource ] |= halves;
+
+  if ( halves & SPAWN_LIMIT_SOFT ) this->limits[ resource ].rlim_cur = value;
+  if ( halves & SPAWN_LIMIT_HARD ) this->limits[ resource ].rlim_max = value;
+}
+
+rlim_t spawn_get_limit( const spawn_t* this, int resource, unsigned char half )
+{
+  struct rlimit limit;
+  getrlimit( resource, &limit );
+
+  if ( this->limits_set[ resource ] & SPAWN_LIMIT_SOFT )
+  {
+    limit.rlim_cur = this->limits[ resource ].rlim_cur;
+  }
+  if ( this->limits_set[ resource ] & SPAWN_LIMIT_HARD )
+  {
+    limit.rlim_max = this->limits[ resource ].rlim_max;
+  }
+
+  return half == SPAWN_LIMIT_HARD ? limit.rlim_max : limit.rlim_cur;
+}
+
+const spawn_limit_t* spawn_find_limit( char option )
+{
+  const spawn_limit_t* limit;
+  for ( limit = g_limits; limit->option != 0; limit++ )
+  {
+    if ( limit->option == option ) return limit;
+  }
+
+  return NULL;
+}
+
+const spawn_limit_t* spawn_all_limits()
+{
+  return g_limits;
+}
+
+bool spawn_parse_cpus( const char* text, cpu_set_t* cpus )
+{
+  CPU_ZERO( cpus );
+
+  const char* current = text;
+  while ( *current != '\0' )
+  {
+    char* end;
+    unsigned long first = strtoul( current, &end, 10 );
+    unsigned long last = first;
+
+    if ( end == current ) break;
+    current = end;
+
+    if ( *current == '-' )
+    {
+      last = strtoul( current + 1, &end, 10 );
+      if ( end == current + 1 ) break;
+      current = end;
+    }
+
+    if ( first > last || last >= CPU_SETSIZE ) break;
+    for ( ; first <= last; first++ )
+    {
+      CPU_SET( first, cpus );
+    }
+
+    if ( *current == ',' && current[ 1 ] != '\0' ) current++;
+    else if ( *current != '\0' ) break;
+  }
+
+  if ( *current != '\0' || CPU_COUNT( cpus ) == 0 )
+  {
+    printf( "%s: not a list of CPUs (e.g. 0-3,8)\n", text );
+    return false;
+  }
+
+  return true;
+}
+
+void spawn_format_cpus( const cpu_set_t* cpus, char* out, size_t size )
+{
+  size_t length = 0;
+  out[ 0 ] = '\0';
+
+  int cpu = 0;
+  while ( cpu < CPU_SETSIZE && length < size )
+  {
+    if ( !CPU_ISSET( cpu, cpus ) )
+    {
+      cpu += 1;
+      continue;
+    }
+
+    // find the end of this run of CPUs
+    int last = cpu;
+    while ( last + 1 < CPU_SETSIZE && CPU_ISSET( last + 1, cpus ) ) last++;
+
+    const char* separator = length > 0 ? "," : "";
+    if ( last == cpu )
+    {
+      length += snprintf( out + length, size - length, "%s%d", separator, cpu );
+    }
+    else
+    {
+      length += snprintf( out + length, size - length, "%s%d-%d",
+                          separator, cpu, last );
+    }
+
+    cpu = last + 1;
+  }
+}
+
+bool spawn_pin( pid_t pid, const cpu_set_t* cpus )
+{
+  // affinity belongs to each thread, so every one of them is pinned
+  // (n.b. threads started while this runs could be missed)
+  char path[ 64 ];
+  snprintf( path, sizeof( path ), "/proc/%d/task", pid );
+
+  DIR* tasks = opendir( path );
+  if ( tasks == NULL )
+  {
+    perror( "affinity" );
+    return false;
+  }
+
+  bool ok = true;
+
+  struct dirent* entry;
+  while ( ( entry = readdir( tasks ) ) != NULL )
+  {
+    pid_t tid = atoi( entry->d_name );
+    if ( tid <= 0 ) continue;
+
+    if ( sched_setaffinity( tid, sizeof( *cpus ), cpus ) < 0 )
+    {
+      perror( "affinity" );
+      ok = false;
+      break;
+    }
+  }
+
+  closedir( tasks );
+  return ok;
+}
@@ -0,0 +1,724 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "tasks.h"
+#include "shell.h"
+#include "memstats.h"
+
+/**
+ * Every task in a file.
+ */
+typedef struct task_graph_t
+{
+  /** The tasks, in the order they were declared */
+  task_t* tasks;
+  unsigned int count;
+
+  /** The tasks in an order where each comes after its dependencies */
+  unsigned int* order;
+} task_graph_t;
+
+/**
+ * Gets the time (monotonic, in nanoseconds).
+ */
+static int64_t tasks_now( void )
+{
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return ( int64_t ) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Makes room for one more entry of [size] bytes on the end of an array
+ * with [count] of them already (which doubles in size as it fills).
+ */
+static void* tasks_append( void* array, unsigned int count, size_t size )
+{
+  if ( count >= 4 && ( count & ( count - 1 ) ) != 0 ) return array;
+
+  return realloc( array, ( count < 4 ? 4 : count * 2 ) * size );
+}
+
+/**
+ * Adds a new task to the graph, returning it.
+ */
+static task_t* tasks_add( task_graph_t* graph, const char* name, unsigned int line )
+{
+  graph->tasks = tasks_append( graph->tasks, graph->count, sizeof( task_t ) );
+
+  task_t* task = &graph->tasks[ graph->count++ ];
+  memset( task, 0, sizeof( *task ) );
+  task->name = strdup( name );
+  task->line = line;
+  task->state = TASK_WAITING;
+  task->critical = -1;
+  return task;
+}
+
+/**
+ * Reads the tasks out of the file at [path]. Returns [false] (after
+ * telling the user why) if it isn't a task file.
+ */
+static bool tasks_read( task_graph_t* graph, const char* path )
+{
+  FILE* file = fopen( path, "r" );
+  if ( file == NULL )
+  {
+    perror( path );
+    return false;
+  }
+
+  char* line = NULL;
+  size_t size = 0;
+  ssize_t length;
+  unsigned int number = 0;
+  task_t* task = NULL;
+  bool ok = true;
+
+  while ( ok && ( length = getline( &line, &size, file ) ) >= 0 )
+  {
+    number += 1;
+
+    while ( length > 0 && isspace( ( unsigned char ) line[ length - 1 ] ) )
+    {
+      line[ --length ] = '\0';
+    }
+
+    char* text = line;
+    while ( isspace( ( unsigned char ) *text ) ) text++;
+
+    if ( *text == '\0' || *text == '#' ) continue;
+
+    // an indented line => one of the task's commands
+    if ( text != line )
+    {
+      if ( task == NULL )
+      {
+        printf( "%s:%u: command outside of any task\n", path, number );
+        ok = false;
+        break;
+      }
+
+      task->commands = tasks_append( task->commands, task->command_count,
+                                     sizeof( char* ) );
+      task->commands[ task->command_count++ ] = strdup( text );
+      continue;
+    }
+
+    // otherwise => NAME: [DEPENDENCY]...
+    char* colon = strchr( line, ':' );
+    char* end = colon;
+    while ( end != NULL && end > line && isspace( ( unsigned char ) end[ -1 ] ) ) end--;
+
+    if ( colon == NULL || end == line || strcspn( line, " \t" ) < ( size_t )( end - line ) )
+    {
+      printf( "%s:%u: expected NAME: [DEPENDENCY]...\n", path, number );
+      ok = false;
+      break;
+    }
+
+    *end = '\0';
+    task = tasks_add( graph, line, number );
+
+    char* save;
+    char* need;
+    for ( need = strtok_r( colon + 1, " \t", &save ); need != NULL;
+          need = strtok_r( NULL, " \t", &save ) )
+    {
+      task->needs = tasks_append( task->needs, task->need_count, sizeof( char* ) );
+      task->needs[ task->need_count++ ] = strdup( need );
+    }
+  }
+
+  free( line );
+  fclose( file );
+  return ok;
+}
+
+/**
+ * Orders (pointers to) tasks by their names.
+ */
+static int tasks_compare_names( const void* left, const void* right )
+{
+  return strcmp( ( *( task_t* const* ) left )->name,
+                 ( *( task_t* const* ) right )->name );
+}
+
+/**
+ * Looks up every task's dependencies by name, linking each to the
+ * tasks which depend on it. Returns [false] (after telling the user
+ * why) if a name is declared twice or isn't declared at all.
+ */
+static bool tasks_link( task_graph_t* graph, const char* path )
+{
+  task_t** names = malloc( graph->count * sizeof( *names ) );
+  unsigned int index;
+  for ( index = 0; index < graph->count; index++ )
+  {
+    names[ index ] = &graph->tasks[ index ];
+  }
+
+  qsort( names, graph->count, sizeof( *names ), tasks_compare_names );
+
+  bool ok = true;
+  for ( index = 1; ok && index < graph->count; index++ )
+  {
+    if ( strcmp( names[ index - 1 ]->name, names[ index ]->name ) == 0 )
+    {
+      // (qsort isn't stable, so either could have been declared first)
+      const task_t* first = names[ index - 1 ];
+      const task_t* second = names[ index ];
+      if ( first->line > second->line )
+      {
+        first = names[ index ];
+        second = names[ index - 1 ];
+      }
+
+      printf( "%s:%u: %s was already declared on line %u\n", path,
+              second->line, second->name, first->line );
+      ok = false;
+    }
+  }
+
+  for ( index = 0; ok && index < graph->count; index++ )
+  {
+    task_t* task = &graph->tasks[ index ];
+
+    unsigned int need;
+    for ( need = 0; need < task->need_count; need++ )
+    {
+      task_t key;
+      key.name = task->needs[ need ];
+      const task_t* wanted = &key;
+
+      task_t* const* match = bsearch( &wanted, names, graph->count,
+                                      sizeof( *names ), tasks_compare_names );
+      if ( match == NULL )
+      {
+        printf( "%s:%u: %s depends on %s, which isn't declared\n", path,
+                task->line, task->name, task->needs[ need ] );
+        ok = false;
+        break;
+      }
+
+      task_t* dependency = *match;
+      dependency->dependents = tasks_append( dependency->dependents,
+                                             dependency->dependent_count,
+                                             sizeof( unsigned int ) );
+      dependency->dependents[ dependency->dependent_count++ ] = index;
+      task->pending += 1;
+    }
+  }
+
+  free( names );
+  return ok;
+}
+
+/**
+ * Puts the tasks in an order where each comes after everything it
+ * depends on, and works out how urgent each is (its rank). Returns
+ * [false] (after telling the user which tasks) if there's a cycle.
+ */
+static bool tasks_order( task_graph_t* graph, const char* path )
+{
+  graph->order = malloc( graph->count * sizeof( *graph->order ) );
+
+  unsigned int* pending = malloc( graph->count * sizeof( *pending ) );
+  unsigned int ordered = 0;
+
+  unsigned int index;
+  for ( index = 0; index < graph->count; index++ )
+  {
+    pending[ index ] = graph->tasks[ index ].pending;
+    if ( pending[ index ] == 0 ) graph->order[ ordered++ ] = index;
+  }
+
+  // (the order doubles as the queue of tasks with nothing left pending)
+  for ( index = 0; index < ordered; index++ )
+  {
+    const task_t* task = &graph->tasks[ graph->order[ index ] ];
+
+    unsigned int dependent;
+    for ( dependent = 0; dependent < task->dependent_count; dependent++ )
+    {
+      if ( --pending[ task->dependents[ dependent ] ] == 0 )
+      {
+        graph->order[ ordered++ ] = task->dependents[ dependent ];
+      }
+    }
+  }
+
+  if ( ordered < graph->count )
+  {
+    printf( "%s: there's a cycle between", path );
+    for ( index = 0; index < graph->count; index++ )
+    {
+      if ( pending[ index ] > 0 ) printf( " %s", graph->tasks[ index ].name );
+    }
+    printf( "\n" );
+
+    free( pending );
+    return false;
+  }
+
+  // a task's rank is the longest chain of tasks starting with it, so
+  // they're worked out from the end
+  for ( index = graph->count; index-- > 0; )
+  {
+    task_t* task = &graph->tasks[ graph->order[ index ] ];
+
+    unsigned int dependent;
+    for ( dependent = 0; dependent < task->dependent_count; dependent++ )
+    {
+      unsigned int rank = graph->tasks[ task->dependents[ dependent ] ].rank;
+      if ( rank > task->rank ) task->rank = rank;
+    }
+
+    task->rank += 1;
+  }
+
+  free( pending );
+  return true;
+}
+
+/**
+ * Orders tasks with the most urgent first, then in the order they were
+ * declared (for qsort_r, given the tasks).
+ */
+static int tasks_compare_ranks( const void* left, const void* right, void* tasks )
+{
+  unsigned int first = *( const unsigned int* ) left;
+  unsigned int second = *( const unsigned int* ) right;
+  unsigned int first_rank = ( ( const task_t* ) tasks )[ first ].rank;
+  unsigned int second_rank = ( ( const task_t* ) tasks )[ second ].rank;
+
+  if ( first_rank != second_rank ) return first_rank > second_rank ? -1 : 1;
+  return first < second ? -1 : first > second;
+}
+
+/**
+ * Gives a worker the tasks which are [ready], on the bottom of its
+ * deque. The most urgent goes last, so the worker starts that one
+ * itself, with the rest in order of urgency for others to steal.
+ */
+static void tasks_offer( task_graph_t* graph, task_worker_t* worker,
+                         unsigned int* ready, unsigned int count )
+{
+  if ( count == 0 ) return;
+
+  qsort_r( ready, count, sizeof( *ready ), tasks_compare_ranks, graph->tasks );
+
+  task_deque_t* deque = &worker->deque;
+
+  unsigned int index;
+  for ( index = 1; index < count; index++ )
+  {
+    graph->tasks[ ready[ index ] ].state = TASK_READY;
+    deque->items[ deque->bottom++ ] = ready[ index ];
+  }
+
+  graph->tasks[ ready[ 0 ] ].state = TASK_READY;
+  deque->items[ deque->bottom++ ] = ready[ 0 ];
+}
+
+/**
+ * Takes the next task for worker [self] to run: the newest in its own
+ * deque, or (if that's empty) the oldest in whichever other worker's
+ * deque has the most urgent task there. Returns -1 if there aren't
+ * any ready tasks left.
+ */
+static int tasks_take( const task_graph_t* graph, task_worker_t* workers,
+                       unsigned int jobs, unsigned int self )
+{
+  task_deque_t* own = &workers[ self ].deque;
+  if ( own->bottom > own->top )
+  {
+    return own->items[ --own->bottom ];
+  }
+
+  task_deque_t* victim = NULL;
+
+  unsigned int index;
+  for ( index = 0; index < jobs; index++ )
+  {
+    task_deque_t* deque = &workers[ index ].deque;
+    if ( deque->bottom == deque->top ) continue;
+
+    if ( victim == NULL || graph->tasks[ deque->items[ deque->top ] ].rank
+                         > graph->tasks[ victim->items[ victim->top ] ].rank )
+    {
+      victim = deque;
+    }
+  }
+
+  if ( victim == NULL ) return -1;
+
+  workers[ self ].steals += 1;
+  return victim->items[ victim->top++ ];
+}
+
+/**
+ * Runs a task's commands (in the process forked for it), in a shell of
+ * its own, stopping at the first one which fails. This never returns.
+ */
+static void tasks_child( const task_t* task )
+{
+  shell_t shell;
+  shell_init( &shell );
+  shell_set_active( &shell );
+
+  bool running = true;
+
+  unsigned int index;
+  for ( index = 0; running && index < task->command_count; index++ )
+  {
+    command_t* command = malloc( sizeof( *command ) );
+    command_init( command );
+    command->string = mem_strdup( MEM_STRINGS, task->commands[ index ] );
+    command_parse( command, command->string );
+
+    running = shell_run_command( &shell, command );
+    shell_wait( &shell );
+    shell_reap( &shell );
+
+    if ( shell.last_status != 0 ) break;
+  }
+
+  int status = shell.last_status;
+  fflush( stdout );
+  shell_destroy( &shell );
+
+  _exit( status );
+}
+
+/**
+ * Marks everything which depends on a failed task (however indirectly)
+ * as skipped, returning how many tasks that was.
+ */
+static unsigned int tasks_skip( task_graph_t* graph, const task_t* failed,
+                                const task_t* task )
+{
+  unsigned int skipped = 0;
+
+  unsigned int dependent;
+  for ( dependent = 0; dependent < task->dependent_count; dependent++ )
+  {
+    task_t* skip = &graph->tasks[ task->dependents[ dependent ] ];
+    if ( skip->state != TASK_WAITING ) continue;
+
+    printf( "tasks: skipping %s (%s failed)\n", skip->name, failed->name );
+    skip->state = TASK_SKIPPED;
+    skipped += 1 + tasks_skip( graph, failed, skip );
+  }
+
+  return skipped;
+}
+
+/**
+ * Finishes the task a worker was running, with the given status (from
+ * waitpid), handing whatever it was holding up to the same worker.
+ * Returns how many tasks that finished (i.e. counting any skipped).
+ */
+static unsigned int tasks_finish( task_graph_t* graph, task_worker_t* worker,
+                                  int status, unsigned int* ready )
+{
+  task_t* task = &graph->tasks[ worker->task ];
+  worker->task = -1;
+
+  task->finished = tasks_now();
+  task->status = WIFSIGNALED( status ) ? 128 + WTERMSIG( status ) : WEXITSTATUS( status );
+  worker->busy += task->finished - task->started;
+
+  if ( task->status != 0 )
+  {
+    task->state = TASK_FAILED;
+    printf( "tasks: %s failed (%d)\n", task->name, task->status );
+    return 1 + tasks_skip( graph, task, task );
+  }
+
+  task->state = TASK_DONE;
+
+  unsigned int count = 0;
+
+  unsigned int dependent;
+  for ( dependent = 0; dependent < task->dependent_count; dependent++ )
+  {
+    task_t* next = &graph->tasks[ task->dependents[ dependent ] ];
+    if ( --next->pending == 0 && next->state == TASK_WAITING )
+    {
+      ready[ count++ ] = task->dependents[ dependent ];
+    }
+  }
+
+  tasks_offer( graph, worker, ready, count );
+  return 1;
+}
+
+/**
+ * Starts the next task for each idle worker, while there are any
+ * ready. Tasks without any commands are finished then and there.
+ * Returns how many tasks were finished along the way.
+ */
+static unsigned int tasks_start( task_graph_t* graph, task_worker_t* workers,
+                                 unsigned int jobs, unsigned int* ready )
+{
+  unsigned int finished = 0;
+
+  unsigned int index;
+  for ( index = 0; index < jobs; index++ )
+  {
+    task_worker_t* worker = &workers[ index ];
+
+    while ( worker->task == -1 )
+    {
+      int next = tasks_take( graph, workers, jobs, index );
+      if ( next == -1 ) break;
+
+      task_t* task = &graph->tasks[ next ];
+      task->state = TASK_RUNNING;
+      task->worker = index;
+      task->started = tasks_now();
+      worker->task = next;
+      worker->runs += 1;
+
+      if ( task->command_count == 0 )
+      {
+        finished += tasks_finish( graph, worker, 0, ready );
+        continue;
+      }
+
+      // (or the child would write out whatever we hadn't yet, again)
+      fflush( stdout );
+
+      task->pid = fork();
+      if ( task->pid == 0 )
+      {
+        tasks_child( task );
+      }
+      if ( task->pid < 0 )
+      {
+        perror( task->name );
+        finished += tasks_finish( graph, worker, 1 << 8, ready );
+      }
+    }
+  }
+
+  return finished;
+}
+
+/**
+ * Prints how long the tasks took, how busy the workers were kept, and
+ * which chain of tasks held everything else up.
+ */
+static void tasks_report( task_graph_t* graph, task_worker_t* workers,
+                          unsigned int jobs, int64_t elapsed )
+{
+  unsigned int done = 0, failed = 0, skipped = 0;
+  int64_t busy = 0;
+  unsigned int steals = 0;
+
+  // the chains are added up from the start, so each task's is ready
+  // by the time the tasks which depend on it need it
+  int last = -1;
+
+  unsigned int index;
+  for ( index = 0; index < graph->count; index++ )
+  {
+    task_t* task = &graph->tasks[ graph->order[ index ] ];
+
+    done += task->state == TASK_DONE;
+    failed += task->state == TASK_FAILED;
+    skipped += task->state == TASK_SKIPPED;
+
+    if ( task->state == TASK_DONE || task->state == TASK_FAILED )
+    {
+      task->chain += task->finished - task->started;
+    }
+
+    unsigned int dependent;
+    for ( dependent = 0; dependent < task->dependent_count; dependent++ )
+    {
+      task_t* next = &graph->tasks[ task->dependents[ dependent ] ];
+      if ( next->critical == -1 || task->chain > next->chain )
+      {
+        next->chain = task->chain;
+        next->critical = graph->order[ index ];
+      }
+    }
+
+    if ( last == -1 || task->chain > graph->tasks[ last ].chain )
+    {
+      last = graph->order[ index ];
+    }
+  }
+
+  for ( index = 0; index < jobs; index++ )
+  {
+    busy += workers[ index ].busy;
+    steals += workers[ index ].steals;
+  }
+
+  printf( "tasks: %u done, %u failed, %u skipped in %.2fs with %u workers\n",
+          done, failed, skipped, elapsed / 1e9, jobs );
+  printf( "tasks: workers were busy %.0f%% of the time (%.2fs of %.2fs),"
+          " with %u steals\n",
+          elapsed > 0 ? 100.0 * busy / ( ( double ) elapsed * jobs ) : 100.0,
+          busy / 1e9, elapsed * ( double ) jobs / 1e9, steals );
+
+  for ( index = 0; index < jobs; index++ )
+  {
+    printf( "tasks:   worker %u ran %u in %.2fs (%u stolen)\n", index,
+            workers[ index ].runs, workers[ index ].busy / 1e9,
+            workers[ index ].steals );
+  }
+
+  if ( last == -1 ) return;
+
+  // (the chain is followed back from its end, into the order since
+  // that isn't needed any more, so it's printed reversed)
+  unsigned int length = 0;
+  int task;
+  for ( task = last; task != -1; task = graph->tasks[ task ].critical )
+  {
+    graph->order[ length++ ] = task;
+  }
+
+  printf( "tasks: critical path took %.2fs of the %.2fs:",
+          graph->tasks[ last ].chain / 1e9, elapsed / 1e9 );
+  while ( length-- > 0 )
+  {
+    printf( " %s%s", graph->tasks[ graph->order[ length ] ].name,
+            length > 0 ? " ->" : "" );
+  }
+  printf( "\n" );
+}
+
+/**
+ * Frees everything in the graph.
+ */
+static void tasks_free( task_graph_t* graph )
+{
+  unsigned int index;
+  for ( index = 0; index < graph->count; index++ )
+  {
+    task_t* task = &graph->tasks[ index ];
+
+    unsigned int item;
+    for ( item = 0; item < task->command_count; item++ ) free( task->commands[ item ] );
+    for ( item = 0; item < task->need_count; item++ ) free( task->needs[ item ] );
+
+    free( task->name );
+    free( task->commands );
+    free( task->needs );
+    free( task->dependents );
+  }
+
+  free( graph->tasks );
+  free( graph->order );
+}
+
+int tasks_run( const char* path, unsigned int jobs )
+{
+  task_graph_t graph = { NULL, 0, NULL };
+
+  if ( !tasks_read( &graph, path ) || !tasks_link( &graph, path )
+    || !tasks_order( &graph, path ) )
+  {
+    tasks_free( &graph );
+    return 2;
+  }
+
+  if ( jobs == 0 ) jobs = 1;
+
+  // (no task is ever in more than one deque, or in one more than once)
+  task_worker_t* workers = calloc( jobs, sizeof( *workers ) );
+  unsigned int* ready = malloc( ( graph.count + 1 ) * sizeof( *ready ) );
+
+  unsigned int index;
+  for ( index = 0; index < jobs; index++ )
+  {
+    workers[ index ].deque.items = malloc( ( graph.count + 1 ) * sizeof( unsigned int ) );
+    workers[ index ].task = -1;
+  }
+
+  // the tasks which are ready to start with are dealt out between the
+  // workers, the most urgent first
+  unsigned int count = 0;
+  for ( index = 0; index < graph.count; index++ )
+  {
+    if ( graph.tasks[ index ].pending == 0 ) ready[ count++ ] = index;
+  }
+  qsort_r( ready, count, sizeof( *ready ), tasks_compare_ranks, graph.tasks );
+
+  unsigned int* dealt = malloc( ( count + 1 ) * sizeof( *dealt ) );
+
+  unsigned int worker;
+  for ( worker = 0; worker < jobs && worker < count; worker++ )
+  {
+    unsigned int share = 0;
+    for ( index = worker; index < count; index += jobs )
+    {
+      dealt[ share++ ] = ready[ index ];
+    }
+
+    tasks_offer( &graph, &workers[ worker ], dealt, share );
+  }
+
+  free( dealt );
+
+  int64_t started = tasks_now();
+  unsigned int finished = 0;
+
+  while ( finished < graph.count )
+  {
+    finished += tasks_start( &graph, workers, jobs, ready );
+    if ( finished == graph.count ) break;
+
+    int status;
+    pid_t pid = waitpid( -1, &status, 0 );
+    if ( pid < 0 )
+    {
+      if ( errno == EINTR ) continue;
+      break;
+    }
+
+    for ( index = 0; index < jobs; index++ )
+    {
+      if ( workers[ index ].task != -1
+        && graph.tasks[ workers[ index ].task ].pid == pid )
+      {
+        finished += tasks_finish( &graph, &workers[ index ], status, ready );
+        break;
+      }
+    }
+  }
+
+  tasks_report( &graph, workers, jobs, tasks_now() - started );
+
+  bool failed = false;
+  for ( index = 0; index < graph.count; index++ )
+  {
+    failed = failed || graph.tasks[ index ].state != TASK_DONE;
+  }
+
+  for ( index = 0; index < jobs; index++ )
+  {
+    free( workers[ index ].deque.items );
+  }
+  free( workers );
+  free( ready );
+  tasks_free( &graph );
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,631 @@
+/*
+ * Name: Austin Donovan
+ * Id:   1001311620
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "zygote.h"
+#include "buffer.h"
+
+extern char** environ;
+
+// what the helper sends back
+#define ZYGOTE_STARTED 1
+#define ZYGOTE_STATUS  2
+
+typedef struct zygote_request_t zygote_request_t;
+typedef struct zygote_reply_t zygote_reply_t;
+
+/**
+ * The start of a launch request, followed by the working directory,
+ * the arguments and then the environment changes (`NAME=value` to set
+ * one, or just `NAME` to unset it), each NUL-terminated. The child's
+ * stdin, stdout and stderr are sent along with it.
+ */
+struct zygote_request_t
+{
+  /** The number of arguments */
+  uint32_t argc;
+
+  /** The number of environment changes */
+  uint32_t envc;
+
+  /** The attributes the child is started with */
+  spawn_t spawn;
+};
+
+/**
+ * Something the helper tells the shell: that it started a child
+ * (ZYGOTE_STARTED, in reply to each request), or that one of them
+ * changed state (ZYGOTE_STATUS, whenever it happens).
+ */
+struct zygote_reply_t
+{
+  /** ZYGOTE_STARTED or ZYGOTE_STATUS */
+  uint32_t type;
+
+  /** The child (or -1, if it couldn't be started) */
+  pid_t pid;
+
+  /** Its status from waitpid (or errno, if it couldn't be started) */
+  int status;
+};
+
+//
+// The helper's side
+//
+
+/**
+ * Starts the program in a request, in the process just forked for it.
+ */
+static void zygote_exec( char* request, size_t length, const int* fds )
+{
+  zygote_request_t* header = ( zygote_request_t* ) request;
+  char* current = request + sizeof( *header );
+  char* end = request + length;
+
+  const char* directory = current;
+  current += strlen( current ) + 1;
+
+  command_t command;
+  command_init( &command );
+
+  uint32_t i;
+  for ( i = 0; i < header->argc && current < end; i++ )
+  {
+    list_string_enqueue( command.tokens, current );
+    current += strlen( current ) + 1;
+  }
+
+  for ( i = 0; i < header->envc && current < end; i++ )
+  {
+    size_t size = strlen( current ) + 1;
+    char* equals = strchr( current, '=' );
+    if ( equals == NULL )
+    {
+      unsetenv( current );
+    }
+    else
+    {
+      *equals = '\0';
+      setenv( current, equals + 1, 1 );
+    }
+    current += size;
+  }
+
+  if ( chdir( directory ) < 0 )
+  {
+    perror( directory );
+    _exit( 1 );
+  }
+
+  for ( i = 0; i < 3; i++ )
+  {
+    dup2( fds[ i ], i );
+    close( fds[ i ] );
+  }
+
+  if ( !spawn_apply( &header->spawn ) )
+  {
+    fflush( stdout );
+    _exit( 1 );
+  }
+
+  command_execv( &command );
+}
+
+/**
+ * Tells the shell about every child that's changed state.
+ */
+static void zygote_report( int socket )
+{
+  int status;
+  pid_t pid;
+  while ( ( pid = waitpid( -1, &status, WNOHANG | WUNTRACED | WCONTINUED ) ) > 0 )
+  {
+    zygote_reply_t reply = { ZYGOTE_STATUS, pid, status };
+    send( socket, &reply, sizeof( reply ), MSG_NOSIGNAL );
+  }
+}
+
+/**
+ * Takes a single request from the shell, and starts its program.
+ * Returns [false] once the shell has hung up.
+ */
+static bool zygote_launch( int socket, char* request )
+{
+  union
+  {
+    char buffer[ CMSG_SPACE( sizeof( int ) * 3 ) ];
+    struct cmsghdr align;
+  } control;
+
+  struct iovec part = { .iov_base = request, .iov_len = ZYGOTE_MAX_REQUEST };
+
+  struct msghdr message;
+  memset( &message, 0, sizeof( message ) );
+  message.msg_iov = &part;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof( control.buffer );
+
+  ssize_t length = recvmsg( socket, &message, MSG_CMSG_CLOEXEC );
+  if ( length < 0 ) return errno == EINTR;
+  if ( length == 0 ) return false;
+
+  int fds[ 3 ] = { -1, -1, -1 };
+  struct cmsghdr* header = CMSG_FIRSTHDR( &message );
+  if ( header != NULL && header->cmsg_type == SCM_RIGHTS
+    && header->cmsg_len == CMSG_LEN( sizeof( fds ) ) )
+  {
+    memcpy( fds, CMSG_DATA( header ), sizeof( fds ) );
+  }
+
+  zygote_reply_t reply = { ZYGOTE_STARTED, -1, EINVAL };
+  if ( length >= ( ssize_t ) sizeof( zygote_request_t ) && fds[ 2 ] != -1 )
+  {
+    const spawn_t* spawn = &( ( zygote_request_t* ) request )->spawn;
+
+    reply.pid = fork();
+    if ( reply.pid == 0 )
+    {
+      zygote_exec( request, length, fds );
+    }
+
+    reply.status = errno;
+    if ( reply.pid > 0 )
+    {
+      spawn_adopt( spawn, reply.pid );
+    }
+  }
+
+  int i;
+  for ( i = 0; i < 3; i++ )
+  {
+    if ( fds[ i ] != -1 ) close( fds[ i ] );
+  }
+
+  send( socket, &reply, sizeof( reply ), MSG_NOSIGNAL );
+  return true;
+}
+
+/**
+ * The helper's loop, which runs until the shell hangs up.
+ */
+static void zygote_serve( int socket )
+{
+  // the terminal's signals are for whatever is in the foreground, and
+  // never for the helper
+  setpgid( 0, 0 );
+
+  sigset_t child;
+  sigemptyset( &child );
+  sigaddset( &child, SIGCHLD );
+  sigprocmask( SIG_BLOCK, &child, NULL );
+  int signals = signalfd( -1, &child, SFD_CLOEXEC );
+
+  char* request = malloc( ZYGOTE_MAX_REQUEST );
+
+  struct pollfd fds[ 2 ] = {
+    { .fd = socket, .events = POLLIN },
+    { .fd = signals, .events = POLLIN }
+  };
+
+  for ( ;; )
+  {
+    if ( poll( fds, 2, -1 ) < 0 ) continue;
+
+    if ( fds[ 1 ].revents != 0 )
+    {
+      struct signalfd_siginfo info;
+      read( signals, &info, sizeof( info ) );
+      zygote_report( socket );
+    }
+
+    if ( fds[ 0 ].revents != 0 && !zygote_launch( socket, request ) ) break;
+  }
+
+  free( request );
+  exit( 0 );
+}
+
+//
+// The shell's side
+//
+
+/**
+ * Finds the child with the given pid, or NULL.
+ */
+static zygote_child_t* zygote_find( zygote_t* this, pid_t pid )
+{
+  zygote_child_t* child;
+  for ( child = this->children; child != NULL; child = child->next )
+  {
+    if ( child->pid == pid ) return child;
+  }
+
+  return NULL;
+}
+
+/**
+ * Stops tracking a child.
+ */
+static void zygote_remove( zygote_t* this, zygote_child_t* child )
+{
+  zygote_child_t** link = &this->children;
+  while ( *link != child )
+  {
+    link = &( *link )->next;
+  }
+
+  *link = child->next;
+  free( child );
+}
+
+/**
+ * Records a status the helper reported.
+ */
+static void zygote_record( zygote_t* this, const zygote_reply_t* reply )
+{
+  zygote_child_t* child = zygote_find( this, reply->pid );
+  if ( child == NULL ) return;
+
+  if ( WIFSTOPPED( reply->status ) )
+  {
+    child->state = ZYGOTE_STOPPED;
+  }
+  else if ( WIFCONTINUED( reply->status ) )
+  {
+    if ( child->state == ZYGOTE_STOPPED ) child->state = ZYGOTE_RUNNING;
+    return;
+  }
+  else
+  {
+    child->state = ZYGOTE_EXITED;
+  }
+
+  child->status = reply->status;
+}
+
+/**
+ * Gives up on the helper, e.g. after it died. Its children can't be
+ * waited on anymore, so they're treated as killed.
+ */
+static void zygote_lost( zygote_t* this )
+{
+  if ( this->socket == -1 ) return;
+
+  printf( "Lost the spawner process, starting programs directly\n" );
+  close( this->socket );
+  this->socket = -1;
+
+  zygote_child_t* child;
+  for ( child = this->children; child != NULL; child = child->next )
+  {
+    child->state = ZYGOTE_EXITED;
+    child->status = SIGKILL;
+  }
+}
+
+/**
+ * Takes one message from the helper, waiting for it if [block].
+ * Statuses are recorded as they come in. Returns the message's type,
+ * or zero if there wasn't one.
+ */
+static uint32_t zygote_receive( zygote_t* this, bool block, zygote_reply_t* reply )
+{
+  if ( this->socket == -1 ) return 0;
+
+  ssize_t length = recv( this->socket, reply, sizeof( *reply ),
+                         block ? 0 : MSG_DONTWAIT );
+
+  if ( length < 0 && ( errno == EAGAIN || errno == EINTR ) ) return 0;
+  if ( length != sizeof( *reply ) )
+  {
+    zygote_lost( this );
+    return 0;
+  }
+
+  if ( reply->type == ZYGOTE_STATUS )
+  {
+    zygote_record( this, reply );
+  }
+
+  return reply->type;
+}
+
+/**
+ * Records every status the helper has sent so far.
+ */
+static void zygote_drain( zygote_t* this )
+{
+  zygote_reply_t reply;
+  while ( zygote_receive( this, false, &reply ) != 0 );
+}
+
+bool zygote_start( zygote_t* this )
+{
+  this->children = NULL;
+  this->environment = NULL;
+
+  int pair[ 2 ];
+  if ( socketpair( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair ) < 0 )
+  {
+    perror( "socketpair" );
+    this->socket = -1;
+    return false;
+  }
+
+  fflush( stdout );
+  this->pid = fork();
+  if ( this->pid == 0 )
+  {
+    close( pair[ 0 ] );
+    zygote_serve( pair[ 1 ] );
+  }
+
+  close( pair[ 1 ] );
+
+  if ( this->pid < 0 )
+  {
+    perror( "fork" );
+    close( pair[ 0 ] );
+    this->socket = -1;
+    return false;
+  }
+
+  this->socket = pair[ 0 ];
+
+  // remember the environment it has, so only what changes is sent
+  size_t count = 0;
+  while ( environ[ count ] != NULL ) count++;
+
+  this->environment = calloc( count + 1, sizeof( char* ) );
+
+  size_t i;
+  for ( i = 0; i < count; i++ )
+  {
+    this->environment[ i ] = strdup( environ[ i ] );
+  }
+
+  return true;
+}
+
+void zygote_stop( zygote_t* this )
+{
+  if ( this->socket != -1 )
+  {
+    close( this->socket );
+    this->socket = -1;
+  }
+  if ( this->pid > 0 )
+  {
+    waitpid( this->pid, NULL, 0 );
+    this->pid = 0;
+  }
+
+  while ( this->children != NULL )
+  {
+    zygote_remove( this, this->children );
+  }
+
+  char** entry;
+  for ( entry = this->environment; entry != NULL && *entry != NULL; entry++ )
+  {
+    free( *entry );
+  }
+  free( this->environment );
+  this->environment = NULL;
+}
+
+/**
+ * Checks if the helper's environment has exactly the given entry.
+ */
+static bool zygote_has_entry( const zygote_t* this, const char* entry )
+{
+  char** current;
+  for ( current = this->environment; *current != NULL; current++ )
+  {
+    if ( strcmp( *current, entry ) == 0 ) return true;
+  }
+
+  return false;
+}
+
+/**
+ * Appends the changes to the helper's environment needed to make it
+ * the shell's current one (plus the command's own assignments).
+ * Returns how many there are.
+ */
+static uint32_t zygote_environment( const zygote_t* this,
+                                    const command_t* command, buffer_t* out )
+{
+  uint32_t count = 0;
+
+  char** entry;
+  for ( entry = environ; *entry != NULL; entry++ )
+  {
+    if ( !zygote_has_entry( this, *entry ) )
+    {
+      buffer_append_string( out, *entry );
+      count += 1;
+    }
+  }
+
+  for ( entry = this->environment; *entry != NULL; entry++ )
+  {
+    char* name = strndup( *entry, strcspn( *entry, "=" ) );
+    if ( getenv( name ) == NULL )
+    {
+      buffer_append_string( out, name );
+      count += 1;
+    }
+    free( name );
+  }
+
+  unsigned int index;
+  for ( index = 0; index < command->assignments->size; index++ )
+  {
+    buffer_append_string( out, list_string_get( command->assignments, index ) );
+    count += 1;
+  }
+
+  return count;
+}
+
+bool zygote_spawn( zygote_t* this, const command_t* command, const spawn_t* spawn,
+                   pid_t* pid )
+{
+  if ( this->socket == -1 ) return false;
+
+  char* directory = getcwd( NULL, 0 );
+  if ( directory == NULL ) return false;
+
+  zygote_request_t header;
+  memset( &header, 0, sizeof( header ) );
+  header.argc = command->tokens->size;
+  header.spawn = *spawn;
+
+  buffer_t request;
+  buffer_init( &request );
+  buffer_append( &request, &header, sizeof( header ) );
+  buffer_append_string( &request, directory );
+  free( directory );
+
+  unsigned int index;
+  for ( index = 0; index < command->tokens->size; index++ )
+  {
+    buffer_append_string( &request, list_string_get( command->tokens, index ) );
+  }
+
+  header.envc = zygote_environment( this, command, &request );
+  memcpy( request.data, &header, sizeof( header ) );
+
+  bool sent = false;
+  if ( request.size <= ZYGOTE_MAX_REQUEST )
+  {
+    union
+    {
+      char buffer[ CMSG_SPACE( sizeof( int ) * 3 ) ];
+      struct cmsghdr align;
+    } control;
+
+    int fds[ 3 ] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    struct iovec part = { .iov_base = request.data, .iov_len = request.size };
+
+    struct msghdr message;
+    memset( &message, 0, sizeof( message ) );
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof( control.buffer );
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR( &message );
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN( sizeof( fds ) );
+    memcpy( CMSG_DATA( cmsg ), fds, sizeof( fds ) );
+
+    // (anything the shell buffered has to come before the program's
+    // output, the same as if it had forked it itself)
+    fflush( stdout );
+    fflush( stderr );
+
+    ssize_t result;
+    do
+    {
+      result = sendmsg( this->socket, &message, MSG_NOSIGNAL );
+    }
+    while ( result < 0 && errno == EINTR );
+
+    sent = result == ( ssize_t ) request.size;
+  }
+
+  buffer_destroy( &request );
+  if ( !sent ) return false;
+
+  // statuses of other children can come in ahead of the reply
+  zygote_reply_t reply;
+  uint32_t type;
+  while ( ( type = zygote_receive( this, true, &reply ) ) != ZYGOTE_STARTED )
+  {
+    if ( this->socket == -1 ) return false;
+  }
+
+  *pid = reply.pid;
+  if ( reply.pid < 0 )
+  {
+    errno = reply.status;
+    perror( "Failed to start child process " );
+    return true;
+  }
+
+  zygote_child_t* child = malloc( sizeof( *child ) );
+  child->pid = reply.pid;
+  child->state = ZYGOTE_RUNNING;
+  child->status = 0;
+  child->next = this->children;
+  this->children = child;
+
+  return true;
+}
+
+bool zygote_owns( zygote_t* this, pid_t pid )
+{
+  return zygote_find( this, pid ) != NULL;
+}
+
+pid_t zygote_waitpid( zygote_t* this, pid_t pid, int* status, int options )
+{
+  for ( ;; )
+  {
+    zygote_drain( this );
+
+    zygote_child_t* child = zygote_find( this, pid );
+    if ( child == NULL )
+    {
+      errno = ECHILD;
+      return -1;
+    }
+
+    if ( child->state == ZYGOTE_EXITED )
+    {
+      *status = child->status;
+      zygote_remove( this, child );
+      return pid;
+    }
+    if ( child->state == ZYGOTE_STOPPED && ( options & WUNTRACED ) )
+    {
+      // (a stop is only reported once, like waitpid does)
+      *status = child->status;
+      child->state = ZYGOTE_RUNNING;
+      return pid;
+    }
+
+    if ( options & WNOHANG ) return 0;
+
+    zygote_reply_t reply;
+    zygote_receive( this, true, &reply );
+  }
+}
+
+void zygote_continued( zygote_t* this, pid_t pid )
+{
+  zygote_drain( this );
+
+  zygote_child_t* child = zygote_find( this, pid );
+  if ( child != NULL && child->state == ZYGOTE_STOPPED )
+  {
+    child->state = ZYGOTE_RUNNING;
+  }
+}